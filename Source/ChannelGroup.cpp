@@ -44,6 +44,8 @@ static String layoutGroupsKey("Layout");
 
 
 #define MAX_DELAY_SAMPLES 240000 // 5 seconds at 48k
+#define MAX_MONITOR_DELAY_BLOCK 4096
+#define MONITOR_DELAY_FADE_MS 20.0
 
 using namespace SonoAudio;
 
@@ -60,8 +62,9 @@ void ChannelGroup::copyParametersFrom(const ChannelGroup& other)
     expanderParamsChanged = true;
     eqParamsChanged = true;
     limiterParamsChanged = true;
-    monitorDelayParamsChanged = true;
 
+    // not from the audio thread, it may need to allocate
+    commitMonitorDelayParams();
 }
 
 void ChannelGroupParams::setToDefaults(bool isplugin)
@@ -147,6 +150,8 @@ void ChannelGroup::init(double sampRate)
     commitExpanderParams();
     commitEqParams();
     commitLimiterParams();
+
+    monitorDelay.setCrossfadeSamples((int) (MONITOR_DELAY_FADE_MS * 1e-3 * sampleRate));
     commitMonitorDelayParams();
 
 }
@@ -154,49 +159,25 @@ void ChannelGroup::init(double sampRate)
 void ChannelGroup::setMonitoringDelayEnabled(bool enabled, int numchans)
 {
     if (enabled) {
-        if (!monitorDelayLine) {
-            const ScopedLock lock(_monitorDelayLock);
-            // need to initialize it
-            monitorDelayLine = std::make_unique<juce::dsp::DelayLine<float,juce::dsp::DelayLineInterpolationTypes::None> >(MAX_DELAY_SAMPLES);
-            monitorDelayLine->setDelay(_monitorDelayTimeSamples);
-
-            juce::dsp::ProcessSpec delayspec = { sampleRate, 4096, (juce::uint32) numchans };
-            monitorDelayLine->prepare(delayspec);
-
-            _monitorDelayChans = numchans;
-            delayWorkBuffer.setSize(numchans, 4096, false, false, true);
-        }
-        else if (_monitorDelayChans != numchans) {
-            //
-            const ScopedLock lock(_monitorDelayLock);
-
-            juce::dsp::ProcessSpec delayspec = { sampleRate, 4096, (juce::uint32) numchans };
-            monitorDelayLine->prepare(delayspec);
-            monitorDelayLine->reset();
-            _monitorDelayChans = numchans;
-            delayWorkBuffer.setSize(numchans, 4096, false, false, true);
-        }
-
-        
+        // only allocates the first time, or for more channels than before.
+        // always at least stereo, so file and soundboard groups can change between mono and stereo
+        // sources from the audio thread without needing more
+        monitorDelay.prepare(jmax(2, numchans), MAX_DELAY_SAMPLES, MAX_MONITOR_DELAY_BLOCK);
+    }
 
+    params.monitorDelayParams.enabled = enabled;
 
-        // if monitorDelayActive is ever true, it means it has already been initialized
-        params.monitorDelayParams.enabled = true;
-        _monitorDelayActive = true;
-    }
-    else {
-        params.monitorDelayParams.enabled = false;
-        _monitorDelayActive = false;
+    if (monitorDelay.isEnabled() != enabled) {
+        monitorDelay.setEnabled(enabled);
     }
 }
 
 void ChannelGroup::setMonitoringDelayTimeMs(double delayms)
 {
     params.monitorDelayParams.delayTimeMs = delayms;
-    auto newsamps = 1e-3 * delayms * sampleRate;
-    if ( fabs(_monitorDelayTimeSamples - newsamps) > 1) {
-        _monitorDelayTimeSamples = jmin(newsamps, (double)MAX_DELAY_SAMPLES);
-        _monitorDelayTimeChanged = true;
+    const int newsamps = (int) jmin(1e-3 * delayms * sampleRate, (double)MAX_DELAY_SAMPLES);
+    if (monitorDelay.getDelaySamples() != newsamps) {
+        monitorDelay.setDelaySamples(newsamps);
     }
 }
 
@@ -403,83 +384,16 @@ void ChannelGroup::processMonitor (AudioBuffer<float>& frombuffer, int fromStart
     auto & revprocstate = orevprocstate != nullptr ? *orevprocstate : revProcState;
 
 
-    if (monitorDelayParamsChanged) {
-        commitMonitorDelayParams();
-        monitorDelayParamsChanged = false;
-    }
-
-    bool domondelay = _monitorDelayActive.load();
-    int mondelayfade = 0;
-
     auto * usefrombuffer = &frombuffer;
     auto useFromStartChan = fromStartChan;
     auto useFromNumChan = fromNumChan;
 
-    if (domondelay || _monitorDelayLastActive != domondelay) {
-        const ScopedTryLock lock(_monitorDelayLock);
-        if (lock.isLocked()) {
-
-            // transition between delayed and not
-            if (_monitorDelayLastActive != domondelay) {
-                if (domondelay) {
-                    monitorDelayLine->reset();
-                    mondelayfade = 1; // fade in
-                }
-                else {
-                    mondelayfade = -1; // fade out
-                }
-            }
-
-            if (domondelay) {
-                if (_monitorDelayTimeChanged.load() && !_monitorDelayTimeChanging) {
-                    _monitorDelayTimeChanged = false;
-                    mondelayfade = -1.0f; // fade out
-                    _monitorDelayTimeChanging = true;
-                }
-                else if (_monitorDelayTimeChanging) {
-                    // already faded out, now apply new delay time
-                    _monitorDelayTimeChanging = false;
-                    monitorDelayLine->setDelay(_monitorDelayTimeSamples);
-                    mondelayfade = 1; // fade in
-                }
-            }
-
-            if ((domondelay || mondelayfade != 0)) {
-                // should match dest num channels, but we need to make sure of it
-                if (params.numChannels == _monitorDelayChans) {
-                    auto delayinoutBlock = dsp::AudioBlock<float>(delayWorkBuffer).getSubsetChannelBlock(0, (size_t)params.numChannels).getSubBlock(0, numSamples);
-
-                    // apply it going in
-                    for (int srcchan = fromStartChan, chan = 0; chan < delayWorkBuffer.getNumChannels() && srcchan < fromStartChan + params.numChannels && srcchan < fromNumChan; ++srcchan, ++chan) {
-                        if (mondelayfade != 0) {
-                            delayWorkBuffer.copyFromWithRamp(chan, 0, frombuffer.getReadPointer(srcchan), numSamples,
-                                mondelayfade > 0 ? 0.0f : 1.0f, mondelayfade > 0 ? 1.0f : 0.0f);
-                            //tobuffer.applyGainRamp(0, numSamples, mondelayfade > 0 ? 0.0f : 1.0f, mondelayfade > 0 ? 1.0f : 0.0f);
-                        }
-                        else {
-                            delayWorkBuffer.copyFrom(chan, 0, frombuffer.getReadPointer(srcchan), numSamples);
-                        }
-                    }
-
-                    monitorDelayLine->process(dsp::ProcessContextReplacing<float>(delayinoutBlock));
-
-                    // apply it coming out
-                    for (int chan = 0; chan < params.numChannels && chan < delayWorkBuffer.getNumChannels(); ++chan) {
-                        if (mondelayfade != 0) {
-                            delayWorkBuffer.applyGainRamp(chan, 0, numSamples, mondelayfade > 0 ? 0.0f : 1.0f, mondelayfade > 0 ? 1.0f : 0.0f);
-                        }
-                    }
-
-                    usefrombuffer = &delayWorkBuffer;
-                    useFromStartChan = 0;
-                    useFromNumChan = jmin(params.numChannels, delayWorkBuffer.getNumChannels());
-                }
-            }
-
-            _monitorDelayLastActive = domondelay;
-
-            
-        }
+    // crossfades between delay times, and to and from no delay, on its own
+    const int mondelaychans = jmin(params.numChannels, fromNumChan - fromStartChan);
+    if (monitorDelay.process(frombuffer, fromStartChan, mondelaychans, numSamples)) {
+        usefrombuffer = &monitorDelay.getOutput();
+        useFromStartChan = 0;
+        useFromNumChan = mondelaychans;
     }
 
     if (useFromNumChan > 0 && destNumChans == 2) {
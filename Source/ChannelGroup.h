@@ -11,6 +11,7 @@
 #include "faustLimiter.h"
 
 #include "EffectParams.h"
+#include "MonitorDelayLine.h"
 
 namespace SonoAudio {
 
@@ -164,17 +165,7 @@ public:
     bool _lastLimiterEnabled = false;
 
     // monitoring delay
-    std::unique_ptr<juce::dsp::DelayLine<float,juce::dsp::DelayLineInterpolationTypes::None> > monitorDelayLine;
-    bool monitorDelayParamsChanged = false;
-    double _monitorDelayTimeSamples = 0.0;
-    int _monitorDelayChans = 0;
-    std::atomic<bool>  _monitorDelayTimeChanged { false };
-    bool  _monitorDelayTimeChanging = false;
-    std::atomic<bool>  _monitorDelayActive  { false };
-    bool   _monitorDelayLastActive = false;
-    CriticalSection _monitorDelayLock;
-
-    AudioBuffer<float> delayWorkBuffer;
+    MonitorDelayLine monitorDelay;
 
 
     double sampleRate = 48000.0;
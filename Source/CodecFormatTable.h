@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#if USE_CODEC_OPUS || !defined(USE_CODEC_OPUS)
+#include <opus/opus_defines.h>
+#else
+// built without Opus (e.g. the codec benchmark), the Opus entries are skipped
+#define OPUS_SIGNAL_MUSIC 3002
+#endif
+
+// The network audio formats a user can choose between, low bandwidth to high.
+// This is plain data (no JUCE) so the codec benchmark can run the exact same list
+// that SonobusAudioProcessor::initFormats() builds from it.
+
+struct CodecFormatTableEntry
+{
+    bool opus;
+    // PCM options
+    int bitdepth; // bytes
+    // opus options
+    int bitrate;  // per channel
+    int complexity;
+    int signalType;
+    int minPreferredBlocksize;
+};
+
+static const CodecFormatTableEntry codecFormatTable[] = {
+    //{ true, 0,   8000, 10, OPUS_SIGNAL_MUSIC, 960 },
+    { true, 0,  16000, 10, OPUS_SIGNAL_MUSIC, 960 },
+    { true, 0,  24000, 10, OPUS_SIGNAL_MUSIC, 480 },
+    { true, 0,  48000, 10, OPUS_SIGNAL_MUSIC, 240 },
+    { true, 0,  64000, 10, OPUS_SIGNAL_MUSIC, 240 },
+    { true, 0,  96000, 10, OPUS_SIGNAL_MUSIC, 120 },
+    { true, 0, 128000, 10, OPUS_SIGNAL_MUSIC, 120 },
+    { true, 0, 160000, 10, OPUS_SIGNAL_MUSIC, 120 },
+    { true, 0, 256000, 10, OPUS_SIGNAL_MUSIC, 120 },
+
+    { false, 2, 0, 0, 0, 16 },
+    { false, 3, 0, 0, 0, 16 },
+    { false, 4, 0, 0, 0, 16 },
+    //{ false, 8, 0, 0, 0, 16 }, // insanity!
+};
+
+static const int codecFormatTableSize = sizeof(codecFormatTable) / sizeof(codecFormatTable[0]);
+
+static const int codecFormatTableDefaultIndex = 4; // 96kpbs/ch Opus
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "FxPipeline.h"
+
+namespace SonoAudio {
+
+FxPipeline::FxPipeline (int numLanes) : Thread ("SonoBusFxThread")
+{
+    for (int i = 0; i < numLanes; ++i) {
+        mLanes.add (new Lane());
+    }
+}
+
+FxPipeline::~FxPipeline()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (400);
+}
+
+void FxPipeline::prepare (int lane, int numChannels, int maxSamples, ProcessFunc func)
+{
+    const ScopedLock sl (mProcessLock);
+
+    auto & l = *mLanes[lane];
+
+    for (auto & slot : l.slots) {
+        slot.buffer.setSize (numChannels, maxSamples, false, true, true);
+        slot.numChannels = slot.numSamples = 0;
+        slot.state = SlotEmpty;
+    }
+    l.fifo.setSize (numChannels, 2 * maxSamples, false, true, true);
+    l.fifoRead = l.fifoCount = 0;
+    l.fifoPrimed = false;
+    l.writeIndex = 0;
+    l.maxChannels = numChannels;
+    l.maxSamples = maxSamples;
+    l.func = std::move (func);
+}
+
+void FxPipeline::setEnabled (bool enabled)
+{
+    if (enabled && ! isThreadRunning()) {
+#if JUCE_WINDOWS
+        // do not use startRealtimeThread() call because it triggers the whole process to be realtime, which we don't want
+        startThread (Thread::Priority::highest);
+#else
+        if (! startRealtimeThread (Thread::RealtimeOptions{}.withPriority (1).withMaximumProcessingTimeMs (5))) {
+            DBG("Fx thread failed to start realtime: trying regular");
+            startThread (Thread::Priority::highest);
+        }
+#endif
+    }
+
+    mEnabled = enabled;
+}
+
+bool FxPipeline::finishSlot (Lane & lane, Slot & slot)
+{
+    int state = slot.state.load (std::memory_order_acquire);
+
+    if (state == SlotEmpty) {
+        return false;
+    }
+
+    if (state == SlotQueued) {
+        if (slot.state.compare_exchange_strong (state, SlotBusy, std::memory_order_acq_rel)) {
+            // the worker didn't get to it in time, do it ourselves
+            lane.func (slot.buffer, slot.numChannels, slot.numSamples);
+            slot.state.store (SlotDone, std::memory_order_release);
+            ++mMissed;
+            return true;
+        }
+    }
+
+    // the worker is on it, and it takes about as long as doing it here would
+    while (slot.state.load (std::memory_order_acquire) == SlotBusy) {
+        Thread::yield();
+    }
+
+    return true;
+}
+
+void FxPipeline::writeFifo (Lane & lane, const Slot & slot)
+{
+    const int size = lane.fifo.getNumSamples();
+    const int start = (lane.fifoRead + lane.fifoCount) % size;
+    const int first = jmin (slot.numSamples, size - start);
+
+    for (int ch = 0; ch < lane.maxChannels; ++ch) {
+        if (ch < slot.numChannels) {
+            lane.fifo.copyFrom (ch, start, slot.buffer, ch, 0, first);
+            lane.fifo.copyFrom (ch, 0, slot.buffer, ch, first, slot.numSamples - first);
+        } else {
+            lane.fifo.clear (ch, start, first);
+            lane.fifo.clear (ch, 0, slot.numSamples - first);
+        }
+    }
+
+    lane.fifoCount += slot.numSamples;
+}
+
+void FxPipeline::readFifo (Lane & lane, AudioBuffer<float>& buffer, int numChannels, int numSamples)
+{
+    const int size = lane.fifo.getNumSamples();
+    const int first = jmin (numSamples, size - lane.fifoRead);
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+        buffer.copyFrom (ch, 0, lane.fifo, ch, lane.fifoRead, first);
+        buffer.copyFrom (ch, first, lane.fifo, ch, 0, numSamples - first);
+    }
+
+    lane.fifoRead = (lane.fifoRead + numSamples) % size;
+    lane.fifoCount -= numSamples;
+}
+
+void FxPipeline::process (int lane, AudioBuffer<float>& buffer, int numChannels, int numSamples)
+{
+    auto & l = *mLanes[lane];
+
+    if (! l.func) {
+        return;
+    }
+
+    auto & prev = l.slots[1 - l.writeIndex];
+    auto & next = l.slots[l.writeIndex];
+
+    if (! mEnabled.load() || numChannels > l.maxChannels || numSamples > l.maxSamples) {
+        // keep the effect state in order, but the pending output is dropped
+        finishSlot (l, prev);
+        prev.state.store (SlotEmpty, std::memory_order_relaxed);
+        l.fifoPrimed = false;
+
+        l.func (buffer, numChannels, numSamples);
+        return;
+    }
+
+    // queue up this block's input first
+    for (int ch = 0; ch < numChannels; ++ch) {
+        next.buffer.copyFrom (ch, 0, buffer, ch, 0, numSamples);
+    }
+    next.numChannels = numChannels;
+    next.numSamples = numSamples;
+
+    if (! l.fifoPrimed) {
+        // pipeline just (re)started, the latency is made up of silence
+        l.fifo.clear();
+        l.fifoRead = 0;
+        l.fifoCount = l.maxSamples;
+        l.fifoPrimed = true;
+    }
+    else if (finishSlot (l, prev)) {
+        // the output of the last one goes in behind what's left of the latency
+        writeFifo (l, prev);
+    }
+
+    // there are always maxSamples in the FIFO at this point
+    jassert (l.fifoCount == l.maxSamples);
+    readFifo (l, buffer, numChannels, numSamples);
+
+    prev.state.store (SlotEmpty, std::memory_order_relaxed);
+    next.state.store (SlotQueued, std::memory_order_release);
+    l.writeIndex = 1 - l.writeIndex;
+
+    notify();
+}
+
+void FxPipeline::flush (int lane)
+{
+    auto & l = *mLanes[lane];
+
+    if (! l.func) {
+        return;
+    }
+
+    auto & prev = l.slots[1 - l.writeIndex];
+    if (finishSlot (l, prev)) {
+        prev.state.store (SlotEmpty, std::memory_order_relaxed);
+    }
+    l.fifoPrimed = false;
+}
+
+void FxPipeline::run()
+{
+    while (! threadShouldExit()) {
+        wait (20);
+
+        const ScopedLock sl (mProcessLock);
+
+        for (auto * lane : mLanes) {
+            for (auto & slot : lane->slots) {
+                int expected = SlotQueued;
+                if (slot.state.compare_exchange_strong (expected, SlotBusy, std::memory_order_acq_rel)) {
+                    lane->func (slot.buffer, slot.numChannels, slot.numSamples);
+                    slot.state.store (SlotDone, std::memory_order_release);
+                }
+            }
+        }
+    }
+
+    DBG("Fx thread finishing");
+}
+
+}
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+#include <functional>
+
+namespace SonoAudio {
+
+// Runs block effects (the reverbs) on a worker thread, behind the audio thread.
+//
+// Each lane takes a buffer of effect input from the audio callback and queues it for the
+// worker, the output comes back through a FIFO that starts out holding the prepared
+// maximum block size of silence. So the effect output has a fixed latency of that many
+// samples whatever the callback sizes are, the dry signal is untouched. Every lane has
+// two slots: while the worker processes the one queued last callback, the audio thread
+// fills the other.
+//
+// The audio thread never takes a lock. If the worker hasn't even started on a block by
+// the time its output is due, the audio thread processes it inline instead (a miss).
+// If the worker is in the middle of it, the audio thread spins until it is done, which
+// costs no more than processing it inline would have.
+
+class FxPipeline : private Thread
+{
+public:
+    using ProcessFunc = std::function<void (AudioBuffer<float>& buffer, int numChannels, int numSamples)>;
+
+    explicit FxPipeline (int numLanes);
+    ~FxPipeline() override;
+
+    // not while process() can be called (e.g. from prepareToPlay), drops anything pending
+    void prepare (int lane, int numChannels, int maxSamples, ProcessFunc func);
+
+    // message thread. when disabled, process() runs the effect inline without added latency
+    void setEnabled (bool enabled);
+    bool isEnabled() const { return mEnabled.load(); }
+
+    // audio thread. Replaces the first numSamples of numChannels channels of buffer with
+    // effect output from maxSamples ago and queues the input for the worker.
+    // Blocks that don't fit the prepared size are processed inline, which restarts the FIFO.
+    void process (int lane, AudioBuffer<float>& buffer, int numChannels, int numSamples);
+
+    // audio thread. finishes and drops anything pending, call it when the effect is bypassed
+    // so a stale block isn't returned when it comes back
+    void flush (int lane);
+
+    // number of blocks the worker missed and the audio thread processed itself
+    uint32 getMissedCount() const { return mMissed.load(); }
+
+private:
+    enum SlotState { SlotEmpty = 0, SlotQueued, SlotBusy, SlotDone };
+
+    struct Slot {
+        AudioBuffer<float> buffer;
+        int numChannels = 0;
+        int numSamples = 0;
+        std::atomic<int> state { SlotEmpty };
+    };
+
+    struct Lane {
+        Slot slots[2];
+        int writeIndex = 0;
+        int maxChannels = 0;
+        int maxSamples = 0;
+        ProcessFunc func;
+
+        // effect output waiting to be handed back, room for maxSamples of latency plus a block
+        AudioBuffer<float> fifo;
+        int fifoRead = 0;
+        int fifoCount = 0;
+        // cleared when the pipelined output was interrupted, refilled with silence on the next block
+        bool fifoPrimed = false;
+    };
+
+    void run() override;
+
+    // makes sure the slot isn't queued or being processed anymore,
+    // returns true if it holds output
+    bool finishSlot (Lane & lane, Slot & slot);
+
+    void writeFifo (Lane & lane, const Slot & slot);
+    void readFifo (Lane & lane, AudioBuffer<float>& buffer, int numChannels, int numSamples);
+
+    OwnedArray<Lane> mLanes;
+
+    // held by the worker while it processes, so prepare() can't pull buffers out from under it
+    CriticalSection mProcessLock;
+
+    std::atomic<bool> mEnabled { false };
+    std::atomic<uint32> mMissed { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FxPipeline)
+};
+
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace SonoAudio {
+
+// Uncompressed WAV/AIFF files are read straight out of a memory mapping instead of
+// being decoded through a read-ahead buffer, so seeking and looping costs nothing.
+// Mapping the same file from another reader (e.g. the waveform view) shares the
+// same pages through the OS file cache.
+
+// files larger than this are left to the regular buffered readers. The whole file gets
+// paged in before it's played from the mapping, so this is kept to what's reasonable to
+// hold in memory
+static const int64 maxMappedAudioFileBytes = (sizeof(void*) >= 8) ? (int64) 256 * 1024 * 1024 : (int64) 64 * 1024 * 1024;
+
+// returns nullptr if the file's format can't be memory-mapped, or it couldn't be mapped
+inline MemoryMappedAudioFormatReader * createMappedAudioReader(AudioFormatManager & formatManager, const File & file)
+{
+    if (! file.existsAsFile() || file.getSize() > maxMappedAudioFileBytes) {
+        return nullptr;
+    }
+
+    auto * format = formatManager.findFormatForFileExtension(file.getFileExtension());
+    if (format == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader(file));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0 || ! reader->mapEntireFile()) {
+        return nullptr;
+    }
+
+    return reader.release();
+}
+
+
+// Touches every page of a mapped reader a bit at a time on a background TimeSliceThread,
+// so the audio thread never takes the page faults. The reader shouldn't be played until
+// this is finished, it sends a change message when it is.
+// Removes itself from the thread when done, but the owner must still call
+// removeTimeSliceClient() before deleting it or the reader.
+class MappedReaderWarmer : public TimeSliceClient, public ChangeBroadcaster
+{
+public:
+    explicit MappedReaderWarmer(const MemoryMappedAudioFormatReader & reader_)
+    : reader(reader_)
+    {
+        const int bytesPerFrame = jmax(1, (int) (reader.numChannels * reader.bitsPerSample / 8));
+        samplesPerPage = jmax((int64) 1, (int64) (4096 / bytesPerFrame));
+        position = reader.getMappedSection().getStart();
+    }
+
+    int useTimeSlice() override
+    {
+        const auto section = reader.getMappedSection();
+        const int64 endpos = jmin(section.getEnd(), position + samplesPerPage * pagesPerSlice);
+
+        for (; position < endpos; position += samplesPerPage) {
+            reader.touchSample(position);
+        }
+
+        if (position >= section.getEnd()) {
+            finished = true;
+            sendChangeMessage();
+            return -1;
+        }
+
+        return 1;
+    }
+
+    bool isFinished() const { return finished.load(); }
+
+private:
+    // 1 MB per slice, so other clients of the disk thread keep getting their turn
+    static constexpr int64 pagesPerSlice = 256;
+
+    const MemoryMappedAudioFormatReader & reader;
+    int64 samplesPerPage = 1;
+    int64 position = 0;
+    std::atomic<bool> finished { false };
+};
+
+}
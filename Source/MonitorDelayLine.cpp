@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "MonitorDelayLine.h"
+
+using namespace SonoAudio;
+
+MonitorDelayLine::MonitorDelayLine()
+{
+}
+
+MonitorDelayLine::~MonitorDelayLine()
+{
+    delete mPending.exchange(nullptr);
+    delete mRetired.exchange(nullptr);
+    delete mCurrent;
+}
+
+void MonitorDelayLine::prepare (int numChannels, int maxDelaySamples, int maxBlockSize)
+{
+    // whatever the audio thread is done with
+    delete mRetired.exchange(nullptr, std::memory_order_acq_rel);
+
+    if (numChannels <= mPreparedChannels && maxDelaySamples <= mPreparedDelay && maxBlockSize <= mPreparedBlock) {
+        return;
+    }
+
+    mPreparedChannels = jmax(numChannels, mPreparedChannels);
+    mPreparedDelay = jmax(maxDelaySamples, mPreparedDelay);
+    mPreparedBlock = jmax(maxBlockSize, mPreparedBlock);
+
+    auto state = std::make_unique<State>();
+
+    // the write for a block must never reach what the longest tap still has to read
+    const int size = nextPowerOfTwo(mPreparedDelay + mPreparedBlock);
+
+    state->ring.setSize(mPreparedChannels, size);
+    state->ring.clear();
+    state->output.setSize(mPreparedChannels, mPreparedBlock);
+    state->scratch.setSize(1, mPreparedBlock);
+    state->validStart.assign((size_t) mPreparedChannels, 0);
+    state->writeFadePos.assign((size_t) mPreparedChannels, 0);
+    state->mask = size - 1;
+    state->maxDelay = mPreparedDelay;
+    state->maxBlock = mPreparedBlock;
+
+    // one the audio thread never picked up can just go
+    delete mPending.exchange(state.release(), std::memory_order_acq_rel);
+}
+
+void MonitorDelayLine::setEnabled (bool enabled)
+{
+    mEnabled.store(enabled);
+}
+
+void MonitorDelayLine::setDelaySamples (int delaySamples)
+{
+    mTargetDelay.store(jmax(0, delaySamples));
+}
+
+void MonitorDelayLine::setCrossfadeSamples (int numSamples)
+{
+    mCrossfadeSamples.store(jmax(1, numSamples));
+}
+
+void MonitorDelayLine::restart()
+{
+    // the channels get reset as they are written
+    mWrittenChannels = 0;
+    mCurrentDelay = 0;
+    mFading = false;
+}
+
+void MonitorDelayLine::copyHistory (const State & from, State & to)
+{
+    // prepare() only ever grows, and the rest of the channels weren't written
+    const int chans = jmin(from.ring.getNumChannels(), to.ring.getNumChannels(), mWrittenChannels);
+
+    for (int ch = 0; ch < chans; ++ch) {
+        const size_t c = (size_t) ch;
+        const int64 histlen = jmin((int64) from.ring.getNumSamples(), mWritePos - from.validStart[c]);
+
+        for (int64 pos = mWritePos - histlen; pos < mWritePos; ) {
+            const int frompos = (int) (pos & from.mask);
+            const int topos = (int) (pos & to.mask);
+            const int count = (int) jmin(mWritePos - pos, (int64) (from.ring.getNumSamples() - frompos), (int64) (to.ring.getNumSamples() - topos));
+
+            FloatVectorOperations::copy(to.ring.getWritePointer(ch) + topos, from.ring.getReadPointer(ch) + frompos, count);
+
+            pos += count;
+        }
+
+        to.validStart[c] = mWritePos - histlen;
+        to.writeFadePos[c] = from.writeFadePos[c];
+    }
+
+    mWrittenChannels = chans;
+}
+
+AudioBuffer<float>& MonitorDelayLine::getOutput()
+{
+    return mCurrent->output;
+}
+
+void MonitorDelayLine::readTap (const State & state, int chan, int delay, const float * dry, float * dest, int numSamples) const
+{
+    if (delay == 0) {
+        // straight from the input, the faded in copy in the ring is only for the delayed taps
+        FloatVectorOperations::copy(dest, dry, numSamples);
+        return;
+    }
+
+    const int64 start = mWritePos - delay;
+
+    // silence for anything from before the last reset
+    const int zeros = (int) jlimit((int64) 0, (int64) numSamples, state.validStart[(size_t) chan] - start);
+    if (zeros > 0) {
+        FloatVectorOperations::clear(dest, zeros);
+    }
+
+    const int remaining = numSamples - zeros;
+    if (remaining <= 0) {
+        return;
+    }
+
+    const int size = state.ring.getNumSamples();
+    const int readpos = (int) ((start + zeros) & state.mask);
+    const int first = jmin(remaining, size - readpos);
+    const float * src = state.ring.getReadPointer(chan);
+
+    FloatVectorOperations::copy(dest + zeros, src + readpos, first);
+    if (first < remaining) {
+        FloatVectorOperations::copy(dest + zeros + first, src, remaining - first);
+    }
+}
+
+bool MonitorDelayLine::process (const AudioBuffer<float>& input, int inStartChan, int numChannels, int numSamples)
+{
+    if (mPending.load(std::memory_order_relaxed) != nullptr && mRetired.load(std::memory_order_acquire) == nullptr) {
+        if (auto * fresh = mPending.exchange(nullptr, std::memory_order_acq_rel)) {
+            if (mCurrent != nullptr && mActive) {
+                // so the output just carries on
+                copyHistory(*mCurrent, *fresh);
+            }
+            else {
+                restart();
+            }
+
+            mRetired.store(mCurrent, std::memory_order_release);
+            mCurrent = fresh;
+        }
+    }
+
+    const bool enabled = mEnabled.load(std::memory_order_relaxed);
+
+    if (mCurrent == nullptr) {
+        return false;
+    }
+
+    if (! mActive) {
+        if (! enabled) {
+            return false;
+        }
+
+        // whatever is left in the ring is from the last time it was active
+        mActive = true;
+        restart();
+    }
+
+    auto & state = *mCurrent;
+
+    if (numChannels <= 0 || numChannels > state.ring.getNumChannels() || numSamples > state.maxBlock) {
+        return false;
+    }
+
+    // channels that weren't written last time start over from silence
+    for (int ch = mWrittenChannels; ch < numChannels; ++ch) {
+        state.validStart[(size_t) ch] = mWritePos;
+        state.writeFadePos[(size_t) ch] = 0;
+    }
+    mWrittenChannels = numChannels;
+
+    // write first, so a tap at zero delay reads this block
+    const int size = state.ring.getNumSamples();
+    const int writepos = (int) (mWritePos & state.mask);
+    const int first = jmin(numSamples, size - writepos);
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+        state.ring.copyFrom(ch, writepos, input, inStartChan + ch, 0, first);
+        if (first < numSamples) {
+            state.ring.copyFrom(ch, 0, input, inStartChan + ch, first, numSamples - first);
+        }
+    }
+
+    const int fadeLength = mCrossfadeSamples.load(std::memory_order_relaxed);
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+        int & fadepos = state.writeFadePos[(size_t) ch];
+        if (fadepos >= fadeLength) {
+            continue;
+        }
+
+        const int fadecount = jmin(numSamples, fadeLength - fadepos);
+        const float step = 1.0f / fadeLength;
+        float * dest = state.ring.getWritePointer(ch);
+        float gain = fadepos * step;
+
+        for (int i = 0; i < fadecount; ++i) {
+            dest[(writepos + i) & state.mask] *= gain;
+            gain += step;
+        }
+
+        fadepos += fadecount;
+    }
+
+    const int target = enabled ? jmin(mTargetDelay.load(std::memory_order_relaxed), state.maxDelay) : 0;
+
+    if (! mFading && target != mCurrentDelay) {
+        // a change while fading gets picked up once that one is done
+        mFromDelay = mCurrentDelay;
+        mToDelay = target;
+        mFadePos = 0;
+        mFadeLength = fadeLength;
+        mFading = true;
+    }
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+        const float * dry = input.getReadPointer(inStartChan + ch);
+        float * out = state.output.getWritePointer(ch);
+
+        if (! mFading) {
+            readTap(state, ch, mCurrentDelay, dry, out, numSamples);
+        }
+        else {
+            float * other = state.scratch.getWritePointer(0);
+
+            readTap(state, ch, mFromDelay, dry, out, numSamples);
+            readTap(state, ch, mToDelay, dry, other, numSamples);
+
+            const float step = 1.0f / mFadeLength;
+            float gain = mFadePos * step;
+
+            for (int i = 0; i < numSamples; ++i) {
+                out[i] += (other[i] - out[i]) * jmin(1.0f, gain);
+                gain += step;
+            }
+        }
+    }
+
+    mWritePos += numSamples;
+
+    if (mFading) {
+        mFadePos += numSamples;
+        if (mFadePos >= mFadeLength) {
+            mCurrentDelay = mToDelay;
+            mFading = false;
+        }
+    }
+
+    if (! enabled && ! mFading && mCurrentDelay == 0) {
+        // all the way back to dry, nothing to do until it's enabled again
+        mActive = false;
+    }
+
+    return true;
+}
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+#include <vector>
+
+namespace SonoAudio {
+
+// Multichannel delay line for monitoring, safe to control from any thread while the
+// audio thread runs it, without locks.
+//
+// The delay is read from a preallocated power-of-two ring buffer. Whenever the delay
+// changes the output crossfades from a read tap at the old delay to one at the new
+// delay, so there are no clicks. Disabling it is just a crossfade to a tap at zero
+// delay (the dry signal), after which process() stops doing any work until it is
+// enabled again.
+//
+// Buffers are only ever allocated by prepare() on a non-audio thread. The new buffers
+// are handed to the audio thread, which swaps them in at the start of a block (carrying
+// over what's been delayed so far) and hands back the old ones to be freed by the next
+// prepare() call.
+
+class MonitorDelayLine
+{
+public:
+    MonitorDelayLine();
+    ~MonitorDelayLine();
+
+    // not the audio thread. makes sure there is room for this many channels, samples
+    // of delay, and samples per process() call. does nothing if there already is
+    void prepare (int numChannels, int maxDelaySamples, int maxBlockSize);
+
+    // any thread
+    void setEnabled (bool enabled);
+    bool isEnabled() const { return mEnabled.load(); }
+
+    // any thread, clamped to the prepared maximum when applied
+    void setDelaySamples (int delaySamples);
+    int getDelaySamples() const { return mTargetDelay.load(); }
+
+    // any thread. how long it takes to crossfade to a new delay
+    void setCrossfadeSamples (int numSamples);
+
+    // audio thread. delays numChannels channels of input starting at inStartChan.
+    // returns false if the input should be used as is, because the delay is not active
+    // or is not prepared for that many channels or samples. Otherwise the result is
+    // in the first numChannels channels of getOutput().
+    bool process (const AudioBuffer<float>& input, int inStartChan, int numChannels, int numSamples);
+
+    // audio thread, only valid after process() returned true
+    AudioBuffer<float>& getOutput();
+
+private:
+    struct State
+    {
+        AudioBuffer<float> ring;
+        AudioBuffer<float> output;
+        AudioBuffer<float> scratch;
+        // per channel, anything written before this is stale and read as silence
+        std::vector<int64> validStart;
+        // per channel, the input is faded in after a reset, so the delayed signal doesn't start abruptly
+        std::vector<int> writeFadePos;
+        int mask = 0;
+        int maxDelay = 0;
+        int maxBlock = 0;
+    };
+
+    void readTap (const State & state, int chan, int delay, const float * dry, float * dest, int numSamples) const;
+
+    // owned by the audio thread
+    State * mCurrent = nullptr;
+    int64 mWritePos = 0;
+    int mWrittenChannels = 0; // channels written last block, any beyond that are reset when they show up
+    int mCurrentDelay = 0;
+    int mFromDelay = 0;
+    int mToDelay = 0;
+    int mFadePos = 0;
+    int mFadeLength = 1;
+    bool mFading = false;
+    bool mActive = false;
+
+    void restart();
+    void copyHistory (const State & from, State & to);
+
+    // handoff between prepare() and the audio thread
+    std::atomic<State*> mPending { nullptr };
+    std::atomic<State*> mRetired { nullptr };
+
+    // what has been prepared so far, only used by prepare()
+    int mPreparedChannels = 0;
+    int mPreparedDelay = 0;
+    int mPreparedBlock = 0;
+
+    std::atomic<bool> mEnabled { false };
+    std::atomic<int> mTargetDelay { 0 };
+    std::atomic<int> mCrossfadeSamples { 1024 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MonitorDelayLine)
+};
+
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+namespace SonoAudio {
+
+// Bounded lock-free multi-producer single-consumer queue.
+// Each slot carries a sequence number: producers claim a slot by advancing
+// the write position, fill it in place, then publish it by bumping the
+// slot sequence. The consumer only ever looks at its own read position.
+// Items are filled and consumed in place via callbacks so large payloads
+// (e.g. whole packets) are never copied through temporaries.
+
+template <typename T, int Capacity>
+class MpscQueue
+{
+public:
+    MpscQueue()
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+        for (uint32 i = 0; i < (uint32) Capacity; ++i) {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // any thread. fill is called with the claimed item and must not throw.
+    // returns false without calling fill if the queue is full
+    template <typename Fill>
+    bool tryPush(Fill && fill) noexcept
+    {
+        auto pos = mWritePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            Slot & slot = mSlots[pos & (Capacity - 1)];
+            const auto seq = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = (int32) (seq - pos);
+
+            if (diff == 0) {
+                if (mWritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(slot.item);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                // lost the race, pos was reloaded
+            }
+            else if (diff < 0) {
+                // consumer hasn't released this slot yet
+                return false;
+            }
+            else {
+                pos = mWritePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // single consumer thread only. consume is called with the oldest item,
+    // the slot is handed back to the producers afterwards
+    template <typename Consume>
+    bool tryPop(Consume && consume)
+    {
+        Slot & slot = mSlots[mReadPos & (Capacity - 1)];
+        const auto seq = slot.sequence.load(std::memory_order_acquire);
+
+        if ((int32) (seq - (mReadPos + 1)) < 0) {
+            // empty, or the next producer hasn't finished filling it
+            return false;
+        }
+
+        consume(slot.item);
+
+        slot.sequence.store(mReadPos + Capacity, std::memory_order_release);
+        ++mReadPos;
+        return true;
+    }
+
+    // consumer thread only
+    bool isEmpty() const noexcept
+    {
+        return (int32) (mSlots[mReadPos & (Capacity - 1)].sequence.load(std::memory_order_acquire) - (mReadPos + 1)) < 0;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32> sequence { 0 };
+        T item;
+    };
+
+    Slot mSlots[Capacity];
+
+    alignas(64) std::atomic<uint32> mWritePos { 0 };
+    alignas(64) uint32 mReadPos = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (MpscQueue)
+};
+
+}
@@ -35,6 +35,10 @@ enum {
     separatorColourId = 0x1002850,
 };
 
+enum {
+    StageProfilingTimerId = 1
+};
+
 
 void OptionsView::initializeLanguages()
 {
@@ -142,6 +146,42 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     mOptionsFormatChoiceDefaultChoice->setTooltip(TRANS("The default send quality will be used when you first connect with someone. The values specified with a kbps/ch are Opus compressed audio and use less network bandwidth at the expense of a little latency. It is not recommended to use less than 96 kpbs/ch, as that will increase latency more. The PCM 16bit (and above) use uncompressed audio data and will use the most network bandwidth, but have the least latency and CPU load. If you are connecting with a known small group who all have network service that can support it, using PCM 16 bit is recommended for the lowest latency. Otherwise 96 kbps/ch is a good default."));
 
 
+    mOptionsAdaptiveRecvFormatButton = std::make_unique<ToggleButton>(TRANS("Adapt received quality to network conditions"));
+    mOptionsAdaptiveRecvFormatButton->addListener(this);
+    mOptionsAdaptiveRecvFormatButton->setTooltip(TRANS("When enabled, the quality that others send to you will be automatically lowered when packet loss or increasing ping times indicate network congestion, and raised again when the connection is clean, staying within the range specified here."));
+
+    mOptionsSendSilenceSuppressionButton = std::make_unique<ToggleButton>(TRANS("Don't send audio data while silent"));
+    mOptionsSendSilenceSuppressionButton->addListener(this);
+    mOptionsSendSilenceSuppressionButton->setTooltip(TRANS("When enabled, only a tiny marker is sent instead of audio data while what you are sending is completely silent, which saves network bandwidth and CPU for everyone in larger groups."));
+
+    mOptionsSendFecButton = std::make_unique<ToggleButton>(TRANS("Send error correction data"));
+    mOptionsSendFecButton->addListener(this);
+    mOptionsSendFecButton->setTooltip(TRANS("When enabled, a little extra data is sent along with the audio, so that others can rebuild a lost packet right away instead of waiting for it to be sent again. Helps on lossy connections, at the cost of about 25% more upload bandwidth."));
+
+    mOptionsServerRelayButton = std::make_unique<ToggleButton>(TRANS("Relay audio when hosting a connection server"));
+    mOptionsServerRelayButton->addListener(this);
+    mOptionsServerRelayButton->setTooltip(TRANS("When others use this computer as their connection server, let it pass audio between group members that can't connect to each other directly. This uses your upload bandwidth for their audio."));
+
+    mOptionsReverbWorkerButton = std::make_unique<ToggleButton>(TRANS("Process reverb on a separate thread"));
+    mOptionsReverbWorkerButton->addListener(this);
+    mOptionsReverbWorkerButton->setTooltip(TRANS("When enabled, the reverbs are processed on another CPU core alongside the audio, which can help avoid dropouts with small buffer sizes. The reverb output is delayed by one more audio block, your dry audio is not."));
+
+    mOptionsAdaptiveMinFormatChoice = std::make_unique<SonoChoiceButton>();
+    mOptionsAdaptiveMinFormatChoice->setTitle(TRANS("Lowest Adaptive Quality"));
+    mOptionsAdaptiveMinFormatChoice->addChoiceListener(this);
+    mOptionsAdaptiveMaxFormatChoice = std::make_unique<SonoChoiceButton>();
+    mOptionsAdaptiveMaxFormatChoice->setTitle(TRANS("Highest Adaptive Quality"));
+    mOptionsAdaptiveMaxFormatChoice->addChoiceListener(this);
+    for (int i=0; i < numformats; ++i) {
+        auto name = processor.getAudioCodeFormatName(i);
+        mOptionsAdaptiveMinFormatChoice->addItem(name, i+1);
+        mOptionsAdaptiveMaxFormatChoice->addItem(name, i+1);
+    }
+
+    mOptionsAdaptiveRangeStaticLabel = std::make_unique<Label>("", TRANS("Range:"));
+    configLabel(mOptionsAdaptiveRangeStaticLabel.get(), false);
+    mOptionsAdaptiveRangeStaticLabel->setJustificationType(Justification::centredRight);
+
     mOptionsAutosizeStaticLabel = std::make_unique<Label>("", TRANS("Default Jitter Buffer"));
     configLabel(mOptionsAutosizeStaticLabel.get(), false);
     mOptionsAutosizeStaticLabel->setJustificationType(Justification::centredLeft);
@@ -271,6 +311,14 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     mOptionsDisableShortcutButton = std::make_unique<ToggleButton>(TRANS("Disable keyboard shortcuts"));
     mOptionsDisableShortcutButton->addListener(this);
 
+    mOptionsStageProfilingButton = std::make_unique<ToggleButton>(TRANS("Profile audio processing stage timing"));
+    mOptionsStageProfilingButton->addListener(this);
+
+    mStageProfilingStatsLabel = std::make_unique<Label>("profstats", "");
+    mStageProfilingStatsLabel->setFont(Font(Font::getDefaultMonospacedFontName(), 11, Font::plain));
+    mStageProfilingStatsLabel->setJustificationType(Justification::topLeft);
+    mStageProfilingStatsLabel->setColour(Label::textColourId, Colour(0xaaeeeeee));
+
 #if JUCE_IOS
     if (JUCEApplicationBase::isStandaloneApp()) {
         mOptionsAllowBluetoothInput = std::make_unique<ToggleButton>(TRANS("Allow Bluetooth Input"));
@@ -374,6 +422,13 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     mOptionsComponent->addAndMakeVisible(mOptionsDefaultLevelSlider.get());
     mOptionsComponent->addAndMakeVisible(mOptionsDefaultLevelSliderLabel.get());
     mOptionsComponent->addAndMakeVisible(mOptionsChangeAllFormatButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveRecvFormatButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveMinFormatChoice.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveMaxFormatChoice.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsAdaptiveRangeStaticLabel.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsSendSilenceSuppressionButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsSendFecButton.get());
+    mOptionsComponent->addAndMakeVisible(mOptionsReverbWorkerButton.get());
     mOptionsComponent->addAndMakeVisible(mVersionLabel.get());
     mOptionsComponent->addAndMakeVisible(mOptionsLanguageChoice.get());
     mOptionsComponent->addAndMakeVisible(mOptionsUnivFontButton.get());
@@ -391,12 +446,17 @@ OptionsView::OptionsView(SonobusAudioProcessor& proc, std::function<AudioDeviceM
     if (JUCEApplicationBase::isStandaloneApp()) {
         mOptionsComponent->addAndMakeVisible(mOptionsOverrideSamplerateButton.get());
         mOptionsComponent->addAndMakeVisible(mOptionsShouldCheckForUpdateButton.get());
+        mOptionsComponent->addAndMakeVisible(mOptionsServerRelayButton.get());
         if (mOptionsAllowBluetoothInput) {
             mOptionsComponent->addAndMakeVisible(mOptionsAllowBluetoothInput.get());
         }
     }
     mOptionsComponent->addAndMakeVisible(mOptionsSliderSnapToMouseButton.get());
     mOptionsComponent->addAndMakeVisible(mOptionsDisableShortcutButton.get());
+#if SONOBUS_STAGE_PROFILING
+    mOptionsComponent->addAndMakeVisible(mOptionsStageProfilingButton.get());
+    mOptionsComponent->addChildComponent(mStageProfilingStatsLabel.get());
+#endif
 
 
 
@@ -536,7 +596,13 @@ juce::Rectangle<int> OptionsView::getPreferredContentBounds() const
 
 void OptionsView::timerCallback(int timerid)
 {
-
+    if (timerid == StageProfilingTimerId) {
+        if (!processor.getStageProfilingEnabled()) {
+            stopTimer(StageProfilingTimerId);
+            return;
+        }
+        mStageProfilingStatsLabel->setText(processor.getStageProfiler().getSummaryText(), dontSendNotification);
+    }
 }
 
 void OptionsView::grabInitialFocus()
@@ -597,6 +663,18 @@ void OptionsView::updateState(bool ignorecheck)
 
     mOptionsChangeAllFormatButton->setToggleState(processor.getChangingDefaultAudioCodecSetsExisting(), dontSendNotification);
 
+    int adaptmin = 0, adaptmax = 0;
+    processor.getAdaptiveRecvFormatRange(adaptmin, adaptmax);
+    mOptionsAdaptiveRecvFormatButton->setToggleState(processor.getDefaultAdaptiveRecvFormat(), dontSendNotification);
+    mOptionsAdaptiveMinFormatChoice->setSelectedItemIndex(adaptmin, dontSendNotification);
+    mOptionsAdaptiveMaxFormatChoice->setSelectedItemIndex(adaptmax, dontSendNotification);
+    mOptionsSendSilenceSuppressionButton->setToggleState(processor.getSendSilenceSuppression(), dontSendNotification);
+    mOptionsSendFecButton->setToggleState(processor.getSendFecEnabled(), dontSendNotification);
+    mOptionsServerRelayButton->setToggleState(processor.getServerRelayEnabled(), dontSendNotification);
+    mOptionsReverbWorkerButton->setToggleState(processor.getReverbOnWorkerThread(), dontSendNotification);
+    mOptionsAdaptiveMinFormatChoice->setEnabled(processor.getDefaultAdaptiveRecvFormat());
+    mOptionsAdaptiveMaxFormatChoice->setEnabled(processor.getDefaultAdaptiveRecvFormat());
+
     mOptionsAutoDropThreshSlider->setValue(1 / jmax(0.001f, processor.getAutoresizeBufferDropRateThreshold()), dontSendNotification);
 
     int port = processor.getUseSpecificUdpPort();
@@ -641,6 +719,12 @@ void OptionsView::updateState(bool ignorecheck)
     mOptionsSliderSnapToMouseButton->setToggleState(processor.getSlidersSnapToMousePosition(), dontSendNotification);
     mOptionsDisableShortcutButton->setToggleState(processor.getDisableKeyboardShortcuts(), dontSendNotification);
 
+    mOptionsStageProfilingButton->setToggleState(processor.getStageProfilingEnabled(), dontSendNotification);
+    mStageProfilingStatsLabel->setVisible(processor.getStageProfilingEnabled());
+    if (processor.getStageProfilingEnabled()) {
+        startTimer(StageProfilingTimerId, 1000);
+    }
+
     uint32 recmask = processor.getDefaultRecordingOptions();
 
     mOptionsRecOthersButton->setToggleState((recmask & SonobusAudioProcessor::RecordIndividualUsers) != 0, dontSendNotification);
@@ -780,6 +864,38 @@ void OptionsView::updateLayout()
     optionsChangeAllQualBox.items.add(FlexItem(10, 12).withFlex(1));
     optionsChangeAllQualBox.items.add(FlexItem(180, minpassheight, *mOptionsChangeAllFormatButton).withMargin(0).withFlex(0));
 
+    optionsAdaptiveRecvFormatBox.items.clear();
+    optionsAdaptiveRecvFormatBox.flexDirection = FlexBox::Direction::row;
+    optionsAdaptiveRecvFormatBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsAdaptiveRecvFormatBox.items.add(FlexItem(180, minpassheight, *mOptionsAdaptiveRecvFormatButton).withMargin(0).withFlex(1));
+
+    optionsAdaptiveRangeBox.items.clear();
+    optionsAdaptiveRangeBox.flexDirection = FlexBox::Direction::row;
+    optionsAdaptiveRangeBox.items.add(FlexItem(60, minitemheight, *mOptionsAdaptiveRangeStaticLabel).withMargin(0).withFlex(0));
+    optionsAdaptiveRangeBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsAdaptiveMinFormatChoice).withMargin(0).withFlex(1));
+    optionsAdaptiveRangeBox.items.add(FlexItem(4, 4));
+    optionsAdaptiveRangeBox.items.add(FlexItem(minButtonWidth, minitemheight, *mOptionsAdaptiveMaxFormatChoice).withMargin(0).withFlex(1));
+
+    optionsSendSilenceBox.items.clear();
+    optionsSendSilenceBox.flexDirection = FlexBox::Direction::row;
+    optionsSendSilenceBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsSendSilenceBox.items.add(FlexItem(180, minpassheight, *mOptionsSendSilenceSuppressionButton).withMargin(0).withFlex(1));
+
+    optionsSendFecBox.items.clear();
+    optionsSendFecBox.flexDirection = FlexBox::Direction::row;
+    optionsSendFecBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsSendFecBox.items.add(FlexItem(180, minpassheight, *mOptionsSendFecButton).withMargin(0).withFlex(1));
+
+    optionsServerRelayBox.items.clear();
+    optionsServerRelayBox.flexDirection = FlexBox::Direction::row;
+    optionsServerRelayBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsServerRelayBox.items.add(FlexItem(180, minpassheight, *mOptionsServerRelayButton).withMargin(0).withFlex(1));
+
+    optionsReverbWorkerBox.items.clear();
+    optionsReverbWorkerBox.flexDirection = FlexBox::Direction::row;
+    optionsReverbWorkerBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsReverbWorkerBox.items.add(FlexItem(180, minpassheight, *mOptionsReverbWorkerButton).withMargin(0).withFlex(1));
+
     optionsCheckForUpdateBox.items.clear();
     optionsCheckForUpdateBox.flexDirection = FlexBox::Direction::row;
     optionsCheckForUpdateBox.items.add(FlexItem(10, 12).withFlex(0));
@@ -796,6 +912,11 @@ void OptionsView::updateLayout()
     optionsDisableShortcutsBox.items.add(FlexItem(180, minpassheight, *mOptionsDisableShortcutButton).withMargin(0).withFlex(1));
 
 
+    optionsStageProfilingBox.items.clear();
+    optionsStageProfilingBox.flexDirection = FlexBox::Direction::row;
+    optionsStageProfilingBox.items.add(FlexItem(10, 12).withFlex(0));
+    optionsStageProfilingBox.items.add(FlexItem(180, minpassheight, *mOptionsStageProfilingButton).withMargin(0).withFlex(1));
+
     optionsAllowBluetoothBox.items.clear();
     optionsAllowBluetoothBox.flexDirection = FlexBox::Direction::row;
     if (mOptionsAllowBluetoothInput) {
@@ -820,6 +941,10 @@ void OptionsView::updateLayout()
     optionsBox.items.add(FlexItem(4, 4));
     optionsBox.items.add(FlexItem(100, minitemheight, optionsSendQualBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(100, minitemheight - 10, optionsChangeAllQualBox).withMargin(1).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsAdaptiveRecvFormatBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minitemheight, optionsAdaptiveRangeBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsSendSilenceBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsSendFecBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(4, 4));
     optionsBox.items.add(FlexItem(100, minitemheight, optionsNetbufBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(4, 3));
@@ -838,9 +963,17 @@ void OptionsView::updateLayout()
             optionsBox.items.add(FlexItem(100, minpassheight, optionsAllowBluetoothBox).withMargin(2).withFlex(0));
         }
         optionsBox.items.add(FlexItem(100, minpassheight, optionsCheckForUpdateBox).withMargin(2).withFlex(0));
+        optionsBox.items.add(FlexItem(100, minpassheight, optionsServerRelayBox).withMargin(2).withFlex(0));
     }
     optionsBox.items.add(FlexItem(100, minpassheight, optionsDisableShortcutsBox).withMargin(2).withFlex(0));
     optionsBox.items.add(FlexItem(100, minpassheight, optionsDynResampleBox).withMargin(2).withFlex(0));
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsReverbWorkerBox).withMargin(2).withFlex(0));
+#if SONOBUS_STAGE_PROFILING
+    optionsBox.items.add(FlexItem(100, minpassheight, optionsStageProfilingBox).withMargin(2).withFlex(0));
+    if (processor.getStageProfilingEnabled()) {
+        optionsBox.items.add(FlexItem(100, 14 * (SonoAudio::StageProfiler::NumStages + 1), *mStageProfilingStatsLabel).withMargin(2).withFlex(0));
+    }
+#endif
 
     if ( ! JUCEApplicationBase::isStandaloneApp()) {
         optionsBox.items.add(FlexItem(100, minitemheight, optionsPluginDefaultBox).withMargin(2).withFlex(0));
@@ -1100,6 +1233,24 @@ void OptionsView::buttonClicked (Button* buttonThatWasClicked)
 
         processor.setDefaultRecordingOptions(recmask);
     }
+    else if (buttonThatWasClicked == mOptionsAdaptiveRecvFormatButton.get()) {
+        bool newval = mOptionsAdaptiveRecvFormatButton->getToggleState();
+        processor.setDefaultAdaptiveRecvFormat(newval);
+        mOptionsAdaptiveMinFormatChoice->setEnabled(newval);
+        mOptionsAdaptiveMaxFormatChoice->setEnabled(newval);
+    }
+    else if (buttonThatWasClicked == mOptionsSendSilenceSuppressionButton.get()) {
+        processor.setSendSilenceSuppression(mOptionsSendSilenceSuppressionButton->getToggleState());
+    }
+    else if (buttonThatWasClicked == mOptionsSendFecButton.get()) {
+        processor.setSendFecEnabled(mOptionsSendFecButton->getToggleState());
+    }
+    else if (buttonThatWasClicked == mOptionsServerRelayButton.get()) {
+        processor.setServerRelayEnabled(mOptionsServerRelayButton->getToggleState());
+    }
+    else if (buttonThatWasClicked == mOptionsReverbWorkerButton.get()) {
+        processor.setReverbOnWorkerThread(mOptionsReverbWorkerButton->getToggleState());
+    }
     else if (buttonThatWasClicked == mOptionsChangeAllFormatButton.get()) {
         processor.setChangingDefaultAudioCodecSetsExisting(mOptionsChangeAllFormatButton->getToggleState());
     }
@@ -1161,6 +1312,19 @@ void OptionsView::buttonClicked (Button* buttonThatWasClicked)
             updateSliderSnap();
         }
     }
+    else if (buttonThatWasClicked == mOptionsStageProfilingButton.get()) {
+        bool newval = mOptionsStageProfilingButton->getToggleState();
+        processor.setStageProfilingEnabled(newval);
+        mStageProfilingStatsLabel->setText("", dontSendNotification);
+        mStageProfilingStatsLabel->setVisible(newval);
+        if (newval) {
+            startTimer(StageProfilingTimerId, 1000);
+        } else {
+            stopTimer(StageProfilingTimerId);
+        }
+        updateLayout();
+        resized();
+    }
     else if (buttonThatWasClicked == mOptionsDisableShortcutButton.get()) {
         bool newval = mOptionsDisableShortcutButton->getToggleState();
         processor.setDisableKeyboardShortcuts(newval);
@@ -1223,6 +1387,20 @@ void OptionsView::choiceButtonSelected(SonoChoiceButton *comp, int index, int id
     if (comp == mOptionsFormatChoiceDefaultChoice.get()) {
         processor.setDefaultAudioCodecFormat(index);
     }
+    else if (comp == mOptionsAdaptiveMinFormatChoice.get() || comp == mOptionsAdaptiveMaxFormatChoice.get()) {
+        int adaptmin = 0, adaptmax = 0;
+        processor.getAdaptiveRecvFormatRange(adaptmin, adaptmax);
+        if (comp == mOptionsAdaptiveMinFormatChoice.get()) {
+            adaptmin = index;
+            adaptmax = jmax(adaptmin, adaptmax);
+        } else {
+            adaptmax = index;
+            adaptmin = jmin(adaptmin, adaptmax);
+        }
+        processor.setAdaptiveRecvFormatRange(adaptmin, adaptmax);
+        mOptionsAdaptiveMinFormatChoice->setSelectedItemIndex(adaptmin, dontSendNotification);
+        mOptionsAdaptiveMaxFormatChoice->setSelectedItemIndex(adaptmax, dontSendNotification);
+    }
     else if (comp == mOptionsAutosizeDefaultChoice.get()) {
         processor.setDefaultAutoresizeBufferMode((SonobusAudioProcessor::AutoNetBufferMode) ident);
     }
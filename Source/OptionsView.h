@@ -126,6 +126,14 @@ protected:
     std::unique_ptr<TextEditor>  mOptionsUdpPortEditor;
     std::unique_ptr<Label> mVersionLabel;
     std::unique_ptr<ToggleButton> mOptionsChangeAllFormatButton;
+    std::unique_ptr<ToggleButton> mOptionsAdaptiveRecvFormatButton;
+    std::unique_ptr<SonoChoiceButton> mOptionsAdaptiveMinFormatChoice;
+    std::unique_ptr<SonoChoiceButton> mOptionsAdaptiveMaxFormatChoice;
+    std::unique_ptr<Label>  mOptionsAdaptiveRangeStaticLabel;
+    std::unique_ptr<ToggleButton> mOptionsSendSilenceSuppressionButton;
+    std::unique_ptr<ToggleButton> mOptionsSendFecButton;
+    std::unique_ptr<ToggleButton> mOptionsServerRelayButton;
+    std::unique_ptr<ToggleButton> mOptionsReverbWorkerButton;
 
     std::unique_ptr<ToggleButton> mOptionsHearLatencyButton;
     std::unique_ptr<ToggleButton> mOptionsMetRecordedButton;
@@ -136,6 +144,8 @@ protected:
     std::unique_ptr<ToggleButton> mOptionsSliderSnapToMouseButton;
     std::unique_ptr<ToggleButton> mOptionsAllowBluetoothInput;
     std::unique_ptr<ToggleButton> mOptionsDisableShortcutButton;
+    std::unique_ptr<ToggleButton> mOptionsStageProfilingButton;
+    std::unique_ptr<Label> mStageProfilingStatsLabel;
     std::unique_ptr<TextButton> mOptionsSavePluginDefaultButton;
     std::unique_ptr<TextButton> mOptionsResetPluginDefaultButton;
 
@@ -177,6 +187,12 @@ protected:
     FlexBox optionsOverrideSamplerateBox;
     FlexBox optionsCheckForUpdateBox;
     FlexBox optionsChangeAllQualBox;
+    FlexBox optionsAdaptiveRecvFormatBox;
+    FlexBox optionsAdaptiveRangeBox;
+    FlexBox optionsSendSilenceBox;
+    FlexBox optionsSendFecBox;
+    FlexBox optionsServerRelayBox;
+    FlexBox optionsReverbWorkerBox;
     FlexBox optionsInputLimitBox;
     FlexBox optionsAutoReconnectBox;
     FlexBox optionsSnapToMouseBox;
@@ -186,6 +202,7 @@ protected:
     FlexBox optionsAllowBluetoothBox;
     FlexBox optionsAutoDropThreshBox;
     FlexBox optionsPluginDefaultBox;
+    FlexBox optionsStageProfilingBox;
 
     FlexBox recOptionsBox;
     FlexBox optionsRecordFormatBox;
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "PeerClockSync.h"
+
+#include "aoo/aoo.h"
+
+PeerClockSync::PeerClockSync()
+{
+}
+
+void PeerClockSync::reset()
+{
+    const SpinLock::ScopedLockType lock(mLock);
+
+    mBaseTime = 0;
+    mFilterCount = mFilterPos = 0;
+    mHistoryCount = mHistoryPos = 0;
+    mLastFilteredTime = -1.0;
+    mRefTime = mOffset = mDrift = mResidual = mBestDelay = 0.0;
+    mValid = false;
+}
+
+double PeerClockSync::toSeconds(uint64_t t) const
+{
+    return aoo_osctime_duration(mBaseTime, t);
+}
+
+bool PeerClockSync::addSample(uint64_t t1, uint64_t t2, uint64_t t3)
+{
+    const double rtt = aoo_osctime_duration(t1, t3);
+    if (rtt < 0.0 || rtt > 2.0) {
+        // clock went backwards or the reply is hopelessly late
+        return false;
+    }
+
+    const SpinLock::ScopedLockType lock(mLock);
+
+    if (mBaseTime == 0) {
+        mBaseTime = t1;
+    }
+
+    Sample sample;
+    sample.time = toSeconds(t3);
+    sample.offset = aoo_osctime_duration(t1, t2) - 0.5 * rtt;
+    sample.delay = rtt;
+
+    mFilter[mFilterPos] = sample;
+    mFilterPos = (mFilterPos + 1) % FilterSize;
+    mFilterCount = jmin(mFilterCount + 1, FilterSize);
+
+    // the sample with the smallest round trip had the least queueing delay,
+    // so it is the one whose offset we trust
+    int best = 0;
+    for (int i = 1; i < mFilterCount; ++i) {
+        if (mFilter[i].delay < mFilter[best].delay) {
+            best = i;
+        }
+    }
+    mBestDelay = mFilter[best].delay;
+
+    // only use each filtered sample once
+    if (mFilter[best].time > mLastFilteredTime) {
+        mLastFilteredTime = mFilter[best].time;
+        mHistory[mHistoryPos] = mFilter[best];
+        mHistoryPos = (mHistoryPos + 1) % HistorySize;
+        mHistoryCount = jmin(mHistoryCount + 1, HistorySize);
+
+        updateModel();
+    }
+
+    mValid = mFilterCount >= 4;
+
+    return true;
+}
+
+void PeerClockSync::updateModel()
+{
+    // weighted least squares fit of offset over time,
+    // where samples with a longer round trip count less
+    double sumw = 0.0, sumt = 0.0, sumo = 0.0;
+    double mintime = mHistory[0].time, maxtime = mHistory[0].time;
+
+    for (int i = 0; i < mHistoryCount; ++i) {
+        const auto & s = mHistory[i];
+        const double w = 1.0 / (s.delay + 1e-3);
+        sumw += w;
+        sumt += w * s.time;
+        sumo += w * s.offset;
+        mintime = jmin(mintime, s.time);
+        maxtime = jmax(maxtime, s.time);
+    }
+
+    const double meant = sumt / sumw;
+    const double meano = sumo / sumw;
+
+    if (mHistoryCount >= 4 && maxtime - mintime >= MinDriftSpan) {
+        double stt = 0.0, sto = 0.0;
+        for (int i = 0; i < mHistoryCount; ++i) {
+            const auto & s = mHistory[i];
+            const double w = 1.0 / (s.delay + 1e-3);
+            stt += w * (s.time - meant) * (s.time - meant);
+            sto += w * (s.time - meant) * (s.offset - meano);
+        }
+        mDrift = stt > 0.0 ? jlimit(-MaxDrift, MaxDrift, sto / stt) : 0.0;
+        mRefTime = meant;
+        mOffset = meano;
+    }
+    else {
+        // not enough of a time span to tell drift from noise, use the most recent point
+        const auto & last = mHistory[(mHistoryPos + HistorySize - 1) % HistorySize];
+        mDrift = 0.0;
+        mRefTime = last.time;
+        mOffset = last.offset;
+    }
+
+    double sumr = 0.0;
+    for (int i = 0; i < mHistoryCount; ++i) {
+        const auto & s = mHistory[i];
+        const double w = 1.0 / (s.delay + 1e-3);
+        const double r = s.offset - offsetAt(s.time);
+        sumr += w * r * r;
+    }
+    mResidual = std::sqrt(sumr / sumw);
+}
+
+double PeerClockSync::offsetAt(double time) const
+{
+    return mOffset + mDrift * (time - mRefTime);
+}
+
+bool PeerClockSync::isValid() const
+{
+    const SpinLock::ScopedLockType lock(mLock);
+    return mValid;
+}
+
+double PeerClockSync::getOffsetMs() const
+{
+    return getOffsetMsAt(aoo_osctime_get());
+}
+
+double PeerClockSync::getOffsetMsAt(uint64_t localtime) const
+{
+    const SpinLock::ScopedLockType lock(mLock);
+    if (!mValid) return 0.0;
+    return 1e3 * offsetAt(toSeconds(localtime));
+}
+
+double PeerClockSync::getDriftPpm() const
+{
+    const SpinLock::ScopedLockType lock(mLock);
+    return 1e6 * mDrift;
+}
+
+double PeerClockSync::getUncertaintyMs() const
+{
+    const SpinLock::ScopedLockType lock(mLock);
+    return 1e3 * (0.5 * mBestDelay + mResidual);
+}
+
+double PeerClockSync::getBestRoundtripMs() const
+{
+    const SpinLock::ScopedLockType lock(mLock);
+    return 1e3 * mBestDelay;
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Estimates the offset and drift between our clock and a remote peer's clock
+// from ping round trips, the way NTP does it:
+//
+// each ping gives us t1 (our send time), t2 (remote time) and t3 (our receive time),
+// so the offset is t2 - (t1 + t3)/2 with an error of at most half the round trip.
+// Of the last few samples only the one with the smallest round trip is trusted
+// (the clock filter), and a line fitted through the recent filtered points
+// gives the drift, so the offset can be extrapolated between pings.
+//
+// All times are NTP time tags as returned by aoo_osctime_get().
+// addSample() and the getters may be called from different threads.
+
+class PeerClockSync
+{
+public:
+    PeerClockSync();
+
+    void reset();
+
+    // returns false if the sample was discarded
+    bool addSample(uint64_t t1, uint64_t t2, uint64_t t3);
+
+    // true once there are enough samples for a usable offset
+    bool isValid() const;
+
+    // remote clock minus our clock, extrapolated to the given local time (or now)
+    double getOffsetMs() const;
+    double getOffsetMsAt(uint64_t localtime) const;
+
+    // how fast the remote clock runs relative to ours (0 until it can be estimated)
+    double getDriftPpm() const;
+
+    // rough bound on the error of getOffsetMs()
+    double getUncertaintyMs() const;
+
+    // smallest round trip in the clock filter
+    double getBestRoundtripMs() const;
+
+private:
+    struct Sample {
+        double time = 0.0;    // local time in seconds since mBaseTime
+        double offset = 0.0;  // seconds
+        double delay = 0.0;   // round trip in seconds
+    };
+
+    static constexpr int FilterSize = 8;
+    static constexpr int HistorySize = 32;
+    // the remote clock is not allowed to drift further than this (crystals are < 100 ppm)
+    static constexpr double MaxDrift = 500e-6;
+    // minimum time span of the history before the drift is estimated
+    static constexpr double MinDriftSpan = 10.0;
+
+    double toSeconds(uint64_t t) const;
+    void updateModel();
+    double offsetAt(double time) const;
+
+    mutable SpinLock mLock;
+
+    uint64_t mBaseTime = 0;
+
+    Sample mFilter[FilterSize];
+    int mFilterCount = 0;
+    int mFilterPos = 0;
+
+    Sample mHistory[HistorySize];
+    int mHistoryCount = 0;
+    int mHistoryPos = 0;
+    double mLastFilteredTime = -1.0;
+
+    // model: offset(t) = mOffset + mDrift * (t - mRefTime)
+    double mRefTime = 0.0;
+    double mOffset = 0.0;
+    double mDrift = 0.0;
+    double mResidual = 0.0;
+    double mBestDelay = 0.0;
+    bool mValid = false;
+};
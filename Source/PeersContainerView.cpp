@@ -434,6 +434,9 @@ PeerViewInfo * PeersContainerView::createPeerViewInfo()
     pvf->sendMutedButton = std::make_unique<ToggleButton>(TRANS("Disable Sending"));
     pvf->sendMutedButton->addListener(this);
 
+    pvf->sendRelayButton = std::make_unique<ToggleButton>(TRANS("Send through server relay"));
+    pvf->sendRelayButton->addListener(this);
+
     pvf->recvMutedButton = std::make_unique<TextButton>(TRANS("MUTE"));
     pvf->recvMutedButton->addListener(this);
     pvf->recvMutedButton->setLookAndFeel(&pvf->medLnf);
@@ -895,6 +898,7 @@ void PeersContainerView::rebuildPeerViews()
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->changeAllFormatButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->staticFormatChoiceLabel.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->sendMutedButton.get());
+        pvf->sendOptionsContainer->addAndMakeVisible(pvf->sendRelayButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->optionsRemoveButton.get());
         pvf->sendOptionsContainer->addAndMakeVisible(pvf->optionsBlockButton.get());
 
@@ -1234,6 +1238,7 @@ void PeersContainerView::updateLayout()
         pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight-10,  pvf->optionsChangeAllQualBox).withMargin(2).withFlex(0));
         pvf->sendOptionsBox.items.add(FlexItem(4, 4));
         pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight, pvf->optionsSendMutedBox).withMargin(0).withFlex(0));
+        pvf->sendOptionsBox.items.add(FlexItem(100, minitemheight, *pvf->sendRelayButton).withMargin(0).withFlex(0));
 
 
         pvf->recvbox.items.clear();
@@ -1630,6 +1635,9 @@ void PeersContainerView::updatePeerViews(int specific)
     uint32 nowstampms = Time::getMillisecondCounter();
     bool needsUpdateLayout = false;
 
+    processor.getPeerStatsSnapshot(mPeerStats);
+    const SonobusAudioProcessor::PeerStats nostats;
+
 
     //    for (int i=0; i < mPeerViews.size(); ++i) {
     for (int di=0; di < mPeerUpdateOrdering.size(); ++di) {
@@ -1644,7 +1652,9 @@ void PeersContainerView::updatePeerViews(int specific)
 
         pvf->channelGroups->setPeerMode(true, i);
 
-        bool connected = processor.getRemotePeerConnected(i);
+        const auto & stats = (i < mPeerStats.numPeers) ? mPeerStats.peers[i] : nostats;
+
+        bool connected = stats.connected;
         auto fullmode = pvf->fullMode;
 
         String hostname;
@@ -1661,24 +1671,24 @@ void PeersContainerView::updatePeerViews(int specific)
         }
 
         String sendtext;
-        bool sendactive = processor.getRemotePeerSendActive(i);
-        bool sendallow = processor.getRemotePeerSendAllow(i);
+        bool sendactive = stats.sendActive;
+        bool sendallow = stats.sendAllow;
 
-        bool recvactive = processor.getRemotePeerRecvActive(i);
-        bool recvallow = processor.getRemotePeerRecvAllow(i);
-        bool latactive = processor.isRemotePeerLatencyTestActive(i);
-        bool safetymuted = processor.getRemotePeerSafetyMuted(i);
-        bool blocked = processor.getRemotePeerBlockedUs(i);
+        bool recvactive = stats.recvActive;
+        bool recvallow = stats.recvAllow;
+        bool latactive = stats.latencyTestActive;
+        bool safetymuted = stats.safetyMuted;
+        bool blocked = stats.blockedUs;
 
-        const int chcnt = processor.getRemotePeerRecvChannelCount(i);
+        const int chcnt = stats.recvChannels;
 
         double sendrate = 0.0;
         double recvrate = 0.0;
         
         if (lastUpdateTimestampMs > 0) {
             double timedelta = (nowstampms - lastUpdateTimestampMs) * 1e-3;
-            int64_t nbs = processor.getRemotePeerBytesSent(i);
-            int64_t nbr = processor.getRemotePeerBytesReceived(i);
+            int64_t nbs = stats.bytesSent;
+            int64_t nbr = stats.bytesReceived;
             
             sendrate = (nbs - pvf->lastBytesSent) / timedelta;
             recvrate = (nbr - pvf->lastBytesRecv) / timedelta;
@@ -1707,16 +1717,14 @@ void PeersContainerView::updatePeerViews(int specific)
         }
         
         String recvtext;
-        SonobusAudioProcessor::AudioCodecFormatInfo recvfinfo;
-        processor.getRemotePeerReceiveAudioCodecFormat(i, recvfinfo);
 
         if (recvactive) {
             //recvtext << String(juce::CharPointer_UTF8 ("\xe2\x86\x93 ")) // down arrow
             recvtext << chcnt << "ch "
-            << recvfinfo.name
+            << String::fromUTF8(stats.recvFormatName)
             << String::formatted(" | %d kb/s", lrintf(recvrate * 8 * 1e-3));
 
-            int64_t dropped = processor.getRemotePeerPacketsDropped(i);
+            int64_t dropped = stats.packetsDropped;
             if (dropped > 0) {
                 recvtext += String::formatted(" | %d drop", dropped);
             }
@@ -1726,11 +1734,20 @@ void PeersContainerView::updatePeerViews(int specific)
                 pvf->lastDroppedChangedTimestampMs = nowstampms;
             }
 
-            int64_t resent = processor.getRemotePeerPacketsResent(i);
+            int64_t resent = stats.packetsResent;
             if (resent > 0) {
                 recvtext += String::formatted(" | %d resent", resent);
             }
 
+            int64_t recovered = stats.packetsRecovered;
+            if (recovered > 0) {
+                recvtext += String::formatted(" | %d fec", recovered);
+            }
+            else if (stats.parityPacketsReceived > 0) {
+                // they're sending error correction, but nothing needed it yet
+                recvtext += String(" | fec");
+            }
+
             if (nowstampms < pvf->lastDroppedChangedTimestampMs + 1500) {
                 pvf->recvActualBitrateLabel->setColour(Label::textColourId, droppedTextColor);
             }
@@ -1752,13 +1769,14 @@ void PeersContainerView::updatePeerViews(int specific)
 
         pvf->changeAllFormatButton->setToggleState(processor.getChangingDefaultAudioCodecSetsExisting(), dontSendNotification);
 
+        pvf->sendRelayButton->setToggleState(processor.getRemotePeerUseRelay(i), dontSendNotification);
+
         pvf->changeAllRecvFormatButton->setToggleState(processor.getChangingDefaultRecvAudioCodecSetsExisting(), dontSendNotification);
 
         pvf->sendActualBitrateLabel->setText(sendtext, dontSendNotification);
         pvf->recvActualBitrateLabel->setText(recvtext, dontSendNotification);
 
-        SonobusAudioProcessor::LatencyInfo latinfo;
-        processor.getRemotePeerLatencyInfo(i, latinfo);
+        const SonobusAudioProcessor::LatencyInfo & latinfo = stats.latency;
         
         //pvf->pingLabel->setText(String::formatted("%d ms", (int)latinfo.pingMs ), dontSendNotification);
         pvf->pingLabel->setText(String::formatted("%d", (int)lrintf(latinfo.pingMs) ), dontSendNotification);
@@ -1784,9 +1802,9 @@ void PeersContainerView::updatePeerViews(int specific)
         pvf->latActiveButton->setToggleState(latactive, dontSendNotification);
 
 
-        bool initCompleted = false;
-        int autobufmode = (int)processor.getRemotePeerAutoresizeBufferMode(i, initCompleted);
-        float buftimeMs = processor.getRemotePeerBufferTime(i);
+        bool initCompleted = stats.autoBufferInitCompleted;
+        int autobufmode = stats.autoBufferMode;
+        float buftimeMs = stats.bufferTimeMs;
         
         pvf->autosizeButton->setSelectedId(autobufmode, dontSendNotification);
         String buflab = (autobufmode == SonobusAudioProcessor::AutoNetBufferModeOff ? "" :
@@ -1803,13 +1821,13 @@ void PeersContainerView::updatePeerViews(int specific)
             pvf->bufferTimeSlider->setValue(buftimeMs, dontSendNotification);
         }
 
-        pvf->remoteSendFormatChoiceButton->setSelectedId(processor.getRequestRemotePeerSendAudioCodecFormat(i), dontSendNotification);
+        pvf->remoteSendFormatChoiceButton->setSelectedId(stats.reqRemoteSendFormatIndex, dontSendNotification);
         
         
-        int formatindex = processor.getRemotePeerAudioCodecFormat(i);
+        int formatindex = stats.sendFormatIndex;
         pvf->formatChoiceButton->setSelectedItemIndex(formatindex >= 0 ? formatindex : processor.getDefaultAudioCodecFormat(), dontSendNotification);
         String sendqual;
-        sendqual << processor.getRemotePeerActualSendChannelCount(i) << "ch " << processor.getAudioCodeFormatName(formatindex);
+        sendqual << stats.actualSendChannels << "ch " << processor.getAudioCodeFormatName(formatindex);
         pvf->sendQualityLabel->setText(sendqual, dontSendNotification);
         
         // pvf->recvMeter->setMeterSource (processor.getRemotePeerRecvMeterSource(i));
@@ -1939,13 +1957,15 @@ String PeersContainerView::generateLatencyMessage(const SonobusAudioProcessor::L
 void PeersContainerView::timerCallback(int timerId)
 {
     if (timerId == FillRatioUpdateTimerId) {
+        processor.getPeerStatsSnapshot(mPeerStats);
+
         for (int di=0; di < mPeerViews.size(); ++di) {
             PeerViewInfo * pvf = mPeerViews.getUnchecked(di);
             int i = mPeerUpdateOrdering[di];
 
-            float ratio, stdev;
-            if (processor.getRemotePeerReceiveBufferFillRatio(i, ratio, stdev)) {
-                pvf->jitterBufferMeter->setFillRatio(ratio, stdev);
+            if (i < mPeerStats.numPeers) {
+                const auto & stats = mPeerStats.peers[i];
+                pvf->jitterBufferMeter->setFillRatio(stats.fillRatio, stats.fillRatioStdev);
             }
         }
     }
@@ -2107,6 +2127,13 @@ void PeersContainerView::buttonClicked (Button* buttonThatWasClicked)
             processor.resetRemotePeerPacketStats(i);
             return;
         }
+        else if (pvf->sendRelayButton.get() == buttonThatWasClicked) {
+            if (!processor.setRemotePeerUseRelay(i, pvf->sendRelayButton->getToggleState())) {
+                pvf->sendRelayButton->setToggleState(processor.getRemotePeerUseRelay(i), dontSendNotification);
+                showPopTip(TRANS("The connection server does not relay for this user"), 4000, pvf->sendRelayButton.get(), 240);
+            }
+            return;
+        }
         else if (pvf->changeAllFormatButton.get() == buttonThatWasClicked) {
             processor.setChangingDefaultAudioCodecSetsExisting(buttonThatWasClicked->getToggleState());
             return;
@@ -2269,9 +2296,9 @@ void PeersContainerView::showSendOptions(int dindex, bool flag, Component * from
         
         const int defWidth = 245;
 #if JUCE_IOS || JUCE_ANDROID
-        const int defHeight = 144;
+        const int defHeight = 188;
 #else
-        const int defHeight = 116;
+        const int defHeight = 152;
 #endif
         
         
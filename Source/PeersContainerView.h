@@ -40,6 +40,7 @@ public:
     std::unique_ptr<TextEditor> addrLabel;
     std::unique_ptr<Label> staticAddrLabel;
     std::unique_ptr<ToggleButton> sendMutedButton;
+    std::unique_ptr<ToggleButton> sendRelayButton;
     std::unique_ptr<TextButton> recvMutedButton;
     std::unique_ptr<TextButton> recvSoloButton;
     std::unique_ptr<SonoDrawableButton> latActiveButton;
@@ -230,6 +231,7 @@ public:
     int getPendingPeerCount() const { return (int)mPendingUsers.size(); }
     
     void rebuildPeerViews();
+    // stats come from the processor's lock-free snapshot
     void updatePeerViews(int specific=-1);
     
     void setNarrowMode(bool flag) { isNarrow = flag; updateLayout(); }
@@ -328,6 +330,9 @@ protected:
     bool peerModeFull = true; // default
 
     uint32 lastUpdateTimestampMs = 0;
+
+    // latest copy of the processor's published peer stats
+    SonobusAudioProcessor::PeerStatsSnapshot mPeerStats;
     
     Colour mutedBySoloColor;
     Colour mutedTextColor;
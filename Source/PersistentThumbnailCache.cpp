@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "PersistentThumbnailCache.h"
+
+namespace SonoAudio {
+
+// shares the cache thread with the thumbnails, and holds it up while things are busy
+class PersistentThumbnailCache::Throttler : public TimeSliceClient
+{
+public:
+    explicit Throttler (PersistentThumbnailCache & owner_) : owner (owner_) {}
+
+    int useTimeSlice() override
+    {
+        std::function<bool()> check;
+        {
+            const ScopedLock sl (owner.mLock);
+            check = busyCheck;
+        }
+
+        if (check && check()) {
+            // every other client gets one slice per round, so this limits how fast they go
+            Thread::sleep (100);
+            return 0;
+        }
+
+        return 250;
+    }
+
+    PersistentThumbnailCache & owner;
+    std::function<bool()> busyCheck;
+};
+
+
+PersistentThumbnailCache::PersistentThumbnailCache (int maxNumThumbsInMemory, const File & directory, int64 maxBytesOnDisk)
+: AudioThumbnailCache (maxNumThumbsInMemory), mDirectory (directory), mMaxBytesOnDisk (maxBytesOnDisk)
+{
+    mThrottler = std::make_unique<Throttler>(*this);
+    getTimeSliceThread().addTimeSliceClient (mThrottler.get());
+}
+
+PersistentThumbnailCache::~PersistentThumbnailCache()
+{
+    getTimeSliceThread().removeTimeSliceClient (mThrottler.get());
+}
+
+int64 PersistentThumbnailCache::getFileHash (const File & file)
+{
+    return FileInputSource (file, true).hashCode();
+}
+
+void PersistentThumbnailCache::addPersistentHash (int64 hashCode)
+{
+    const ScopedLock sl (mLock);
+    mPersistentHashes.addIfNotAlreadyThere (hashCode);
+}
+
+void PersistentThumbnailCache::setBusyCheck (std::function<bool()> check)
+{
+    const ScopedLock sl (mLock);
+    mThrottler->busyCheck = std::move (check);
+}
+
+bool PersistentThumbnailCache::isPersistent (int64 hashCode) const
+{
+    const ScopedLock sl (mLock);
+    return mPersistentHashes.contains (hashCode);
+}
+
+File PersistentThumbnailCache::getFileForHash (int64 hashCode) const
+{
+    return mDirectory.getChildFile (String::toHexString (hashCode) + ".thumb");
+}
+
+void PersistentThumbnailCache::saveNewlyFinishedThumbnail (const AudioThumbnailBase& thumb, int64 hashCode)
+{
+    if (! isPersistent (hashCode) || thumb.getTotalLength() <= 0.0) {
+        return;
+    }
+
+    if (! mDirectory.createDirectory()) {
+        DBG("Could not create thumbnail cache dir: " << mDirectory.getFullPathName());
+        return;
+    }
+
+    // write it aside first, so a half written file is never loaded
+    TemporaryFile tempFile (getFileForHash (hashCode));
+    {
+        FileOutputStream out (tempFile.getFile());
+        if (! out.openedOk()) {
+            return;
+        }
+        thumb.saveTo (out);
+    }
+
+    if (tempFile.overwriteTargetFileWithTemporary()) {
+        trimDirectory();
+    }
+}
+
+bool PersistentThumbnailCache::loadNewThumb (AudioThumbnailBase& thumb, int64 hashCode)
+{
+    if (! isPersistent (hashCode)) {
+        return false;
+    }
+
+    auto file = getFileForHash (hashCode);
+
+    if (! file.existsAsFile()) {
+        return false;
+    }
+
+    bool loaded = false;
+    {
+        FileInputStream in (file);
+        loaded = in.openedOk() && thumb.loadFrom (in);
+    }
+
+    if (loaded) {
+        // marks it as recently used
+        file.setLastModificationTime (Time::getCurrentTime());
+    }
+    else {
+        DBG("Removing bad thumbnail cache file: " << file.getFullPathName());
+        file.deleteFile();
+    }
+
+    return loaded;
+}
+
+void PersistentThumbnailCache::trimDirectory()
+{
+    auto files = mDirectory.findChildFiles (File::findFiles, false, "*.thumb");
+
+    int64 total = 0;
+    for (auto & file : files) {
+        total += file.getSize();
+    }
+
+    if (total <= mMaxBytesOnDisk) {
+        return;
+    }
+
+    std::sort (files.begin(), files.end(), [] (const File & a, const File & b) {
+        return a.getLastModificationTime() < b.getLastModificationTime();
+    });
+
+    for (auto & file : files) {
+        if (total <= mMaxBytesOnDisk) {
+            break;
+        }
+        total -= file.getSize();
+        file.deleteFile();
+    }
+}
+
+}
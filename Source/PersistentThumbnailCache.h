@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <functional>
+
+namespace SonoAudio {
+
+// An AudioThumbnailCache that also keeps finished thumbnails as files in a directory,
+// so re-opening a long recording draws its waveform right away instead of scanning
+// the whole file again.
+//
+// Only thumbnails whose hash was marked with addPersistentHash() are written or looked
+// up on disk. That hash should change when the file does, which the hash of a
+// FileInputSource using the file time does (see getFileHash()).
+//
+// Thumbnails are generated on the cache's low priority thread, and while the busy
+// check returns true (e.g. recording to disk) generation is throttled, so it doesn't
+// compete with the recording writers for disk and CPU.
+
+class PersistentThumbnailCache : public AudioThumbnailCache
+{
+public:
+    PersistentThumbnailCache (int maxNumThumbsInMemory, const File & directory, int64 maxBytesOnDisk = 64 * 1024 * 1024);
+    ~PersistentThumbnailCache() override;
+
+    // hash for a local file, keyed on its path and modification time
+    static int64 getFileHash (const File & file);
+
+    void addPersistentHash (int64 hashCode);
+
+    // the check is run on the cache thread, so it must be safe to call from there
+    void setBusyCheck (std::function<bool()> check);
+
+protected:
+    void saveNewlyFinishedThumbnail (const AudioThumbnailBase& thumb, int64 hashCode) override;
+    bool loadNewThumb (AudioThumbnailBase& thumb, int64 hashCode) override;
+
+private:
+    class Throttler;
+
+    bool isPersistent (int64 hashCode) const;
+    File getFileForHash (int64 hashCode) const;
+
+    // deletes the least recently used files until it's under maxBytesOnDisk
+    void trimDirectory();
+
+    File mDirectory;
+    int64 mMaxBytesOnDisk;
+
+    Array<int64> mPersistentHashes;
+    CriticalSection mLock;
+
+    std::unique_ptr<Throttler> mThrottler;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PersistentThumbnailCache)
+};
+
+}
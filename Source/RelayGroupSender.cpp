@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "RelayGroupSender.h"
+
+#include "oscpack/osc/OscOutboundPacketStream.h"
+#include "oscpack/osc/OscReceivedElements.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace SonoAudio;
+
+bool RelayGroupSender::StreamSettings::operator== (const StreamSettings & other) const
+{
+    return numChannels == other.numChannels
+        && formatIndex == other.formatIndex
+        && packetSize == other.packetSize
+        && fecGroupSize == other.fecGroupSize
+        && coupled == other.coupled;
+}
+
+RelayGroupSender::RelayGroupSender (int32_t sourceId, GroupSendFunction groupSend)
+: mSource(aoo::isource::create(sourceId)), mGroupSend(std::move(groupSend))
+{
+    // one peer asking for a different codec doesn't change it for the whole group
+    mSource->set_respect_codec_change_requests(0);
+
+    aoo_relay_group relay = { sendToGroup, this };
+    mSource->set_option(aoo_opt_relay_group, &relay, sizeof(relay));
+}
+
+RelayGroupSender::~RelayGroupSender()
+{
+}
+
+int32_t RelayGroupSender::sendToGroup (void * user, const char * data, int32_t size)
+{
+    auto * self = static_cast<RelayGroupSender*>(user);
+
+    const ScopedLock sl (self->mGroupLock);
+
+    if (self->mGroup.isEmpty() || !self->mGroupSend(self->mGroup.toRawUTF8(), data, size)) {
+        return -1;
+    }
+    return size;
+}
+
+bool RelayGroupSender::canShare (const Candidate & candidate)
+{
+    return candidate.eligible && candidate.sending
+        && candidate.endpoint && candidate.sendFn && candidate.peerSource && candidate.sinkId != AOO_ID_NONE
+        && (candidate.sinkFlags & AOO_PROTOCOL_FLAG_COMPACT_DATA);
+}
+
+int RelayGroupSender::findMember (void * endpoint, int32_t sinkId) const
+{
+    for (int i = 0; i < (int) mMembers.size(); ++i) {
+        if (mMembers[i].endpoint == endpoint && mMembers[i].sinkId == sinkId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool RelayGroupSender::isMember (void * endpoint, int32_t sinkId) const
+{
+    const ScopedLock sl (mMemberLock);
+    return findMember(endpoint, sinkId) >= 0;
+}
+
+void RelayGroupSender::update (const String & group, const Candidate * candidates, int numCandidates, const SetupFunction & setup)
+{
+    const ScopedLock sl (mMemberLock);
+
+    // the candidate for each member, if it still is one
+    auto findCandidate = [&] (const Member & member) -> const Candidate * {
+        for (int i = 0; i < numCandidates; ++i) {
+            if (candidates[i].endpoint == member.endpoint && candidates[i].sinkId == member.sinkId) {
+                return &candidates[i];
+            }
+        }
+        return nullptr;
+    };
+
+    auto leaveAll = [&] {
+        while (!mMembers.empty()) {
+            leave((int) mMembers.size() - 1, findCandidate(mMembers.back()));
+        }
+    };
+
+    bool groupChanged;
+    {
+        const ScopedLock gsl (mGroupLock);
+        groupChanged = group != mGroup;
+    }
+
+    if (groupChanged) {
+        // everyone goes back to their own source before the packets go somewhere else
+        leaveAll();
+
+        const ScopedLock gsl (mGroupLock);
+        mGroup = group;
+    }
+
+    // the settings that the most peers who could share have, keeping the current ones on a tie
+    int best = -1;
+    int bestCount = 0;
+
+    if (group.isNotEmpty()) {
+        for (int i = 0; i < numCandidates; ++i) {
+            if (!canShare(candidates[i])) continue;
+
+            int count = 0;
+            for (int j = 0; j < numCandidates; ++j) {
+                if (canShare(candidates[j]) && candidates[j].settings == candidates[i].settings) {
+                    ++count;
+                }
+            }
+
+            const bool current = mHaveSettings && candidates[i].settings == mSettings;
+            if (count > bestCount || (count == bestCount && current)) {
+                best = i;
+                bestCount = count;
+            }
+        }
+    }
+
+    if (bestCount < 2) {
+        best = -1;
+    }
+
+    if (best >= 0 && (!mHaveSettings || candidates[best].settings != mSettings)) {
+        // a different stream, so nobody stays on the old one
+        leaveAll();
+
+        mSettings = candidates[best].settings;
+        mHaveSettings = true;
+        mNumChannels = mSettings.numChannels;
+        setup(*mSource, best);
+    }
+
+    auto wanted = [&] (const Candidate * candidate) {
+        return best >= 0 && candidate && canShare(*candidate) && candidate->settings == mSettings;
+    };
+
+    for (int i = (int) mMembers.size() - 1; i >= 0; --i) {
+        const auto * candidate = findCandidate(mMembers[i]);
+        if (!wanted(candidate)) {
+            leave(i, candidate);
+        }
+    }
+
+    for (int i = 0; i < numCandidates; ++i) {
+        if (wanted(&candidates[i]) && findMember(candidates[i].endpoint, candidates[i].sinkId) < 0) {
+            join(candidates[i]);
+        }
+    }
+
+    updateRunning();
+}
+
+void RelayGroupSender::removeSink (void * endpoint, int32_t sinkId)
+{
+    const ScopedLock sl (mMemberLock);
+
+    const int index = findMember(endpoint, sinkId);
+    if (index >= 0) {
+        leave(index, nullptr);
+        updateRunning();
+    }
+}
+
+void RelayGroupSender::returnSink (const Candidate & candidate)
+{
+    const ScopedLock sl (mMemberLock);
+
+    const int index = findMember(candidate.endpoint, candidate.sinkId);
+    if (index >= 0) {
+        leave(index, &candidate);
+        updateRunning();
+    }
+}
+
+void RelayGroupSender::join (const Candidate & candidate)
+{
+    candidate.peerSource->remove_sink(candidate.endpoint, candidate.sinkId);
+
+    mSource->add_sink(candidate.endpoint, candidate.sinkId, candidate.sendFn);
+
+    int32_t flags = candidate.sinkFlags;
+    mSource->set_sinkoption(candidate.endpoint, candidate.sinkId, aoo_opt_protocol_flags, &flags, sizeof(int32_t));
+    int32_t relayed = 1;
+    mSource->set_sinkoption(candidate.endpoint, candidate.sinkId, aoo_opt_relay_group, &relayed, sizeof(int32_t));
+
+    mMembers.push_back({ candidate.endpoint, candidate.sinkId });
+}
+
+void RelayGroupSender::leave (int memberIndex, const Candidate * candidate)
+{
+    const Member member = mMembers[memberIndex];
+    mMembers.erase(mMembers.begin() + memberIndex);
+
+    mSource->remove_sink(member.endpoint, member.sinkId);
+    mMembersLeft = true;
+
+    if (candidate) {
+        // back the way the invite had set it up
+        candidate->peerSource->add_sink(member.endpoint, member.sinkId, candidate->sendFn);
+
+        int32_t flags = candidate->sinkFlags;
+        candidate->peerSource->set_sinkoption(member.endpoint, member.sinkId, aoo_opt_protocol_flags, &flags, sizeof(int32_t));
+    }
+}
+
+void RelayGroupSender::updateRunning()
+{
+    const int count = (int) mMembers.size();
+
+    // the relay still hands the group stream to everyone, so whenever anyone left it
+    // starts over with a new salt, which the sinks that left don't know
+    if (count > 0 && (mNumMembers.load() == 0 || mMembersLeft)) {
+        mSource->start();
+    }
+    else if (count == 0 && mNumMembers.load() > 0) {
+        mSource->stop();
+    }
+
+    mNumMembers = count;
+    mMembersLeft = false;
+}
+
+int32_t RelayGroupSender::readdressCodecChange (const char * data, int32_t size, int32_t sourceId,
+                                                char * buf, int32_t bufSize, int32_t & sinkId)
+{
+    int32_t type, id;
+    const auto onset = aoo_parse_pattern(data, size, &type, &id);
+    if (!onset || type != AOO_TYPE_SOURCE) {
+        return 0;
+    }
+
+    try {
+        osc::ReceivedPacket packet(data, size);
+        osc::ReceivedMessage msg(packet);
+
+        if (strcmp(msg.AddressPattern() + onset, AOO_MSG_CODEC_CHANGE) != 0) {
+            return 0;
+        }
+
+        // /aoo/src/<id>/codecchange <sink> <numchannels> <samplerate> <blocksize> <codec> <options...>
+        auto it = msg.ArgumentsBegin();
+        const int32_t sink = (it++)->AsInt32();
+        const int32_t nchannels = (it++)->AsInt32();
+        const int32_t samplerate = (it++)->AsInt32();
+        const int32_t blocksize = (it++)->AsInt32();
+        const char * codec = (it++)->AsString();
+        const void * options;
+        osc::osc_bundle_element_size_t optionsSize;
+        (it++)->AsBlob(options, optionsSize);
+
+        char address[AOO_MSG_DOMAIN_LEN + AOO_MSG_SOURCE_LEN + 16 + AOO_MSG_CODEC_CHANGE_LEN];
+        snprintf(address, sizeof(address), "%s%s/%d%s", AOO_MSG_DOMAIN, AOO_MSG_SOURCE, sourceId, AOO_MSG_CODEC_CHANGE);
+
+        osc::OutboundPacketStream out(buf, bufSize);
+        out << osc::BeginMessage(address) << sink << nchannels << samplerate << blocksize << codec
+            << osc::Blob(options, optionsSize) << osc::EndMessage;
+
+        sinkId = sink;
+        return (int32_t) out.Size();
+    }
+    catch (const osc::Exception &) {
+        return 0;
+    }
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "aoo/aoo.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace SonoAudio {
+
+// One aoo source that streams our send mix to all of the peers we reach through the
+// connection server's relay, so each block is uploaded once and the server fans it out
+// to the group (see aoo_opt_relay_group), instead of once per relayed peer.
+//
+// A peer can only share it if it would get exactly what the others get: the plain send
+// mix (not a hub mix-minus or cross routed audio), with the same channels, codec format
+// and packet settings, and it must take compact data messages. The group uses the
+// settings most of those peers have, and only when at least two of them do, otherwise
+// there is nothing to save. Everyone else keeps getting their own source's stream.
+//
+// The owner passes in all of its peers whenever something might have changed. Putting
+// a peer in the group just moves its sink from the peer's own source to the group
+// source, and back when it leaves; the remote sink sees that as a new source. The group
+// source ignores codec change requests, those go to the peer's own source instead
+// (see readdressCodecChange() and returnSink()), which then has a different format.
+
+class RelayGroupSender
+{
+public:
+    // what a peer's stream needs to look like, peers can only share one that matches
+    struct StreamSettings
+    {
+        int numChannels = 0;
+        int formatIndex = -1;
+        int packetSize = 0;
+        int fecGroupSize = 0;
+        bool coupled = false; // the sink can decode coupled opus channels
+
+        bool operator== (const StreamSettings & other) const;
+        bool operator!= (const StreamSettings & other) const { return !(*this == other); }
+    };
+
+    // a peer that could get the group stream, what the owner knows about it
+    struct Candidate
+    {
+        void * endpoint = nullptr;
+        aoo_replyfn sendFn = nullptr;
+        aoo::isource * peerSource = nullptr;
+        int32_t sinkId = AOO_ID_NONE;
+        int32_t sinkFlags = 0;
+        bool sending = false;  // the peer wants our audio
+        bool eligible = false; // relayed, and only gets the plain send mix
+        StreamSettings settings;
+    };
+
+    // sends a packet once to the named group on the connection server, from the send thread
+    using GroupSendFunction = std::function<bool (const char * group, const char * data, int32_t size)>;
+
+    // called with the index of a candidate that has the new settings whenever they change,
+    // before any sinks are added, to set up the group source for them
+    using SetupFunction = std::function<void (aoo::isource & source, int candidateIndex)>;
+
+    RelayGroupSender (int32_t sourceId, GroupSendFunction groupSend);
+    ~RelayGroupSender();
+
+    aoo::isource * getSource() const { return mSource.get(); }
+
+    // not the audio thread. decides which of the peers share the group source for the
+    // named group (empty for none), and moves their sinks over, or back to their own
+    // sources. Members that aren't among the candidates any more are just dropped.
+    void update (const String & group, const Candidate * candidates, int numCandidates, const SetupFunction & setup);
+
+    // not the audio thread. takes a sink out of the group without giving it back to the
+    // peer's source, for when the peer uninvites us or goes away
+    void removeSink (void * endpoint, int32_t sinkId);
+
+    // not the audio thread. hands a member's sink back to the peer's own source, for when
+    // that peer needs its own stream right away
+    void returnSink (const Candidate & candidate);
+
+    bool isMember (void * endpoint, int32_t sinkId) const;
+
+    // any thread. the audio thread only needs to process the group source if this isn't 0
+    int getNumMembers() const { return mNumMembers.load(); }
+
+    // any thread. channels of the group stream
+    int getNumChannels() const { return mNumChannels.load(); }
+
+    // a codec change request sent to the group source is meant for the requesting peer's
+    // own stream. If data is one, this writes it to buf addressed to sourceId instead and
+    // returns its size, along with the requesting sink. Otherwise it returns 0.
+    static int32_t readdressCodecChange (const char * data, int32_t size, int32_t sourceId,
+                                         char * buf, int32_t bufSize, int32_t & sinkId);
+
+private:
+    static int32_t sendToGroup (void * user, const char * data, int32_t size);
+
+    struct Member
+    {
+        void * endpoint;
+        int32_t sinkId;
+    };
+
+    static bool canShare (const Candidate & candidate);
+    int findMember (void * endpoint, int32_t sinkId) const;
+    void join (const Candidate & candidate);
+    void leave (int memberIndex, const Candidate * candidate);
+    void updateRunning();
+
+    aoo::isource::pointer mSource;
+    GroupSendFunction mGroupSend;
+
+    // the send thread reads the name while sending
+    CriticalSection mGroupLock;
+    String mGroup;
+
+    // membership changes can come from more than one thread
+    CriticalSection mMemberLock;
+    std::vector<Member> mMembers;
+    StreamSettings mSettings;
+    bool mHaveSettings = false;
+    bool mMembersLeft = false;
+
+    std::atomic<int> mNumMembers { 0 };
+    std::atomic<int> mNumChannels { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RelayGroupSender)
+};
+
+}
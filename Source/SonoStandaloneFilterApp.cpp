@@ -58,6 +58,7 @@ extern juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
 #include "SonoLookAndFeel.h"
 
 #include "SonobusPluginEditor.h"
+#include "SonobusSessionHost.h"
 
 #if JUCE_ANDROID
 #include "android/SonoBusActivity.h"
@@ -126,6 +127,10 @@ public:
     bool doHeadless = false;
     String loadSetupFilename;
     String cmdlineArgUrl;
+    String stageProfileFilename;
+    StringArray hostedRoomNames;
+    bool runRelayServer = false;
+    bool runAsHub = false;
 
     virtual StandalonePluginHolder* createHeadlessPlugin ()
     {
@@ -315,6 +320,18 @@ public:
         const String loadSetupSpec("-l|--load-setup");
         const String loadSetupSpecDesc("-l|--load-setup <setup-filename>");
 
+        const String profileStagesSpec("--profile-stages");
+        const String profileStagesSpecDesc("--profile-stages <trace-filename>");
+
+        const String roomsSpec("-r|--rooms");
+        const String roomsSpecDesc("-r|--rooms <groupname,groupname,...>");
+
+        const String relayServerSpec("--relay-server");
+        const String relayServerSpecDesc("--relay-server");
+
+        const String hubSpec("--hub");
+        const String hubSpecDesc("--hub");
+
         
 
         app.addCommand ({ helpSpec, helpSpec, TRANS("Prints the list of commands"), {}, nullptr });
@@ -356,6 +373,30 @@ public:
             nullptr
         });
 
+        app.addCommand ({ profileStagesSpec, profileStagesSpecDesc,
+            TRANS("Record timing of the audio processing stages, and write them out as a Chrome trace file when quitting."),
+            TRANS("The percentile summary for each stage is also printed to the console on exit. The trace file can be viewed with chrome://tracing or ui.perfetto.dev ."),
+            nullptr
+        });
+
+        app.addCommand ({ roomsSpec, roomsSpecDesc,
+            TRANS("Headless only, join each of these groups as a separate session, all sharing one UDP port and audio device."),
+            TRANS("Any group given with --group is joined as the first one. All of them use the same connection server, username and group password, and each gets the default settings."),
+            nullptr
+        });
+
+        app.addCommand ({ relayServerSpec, relayServerSpecDesc,
+            TRANS("Run the built-in connection server with relaying enabled, so group members that can't connect to each other directly get their audio passed through it."),
+            TRANS("The connection server listens on port 10999. Relaying uses this computer's upload bandwidth for everyone's audio."),
+            nullptr
+        });
+
+        app.addCommand ({ hubSpec, hubSpecDesc,
+            TRANS("Act as a mixing hub for the group, sending each member everyone else's audio."),
+            TRANS("Members that hear from the hub stop connecting to each other directly, so each of them only sends one stream, to the hub."),
+            nullptr
+        });
+
 
 
         if (arglist.removeOptionIfFound(versionSpec)) {
@@ -413,6 +454,38 @@ public:
             loadSetupFilename = setupfile;
         }
 
+        auto proffile = arglist.removeValueForOption(profileStagesSpec);
+        if (proffile.isNotEmpty()) {
+#if SONOBUS_STAGE_PROFILING
+            stageProfileFilename = proffile;
+#else
+            std::cerr << TRANS("Stage profiling was not compiled into this build") << std::endl;
+#endif
+        }
+
+
+        if (arglist.removeOptionIfFound(relayServerSpec)) {
+            runRelayServer = true;
+        }
+
+        if (arglist.removeOptionIfFound(hubSpec)) {
+            runAsHub = true;
+        }
+
+        auto rooms = arglist.removeValueForOption(roomsSpec);
+        if (rooms.isNotEmpty()) {
+            if (cmdlineConnInfo.groupName.isNotEmpty()) {
+                hostedRoomNames.add(cmdlineConnInfo.groupName);
+            }
+            hostedRoomNames.addTokens(rooms, ",", "\"");
+            hostedRoomNames.trim();
+            hostedRoomNames.removeEmptyStrings();
+            hostedRoomNames.removeDuplicates(false);
+
+            if (hostedRoomNames.size() > 0) {
+                doInitialConnect = true;
+            }
+        }
 
         if (arglist.removeOptionIfFound(headlessSpec)) {
 
@@ -423,6 +496,10 @@ public:
                 doImmediateQuit = true;
             }
         }
+        else if (hostedRoomNames.size() > 0) {
+            std::cout << TRANS("Error: --rooms is only supported for headless operation (-q)") << std::endl;
+            doImmediateQuit = true;
+        }
 
         // what args remain? assume it's a URL
         if (arglist.arguments.size() > 0) {
@@ -456,6 +533,19 @@ public:
 
 
             if (auto * sonoproc = dynamic_cast<SonobusAudioProcessor*>(mainWindow->pluginHolder->processor.get())) {
+                if (stageProfileFilename.isNotEmpty()) {
+                    sonoproc->setStageProfilingEnabled(true);
+                }
+
+                if (runRelayServer) {
+                    // the editor starts the server itself
+                    sonoproc->setServerRelayEnabled(true);
+                }
+
+                if (runAsHub) {
+                    sonoproc->setHubMixMinusEnabled(true);
+                }
+
                 if (sonoproc->hasEditor()) {
                     if (auto * sonoeditor = dynamic_cast<SonobusAudioProcessorEditor*>(sonoproc->createEditorIfNeeded())) {
                         sonoeditor->saveSettingsIfNeeded = [this]() {
@@ -512,6 +602,10 @@ public:
             startTimer(500);
 #endif
         }
+        else if (hostedRoomNames.size() > 0) {
+            // headless mode, several rooms in one process
+            startHostedRooms();
+        }
         else {
             // headless mode
 
@@ -519,6 +613,10 @@ public:
 
             if (auto * sonoproc = dynamic_cast<SonobusAudioProcessor*>(pluginHolder->processor.get())) {
 
+                if (stageProfileFilename.isNotEmpty()) {
+                    sonoproc->setStageProfilingEnabled(true);
+                }
+
                 // apply command line connection stuff
 
                 if (loadSetupFilename.isNotEmpty()) {
@@ -546,6 +644,15 @@ public:
                 }
 
 
+                if (runRelayServer) {
+                    sonoproc->setServerRelayEnabled(true);
+                    sonoproc->startAooServer();
+                }
+
+                if (runAsHub) {
+                    sonoproc->setHubMixMinusEnabled(true);
+                }
+
                 if (doInitialConnect) {
                     DBG("CONNECTING HEADLESS INITIAL");
                     sonoproc->connectToServer(cmdlineConnInfo.serverHost, cmdlineConnInfo.serverPort, cmdlineConnInfo.userName, cmdlineConnInfo.userPassword);
@@ -572,6 +679,132 @@ public:
     }
 
 
+    void startHostedRooms()
+    {
+        if (loadSetupFilename.isNotEmpty()) {
+            std::cerr << "Setup files are not supported with --rooms, using the default settings" << std::endl;
+        }
+
+        sessionHost = std::make_unique<SonobusSessionHost>();
+
+        if (!sessionHost->initialize()) {
+            std::cerr << "Error: could not open a UDP port for the rooms" << std::endl;
+            sessionHost.reset();
+            quit();
+            return;
+        }
+
+        for (auto & room : hostedRoomNames) {
+            auto index = sessionHost->addSession();
+            if (index < 0) {
+                std::cerr << "Error: no more than " << SonobusSessionHost::MaxSessions << " rooms are supported, not joining " << room << std::endl;
+                break;
+            }
+
+            auto * session = sessionHost->getSession(index);
+
+            if (stageProfileFilename.isNotEmpty()) {
+                session->setStageProfilingEnabled(true);
+            }
+
+            if (runAsHub) {
+                session->setHubMixMinusEnabled(true);
+            }
+
+            // one connection server is plenty, the first session runs it
+            if (runRelayServer && index == 0) {
+                session->setServerRelayEnabled(true);
+                session->startAooServer();
+            }
+
+            session->connectToServer(cmdlineConnInfo.serverHost, cmdlineConnInfo.serverPort, cmdlineConnInfo.userName, cmdlineConnInfo.userPassword);
+        }
+
+        AudioDeviceManager::AudioDeviceSetup setupOptions;
+        setupOptions.sampleRate = 48000;
+#if JUCE_MAC
+        setupOptions.bufferSize = 128;
+#else
+        setupOptions.bufferSize = 256;
+#endif
+
+        sessionDeviceManager = std::make_unique<AudioDeviceManager>();
+        auto deverr = sessionDeviceManager->initialise(2, 2, nullptr, true, {}, &setupOptions);
+        if (deverr.isNotEmpty()) {
+            std::cerr << "Error opening audio device: " << deverr << std::endl;
+        }
+        sessionDeviceManager->addAudioCallback(sessionHost.get());
+
+        // HACK FOR NOW - todo add listener
+        Thread::sleep(500);
+
+        for (int i = 0, room = 0; i < SonobusSessionHost::MaxSessions && room < hostedRoomNames.size(); ++i) {
+            if (auto * session = sessionHost->getSession(i)) {
+                session->setWatchPublicGroups(false);
+                session->joinServerGroup(hostedRoomNames[room], cmdlineConnInfo.groupPassword, cmdlineConnInfo.groupIsPublic);
+
+                std::cout << "Joining room " << hostedRoomNames[room] << " on UDP port " << sessionHost->getUdpLocalPort() << std::endl;
+                ++room;
+            }
+        }
+    }
+
+    void stopHostedRooms()
+    {
+        if (sessionDeviceManager) {
+            sessionDeviceManager->removeAudioCallback(sessionHost.get());
+            sessionDeviceManager->closeAudioDevice();
+        }
+
+        if (sessionHost) {
+            sessionHost->shutdown();
+        }
+
+        sessionDeviceManager.reset();
+        sessionHost.reset();
+    }
+
+    void writeStageProfile()
+    {
+        if (sessionHost != nullptr) {
+            for (int i = 0; i < SonobusSessionHost::MaxSessions; ++i) {
+                if (auto * session = sessionHost->getSession(i)) {
+                    writeStageProfile(session->getStageProfiler(), stageProfileFilename.upToLastOccurrenceOf(".", false, false)
+                                      + "_" + String(i) + stageProfileFilename.fromLastOccurrenceOf(".", true, false));
+                }
+            }
+            return;
+        }
+
+        SonobusAudioProcessor * processor = nullptr;
+
+        if (mainWindow != nullptr && mainWindow->pluginHolder != nullptr) {
+            processor = dynamic_cast<SonobusAudioProcessor*>(mainWindow->pluginHolder->processor.get());
+        }
+        else if (pluginHolder != nullptr) {
+            processor = dynamic_cast<SonobusAudioProcessor*>(pluginHolder->processor.get());
+        }
+
+        if (processor == nullptr) return;
+
+        writeStageProfile(processor->getStageProfiler(), stageProfileFilename);
+    }
+
+    void writeStageProfile(SonoAudio::StageProfiler & profiler, const String & filename)
+    {
+        profiler.update();
+
+        std::cout << profiler.getSummaryText() << std::endl;
+
+        File tracefile = File::getCurrentWorkingDirectory().getChildFile(filename);
+        if (profiler.exportChromeTrace(tracefile)) {
+            std::cerr << "Wrote stage trace file: " << tracefile.getFullPathName() << std::endl;
+        }
+        else {
+            std::cerr << "Error writing stage trace file: " << tracefile.getFullPathName() << std::endl;
+        }
+    }
+
     bool loadSettingsFromFile(const File & file)
     {
         SonobusAudioProcessor * processor = nullptr;
@@ -687,10 +920,16 @@ public:
   #endif
 #endif
 
+        if (stageProfileFilename.isNotEmpty()) {
+            writeStageProfile();
+        }
+
         mainWindow = nullptr;
 
         pluginHolder = nullptr;
 
+        stopHostedRooms();
+
         appProperties.saveIfNeeded();
 
     }
@@ -882,6 +1121,10 @@ protected:
     // used only in headless mode
     std::unique_ptr<StandalonePluginHolder> pluginHolder;
 
+    // used only in headless mode with --rooms
+    std::unique_ptr<SonobusSessionHost> sessionHost;
+    std::unique_ptr<AudioDeviceManager> sessionDeviceManager;
+
 };
 
 } // namespace juce
@@ -1095,7 +1095,7 @@ SonobusAudioProcessorEditor::SonobusAudioProcessorEditor (SonobusAudioProcessor&
         mDismissTransportButton->setColour(DrawableButton::backgroundColourId, Colours::transparentBlack);
         mDismissTransportButton->setTitle(TRANS("Dismiss File Playback"));
 
-        mWaveformThumbnail.reset (new WaveformTransportComponent (processor.getFormatManager(), processor.getTransportSource(), commandManager));
+        mWaveformThumbnail.reset (new WaveformTransportComponent (processor.getFormatManager(), processor.getTransportSource(), processor.getThumbnailCache(), commandManager));
         mWaveformThumbnail->addChangeListener (this);
         mWaveformThumbnail->setFollowsTransport(false);
         
@@ -1776,7 +1776,7 @@ void SonobusAudioProcessorEditor::choiceButtonSelected(SonoChoiceButton *comp, i
 }
 
 
-bool SonobusAudioProcessorEditor::updatePeerState(bool force)
+bool SonobusAudioProcessorEditor::updatePeerState(bool force, bool periodic)
 {
     if (!mPeerContainer) return false;
     
@@ -1863,7 +1863,7 @@ void SonobusAudioProcessorEditor::timerCallback(int timerid)
 {
     if (timerid == PeriodicUpdateTimerId) {
         
-        bool stateUpdated = updatePeerState();
+        bool stateUpdated = updatePeerState(false, true);
         
         updateChannelState();
         
@@ -207,7 +207,7 @@ private:
 
     void updateServerStatusLabel(const String & mesg, bool mainonly=true);
     void updateChannelState(bool force=false);
-    bool updatePeerState(bool force=false);
+    bool updatePeerState(bool force=false, bool periodic=false);
     void updateTransportState();
     
     void updateOptionsState(bool ignorecheck=false);
@@ -21,7 +21,10 @@
 #include <algorithm>
 
 #include "LatencyMeasurer.h"
+#include "PeerClockSync.h"
+#include "CodecFormatTable.h"
 #include "Metronome.h"
+#include "SonobusSessionHost.h"
 
 using namespace SonoAudio;
 
@@ -41,6 +44,25 @@ typedef int socklen_t;
 #define SENDBUFSIZE_SCALAR 2.0f
 #define PEER_PING_INTERVAL_MS 2000.0
 
+// silence suppression (DTX) of what we send
+#define SEND_SILENCE_THRESHOLD_DB -72.0f
+#define SEND_SILENCE_HANGOVER_MS 250
+#define SEND_FEC_GROUP_SIZE 4
+// how long nothing must have been received from a peer before its effects are skipped
+#define RECV_IDLE_HOLD_SEC 1.0
+// auto net buffer won't shrink below this multiple of the measured arrival jitter
+#define AUTO_NETBUF_JITTER_FACTOR 3.0f
+
+// adaptive receive format controller
+#define ADAPTIVE_EVAL_INTERVAL_MS 2000.0
+#define ADAPTIVE_CHANGE_SETTLE_MS 4000.0   // ignore stats right after a change while the remote switches
+#define ADAPTIVE_CONGESTED_LOSS 0.03f      // loss fraction considered congested
+#define ADAPTIVE_SEVERE_LOSS 0.10f         // loss fraction that steps down immediately
+#define ADAPTIVE_CLEAN_LOSS 0.005f         // loss fraction considered clean
+#define ADAPTIVE_MIN_UP_HOLD 4             // clean windows needed before probing up
+#define ADAPTIVE_MAX_UP_HOLD 32
+#define ADAPTIVE_FAILED_PROBE_MS 20000.0   // congestion this soon after stepping up backs off the probing
+
 String SonobusAudioProcessor::paramInGain     ("ingain");
 String SonobusAudioProcessor::paramDry     ("dry");
 String SonobusAudioProcessor::paramInMonitorMonoPan     ("inmonmonopan");
@@ -112,6 +134,14 @@ static String lastWindowWidthKey("lastWindowWidth");
 static String lastWindowHeightKey("lastWindowHeight");
 static String autoresizeDropRateThreshKey("autoDropRateThreshNew");
 static String reconnectServerLossKey("reconnServLoss");
+static String adaptiveRecvFormatKey("adaptiveRecvFormat");
+static String adaptiveFormatMinKey("adaptiveFormatMin");
+static String adaptiveFormatMaxKey("adaptiveFormatMax");
+static String sendSilenceSuppressionKey("sendSilenceSuppression");
+static String sendFecKey("sendFec");
+static String hubMixMinusKey("hubMixMinus");
+static String serverRelayKey("serverRelay");
+static String reverbOnWorkerKey("reverbOnWorker");
 
 static String compressorStateKey("CompressorState");
 static String expanderStateKey("ExpanderState");
@@ -153,6 +183,8 @@ static String peerOrderPriorityKey("orderpriority");
 
 
 #define METER_RMS_SEC 0.03
+// meters that no view has painted for a while only measure every Nth block
+#define IDLE_METER_DECIMATION 8
 #define MAX_PANNERS 64
 
 #define ECHO_SINKSOURCE_ID 12321
@@ -195,7 +227,7 @@ static addrinfo* getAddressInfo (bool isDatagram, const String& hostName, int po
 
 struct SonobusAudioProcessor::EndpointState {
     EndpointState(String ipaddr_="", int port_=0) : ipaddr(ipaddr_), port(port_) {
-        rawaddr.sa_family = AF_UNSPEC;
+        rawaddr.ss_family = AF_UNSPEC;
     }
     
 
@@ -208,24 +240,28 @@ struct SonobusAudioProcessor::EndpointState {
     
     
     struct sockaddr * getRawAddr() {
-        if (rawaddr.sa_family == AF_UNSPEC) {
+        if (rawaddr.ss_family == AF_UNSPEC) {
             struct addrinfo * info = getAddressInfo(true, ipaddr, port);
             if (info) {
-                memcpy(&rawaddr, info->ai_addr, info->ai_addrlen);
+                // big enough for IPv6 too
+                memcpy(&rawaddr, info->ai_addr, jmin((size_t) info->ai_addrlen, sizeof(rawaddr)));
 
                 freeaddrinfo(info);
             }
         }
-        return &rawaddr;
+        return (struct sockaddr *) &rawaddr;
     }
     
     
     // runtime state
     int64_t sentBytes = 0;
     int64_t recvBytes = 0;
+
+    // when set, packets to this endpoint go through the connection server's relay
+    std::atomic<aoo::net::iclient *> relay { nullptr };
     
 private:
-    struct sockaddr rawaddr;
+    struct sockaddr_storage rawaddr;
     
 };
 
@@ -234,6 +270,8 @@ private:
 
 #define LATENCY_ID_OFFSET 20000
 #define ECHO_ID_OFFSET    40000
+// the one relay group source, see updateRelayGroup()
+#define RELAY_GROUP_ID_OFFSET 60000
 
 enum {
     RemoteNetTypeUnknown = 0,
@@ -243,6 +281,24 @@ enum {
 };
 
 
+// state for the loss and ping driven adaptive receive format
+struct AdaptiveFormatState
+{
+    bool enabled = false;
+    int formatIndex = -1; // last format requested by the controller, -1 not started
+    double lastEvalTimeMs = 0;
+    double lastChangeTimeMs = 0;
+    double lastUpTimeMs = 0;
+    int64_t lastRecvCount = 0;
+    int64_t lastDropCount = 0;
+    int64_t lastResentCount = 0;
+    int congestedWindows = 0;
+    int cleanWindows = 0;
+    int upHoldWindows = ADAPTIVE_MIN_UP_HOLD;
+    float baseRttMs = 0.0f;
+    float bandwidthEstimate = 0.0f; // bits/s per channel
+};
+
 struct SonobusAudioProcessor::RemotePeer {
     RemotePeer(EndpointState * ep = 0, int id_=0, aoo::isink::pointer oursink_ = 0, aoo::isource::pointer oursource_ = 0) : endpoint(ep), 
         ourId(id_), 
@@ -259,6 +315,9 @@ struct SonobusAudioProcessor::RemotePeer {
         
         oursink.reset(aoo::isink::create(ourId));
         oursource.reset(aoo::isource::create(ourId));
+
+        recvMeterSource.setIdleDecimation(IDLE_METER_DECIMATION);
+        sendMeterSource.setIdleDecimation(IDLE_METER_DECIMATION);
         
         // create latency sink/sources
         latencysink.reset(aoo::isink::create(ourId + LATENCY_ID_OFFSET));
@@ -270,6 +329,8 @@ struct SonobusAudioProcessor::RemotePeer {
     EndpointState * endpoint = 0;
     int32_t ourId = AOO_ID_NONE;
     int32_t remoteSinkId = AOO_ID_NONE;
+    // protocol flags the remote sink sent with its invite
+    int32_t remoteSinkFlags = 0;
     int32_t remoteSourceId = AOO_ID_NONE;
     aoo::isink::pointer oursink;
     aoo::isource::pointer oursource;
@@ -298,7 +359,10 @@ struct SonobusAudioProcessor::RemotePeer {
     int  formatIndex = -1; // default
     AudioCodecFormatInfo recvFormat;
     int reqRemoteSendFormatIndex = -1; // no pref
+    AdaptiveFormatState adaptiveFormat;
     int packetsize = 600;
+    int fecGroupSize = 0; // 0 is off
+    int64 recvSilentSamples = 0; // how long the sink has output nothing
     int sendChannels = 1; // actual current send channel count
     int nominalSendChannels = 1; // 0 matches input, 1 is 1, 2 is 2
     int sendChannelsOverride = -1; // -1 don't override
@@ -314,6 +378,8 @@ struct SonobusAudioProcessor::RemotePeer {
     int64_t dataPacketsSent = 0;
     int64_t dataPacketsDropped = 0;
     int64_t dataPacketsResent = 0;
+    int64_t dataPacketsRecovered = 0;
+    int64_t parityPacketsReceived = 0;
     double lastDroptime = 0;
     double resetDroptime = 0;
     int64_t lastDropCount = 0;
@@ -327,6 +393,7 @@ struct SonobusAudioProcessor::RemotePeer {
     bool   gotNewStylePing = false;
     bool   haveSentFirstPeerInfo = false;
     stats::RunCumulantor1D  smoothPingTime; // ms
+    PeerClockSync clockSync;
     stats::RunCumulantor1D  fillRatio;
     stats::RunCumulantor1D  fillRatioSlow;
     stats::RunCumulantor1D  fastDropRate;
@@ -336,6 +403,8 @@ struct SonobusAudioProcessor::RemotePeer {
     bool hasRealLatency = false;
     bool latencyDirty = false;
     AudioSampleBuffer workBuffer;
+    // received audio panned for sending on to other peers (stereo, then mono), see processBlock
+    AudioSampleBuffer sendMixBuffer;
     float recvPanLast[MAX_PANNERS];
     // metering
     foleys::LevelMeterSource sendMeterSource;
@@ -361,6 +430,7 @@ struct SonobusAudioProcessor::RemotePeer {
     float remoteOutLatMs = 0.0f;
     int remoteNetType = RemoteNetTypeUnknown;
     bool remoteIsRecording = false;
+    bool remoteIsHub = false;
     bool hasRemoteInfo = false;
     bool blockedUs = false;
 
@@ -375,7 +445,10 @@ static int32_t endpoint_send(void *e, const char *data, int32_t size)
 {
     SonobusAudioProcessor::EndpointState * endpoint = static_cast<SonobusAudioProcessor::EndpointState*>(e);
     int result = -1;
-    if (endpoint->peer) {
+    if (auto * relay = endpoint->relay.load()) {
+        result = relay->send_relay(data, size, endpoint->getRawAddr()) ? size : -1;
+    }
+    else if (endpoint->peer) {
         result = endpoint->owner->write(*(endpoint->peer), data, size);
     } else {
         result = endpoint->owner->write(endpoint->ipaddr, endpoint->port, data, size);
@@ -482,6 +555,12 @@ public:
             Thread::sleep(20);
             
             _processor.handleEvents();                       
+
+            _processor.publishPeerStats();
+
+            if (_processor.mStageProfiler.isEnabled()) {
+                _processor.mStageProfiler.update();
+            }
         }
         
         DBG("Event thread finishing");
@@ -491,6 +570,28 @@ public:
     
 };
 
+class SonobusAudioProcessor::ControlThread : public juce::Thread
+{
+public:
+    ControlThread(SonobusAudioProcessor & processor) : Thread("SonoBusControlThread") , _processor(processor)
+    {}
+
+    void run() override {
+
+        while (!threadShouldExit()) {
+
+            _processor.mControlWaitable.wait(50);
+
+            _processor.handleQueuedControlMessages();
+        }
+
+        DBG("Control thread finishing");
+    }
+
+    SonobusAudioProcessor & _processor;
+
+};
+
 class SonobusAudioProcessor::ServerThread : public juce::Thread
 {
 public:
@@ -595,9 +696,10 @@ SonobusAudioProcessor::BusesProperties SonobusAudioProcessor::getDefaultLayout()
 
 
 //==============================================================================
-SonobusAudioProcessor::SonobusAudioProcessor()
+SonobusAudioProcessor::SonobusAudioProcessor(SonobusSessionHost * sessionHost, int sessionIndex)
 : AudioProcessor ( getDefaultLayout() ),
 mReconnectTimer(*this),
+mHubGroupCheckTimer(*this),
 soundboardChannelProcessor(std::make_unique<SoundboardChannelProcessor>()),
 mGlobalState("SonobusGlobalState"),
 mState (*this, &mUndoManager, "SonoBusAoO",
@@ -750,6 +852,10 @@ mState (*this, &mUndoManager, "SonoBusAoO",
 
     mSupportDir = options.getDefaultFile().getParentDirectory();
 
+    mThumbnailCache = std::make_unique<SonoAudio::PersistentThumbnailCache>(5, mSupportDir.getChildFile("ThumbnailCache"));
+    // don't get in the way of the disk writers. this runs on the cache thread, so it only reads the atomic flags
+    mThumbnailCache->setBusyCheck([this]() { return writingPossible.load() || userWritingPossible.load(); });
+
    
     
 #if (JUCE_IOS)
@@ -773,6 +879,10 @@ mState (*this, &mUndoManager, "SonoBusAoO",
 
 
     initFormats();
+
+    for (auto * meter : { &inputMeterSource, &postinputMeterSource, &sendMeterSource, &outputMeterSource, &filePlaybackMeterSource, &metMeterSource, &soundboardChannelProcessor->getMeterSource() }) {
+        meter->setIdleDecimation(IDLE_METER_DECIMATION);
+    }
     
     mDefaultAutoNetbufModeParam = mState.getParameter(paramDefaultAutoNetbuf);
     mDefaultAudioFormatParam = mState.getParameter(paramDefaultSendQual);
@@ -806,6 +916,8 @@ mState (*this, &mUndoManager, "SonoBusAoO",
     mMainReverbParams.roomSize = jmap(mMainReverbSize.get(), 0.55f, 1.0f);
     mMainReverb->setParameters(mMainReverbParams);
 
+    mFxPipeline = std::make_unique<SonoAudio::FxPipeline>(FxLaneCount);
+
 
     for (int i=0; i < MAX_CHANGROUPS; ++i) {
 
@@ -833,7 +945,15 @@ mState (*this, &mUndoManager, "SonoBusAoO",
     
     // audio setup
     mFormatManager.registerBasicFormats();    
-    
+
+    // outlives the aoo sources and sinks, which are recreated by initializeAoo()
+    mAudioClock = aoo_clock_new();
+
+    if (sessionHost) {
+        mSessionHost = sessionHost;
+        mAooIdBase = sessionIndex * SonobusSessionHost::SessionIdRange;
+    }
+
     initializeAoo();
 
     mFreshInit = false; // need to ensure this before loaddefaultpluginstate
@@ -856,7 +976,12 @@ SonobusAudioProcessor::~SonobusAudioProcessor()
     mTransportSource.setSource(nullptr);
     mTransportSource.removeChangeListener(this);
 
+    mHubGroupCheckTimer.stopTimer();
+
     cleanupAoo();
+
+    // all subscribers are gone now
+    aoo_clock_free(mAudioClock);
 }
 
 void SonobusAudioProcessor::moveOldMisplacedFiles()
@@ -894,6 +1019,11 @@ void SonobusAudioProcessor::setUseSpecificUdpPort(int port)
 {
     mUseSpecificUdpPort = port;
     
+    if (mSessionHost) {
+        // the port belongs to the session host
+        return;
+    }
+
     if (port != 0) {
         if (port != mUdpLocalPort) {
             cleanupAoo();
@@ -916,6 +1046,15 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
     //mAooSink.reset(aoo::isink::create(1));
 
     mAooDummySource.reset(aoo::isource::create(0));
+    mAooDummySource->set_clock(mAudioClock);
+
+    // called from the send thread under the read lock, mAooClient is created before that
+    // thread starts and only reset under the write lock
+    mRelayGroupSender = std::make_unique<SonoAudio::RelayGroupSender>(mAooIdBase + RELAY_GROUP_ID_OFFSET,
+                                                                      [this](const char * group, const char * data, int32_t size) {
+        return mAooClient && mAooClient->send_relay_group(group, data, size) > 0;
+    });
+    mRelayGroupSender->getSource()->set_clock(mAudioClock);
 
 
 
@@ -928,44 +1067,53 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
     
 
     
-    mUdpSocket = std::make_unique<DatagramSocket>();
-    mUdpSocket->setSendBufferSize(1048576);
-    mUdpSocket->setReceiveBufferSize(1048576);
-
-    /*
-    int tos_local = 0x38; // QOS realtime DSCP
-    int opterr = setsockopt(mUdpSocket->getRawSocketHandle(), IPPROTO_IP, IP_TOS,  &tos_local, sizeof(tos_local));
-    if (opterr != 0) {
-        DBG("Error setting QOS on socket: " << opterr);
+    if (mSessionHost) {
+        // the host has already bound the shared socket
+        mSocket = mSessionHost->getSocket();
+        udpport = mSessionHost->getUdpLocalPort();
     }
-     */
+    else {
+        mUdpSocket = std::make_unique<DatagramSocket>();
+        mUdpSocket->setSendBufferSize(1048576);
+        mUdpSocket->setReceiveBufferSize(1048576);
 
-    if (udpport > 0) {
-        int attempts = 100;
-        while (attempts > 0) {
-            if (mUdpSocket->bindToPort(udpport)) {
-                udpport = mUdpSocket->getBoundPort();
-                DBG("Bound udp port to " << udpport);
-                break;
-            }
-            ++udpport;
-            --attempts;
+        /*
+        int tos_local = 0x38; // QOS realtime DSCP
+        int opterr = setsockopt(mUdpSocket->getRawSocketHandle(), IPPROTO_IP, IP_TOS,  &tos_local, sizeof(tos_local));
+        if (opterr != 0) {
+            DBG("Error setting QOS on socket: " << opterr);
         }
+         */
 
-        if (attempts <= 0) {
-            DBG("COULD NOT BIND TO PORT!");
-            udpport = 0;
-        }
-    }
-    else {
-        // system assigned
-        if (!mUdpSocket->bindToPort(0)) {
-            DBG("Error binding to any udp port!");
+        if (udpport > 0) {
+            int attempts = 100;
+            while (attempts > 0) {
+                if (mUdpSocket->bindToPort(udpport)) {
+                    udpport = mUdpSocket->getBoundPort();
+                    DBG("Bound udp port to " << udpport);
+                    break;
+                }
+                ++udpport;
+                --attempts;
+            }
+
+            if (attempts <= 0) {
+                DBG("COULD NOT BIND TO PORT!");
+                udpport = 0;
+            }
         }
         else {
-            udpport = mUdpSocket->getBoundPort();
-            DBG("Bound system chosen udp port to " << udpport);
+            // system assigned
+            if (!mUdpSocket->bindToPort(0)) {
+                DBG("Error binding to any udp port!");
+            }
+            else {
+                udpport = mUdpSocket->getBoundPort();
+                DBG("Bound system chosen udp port to " << udpport);
+            }
         }
+
+        mSocket = mUdpSocket.get();
     }
     
     
@@ -1003,21 +1151,30 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
 #endif
     
     mServerEndpoint = std::make_unique<EndpointState>();
-    mServerEndpoint->owner = mUdpSocket.get();
+    mServerEndpoint->owner = mSocket;
     
     if (mUdpLocalPort > 0) {
         mAooClient.reset(aoo::net::iclient::create(mServerEndpoint.get(), client_send, mUdpLocalPort));
     }
 
-    
-    mSendThread = std::make_unique<SendThread>(*this);
-    mRecvThread = std::make_unique<RecvThread>(*this);
-    mEventThread = std::make_unique<EventThread>(*this);
+    if (!mSessionHost) {
+        // otherwise the host's threads do the sending, receiving and event handling for us
+        startNetworkThreads();
+    }
 
     if (mAooClient) {
         mClientThread = std::make_unique<ClientThread>(*this);
+        mClientThread->startThread();
     }
-    
+}
+
+void SonobusAudioProcessor::startNetworkThreads()
+{
+    mSendThread = std::make_unique<SendThread>(*this);
+    mRecvThread = std::make_unique<RecvThread>(*this);
+    mEventThread = std::make_unique<EventThread>(*this);
+    mControlThread = std::make_unique<ControlThread>(*this);
+
     uint32_t estWorkDurationMs = 10; // just a guess
     int rtprio = 1; // all that is necessary
 
@@ -1040,23 +1197,25 @@ void SonobusAudioProcessor::initializeAoo(int udpPort)
 #endif
 
     mEventThread->startThread(Thread::Priority::normal);
-
-    if (mAooClient) {
-        mClientThread->startThread();
-    }
-    
+    mControlThread->startThread(Thread::Priority::normal);
 }
 
 void SonobusAudioProcessor::cleanupAoo()
 {
     disconnectFromServer();
     
-    DBG("waiting on recv thread to die");
-    mRecvThread->stopThread(400);
-    DBG("waiting on send thread to die");
-    mSendThread->stopThread(400);
-    DBG("waiting on event thread to die");
-    mEventThread->stopThread(400);
+    if (!mSessionHost) {
+        DBG("waiting on recv thread to die");
+        mRecvThread->stopThread(400);
+        DBG("waiting on send thread to die");
+        mSendThread->stopThread(400);
+        DBG("waiting on event thread to die");
+        mEventThread->stopThread(400);
+        DBG("waiting on control thread to die");
+        mControlThread->signalThreadShouldExit();
+        mControlWaitable.signal();
+        mControlThread->stopThread(400);
+    }
 
     if (mAooClient) {
         mAooClient->disconnect();
@@ -1070,12 +1229,19 @@ void SonobusAudioProcessor::cleanupAoo()
 
         mAooClient.reset();
 
+        mSocket = nullptr;
         mUdpSocket.reset();
         
         mAooDummySource.reset();
+        mRelayGroupSender.reset();
         
         mRemotePeers.clear();
-        
+
+        // queued control messages point into mEndpoints, nothing may still be pushing or handling them.
+        // a hosted session only gets here once it has been taken out of the host
+        jassert(mSessionHost || (!mRecvThread->isThreadRunning() && !mControlThread->isThreadRunning()));
+        while (mControlQueue.tryPop([](ControlMessage &) {})) {}
+
         mEndpoints.clear();
     }
 
@@ -1094,6 +1260,9 @@ void SonobusAudioProcessor::startAooServer()
         if (err != 0) {
             DBG("Error creating Aoo Server: " << err);
         }
+        else if (mAooServer) {
+            mAooServer->set_relay(mServerRelay.get());
+        }
     }
     
     if (mAooServer) {
@@ -1102,6 +1271,26 @@ void SonobusAudioProcessor::startAooServer()
     }
 }
     
+void SonobusAudioProcessor::setHubMixMinusEnabled(bool flag)
+{
+    if (mHubMixMinus.get() == flag) return;
+
+    mHubMixMinus = flag;
+
+    // so the participants know to only talk to us
+    sendRemotePeerInfoUpdate();
+}
+
+void SonobusAudioProcessor::setServerRelayEnabled(bool flag)
+{
+    mServerRelay = flag;
+
+    const ScopedReadLock sl (mCoreLock);
+    if (mAooServer) {
+        mAooServer->set_relay(flag);
+    }
+}
+
 void SonobusAudioProcessor::stopAooServer()
 {
     if (mAooServer) {
@@ -1330,26 +1519,19 @@ void SonobusAudioProcessor::initFormats()
 {
     mAudioFormats.clear();
     
-    // low bandwidth to high
-    //mAudioFormats.add(AudioCodecFormatInfo(8000, 10, OPUS_SIGNAL_MUSIC, 960));
-    mAudioFormats.add(AudioCodecFormatInfo(16000, 10, OPUS_SIGNAL_MUSIC, 960));
-    mAudioFormats.add(AudioCodecFormatInfo(24000, 10, OPUS_SIGNAL_MUSIC, 480));
-    mAudioFormats.add(AudioCodecFormatInfo(48000, 10, OPUS_SIGNAL_MUSIC, 240));
-    mAudioFormats.add(AudioCodecFormatInfo(64000, 10, OPUS_SIGNAL_MUSIC, 240));
-    mAudioFormats.add(AudioCodecFormatInfo(96000, 10, OPUS_SIGNAL_MUSIC, 120));
-    mAudioFormats.add(AudioCodecFormatInfo(128000, 10, OPUS_SIGNAL_MUSIC, 120));
-    mAudioFormats.add(AudioCodecFormatInfo(160000, 10, OPUS_SIGNAL_MUSIC, 120));
-    mAudioFormats.add(AudioCodecFormatInfo(256000, 10, OPUS_SIGNAL_MUSIC, 120));
-    
-    mAudioFormats.add(AudioCodecFormatInfo(2));
-    mAudioFormats.add(AudioCodecFormatInfo(3));
-    mAudioFormats.add(AudioCodecFormatInfo(4));
-    //mAudioFormats.add(AudioCodecFormatInfo(CodecPCM, 8)); // insanity!
+    for (int i=0; i < codecFormatTableSize; ++i) {
+        const auto & entry = codecFormatTable[i];
+        if (entry.opus) {
+            mAudioFormats.add(AudioCodecFormatInfo(entry.bitrate, entry.complexity, entry.signalType, entry.minPreferredBlocksize));
+        } else {
+            mAudioFormats.add(AudioCodecFormatInfo(entry.bitdepth));
+        }
+    }
 
-    mDefaultAudioFormatIndex = 4; // 96kpbs/ch Opus
+    mDefaultAudioFormatIndex = codecFormatTableDefaultIndex;
 }
 
-int SonobusAudioProcessor::findFormatIndex(SonobusAudioProcessor::AudioCodecFormatCodec codec, int bitrate, int bitdepth)
+int SonobusAudioProcessor::findFormatIndex(SonobusAudioProcessor::AudioCodecFormatCodec codec, int bitrate, int bitdepth) const
 {
     for (int i=0; i < mAudioFormats.size(); ++i) {
         const auto & format = mAudioFormats.getReference(i);
@@ -1377,6 +1559,18 @@ String SonobusAudioProcessor::getAudioCodeFormatName(int formatIndex) const
     return info.name;    
 }
 
+float SonobusAudioProcessor::getFormatBitrate(int formatIndex) const
+{
+    // bits/s per channel
+    if (formatIndex < 0 || formatIndex >= mAudioFormats.size()) return 0.0f;
+
+    const auto & format = mAudioFormats.getReference(formatIndex);
+    if (format.codec == CodecOpus) {
+        return format.bitrate;
+    }
+    return (float) (getSampleRate() * format.bitdepth * 8);
+}
+
 bool SonobusAudioProcessor::getAudioCodeFormatInfo(int formatIndex, AudioCodecFormatInfo & retinfo) const
 {
     if (formatIndex >= mAudioFormats.size() || formatIndex < 0) return false;
@@ -1455,13 +1649,23 @@ bool SonobusAudioProcessor::setRequestRemotePeerSendAudioCodecFormat(int index,
     const ScopedReadLock sl (mCoreLock);
     auto remote = mRemotePeers.getUnchecked(index);
 
+    // a manual choice becomes the adaptive starting point
+    remote->adaptiveFormat.formatIndex = formatIndex;
+    remote->adaptiveFormat.lastChangeTimeMs = Time::getMillisecondCounterHiRes();
+
+    return requestRemotePeerSendFormat(remote, formatIndex);
+}
+
+bool SonobusAudioProcessor::requestRemotePeerSendFormat(RemotePeer * remote, int formatIndex)
+{
+    // assumes corelock already held
     aoo_format_storage fmt;
     
-    
     if (formatIndex >= 0) {
         const AudioCodecFormatInfo & info = mAudioFormats.getReference(formatIndex);
 
-        if (formatInfoToAooFormat(info, remote->recvChannels, fmt)) {
+        // we decode coupled streams ourselves, an older source just ignores the layout
+        if (formatInfoToAooFormat(info, remote->recvChannels, fmt, true)) {
             remote->oursink->request_source_codec_change(remote->endpoint, remote->remoteSourceId, fmt.header);
 
             remote->reqRemoteSendFormatIndex = formatIndex; 
@@ -1476,6 +1680,78 @@ bool SonobusAudioProcessor::setRequestRemotePeerSendAudioCodecFormat(int index,
     }
 }
 
+void SonobusAudioProcessor::setRemotePeerAdaptiveRecvFormat(int index, bool flag)
+{
+    if (index >= mRemotePeers.size()) return;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+
+    if (flag && !remote->adaptiveFormat.enabled) {
+        // start fresh
+        remote->adaptiveFormat = AdaptiveFormatState();
+    }
+    remote->adaptiveFormat.enabled = flag;
+}
+
+bool SonobusAudioProcessor::getRemotePeerAdaptiveRecvFormat(int index) const
+{
+    if (index >= mRemotePeers.size()) return false;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->adaptiveFormat.enabled;
+}
+
+float SonobusAudioProcessor::getRemotePeerAdaptiveBandwidthEstimate(int index) const
+{
+    if (index >= mRemotePeers.size()) return 0.0f;
+
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->adaptiveFormat.enabled ? remote->adaptiveFormat.bandwidthEstimate : 0.0f;
+}
+
+void SonobusAudioProcessor::setDefaultAdaptiveRecvFormat(bool flag)
+{
+    mDefaultAdaptiveRecvFormat = flag;
+
+    for (int i=0; i < mRemotePeers.size(); ++i) {
+        setRemotePeerAdaptiveRecvFormat(i, flag);
+    }
+}
+
+void SonobusAudioProcessor::setSendSilenceSuppression(bool flag)
+{
+    mSendSilenceSuppression = flag;
+
+    const ScopedReadLock sl (mCoreLock);
+    for (auto s : mRemotePeers) {
+        if (s->oursource) {
+            s->oursource->set_dtx_threshold(flag ? Decibels::decibelsToGain(SEND_SILENCE_THRESHOLD_DB) : 0.0f);
+        }
+    }
+    if (mRelayGroupSender) {
+        mRelayGroupSender->getSource()->set_dtx_threshold(flag ? Decibels::decibelsToGain(SEND_SILENCE_THRESHOLD_DB) : 0.0f);
+    }
+}
+
+void SonobusAudioProcessor::setSendFecEnabled(bool flag)
+{
+    mSendFec = flag;
+
+    for (int i=0; i < mRemotePeers.size(); ++i) {
+        setRemotePeerSendFecGroupSize(i, flag ? SEND_FEC_GROUP_SIZE : 0);
+    }
+}
+
+void SonobusAudioProcessor::setAdaptiveRecvFormatRange(int minFormatIndex, int maxFormatIndex)
+{
+    int lastindex = mAudioFormats.size() - 1;
+    mAdaptiveFormatMinIndex = jlimit(0, lastindex, minFormatIndex);
+    mAdaptiveFormatMaxIndex = jlimit(mAdaptiveFormatMinIndex, lastindex, maxFormatIndex);
+}
+
 int SonobusAudioProcessor::getRequestRemotePeerSendAudioCodecFormat(int index) const
 {
     if (index >= mRemotePeers.size()) return -1;
@@ -1505,6 +1781,32 @@ void SonobusAudioProcessor::setRemotePeerOrderPriority(int index, int priority)
 }
 
 
+bool SonobusAudioProcessor::getRemotePeerUseRelay(int index) const
+{
+    if (index >= mRemotePeers.size()) return false;
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->endpoint && remote->endpoint->relay.load() != nullptr;
+}
+
+bool SonobusAudioProcessor::setRemotePeerUseRelay(int index, bool flag)
+{
+    if (index >= mRemotePeers.size()) return false;
+
+    const ScopedReadLock sl (mCoreLock);
+
+    auto remote = mRemotePeers.getUnchecked(index);
+    if (!remote->endpoint || !mAooClient) return false;
+
+    // the client needs to know too, so its keepalive pings take the same path
+    if (!mAooClient->set_peer_relay(remote->groupName.toRawUTF8(), remote->userName.toRawUTF8(), flag)) {
+        return false;
+    }
+
+    remote->endpoint->relay = flag ? mAooClient.get() : nullptr;
+    return true;
+}
+
 int SonobusAudioProcessor::getRemotePeerSendPacketsize(int index) const
 {
     if (index >= mRemotePeers.size()) return -1;
@@ -1534,6 +1836,28 @@ void SonobusAudioProcessor::setRemotePeerSendPacketsize(int index, int psize)
     
 }
 
+int SonobusAudioProcessor::getRemotePeerSendFecGroupSize(int index) const
+{
+    if (index >= mRemotePeers.size()) return 0;
+    const ScopedReadLock sl (mCoreLock);
+    auto remote = mRemotePeers.getUnchecked(index);
+    return remote->fecGroupSize;
+}
+
+void SonobusAudioProcessor::setRemotePeerSendFecGroupSize(int index, int groupsize)
+{
+    if (index >= mRemotePeers.size()) return;
+
+    const ScopedReadLock sl (mCoreLock);
+
+    auto remote = mRemotePeers.getUnchecked(index);
+    remote->fecGroupSize = groupsize;
+
+    if (remote->oursource) {
+        remote->oursource->set_fec_groupsize(remote->fecGroupSize);
+    }
+}
+
 void SonobusAudioProcessor::setRemotePeerCompressorParams(int index, int changroup, CompressorParams & params)
 {
     if (index >= mRemotePeers.size()) return;
@@ -2208,6 +2532,18 @@ SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findOrAddRawEndpoi
     }    
 }
 
+SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findEndpoint(const String & host, int port)
+{
+    const ScopedLock sl (mEndpointsLock);
+
+    for (auto ep : mEndpoints) {
+        if (ep->ipaddr == host && ep->port == port) {
+            return ep;
+        }
+    }
+    return nullptr;
+}
+
 SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findOrAddEndpoint(const String & host, int port)
 {
     const ScopedLock sl (mEndpointsLock);        
@@ -2224,7 +2560,7 @@ SonobusAudioProcessor::EndpointState * SonobusAudioProcessor::findOrAddEndpoint(
     if (!endpoint) {
         // add it as new
         endpoint = mEndpoints.add(new EndpointState(host, port));
-        endpoint->owner = mUdpSocket.get();
+        endpoint->owner = mSocket;
         endpoint->peer = std::make_unique<DatagramSocket::RemoteAddrInfo>(host, port);
         DBG("Added new endpoint for " << host << ":" << port);
     }
@@ -2262,20 +2598,144 @@ void SonobusAudioProcessor::updateSafetyMuting(RemotePeer * peer)
 
 }
 
+void SonobusAudioProcessor::updateAdaptiveRecvFormat(RemotePeer * peer, double nowtimems)
+{
+    // assumed corelock already held
+    auto & state = peer->adaptiveFormat;
+
+    if (!state.enabled || !peer->connected || !peer->oursink || peer->recvChannels <= 0) return;
+
+    if (nowtimems - state.lastEvalTimeMs < ADAPTIVE_EVAL_INTERVAL_MS) return;
+
+    const int64_t recvd = peer->dataPacketsReceived - state.lastRecvCount;
+    const int64_t dropped = peer->dataPacketsDropped - state.lastDropCount;
+    const int64_t resent = peer->dataPacketsResent - state.lastResentCount;
+
+    const bool firsteval = state.lastEvalTimeMs == 0;
+
+    state.lastEvalTimeMs = nowtimems;
+    state.lastRecvCount = peer->dataPacketsReceived;
+    state.lastDropCount = peer->dataPacketsDropped;
+    state.lastResentCount = peer->dataPacketsResent;
+
+    if (firsteval || recvd <= 0) {
+        // nothing to judge yet, or they aren't sending to us
+        return;
+    }
+
+    if (state.formatIndex < 0) {
+        // start from whatever they are sending now
+        state.formatIndex = peer->reqRemoteSendFormatIndex >= 0 ? peer->reqRemoteSendFormatIndex : findFormatIndex(peer->recvFormat.codec, peer->recvFormat.bitrate, peer->recvFormat.bitdepth);
+        if (state.formatIndex < 0) return;
+        state.bandwidthEstimate = getFormatBitrate(state.formatIndex);
+        state.lastChangeTimeMs = nowtimems;
+    }
+
+    // track the uncongested ping baseline, quick to go down, slow to creep up
+    const float pingms = peer->smoothPingTime.xbar;
+    if (pingms > 0.0f) {
+        if (state.baseRttMs <= 0.0f || pingms < state.baseRttMs) {
+            state.baseRttMs = pingms;
+        } else {
+            state.baseRttMs += (pingms - state.baseRttMs) * 0.02f;
+        }
+    }
+
+    if (nowtimems - state.lastChangeTimeMs < ADAPTIVE_CHANGE_SETTLE_MS) {
+        return;
+    }
+
+    // follow what they are actually sending, in case our request wasn't honored
+    auto actualindex = findFormatIndex(peer->recvFormat.codec, peer->recvFormat.bitrate, peer->recvFormat.bitdepth);
+    if (actualindex >= 0 && actualindex != state.formatIndex) {
+        state.formatIndex = actualindex;
+    }
+
+    // resent packets did arrive, but indicate loss just the same
+    const float lossfrac = (dropped + 0.5f * resent) / (float) jmax((int64_t)1, recvd + dropped);
+    const bool rttinflated = state.baseRttMs > 0.0f && pingms > state.baseRttMs + jmax(20.0f, state.baseRttMs * 0.5f);
+    const bool rttclean = state.baseRttMs <= 0.0f || pingms < state.baseRttMs + jmax(10.0f, state.baseRttMs * 0.25f);
+
+    const float currbitrate = getFormatBitrate(state.formatIndex);
+    int newindex = state.formatIndex;
+
+    if (lossfrac > ADAPTIVE_CONGESTED_LOSS || rttinflated) {
+        state.cleanWindows = 0;
+        ++state.congestedWindows;
+
+        if (state.congestedWindows >= 2 || lossfrac > ADAPTIVE_SEVERE_LOSS) {
+            // multiplicative decrease of the estimate, then pick the best format that fits under it
+            state.bandwidthEstimate = currbitrate * jlimit(0.5f, 0.85f, 1.0f - lossfrac);
+
+            newindex = jmax(mAdaptiveFormatMinIndex, state.formatIndex - 1);
+            while (newindex > mAdaptiveFormatMinIndex && getFormatBitrate(newindex) > state.bandwidthEstimate) {
+                --newindex;
+            }
+
+            if (nowtimems - state.lastUpTimeMs < ADAPTIVE_FAILED_PROBE_MS) {
+                // the last step up didn't hold, wait longer before trying again
+                state.upHoldWindows = jmin((int)ADAPTIVE_MAX_UP_HOLD, state.upHoldWindows * 2);
+            }
+            state.congestedWindows = 0;
+        }
+    }
+    else if (lossfrac < ADAPTIVE_CLEAN_LOSS && rttclean) {
+        state.congestedWindows = 0;
+        ++state.cleanWindows;
+
+        state.bandwidthEstimate = jmax(state.bandwidthEstimate, currbitrate);
+
+        if (state.lastUpTimeMs > 0 && nowtimems - state.lastUpTimeMs > ADAPTIVE_FAILED_PROBE_MS) {
+            // the last probe has held
+            state.upHoldWindows = ADAPTIVE_MIN_UP_HOLD;
+        }
+
+        if (state.cleanWindows >= state.upHoldWindows && state.formatIndex < mAdaptiveFormatMaxIndex) {
+            newindex = state.formatIndex + 1;
+            state.lastUpTimeMs = nowtimems;
+            state.cleanWindows = 0;
+        }
+    }
+    else {
+        // in between, hold steady
+        state.congestedWindows = 0;
+        state.cleanWindows = 0;
+    }
+
+    newindex = jlimit(mAdaptiveFormatMinIndex, jmax(mAdaptiveFormatMinIndex, mAdaptiveFormatMaxIndex), newindex);
+
+    if (newindex != state.formatIndex) {
+        DBG("Adaptive format for " << peer->userName << " loss: " << lossfrac << " ping: " << pingms << " base: " << state.baseRttMs
+            << " est: " << state.bandwidthEstimate << " -- changing from " << state.formatIndex << " to " << newindex);
+
+        if (requestRemotePeerSendFormat(peer, newindex)) {
+            state.formatIndex = newindex;
+            state.lastChangeTimeMs = nowtimems;
+        }
+    }
+}
+
 void SonobusAudioProcessor::doReceiveData()
 {
-    // receive from udp port, and parse packet
-    char buf[AOO_MAXPACKETSIZE];
+    // receive from udp port, and parse packet (relayed packets come wrapped)
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
     String senderIP;
     int senderPort;
     
-    int nbytes = mUdpSocket->read(buf, AOO_MAXPACKETSIZE, false, senderIP, senderPort);
+    int nbytes = mUdpSocket->read(buf, (int) sizeof(buf), false, senderIP, senderPort);
 
     if (nbytes == 0) return;
     else if (nbytes < 0) {
         DBG("Error receiving UDP");
         return;
     }
+
+    handleReceivedPacket(buf, nbytes, senderIP, senderPort);
+}
+
+void SonobusAudioProcessor::handleReceivedPacket(const char * buf, int nbytes, const String & senderIP, int senderPort)
+{
+    SONO_PROFILE_STAGE(mStageProfiler, ThreadRecv, StageRecvThread);
     
     // find endpoint from sender info
     EndpointState * endpoint = findOrAddEndpoint(senderIP, senderPort);
@@ -2345,6 +2805,27 @@ void SonobusAudioProcessor::doReceiveData()
                     // this is the special one that can accept blind invites
                     mAooDummySource->handle_message(buf, nbytes, endpoint, endpoint_send);
                 }
+                else if (mRelayGroupSender->getSource()->get_id(dummyid) && id == dummyid) {
+                    // a codec change request is for that peer's own source, which then leaves the group
+                    char readdressed[AOO_MAXPACKETSIZE];
+                    int32_t sinkid = AOO_ID_NONE;
+                    auto * peer = findRemotePeer(endpoint, -1);
+                    int32_t size = peer ? SonoAudio::RelayGroupSender::readdressCodecChange(buf, nbytes, peer->ourId, readdressed, sizeof(readdressed), sinkid) : 0;
+
+                    if (size > 0 && sinkid == peer->remoteSinkId) {
+                        SonoAudio::RelayGroupSender::Candidate candidate;
+                        candidate.endpoint = endpoint;
+                        candidate.sendFn = endpoint_send;
+                        candidate.peerSource = peer->oursource.get();
+                        candidate.sinkId = peer->remoteSinkId;
+                        candidate.sinkFlags = peer->remoteSinkFlags;
+                        // the source only takes requests from its own sinks
+                        mRelayGroupSender->returnSink(candidate);
+                        peer->oursource->handle_message(readdressed, size, endpoint, endpoint_send);
+                    } else {
+                        mRelayGroupSender->getSource()->handle_message(buf, nbytes, endpoint, endpoint_send);
+                    }
+                }
                 else {
                     for (auto & remote : mRemotePeers) {
                         if (!remote->oursource) continue;
@@ -2371,6 +2852,18 @@ void SonobusAudioProcessor::doReceiveData()
                 //DBG("Got AOO_CLIENT or PEER data");
 
                 if (mAooClient) {
+                    const char * data = nullptr;
+                    int32_t size = 0;
+                    String peerIP;
+                    int peerPort = 0;
+
+                    if (type == AOO_TYPE_CLIENT
+                        && unwrapRelayedPacket(buf, nbytes, endpoint->getRawAddr(), data, size, peerIP, peerPort)) {
+                        // from a peer we can only reach through the connection server
+                        handleReceivedPacket(data, size, peerIP, peerPort);
+                        return;
+                    }
+
                     mAooClient->handle_message(buf, nbytes, endpoint->getRawAddr());
                 }
                 
@@ -2402,7 +2895,7 @@ void SonobusAudioProcessor::doReceiveData()
         notifySendThread();
 
     }
-    else if (handleOtherMessage(endpoint, buf, nbytes)) {
+    else if (dispatchOtherMessage(endpoint, buf, nbytes)) {
 
     }
     else {
@@ -2412,6 +2905,55 @@ void SonobusAudioProcessor::doReceiveData()
         
 }
 
+bool SonobusAudioProcessor::handleClientPacket(const char * buf, int nbytes, const String & senderIP, int senderPort)
+{
+    if (!mAooClient) return false;
+
+    auto * endpoint = findEndpoint(senderIP, senderPort);
+    // not one of ours (yet), let the client decide without keeping an endpoint around
+    EndpointState sender (senderIP, senderPort);
+    auto * rawaddr = endpoint ? endpoint->getRawAddr() : sender.getRawAddr();
+
+    if (endpoint) {
+        endpoint->recvBytes += nbytes + UDP_OVERHEAD_BYTES;
+    }
+
+    const char * data = nullptr;
+    int32_t size = 0;
+    String peerIP;
+    int peerPort = 0;
+
+    if (unwrapRelayedPacket(buf, nbytes, rawaddr, data, size, peerIP, peerPort)) {
+        // the relayed packet may belong to any session, route it like one from the socket
+        mSessionHost->routePacket(data, size, peerIP, peerPort);
+        return true;
+    }
+
+    mAooClient->handle_message(buf, nbytes, rawaddr);
+    return false;
+}
+
+bool SonobusAudioProcessor::unwrapRelayedPacket(const char * buf, int nbytes, void * rawaddr,
+                                                const char *& data, int32_t & size, String & peerIP, int & peerPort)
+{
+    struct sockaddr_storage peeraddr;
+    int32_t peerlen = sizeof(peeraddr);
+
+    if (!mAooClient->unwrap_relay(buf, nbytes, rawaddr, &data, &size, &peeraddr, &peerlen)) {
+        return false;
+    }
+
+    char hostip[INET6_ADDRSTRLEN];
+    if (inet_ntop(peeraddr.ss_family, get_in_addr((struct sockaddr *)&peeraddr), hostip, sizeof(hostip)) == nullptr) {
+        DBG("Error converting relayed peer addr to IP");
+        return false;
+    }
+
+    peerIP = hostip;
+    peerPort = ntohs(get_in_port((struct sockaddr *)&peeraddr));
+    return true;
+}
+
 // XXX
 // all of this should be refactored into its own class
 
@@ -2558,6 +3100,52 @@ static int32_t sonobusOscParsePattern(const char *msg, int32_t n, int32_t & rett
     return 0;
 }
 
+bool SonobusAudioProcessor::dispatchOtherMessage(EndpointState * endpoint, const char *msg, int32_t n)
+{
+    int32_t type = SONOBUS_MSGTYPE_UNKNOWN;
+
+    if (! sonobusOscParsePattern(msg, n, type)) {
+        return false;
+    }
+
+    if (type == SONOBUS_MSGTYPE_PING || type == SONOBUS_MSGTYPE_PINGACK) {
+        // keep these on the recv thread so the timestamps stay accurate
+        return handleOtherMessage(endpoint, msg, n);
+    }
+
+    // everything else may parse json, touch the layout or chat, etc
+    // so hand it off rather than hold up incoming audio
+    bool queued = mControlQueue.tryPush([=](ControlMessage & cmsg) {
+        cmsg.endpoint = endpoint;
+        cmsg.size = jmin(n, (int32_t) sizeof(cmsg.data));
+        memcpy(cmsg.data, msg, cmsg.size);
+    });
+
+    if (!queued) {
+        DBG("Control message queue full, dropping message");
+        return true;
+    }
+
+    notifyControlThread();
+    return true;
+}
+
+void SonobusAudioProcessor::notifyControlThread()
+{
+    if (mSessionHost) {
+        mSessionHost->notifyControlThread();
+    } else {
+        mControlWaitable.signal();
+    }
+}
+
+void SonobusAudioProcessor::handleQueuedControlMessages()
+{
+    while (mControlQueue.tryPop([this](ControlMessage & cmsg) {
+        handleOtherMessage(cmsg.endpoint, cmsg.data, cmsg.size);
+    })) {}
+}
+
 bool SonobusAudioProcessor::handleOtherMessage(EndpointState * endpoint, const char *msg, int32_t n)
 {
     // try to parse it as an OSC /sb  message
@@ -3166,9 +3754,55 @@ void SonobusAudioProcessor::handleRemotePeerInfoUpdate(RemotePeer * peer, const
         DBG("peerinfo: Got remote recording: " << (int)isrec);
         peer->remoteIsRecording = isrec;
     }
+    if (infodata.hasProperty("hub")) {
+        bool ishub = infodata.getProperty("hub", false);
+        DBG("peerinfo: Got remote hub: " << (int)ishub);
+        peer->remoteIsHub = ishub;
+    }
 
     peer->hasRemoteInfo = true;
 
+    if (!mHubMixMinus.get() && peer->groupName.isNotEmpty()) {
+        // can't remove peers with the core lock held, one check covers any that arrive meanwhile
+        if (!mHubGroupCheckTimer.isTimerRunning()) {
+            mHubGroupCheckTimer.startTimer(100);
+        }
+    }
+}
+
+void SonobusAudioProcessor::removeDirectPeersInHubGroups()
+{
+    // a hub sends us everyone else in its group already mixed, so talking to
+    // the others directly as well would have us hear them twice
+    if (mHubMixMinus.get()) return;
+
+    StringArray hubgroups;
+    {
+        const ScopedReadLock sl (mCoreLock);
+        for (auto * peer : mRemotePeers) {
+            if (peer->remoteIsHub && peer->groupName.isNotEmpty()) {
+                hubgroups.addIfNotAlreadyThere(peer->groupName);
+            }
+        }
+    }
+
+    if (hubgroups.isEmpty()) return;
+
+    for (int i = mRemotePeers.size() - 1; i >= 0; --i) {
+        bool remove = false;
+        {
+            const ScopedReadLock sl (mCoreLock);
+            if (i >= mRemotePeers.size()) continue;
+            auto * peer = mRemotePeers.getUnchecked(i);
+            // only once they've told us they aren't a hub themselves
+            remove = peer->hasRemoteInfo && !peer->remoteIsHub && hubgroups.contains(peer->groupName);
+        }
+
+        if (remove) {
+            DBG("Removing direct peer " << i << " in a group with a hub");
+            removeRemotePeer(i);
+        }
+    }
 }
 
 void SonobusAudioProcessor::sendRemotePeerInfoUpdate(int index, RemotePeer * topeer)
@@ -3180,6 +3814,7 @@ void SonobusAudioProcessor::sendRemotePeerInfoUpdate(int index, RemotePeer * top
     info->setProperty("inlat", 1e3 * currSamplesPerBlock / getSampleRate());
     info->setProperty("outlat", 1e3 * currSamplesPerBlock / getSampleRate());
     info->setProperty("rec", isRecordingToFile());
+    info->setProperty("hub", mHubMixMinus.get());
 
     // nettype TODO
 
@@ -3228,8 +3863,21 @@ int32_t SonobusAudioProcessor::sendPeerMessage(RemotePeer * peer, const char *ms
 }
 
 
+void SonobusAudioProcessor::notifySendThread()
+{
+    if (mSessionHost) {
+        mSessionHost->notifySendThread();
+        return;
+    }
+
+    mNeedSendSentinel += 1;
+    mSendWaitable.signal();
+}
+
 void SonobusAudioProcessor::doSendData()
 {
+    SONO_PROFILE_STAGE(mStageProfiler, ThreadSend, StageSendThread);
+
     // just try to send for everybody
     const ScopedReadLock sl (mCoreLock);        
 
@@ -3244,6 +3892,7 @@ void SonobusAudioProcessor::doSendData()
         didsomething = 0;
         
         didsomething |= mAooDummySource->send();
+        didsomething |= mRelayGroupSender->getSource()->send();
         
         if (mAooClient) {
             mAooClient->send();
@@ -3288,17 +3937,11 @@ void SonobusAudioProcessor::doSendData()
 
     if (mNeedsSampleSetup.get()) {
         DBG("Doing sample setup for all");
+        // the aoo sources and sinks switch to the new setup at a block boundary
+        // and fade the old streams out themselves, no need to mute
         setupSourceFormatsForAll();
         mNeedsSampleSetup = false;
 
-        // reset all incoming by toggling muting
-        if (!mMainRecvMute.get()) {
-            DBG("Toggling main recv mute");
-            mState.getParameter(paramMainRecvMute)->setValueNotifyingHost(1.0f);
-            mPendingUnmuteAtStamp = Time::getMillisecondCounter() + 250;
-            mPendingUnmute = true;
-        }
-
         sendRemotePeerInfoUpdate(-1); // send to all
 
     }
@@ -3342,6 +3985,7 @@ void SonobusAudioProcessor::handleEvents()
 {
     const ScopedReadLock sl (mCoreLock);        
     int32_t dummy = 0;
+    const double nowtimems = Time::getMillisecondCounterHiRes();
     
     if (mAooServer /*&& mAooServer->events_available()*/) {
         ProcessorIdPair pp(this, dummy);
@@ -3360,6 +4004,12 @@ void SonobusAudioProcessor::handleEvents()
         mAooDummySource->handle_events(gHandleSourceEvents, &pp);
     }
 
+    if (mRelayGroupSender->getSource()->events_available() > 0) {
+        mRelayGroupSender->getSource()->get_id(dummy);
+        ProcessorIdPair pp(this, dummy);
+        mRelayGroupSender->getSource()->handle_events(gHandleSourceEvents, &pp);
+    }
+
     for (auto & remote : mRemotePeers) {
         if (remote->oursource) {
             remote->oursource->get_id(dummy);
@@ -3370,6 +4020,8 @@ void SonobusAudioProcessor::handleEvents()
             remote->oursink->get_id(dummy);
             ProcessorIdPair pp(this, dummy);
             remote->oursink->handle_events(gHandleSinkEvents, &pp);
+
+            updateAdaptiveRecvFormat(remote, nowtimems);
         }
 
         
@@ -3397,6 +4049,8 @@ void SonobusAudioProcessor::handleEvents()
         
     }
 
+    // after the events, so it sees any codec changes and invites
+    updateRelayGroup();
 }
 
 void SonobusAudioProcessor::sendPingEvent(RemotePeer * peer)
@@ -3441,6 +4095,8 @@ void SonobusAudioProcessor::handlePingEvent(EndpointState * endpoint, uint64_t t
         peer->smoothPingTime.push(peer->pingTime);
     }
 
+    peer->clockSync.addSample(tt1, tt2, tt3);
+
     DBG("ping recvd from " << peer->endpoint->ipaddr << ":" << peer->endpoint->port << " -- " << diff1 << " " << diff2 << " " <<  rtt << " smooth: " << peer->smoothPingTime.xbar << " stdev: " <<peer->smoothPingTime.s2xx);
 
 
@@ -3476,6 +4132,8 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                     peer->smoothPingTime.push(peer->pingTime);
                 }
 
+                peer->clockSync.addSample(e->tt1, e->tt2, e->tt3);
+
                 DBG("ping to source " << sourceId << " recvd from " <<  es->ipaddr << ":" << es->port << " -- " << diff1 << " " << diff2 << " " <<  rtt << " smooth: " << peer->smoothPingTime.xbar << " stdev: " <<peer->smoothPingTime.s2xx);
                 
                 
@@ -3524,6 +4182,7 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                     // add their sink
                     peer->oursource->add_sink(es, peer->remoteSinkId, endpoint_send);
                     peer->oursource->set_sinkoption(es, peer->remoteSinkId, aoo_opt_protocol_flags, &e->flags, sizeof(int32_t));
+                    updateRemoteSinkFlags(peer, e->flags);
 
                     if (peer->sendAllow) {
                         peer->oursource->start();
@@ -3546,6 +4205,10 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                     mAooDummySource->remove_sink(es, dummyid);
                     
                 }
+                else if (mRelayGroupSender->getSource()->get_id(dummyid) && dummyid == sourceId) {
+                    // only we decide who is in the group, see updateRelayGroup()
+                    DBG("Ignoring invite to the relay group source from " << es->ipaddr << ":" << es->port << "  " << e->id);
+                }
                 else {
                     // invited 
                     DBG("Invite received to our source: " << sourceId << " from " << es->ipaddr << ":" << es->port << "  " << e->id);
@@ -3555,8 +4218,11 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                         
                         peer->remoteSinkId = e->id;
 
+                        // invited again, it starts over on its own source and can rejoin the group later
+                        mRelayGroupSender->removeSink(es, peer->remoteSinkId);
                         peer->oursource->add_sink(es, peer->remoteSinkId, endpoint_send);
                         peer->oursource->set_sinkoption(es, peer->remoteSinkId, aoo_opt_protocol_flags, &e->flags, sizeof(int32_t));
+                        updateRemoteSinkFlags(peer, e->flags);
                         
                         if (peer->sendAllow) {
                             peer->oursource->start();
@@ -3620,6 +4286,7 @@ int32_t SonobusAudioProcessor::handleSourceEvents(const aoo_event ** events, int
                         const ScopedReadLock sl (mCoreLock);        
                         ourid = peer->ourId;
                         peer->oursource->remove_all();
+                        mRelayGroupSender->removeSink(es, e->id);
                         //peer->oursink->uninvite_all(); // ??
                         //peer->connected = false;
                         peer->sendActive = false;
@@ -3760,6 +4427,8 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
                 aoo_format_storage f;
                 if (peer->oursink->get_source_format(e->endpoint, e->id, f) > 0) {
                     DBG("Got source format event from " << es->ipaddr << ":" << es->port << "  " <<  e->id  << "  channels: " << f.header.nchannels);
+                    // the peer may have moved us to or from its relay group source
+                    peer->remoteSourceId = e->id;
                     peer->recvMeterSource.resize(f.header.nchannels, meterRmsWindow);
 
                     // check for layout
@@ -3874,7 +4543,8 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
             const ScopedReadLock sl (mCoreLock);        
 
             RemotePeer * peer = findRemotePeer(es, sinkId);
-            if (peer) {
+            // the source it moved away from stopping doesn't mean we stopped receiving
+            if (peer && e->id == peer->remoteSourceId) {
                 peer->recvActive = peer->recvAllow && e->state > 0;
                 if (!peer->recvActive && !peer->sendActive) {
                     peer->connected = false;
@@ -3993,6 +4663,33 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
 
             break;
         }
+        case AOO_BLOCK_RECOVERED_EVENT:
+        {
+            aoo_block_recovered_event *e = (aoo_block_recovered_event *)events[i];
+            EndpointState * es = (EndpointState *)e->endpoint;
+
+            DBG("Got source block recovered event from " << es->ipaddr << ":" << es->port << "  " << e->id << " -- " << e->count);
+            const ScopedReadLock sl (mCoreLock);
+            RemotePeer * peer = findRemotePeer(es, sinkId);
+            if (peer) {
+                peer->dataPacketsRecovered += e->count;
+            }
+
+            break;
+        }
+        case AOO_BLOCK_PARITY_EVENT:
+        {
+            aoo_block_parity_event *e = (aoo_block_parity_event *)events[i];
+            EndpointState * es = (EndpointState *)e->endpoint;
+
+            const ScopedReadLock sl (mCoreLock);
+            RemotePeer * peer = findRemotePeer(es, sinkId);
+            if (peer) {
+                peer->parityPacketsReceived += e->count;
+            }
+
+            break;
+        }
         case AOO_BLOCK_GAP_EVENT:
         {
             aoo_block_gap_event *e = (aoo_block_gap_event *)events[i];
@@ -4054,7 +4751,14 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
                     const float nodropsthresh = 10.0; // no drops in 10 seconds
                     const float adjustlimit = 10; // don't adjust more often than once every 10 seconds
 
-                    if (peer->lastNetBufDecrTime > 0 && peer->buffertimeMs > peer->netBufAutoBaseline && !peer->latencyMatched) {
+                    // never shrink below what the measured arrival jitter needs
+                    float minbuftimeMs = peer->netBufAutoBaseline;
+                    aoo_transit_stats transit;
+                    if (getRemotePeerTransitStats(peer, transit)) {
+                        minbuftimeMs = jmax(minbuftimeMs, AUTO_NETBUF_JITTER_FACTOR * (float) (1e3 * transit.jitter));
+                    }
+
+                    if (peer->lastNetBufDecrTime > 0 && peer->buffertimeMs > minbuftimeMs && !peer->latencyMatched) {
                         double deltatime = (nowtime - peer->lastNetBufDecrTime) * 1e-3;
                         double deltadroptime = (nowtime - peer->lastDroptime) * 1e-3;
                         if (deltatime > adjustlimit) {
@@ -4064,7 +4768,7 @@ int32_t SonobusAudioProcessor::handleSinkEvents(const aoo_event ** events, int32
                                 float adjms = 1000.0f * currSamplesPerBlock / getSampleRate();
                                 peer->buffertimeMs -= adjms;
 
-                                peer->buffertimeMs = std::max(peer->buffertimeMs, peer->netBufAutoBaseline);
+                                peer->buffertimeMs = std::max(peer->buffertimeMs, minbuftimeMs);
 
                                 peer->totalEstLatency = peer->smoothPingTime.xbar + 2*peer->buffertimeMs + (1e3*currSamplesPerBlock/getSampleRate());
                                 peer->oursink->set_buffersize(peer->buffertimeMs);
@@ -4321,6 +5025,9 @@ int32_t SonobusAudioProcessor::handleClientEvents(const aoo_event ** events, int
 
                 EndpointState * endpoint = findOrAddRawEndpoint(e->address);
                 if (endpoint) {
+
+                    // the direct handshake failed, talk through the connection server
+                    endpoint->relay = e->relayed ? mAooClient.get() : nullptr;
                  
                     // check if blocked
                     if (isAddressBlocked(endpoint->ipaddr)) {
@@ -4563,18 +5270,49 @@ void SonobusAudioProcessor::setPatchMatrixValue(int srcindex, int destindex, boo
 
     if (srcindex < MAX_PEERS && destindex < MAX_PEERS) {
         mRemoteSendMatrix[srcindex][destindex] = value;
+        mSendRoutesDirty = true;
 
         const ScopedReadLock sl (mCoreLock);        
         if (destindex < mRemotePeers.size() && destindex >= 0) {
             auto * peer = mRemotePeers.getUnchecked(destindex);
 
-            updateRemotePeerSendChannels(destindex, peer);
-            
+            updateRemotePeerSendChannels(destindex, peer);
+            
+        }
+    }
+}
+
+
+void SonobusAudioProcessor::addRemotePeerToSendMix(RemotePeer * source, AudioSampleBuffer & dest, int destStartChannel, int destChannels, int numSamples, float gain)
+{
+    for (int channel = 0; channel < destChannels; ++channel) {
+
+        // now apply panning
+
+        if (source->recvChannels > 0 && destChannels > 1) {
+            for (int ch=0; ch < source->recvChannels; ++ch) {
+                const float pan = source->recvChannels == 2 ? source->recvStereoPan[ch] : source->recvPan[ch];
+                const float lastpan = source->recvPanLast[ch];
+
+                // apply pan law
+                // -1 is left, 1 is right
+                float pgain = channel == 0 ? (pan >= 0.0f ? (1.0f - pan) : 1.0f) : (pan >= 0.0f ? 1.0f : (1.0f+pan)) ;
+
+                if (pan != lastpan) {
+                    float plastgain = channel == 0 ? (lastpan >= 0.0f ? (1.0f - lastpan) : 1.0f) : (lastpan >= 0.0f ? 1.0f : (1.0f+lastpan));
+
+                    dest.addFromWithRamp(destStartChannel + channel, 0, source->workBuffer.getReadPointer(ch), numSamples, plastgain * gain, pgain * gain);
+                } else {
+                    dest.addFrom (destStartChannel + channel, 0, source->workBuffer, ch, 0, numSamples, pgain * gain);
+                }
+            }
+        } else if (channel < source->workBuffer.getNumChannels()) {
+
+            dest.addFrom(destStartChannel + channel, 0, source->workBuffer, channel, 0, numSamples, gain);
         }
     }
 }
 
-
 void SonobusAudioProcessor::adjustRemoteSendMatrix(int index, bool removed)
 {
     if (removed) {
@@ -4617,6 +5355,22 @@ void SonobusAudioProcessor::adjustRemoteSendMatrix(int index, bool removed)
         }                
 
     }
+
+    mSendRoutesDirty = true;
+}
+
+void SonobusAudioProcessor::compileSendRoutes()
+{
+    // only the set entries of the matrix, per destination
+    for (int dest=0; dest < MAX_PEERS; ++dest) {
+        int count = 0;
+        for (int src=0; src < MAX_PEERS; ++src) {
+            if (mRemoteSendMatrix[src][dest]) {
+                mSendRouteSources[dest][count++] = src;
+            }
+        }
+        mSendRouteCount[dest] = count;
+    }
 }
 
 bool SonobusAudioProcessor::removeAllRemotePeers()
@@ -4634,6 +5388,10 @@ bool SonobusAudioProcessor::removeAllRemotePeers()
             disconnectRemotePeer(index);
         }
 
+        if (mRelayGroupSender) {
+            mRelayGroupSender->removeSink(remote->endpoint, remote->remoteSinkId);
+        }
+
         removed.add(remote);
     }
 
@@ -4649,6 +5407,7 @@ bool SonobusAudioProcessor::removeAllRemotePeers()
             mRemoteSendMatrix[i][j] = false;
         }
     }
+    mSendRoutesDirty = true;
 
     // they will be cleaned up when removed list goes out of scope
 
@@ -4677,6 +5436,10 @@ bool SonobusAudioProcessor::removeRemotePeer(int index, bool sendblock)
             }
             
             adjustRemoteSendMatrix(index, true);
+
+            if (mRelayGroupSender) {
+                mRelayGroupSender->removeSink(remote->endpoint, remote->remoteSinkId);
+            }
             
             std::unique_ptr<RemotePeer> removed(remote);
 
@@ -5174,6 +5937,9 @@ void SonobusAudioProcessor::updateDynamicResampling()
         remote->oursink->set_dynamic_resampling(newval ? 1 : 0);
         remote->oursource->set_dynamic_resampling(newval ? 1 : 0);
     }
+    if (mRelayGroupSender) {
+        mRelayGroupSender->getSource()->set_dynamic_resampling(newval ? 1 : 0);
+    }
 }
 
 
@@ -5255,6 +6021,9 @@ void SonobusAudioProcessor::changeListenerCallback (ChangeBroadcaster* source)
             mTransportSource.setPosition(0.0);
         }
 
+        // it may have been waiting for playback to stop
+        switchToMappedTransportReader();
+
 #if 0
         if (mSendChannels.get() == 0) {
             if (mTransportSource.isPlaying() && mSendPlaybackAudio.get()) {
@@ -5269,6 +6038,9 @@ void SonobusAudioProcessor::changeListenerCallback (ChangeBroadcaster* source)
         }
 #endif
     }
+    else if (source == mMappedFileWarmer.get()) {
+        switchToMappedTransportReader();
+    }
 }
 
 void SonobusAudioProcessor::setRemotePeerBufferTime(int index, float bufferMs)
@@ -5563,6 +6335,26 @@ int64_t  SonobusAudioProcessor::getRemotePeerPacketsResent(int index) const
     return 0;      
 }
 
+int64_t  SonobusAudioProcessor::getRemotePeerPacketsRecovered(int index) const
+{
+    const ScopedReadLock sl (mCoreLock);
+    if (index < mRemotePeers.size()) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(index);
+        return remote->dataPacketsRecovered;
+    }
+    return 0;
+}
+
+int64_t  SonobusAudioProcessor::getRemotePeerParityPacketsReceived(int index) const
+{
+    const ScopedReadLock sl (mCoreLock);
+    if (index < mRemotePeers.size()) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(index);
+        return remote->parityPacketsReceived;
+    }
+    return 0;
+}
+
 bool SonobusAudioProcessor::getRemotePeerSafetyMuted(int index) const
 {
     const ScopedReadLock sl (mCoreLock);
@@ -5590,12 +6382,24 @@ void  SonobusAudioProcessor::resetRemotePeerPacketStats(int index)
         RemotePeer * remote = mRemotePeers.getUnchecked(index);
         remote->dataPacketsResent = 0;
         remote->dataPacketsDropped = 0;
+        remote->dataPacketsRecovered = 0;
+        remote->parityPacketsReceived = 0;
         remote->resetDroptime = Time::getMillisecondCounterHiRes();
         remote->fastDropRate.resetInitVal(0.0f);
     }
 }
 
 
+bool SonobusAudioProcessor::getRemotePeerTransitStats(RemotePeer * peer, aoo_transit_stats & retstats) const
+{
+    // only there if the peer's source time stamps its data (AOO_PROTOCOL_FLAG_TIMESTAMP)
+    if (!peer->oursink) return false;
+    if (peer->oursink->get_source_transit_stats(peer->endpoint, peer->remoteSourceId, retstats) <= 0) {
+        return false;
+    }
+    return retstats.count > 0;
+}
+
 bool SonobusAudioProcessor::getRemotePeerLatencyInfo(int index, LatencyInfo & retinfo) const
 {
     const ScopedReadLock sl (mCoreLock);        
@@ -5668,6 +6472,17 @@ bool SonobusAudioProcessor::getRemotePeerLatencyInfo(int index, LatencyInfo & re
 
         retinfo.pingMs = remote->smoothPingTime.xbar;
 
+        // remote clock minus ours, from the pings
+        retinfo.clockSynced = remote->clockSync.isValid();
+        if (retinfo.clockSynced) {
+            retinfo.clockOffsetMs = remote->clockSync.getOffsetMs();
+            retinfo.clockUncertaintyMs = remote->clockSync.getUncertaintyMs();
+        }
+
+        // arrival jitter and transit time of the time stamped data blocks
+        aoo_transit_stats transit;
+        const bool haveTransit = getRemotePeerTransitStats(remote, transit);
+
         if (remote->hasRemoteInfo) {
             float buftimeMs = jmax((double)remote->buffertimeMs, 1000.0f * currSamplesPerBlock / getSampleRate());
             auto halfping = retinfo.pingMs*0.5f;
@@ -5678,10 +6493,19 @@ bool SonobusAudioProcessor::getRemotePeerLatencyInfo(int index, LatencyInfo & re
             auto sendcodecLat = sendformatinfo.codec == CodecOpus ? 2.5f : 0.0f; // Opus adds codec latency
             auto recvcodecLat = remote->recvFormat.codec == CodecOpus ? 2.5f : 0.0f; // Opus adds codec latency
 
+            // split the round trip using the measured one-way delay if we can
+            auto inhalf = halfping;
+            auto outhalf = halfping;
+            if (haveTransit && retinfo.clockSynced) {
+                inhalf = jlimit(0.0f, retinfo.pingMs, (float) (1e3 * transit.min_transit) + retinfo.clockOffsetMs);
+                outhalf = retinfo.pingMs - inhalf;
+                retinfo.oneWayMeasured = true;
+            }
+
             // new style
-            retinfo.incomingMs = /*absizeMs + */ recvcodecLat +  remote->remoteInLatMs + halfping + buftimeMs;
-            retinfo.outgoingMs = /*absizeMs + */ sendcodecLat +  remote->remoteOutLatMs  +  halfping  + remote->remoteJitterBufMs;
-            retinfo.jitterMs =  2 * remote->fillRatioSlow.s2xx * buftimeMs; // can't find a good estimate for this yet
+            retinfo.incomingMs = /*absizeMs + */ recvcodecLat +  remote->remoteInLatMs + inhalf + buftimeMs;
+            retinfo.outgoingMs = /*absizeMs + */ sendcodecLat +  remote->remoteOutLatMs  +  outhalf  + remote->remoteJitterBufMs;
+            retinfo.jitterMs = haveTransit ? (float) (1e3 * transit.jitter) : 2 * remote->fillRatioSlow.s2xx * buftimeMs;
 
             retinfo.isreal = true;
             retinfo.estimated = false;
@@ -5718,7 +6542,7 @@ bool SonobusAudioProcessor::getRemotePeerLatencyInfo(int index, LatencyInfo & re
 
             retinfo.incomingMs = 2e3*currSamplesPerBlock/getSampleRate() + retinfo.pingMs*0.5f + buftimeMs;
             retinfo.outgoingMs = /* unknwon_remote_output_latency + */  retinfo.totalRoundtripMs - retinfo.incomingMs;
-            retinfo.jitterMs =  2 * remote->fillRatioSlow.s2xx * buftimeMs; // can't find a good estimate for this yet
+            retinfo.jitterMs = haveTransit ? (float) (1e3 * transit.jitter) : 2 * remote->fillRatioSlow.s2xx * buftimeMs;
             retinfo.legacy = true;
         }
 
@@ -5738,6 +6562,87 @@ bool SonobusAudioProcessor::isRemotePeerLatencyTestActive(int index)
 }
 
 
+void SonobusAudioProcessor::fillPeerStats(PeerStatsSnapshot & snap) const
+{
+    const ScopedReadLock sl (mCoreLock);
+
+    snap.numPeers = jmin(mRemotePeers.size(), MAX_PEERS);
+
+    for (int i=0; i < snap.numPeers; ++i) {
+        RemotePeer * remote = mRemotePeers.getUnchecked(i);
+        PeerStats & stats = snap.peers[i];
+
+        stats.connected = remote->connected;
+        stats.sendActive = remote->sendActive;
+        stats.sendAllow = remote->sendAllow;
+        stats.recvActive = remote->recvActive;
+        stats.recvAllow = remote->recvAllow;
+        stats.latencyTestActive = remote->activeLatencyTest;
+        stats.safetyMuted = remote->resetSafetyMuted;
+        stats.blockedUs = remote->blockedUs;
+        stats.recvChannels = remote->recvChannels;
+        stats.actualSendChannels = remote->sendChannels;
+        stats.bytesSent = remote->endpoint->sentBytes;
+        stats.bytesReceived = remote->endpoint->recvBytes;
+        stats.packetsDropped = remote->dataPacketsDropped;
+        stats.packetsResent = remote->dataPacketsResent;
+        stats.packetsRecovered = remote->dataPacketsRecovered;
+        stats.parityPacketsReceived = remote->parityPacketsReceived;
+        stats.fillRatio = remote->fillRatio.xbar;
+        stats.fillRatioStdev = remote->fillRatioSlow.s2xx;
+        // reflect actual truth
+        stats.bufferTimeMs = jmax((double)remote->buffertimeMs, 1000.0f * currSamplesPerBlock / getSampleRate());
+        stats.autoBufferMode = (int) remote->autosizeBufferMode;
+        stats.autoBufferInitCompleted = remote->autoNetbufInitCompleted;
+        stats.sendFormatIndex = remote->formatIndex;
+        stats.reqRemoteSendFormatIndex = remote->reqRemoteSendFormatIndex;
+        remote->recvFormat.name.copyToUTF8(stats.recvFormatName, sizeof(stats.recvFormatName));
+
+        stats.latency = LatencyInfo();
+        getRemotePeerLatencyInfo(i, stats.latency);
+    }
+}
+
+void SonobusAudioProcessor::publishPeerStats()
+{
+    const auto version = mPeerStatsVersion.load(std::memory_order_relaxed);
+    PeerStatsSnapshot & snap = mPeerStats[(version + 1) & 1];
+
+    // the back buffer was the front one until the last publish, keep these
+    // writes after that store, so a reader still copying it sees the version change
+    std::atomic_thread_fence(std::memory_order_release);
+
+    fillPeerStats(snap);
+
+    snap.version = version + 1;
+    mPeerStatsVersion.store(version + 1, std::memory_order_release);
+}
+
+bool SonobusAudioProcessor::getPeerStatsSnapshot(PeerStatsSnapshot & retsnap) const
+{
+    for (;;) {
+        const auto version = mPeerStatsVersion.load(std::memory_order_acquire);
+        if (version == 0) {
+            retsnap.numPeers = 0;
+            return false;
+        }
+
+        const PeerStatsSnapshot & snap = mPeerStats[version & 1];
+        retsnap.version = snap.version;
+        retsnap.numPeers = jlimit(0, (int)MAX_PEERS, snap.numPeers);
+        std::copy(snap.peers, snap.peers + retsnap.numPeers, retsnap.peers);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // the writer fills the other buffer first, and only starts on this one after
+        // publishing that, so if the version hasn't moved at all the copy is intact
+        if (mPeerStatsVersion.load(std::memory_order_relaxed) == version) {
+            return true;
+        }
+    }
+}
+
+
 bool SonobusAudioProcessor::isAnyRemotePeerRecording() const
 {
     const ScopedReadLock sl (mCoreLock);
@@ -5974,7 +6879,7 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
     
     if (doadd) {
         // find free id
-        int32_t newid = 1;
+        int32_t newid = mAooIdBase + 1;
         bool hasit = false;
         while (!hasit) {
             bool safe = true;
@@ -5999,6 +6904,8 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         retpeer->buffertimeMs = mBufferTime.get() * 1000.0f;
         retpeer->formatIndex = mDefaultAudioFormatIndex;
         retpeer->autosizeBufferMode = (AutoNetBufferMode) defaultAutoNetbufMode;
+        retpeer->adaptiveFormat.enabled = mDefaultAdaptiveRecvFormat;
+        retpeer->fecGroupSize = mSendFec ? SEND_FEC_GROUP_SIZE : 0;
 
         retpeer->resetDroptime = Time::getMillisecondCounterHiRes();
         retpeer->fastDropRate.resetInitVal(0.0f);
@@ -6019,10 +6926,17 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         retpeer->resetSafetyMuted = retpeer->buffertimeMs < 3.0f;
         retpeer->blockedUs = false;
         
+        retpeer->oursink->set_clock(mAudioClock);
+        retpeer->oursource->set_clock(mAudioClock);
+        retpeer->latencysource->set_clock(mAudioClock);
+        retpeer->echosource->set_clock(mAudioClock);
+        retpeer->latencysink->set_clock(mAudioClock);
+        retpeer->echosink->set_clock(mAudioClock);
+
         retpeer->oursink->setup(getSampleRate(), currSamplesPerBlock, getMainBusNumOutputChannels());
         retpeer->oursink->set_buffersize(retpeer->buffertimeMs);
 
-        int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+        int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA | AOO_PROTOCOL_FLAG_FEC | AOO_PROTOCOL_FLAG_DTX | AOO_PROTOCOL_FLAG_TIMESTAMP | AOO_PROTOCOL_FLAG_OPUS_LAYOUT;
         retpeer->oursink->set_option(aoo_opt_protocol_flags, &flags, sizeof(int32_t));
 
         retpeer->nominalSendChannels = mSendChannels.get();
@@ -6033,6 +6947,9 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
         retpeer->oursource->setup(getSampleRate(), currSamplesPerBlock, retpeer->sendChannels);
         retpeer->oursource->set_buffersize(sendbufsize);
         retpeer->oursource->set_packetsize(retpeer->packetsize);        
+        retpeer->oursource->set_fec_groupsize(retpeer->fecGroupSize);
+        retpeer->oursource->set_dtx_threshold(mSendSilenceSuppression ? Decibels::decibelsToGain(SEND_SILENCE_THRESHOLD_DB) : 0.0f);
+        retpeer->oursource->set_dtx_hangover(SEND_SILENCE_HANGOVER_MS);
         //setupSourceUserFormat(retpeer, retpeer->oursource.get());
 
         setupSourceFormat(retpeer, retpeer->latencysource.get(), true);
@@ -6075,6 +6992,7 @@ SonobusAudioProcessor::RemotePeer * SonobusAudioProcessor::doAddRemotePeerIfNece
 
         
         retpeer->workBuffer.setSize(2, currSamplesPerBlock, false, false, true);
+        retpeer->sendMixBuffer.setSize(3, currSamplesPerBlock, false, false, true);
 
         int outchannels = getMainBusNumOutputChannels();
         
@@ -6250,6 +7168,10 @@ bool SonobusAudioProcessor::removeAllRemotePeersWithEndpoint(EndpointState * end
 
             commitCacheForPeer(s);
 
+            if (mRelayGroupSender) {
+                mRelayGroupSender->removeSink(s->endpoint, s->remoteSinkId);
+            }
+
             didremove = true;
 
             {
@@ -6279,6 +7201,10 @@ bool SonobusAudioProcessor::doRemoveRemotePeerIfNecessary(EndpointState * endpoi
             didremove = true;
             commitCacheForPeer(s);
 
+            if (mRelayGroupSender) {
+                mRelayGroupSender->removeSink(s->endpoint, s->remoteSinkId);
+            }
+
             {
                 const ScopedWriteLock slw (mCoreLock);
                 removed.add(mRemotePeers.removeAndReturn(i));
@@ -6310,7 +7236,7 @@ bool SonobusAudioProcessor::isAnythingRoutedToPeer(int index) const
 
 ////
 
-bool SonobusAudioProcessor::formatInfoToAooFormat(const AudioCodecFormatInfo & info, int channels, aoo_format_storage & retformat) {
+bool SonobusAudioProcessor::formatInfoToAooFormat(const AudioCodecFormatInfo & info, int channels, aoo_format_storage & retformat, bool coupled) {
                 
         if (info.codec == CodecPCM) {
             aoo_format_pcm *fmt = (aoo_format_pcm *)&retformat;
@@ -6333,6 +7259,8 @@ bool SonobusAudioProcessor::formatInfoToAooFormat(const AudioCodecFormatInfo & i
             fmt->signal_type = info.signal_type;
             fmt->application_type = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
             //fmt->application_type = OPUS_APPLICATION_AUDIO;
+            // only a stereo mix is coupled, separate multichannel sends are unrelated signals
+            fmt->channel_layout = (coupled && channels == 2) ? AOO_OPUS_LAYOUT_COUPLED : AOO_OPUS_LAYOUT_DISCRETE;
             
             return true;
         }
@@ -6350,12 +7278,78 @@ void SonobusAudioProcessor::setupSourceFormat(SonobusAudioProcessor::RemotePeer
     
     aoo_format_storage f;
     int channels = latencymode ? 1  :  peer ? peer->sendChannels : getMainBusNumInputChannels();
+    bool coupled = peer && (peer->remoteSinkFlags & AOO_PROTOCOL_FLAG_OPUS_LAYOUT);
     
-    if (formatInfoToAooFormat(info, channels, f)) {        
+    if (formatInfoToAooFormat(info, channels, f, coupled)) {        
         source->set_format(f.header);        
     }
 }
 
+void SonobusAudioProcessor::updateRemoteSinkFlags(RemotePeer * peer, int32_t flags)
+{
+    bool layoutchanged = (peer->remoteSinkFlags ^ flags) & AOO_PROTOCOL_FLAG_OPUS_LAYOUT;
+    peer->remoteSinkFlags = flags;
+
+    if (layoutchanged) {
+        // now we know if they can decode coupled streams
+        setupSourceFormat(peer, peer->oursource.get());
+    }
+}
+
+void SonobusAudioProcessor::updateRelayGroup()
+{
+    // from the event thread, under the read lock
+    SonoAudio::RelayGroupSender::Candidate candidates[MAX_PEERS];
+    RemotePeer * candidatePeers[MAX_PEERS];
+    int numCandidates = 0;
+    String group;
+
+    // with the hub mix everyone gets their own mix-minus
+    const bool hubmix = mHubMixMinus.get();
+
+    for (int i=0; i < mRemotePeers.size() && numCandidates < MAX_PEERS; ++i) {
+        auto * peer = mRemotePeers.getUnchecked(i);
+        if (!peer->endpoint || !peer->oursource) continue;
+
+        const bool relayed = mAooClient && peer->endpoint->relay.load() != nullptr;
+        if (relayed && group.isEmpty()) {
+            group = peer->groupName;
+        }
+
+        auto & candidate = candidates[numCandidates];
+        candidate.endpoint = peer->endpoint;
+        candidate.sendFn = endpoint_send;
+        candidate.peerSource = peer->oursource.get();
+        candidate.sinkId = peer->remoteSinkId;
+        candidate.sinkFlags = peer->remoteSinkFlags;
+        candidate.sending = peer->sendActive && peer->sendAllow;
+        // anyone routed to this peer makes its stream different from the rest
+        candidate.eligible = relayed && peer->groupName == group && !hubmix && !isAnythingRoutedToPeer(i);
+        candidate.settings.numChannels = peer->sendChannels;
+        candidate.settings.formatIndex = peer->formatIndex < 0 ? mDefaultAudioFormatIndex : peer->formatIndex;
+        candidate.settings.packetSize = peer->packetsize;
+        candidate.settings.fecGroupSize = peer->fecGroupSize;
+        candidate.settings.coupled = (peer->remoteSinkFlags & AOO_PROTOCOL_FLAG_OPUS_LAYOUT) != 0;
+
+        candidatePeers[numCandidates++] = peer;
+    }
+
+    mRelayGroupSender->update(group, candidates, numCandidates, [&](aoo::isource & source, int index) {
+        // the same as this peer's own source
+        auto * peer = candidatePeers[index];
+
+        setupSourceFormat(peer, &source);
+        source.setup(getSampleRate(), currSamplesPerBlock, peer->sendChannels);
+        float sendbufsize = jmax(10.0, SENDBUFSIZE_SCALAR * 1000.0f * currSamplesPerBlock / getSampleRate());
+        source.set_buffersize(sendbufsize);
+        source.set_packetsize(peer->packetsize);
+        source.set_fec_groupsize(peer->fecGroupSize);
+        source.set_dtx_threshold(mSendSilenceSuppression ? Decibels::decibelsToGain(SEND_SILENCE_THRESHOLD_DB) : 0.0f);
+        source.set_dtx_hangover(SEND_SILENCE_HANGOVER_MS);
+        source.set_dynamic_resampling(mDynamicResampling.get() ? 1 : 0);
+    });
+}
+
 ValueTree SonobusAudioProcessor::getSendUserFormatLayoutTree()
 {
     // get userformat from send info
@@ -6919,6 +7913,13 @@ void SonobusAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBloc
     const ScopedReadLock sl (mCoreLock);        
     
     mMetronome->setSampleRate(sampleRate);
+
+    // this also waits for the fx worker to be done with the reverbs.
+    // the reverb output is this far behind on the worker, larger blocks are processed inline
+    const int fxmaxsamples = samplesPerBlock;
+    mFxPipeline->prepare(FxLaneMainReverb, 2, fxmaxsamples, [this](AudioBuffer<float> & buf, int nch, int nsamps) { processMainReverb(buf, nch, nsamps); });
+    mFxPipeline->prepare(FxLaneInputReverb, 2, fxmaxsamples, [this](AudioBuffer<float> & buf, int nch, int nsamps) { processInputReverb(buf, nch, nsamps); });
+
     mMainReverb->setSampleRate(sampleRate);
     mMReverb.setSampleRate(sampleRate);
     mInputReverb.setSampleRate(sampleRate);
@@ -6977,6 +7978,8 @@ void SonobusAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBloc
     mTransportSource.prepareToPlay(currSamplesPerBlock, getSampleRate());
 
     //mAooSource->set_format(fmt->header);
+    aoo_clock_setup(mAudioClock, sampleRate, samplesPerBlock, AOO_TIMEFILTER_BANDWIDTH);
+
     setupSourceFormat(0, mAooDummySource.get());
     mAooDummySource->setup(sampleRate, samplesPerBlock, getTotalNumInputChannels());
 
@@ -7079,8 +8082,8 @@ void SonobusAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBloc
             }
         }
 
-        // reset all incoming by toggling muting
-        if (!mMainRecvMute.get()) {
+        // reset all incoming by toggling muting, only needed for a new samplerate
+        if (lrintf(mPrevSampleRate) != lrintf(sampleRate) && !mMainRecvMute.get()) {
             DBG("Toggling main recv mute");
             mState.getParameter(paramMainRecvMute)->setValueNotifyingHost(1.0f);
             mPendingUnmuteAtStamp = Time::getMillisecondCounter() + 250;
@@ -7107,6 +8110,9 @@ void SonobusAudioProcessor::setupSourceFormatsForAll()
         if (s->workBuffer.getNumSamples() < currSamplesPerBlock) {
             s->workBuffer.setSize(jmax(2, s->recvChannels), currSamplesPerBlock, false, false, true);
         }
+        if (s->sendMixBuffer.getNumSamples() < currSamplesPerBlock) {
+            s->sendMixBuffer.setSize(3, currSamplesPerBlock, false, false, true);
+        }
 
         s->sendChannels = isAnythingRoutedToPeer(i) ? outchannels : s->nominalSendChannels <= 0 ? inchannels : s->nominalSendChannels;
         if (s->sendChannelsOverride > 0) {
@@ -7164,6 +8170,20 @@ void SonobusAudioProcessor::setupSourceFormatsForAll()
         ++i;
     }
 
+    // the group stream is set up like the peers in it
+    if (mRelayGroupSender && mRelayGroupSender->getNumMembers() > 0) {
+        for (auto s : mRemotePeers) {
+            if (mRelayGroupSender->isMember(s->endpoint, s->remoteSinkId)) {
+                auto * source = mRelayGroupSender->getSource();
+                setupSourceFormat(s, source);
+                source->setup(sampleRate, currSamplesPerBlock, s->sendChannels);
+                float sendbufsize = jmax(10.0, SENDBUFSIZE_SCALAR * 1000.0f * currSamplesPerBlock / getSampleRate());
+                source->set_buffersize(sendbufsize);
+                break;
+            }
+        }
+    }
+
     updateRemotePeerUserFormat();
 
 }
@@ -7274,6 +8294,10 @@ void SonobusAudioProcessor::ensureBuffers(int numSamples)
     if (mixBuffer.getNumSamples() < numSamples || mixBuffer.getNumChannels() < maxchans) {
         mixBuffer.setSize(maxchans, numSamples, false, false, true);
     }
+    if (hubMixBuffer.getNumSamples() < numSamples) {
+        // stereo panned mix, then the mono one
+        hubMixBuffer.setSize(3, numSamples, false, false, true);
+    }
     if (workBuffer.getNumSamples() < numSamples || workBuffer.getNumChannels() != maxworkbufchans) {
 
         // only grow the work buffer channel count
@@ -7327,9 +8351,60 @@ void SonobusAudioProcessor::ensureBuffers(int numSamples)
 }
 
 
+void SonobusAudioProcessor::processMainReverb(AudioBuffer<float> & fxbuffer, int numChannels, int numSamples)
+{
+    // assumes reverb is NO dry
+    if (mReverbParamsChanged) {
+        mMainReverb->setParameters(mMainReverbParams);
+        mReverbParamsChanged = false;
+    }
+
+    if (mMainReverbNeedsReset.exchange(false) || mLastReverbModel != mMainReverbModel.get()) {
+        mMReverb.reset();
+        mMainReverb->reset();
+        mZitaReverb.instanceClear();
+    }
+    mLastReverbModel = (ReverbModel) mMainReverbModel.get();
+
+    if (mLastReverbModel == ReverbModelMVerb) {
+        if (numChannels > 1) {
+            mMReverb.process((float **)fxbuffer.getArrayOfWritePointers(), (float **)fxbuffer.getArrayOfWritePointers(), numSamples);
+        }
+    }
+    else if (mLastReverbModel == ReverbModelZita) {
+        if (numChannels > 1) {
+            mZitaReverb.compute(numSamples, (float **)fxbuffer.getArrayOfWritePointers(), (float **)fxbuffer.getArrayOfWritePointers());
+        }
+    }
+    else {
+        if (numChannels > 1) {
+            mMainReverb->processStereo(fxbuffer.getWritePointer(0), fxbuffer.getWritePointer(1), numSamples);
+        } else {
+            mMainReverb->processMono(fxbuffer.getWritePointer(0), numSamples);
+        }
+    }
+}
+
+void SonobusAudioProcessor::processInputReverb(AudioBuffer<float> & revbuffer, int numChannels, int numSamples)
+{
+    if (mInputReverbNeedsReset.exchange(false)) {
+        mInputReverb.reset();
+    }
+
+    mInputReverb.process((float **)revbuffer.getArrayOfWritePointers(), (float **)revbuffer.getArrayOfWritePointers(), numSamples);
+}
+
+void SonobusAudioProcessor::setReverbOnWorkerThread(bool flag)
+{
+    mReverbOnWorkerThread = flag;
+    mFxPipeline->setEnabled(flag);
+}
+
 void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
     ScopedNoDenormals noDenormals;
+    SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageProcessBlock);
+
     auto totalInputChannels  = getTotalNumInputChannels();
     auto mainBusInputChannels  = getMainBusNumInputChannels();
     auto mainBusOutputChannels = getMainBusNumOutputChannels();
@@ -7374,6 +8449,10 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
             blocksizeCounter = -1;
             mNeedsSampleSetup = true;
 
+            // the sources and sinks follow on the send thread, but the shared clock is
+            // only touched here, where it's also updated
+            aoo_clock_setup(mAudioClock, (int32_t) getSampleRate(), numSamples, AOO_TIMEFILTER_BANDWIDTH);
+
             //setupSourceFormatsForAll();
         }
     }
@@ -7457,8 +8536,17 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
     uint64_t t = aoo_osctime_get();
 
+    // advance the shared time filter once, before any source or sink processes this block
+    aoo_clock_update(mAudioClock, t);
+
+    // one clock read for all the meters in this block
+    const int64 meterTime = Time::currentTimeMillis();
+
     // meter input pre everything
-    inputMeterSource.measureBlock (buffer, 0, numSamples);
+    {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMetering);
+        inputMeterSource.measureBlock (buffer, 0, numSamples, meterTime);
+    }
 
 
     inputPostBuffer.clear(0, numSamples);
@@ -7487,6 +8575,8 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
     int destch = 0;
     for (auto i = 0; i < mInputChannelGroupCount && i < MAX_CHANGROUPS; ++i)
     {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageInputGroups);
+
         auto * revbuf = doinreverb ? &inputRevBuffer : nullptr;
 
         mInputChannelGroups[i].processBlock(buffer, inputPostBuffer, destch, mInputChannelGroups[i].params.numChannels, silentBuffer, numSamples, inGain,
@@ -7505,22 +8595,25 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
     }
 
 
-    postinputMeterSource.measureBlock (inputPostBuffer, 0, numSamples);
+    {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMetering);
 
+        postinputMeterSource.measureBlock (inputPostBuffer, 0, numSamples, meterTime);
 
-    // compressor makeup meter level per channel
-    destch = 0;
-    for (auto i = 0; i < mInputChannelGroupCount && i < MAX_CHANGROUPS; ++i) {
-        float redlev = 1.0f;
-        if (mInputChannelGroups[i].params.compressorParams.enabled && mInputChannelGroups[i].compressorOutputLevel) {
-            redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*mInputChannelGroups[i].compressorOutputLevel));
-        }
-        for (auto j=0; j < mInputChannelGroups[i].params.numChannels; ++j) {
-            //int ch = mInputChannelGroups[i].chanStartIndex + j;
-            int ch = destch + j;
-            postinputMeterSource.setReductionLevel(ch, redlev);
+        // compressor makeup meter level per channel
+        destch = 0;
+        for (auto i = 0; i < mInputChannelGroupCount && i < MAX_CHANGROUPS; ++i) {
+            float redlev = 1.0f;
+            if (mInputChannelGroups[i].params.compressorParams.enabled && mInputChannelGroups[i].compressorOutputLevel) {
+                redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*mInputChannelGroups[i].compressorOutputLevel));
+            }
+            for (auto j=0; j < mInputChannelGroups[i].params.numChannels; ++j) {
+                //int ch = mInputChannelGroups[i].chanStartIndex + j;
+                int ch = destch + j;
+                postinputMeterSource.setReductionLevel(ch, redlev);
+            }
+            destch += mInputChannelGroups[i].params.numChannels;
         }
-        destch += mInputChannelGroups[i].params.numChannels;
     }
     
     
@@ -7541,6 +8634,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         }
     }
     else {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePanMix);
         int srcstart = 0;
 
         for (auto i = 0; i < mInputChannelGroupCount && i < MAX_CHANGROUPS; ++i)
@@ -7577,20 +8671,24 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
     int monPanChannels = jmin(inputBuffer.getNumChannels(), totalOutputChannels);
     float tmgain = monPanChannels == 1 && mainBusInputChannels > 0 ? (1.0f/std::max(1.0f, (float)(mainBusInputChannels * 0.5f))): 1.0f;
     int srcstart = 0;
-    for (auto i = 0; i < mInputChannelGroupCount; ++i)
     {
-        float utmgain = anyinputsoloed && !mInputChannelGroups[i].params.soloed ? 0.0f : tmgain;
-        int dstch = mInputChannelGroups[i].params.monDestStartIndex;
-        int dstcnt = jmin(monPanChannels, mInputChannelGroups[i].params.monDestChannels);
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePanMix);
+
+        for (auto i = 0; i < mInputChannelGroupCount; ++i)
+        {
+            float utmgain = anyinputsoloed && !mInputChannelGroups[i].params.soloed ? 0.0f : tmgain;
+            int dstch = mInputChannelGroups[i].params.monDestStartIndex;
+            int dstcnt = jmin(monPanChannels, mInputChannelGroups[i].params.monDestChannels);
 
-        auto * revbuffer = doreverb ? &mainFxBuffer : nullptr;
+            auto * revbuffer = doreverb ? &mainFxBuffer : nullptr;
 
-        mInputChannelGroups[i].processMonitor(inputPostBuffer, srcstart,
-                                              inputBuffer, dstch, dstcnt,
-                                              numSamples, utmgain, nullptr, 
-                                              revbuffer, 0, fxchannels, mainReverbEnabled, drynow);
+            mInputChannelGroups[i].processMonitor(inputPostBuffer, srcstart,
+                                                  inputBuffer, dstch, dstcnt,
+                                                  numSamples, utmgain, nullptr, 
+                                                  revbuffer, 0, fxchannels, mainReverbEnabled, drynow);
 
-        srcstart += mInputChannelGroups[i].params.numChannels;
+            srcstart += mInputChannelGroups[i].params.numChannels;
+        }
     }
 
     // for multichannel send, met and file playback and soundboard follow the last input channel
@@ -7620,18 +8718,18 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
     if (mTransportSource.getTotalLength() > 0)
     {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageFilePlayback);
+
         AudioSourceChannelInfo info (&fileBuffer, 0, numSamples);
         mTransportSource.getNextAudioBlock (info);
         hasfiledata = true;
 
-        filePlaybackMeterSource.measureBlock(fileBuffer);
+        filePlaybackMeterSource.measureBlock(fileBuffer, 0, numSamples, meterTime);
 
         int srcchans = fileChannels;
+        // the monitor delay follows the channel count by itself
         mFilePlaybackChannelGroup.params.numChannels = srcchans;
-        mFilePlaybackChannelGroup.commitMonitorDelayParams(); // need to do this too
-
         mRecFilePlaybackChannelGroup.params.numChannels = srcchans;
-        mRecFilePlaybackChannelGroup.commitMonitorDelayParams(); // need to do this too
 
         if (sendfileaudio) {
 
@@ -7680,7 +8778,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
     }
 
-    bool hassoundboarddata = soundboardChannelProcessor->processAudioBlock(numSamples);
+    bool hassoundboarddata = soundboardChannelProcessor->processAudioBlock(numSamples, meterTime);
     if (hassoundboarddata && sendsoundboardaudio) {
         int startChannel = sendfileaudio ? filestartch + fileChannels : filestartch;
         soundboardChannelProcessor->sendAudioBlock(sendWorkBuffer, numSamples, sendPanChannels, startChannel);
@@ -7713,6 +8811,8 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         }
     }
     if (mLastMetEnabled || metenabled) {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMetronome);
+
         metBuffer.clear(0, numSamples);
         mMetronome->setGain(metgain);
         mMetronome->setTempo(mettempo);
@@ -7727,7 +8827,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
         //
 
-        metMeterSource.measureBlock(metBuffer);
+        metMeterSource.measureBlock(metBuffer, 0, numSamples, meterTime);
 
         if (sendmet) {
 
@@ -7757,12 +8857,13 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
     // process and mix in input reverb into sendworkbuffer (if sending mono or stereo)
     if (doinreverb) {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageInputReverb);
 
         if (inReverbEnabled != mLastInputReverbEnabled && inReverbEnabled) {
-            mInputReverb.reset();
+            mInputReverbNeedsReset = true;
         }
 
-        mInputReverb.process((float **)inputRevBuffer.getArrayOfWritePointers(), (float **)inputRevBuffer.getArrayOfWritePointers(), numSamples);
+        mFxPipeline->process(FxLaneInputReverb, inputRevBuffer, 2, numSamples);
 
         if (inReverbEnabled != mLastInputReverbEnabled ) {
             float sgain = inReverbEnabled ? 0.0f : 1.0f;
@@ -7779,11 +8880,18 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         }
     }
 
+    else {
+        mFxPipeline->flush(FxLaneInputReverb);
+    }
+
     mLastInputReverbEnabled = inReverbEnabled;
 
 
     // send meter post panning (and post file and met)
-    sendMeterSource.measureBlock (sendWorkBuffer, 0, numSamples);
+    {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMetering);
+        sendMeterSource.measureBlock (sendWorkBuffer, 0, numSamples, meterTime);
+    }
 
 
     bool hearlatencytest = mHearLatencyTest.get();
@@ -7838,6 +8946,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
             
             {
                 // get audio data coming in from outside into tempbuf
+                SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePeerSinkProcess);
                 const ScopedReadLock sl (remote->sinkLock); // not contended, should be able to get rid of
 
                 // just in case, should be exceedingly rare this is necessary
@@ -7849,9 +8958,19 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
                 remote->workBuffer.clear(0, numSamples);
 
-                remote->oursink->process((float **)remote->workBuffer.getArrayOfWritePointers(), numSamples, t);
+                // sums straight into the cleared work buffer
+                if (remote->oursink->process_add((float **)remote->workBuffer.getArrayOfWritePointers(), numSamples, t) > 0) {
+                    remote->recvSilentSamples = 0;
+                } else {
+                    // nothing arrived (or only silent blocks), the buffer is still clear
+                    remote->recvSilentSamples += numSamples;
+                }
             }
 
+            // once the effect tails have died out we don't need to run
+            // the effects chain and panning on the silence
+            const bool recvIdle = remote->recvSilentSamples > RECV_IDLE_HOLD_SEC * getSampleRate();
+
             
             // record individual tracks pre-compressor/level/pan, ignoring muting/solo, raw material
 
@@ -7919,33 +9038,42 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
                 }
             }
 
-            for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
-                remote->chanGroups[cgi].processBlock(remote->workBuffer, remote->workBuffer, remote->chanGroups[cgi].params.chanStartIndex,  remote->chanGroups[cgi].params.numChannels, silentBuffer, numSamples, usegain);
+            if (!recvIdle) {
+                SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePeerChannelGroups);
+
+                for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
+                    remote->chanGroups[cgi].processBlock(remote->workBuffer, remote->workBuffer, remote->chanGroups[cgi].params.chanStartIndex,  remote->chanGroups[cgi].params.numChannels, silentBuffer, numSamples, usegain);
+                }
             }
 
             remote->_lastgain = usegain;
 
 
-            remote->recvMeterSource.measureBlock (remote->workBuffer, 0, numSamples);
+            {
+                SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMetering);
+
+                remote->recvMeterSource.measureBlock (remote->workBuffer, 0, numSamples, meterTime);
 
-            for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
-                float redlev = 1.0f;
-                if (remote->chanGroups[cgi].params.compressorParams.enabled && remote->chanGroups[cgi].compressorOutputLevel) {
-                    redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*remote->chanGroups[cgi].compressorOutputLevel));
-                }
-                for (auto j=0; j < remote->chanGroups[cgi].params.numChannels; ++j) {
-                    int ch = remote->chanGroups[cgi].params.chanStartIndex + j;
-                    remote->recvMeterSource.setReductionLevel(ch, redlev);
+                for (auto cgi = 0; cgi < remote->numChanGroups; ++cgi) {
+                    float redlev = 1.0f;
+                    if (remote->chanGroups[cgi].params.compressorParams.enabled && remote->chanGroups[cgi].compressorOutputLevel) {
+                        redlev = jlimit(0.0f, 1.0f, Decibels::decibelsToGain(*remote->chanGroups[cgi].compressorOutputLevel));
+                    }
+                    for (auto j=0; j < remote->chanGroups[cgi].params.numChannels; ++j) {
+                        int ch = remote->chanGroups[cgi].params.chanStartIndex + j;
+                        remote->recvMeterSource.setReductionLevel(ch, redlev);
+                    }
                 }
             }
 
             ++rindex;
             
-            if (wasSilent) continue; // can skip the rest, already fully muted/absent
+            if (wasSilent || recvIdle) continue; // can skip the rest, already fully muted/absent or nothing to hear
             
             float tgain = mainBusOutputChannels == 1 && remote->recvChannels > 0 ? 1.0f/(float)remote->recvChannels : 1.0f;
             tgain *= usegain; // handles main solo
 
+            SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePanMix);
 
             for (auto i = 0; i < remote->numChanGroups; ++i)
             {
@@ -7966,6 +9094,70 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         
         
         
+        const bool hubmix = mHubMixMinus.get();
+
+        if (mSendRoutesDirty.get()) {
+            mSendRoutesDirty = false;
+            compileSendRoutes();
+        }
+
+        // the pan gains only depend on the source, so each source that goes anywhere is panned
+        // once into its own send mix (ramping only where a pan moved), in the layouts its
+        // destinations need. the destinations below then just add those buffers.
+        {
+            SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePanMix);
+
+            enum { StereoMix = 1, MonoMix = 2 };
+            int mixlayouts[MAX_PEERS] = { 0 };
+            int hublayouts = 0;
+
+            for (int dest=0; dest < mRemotePeers.size(); ++dest) {
+                auto * remote = mRemotePeers.getUnchecked(dest);
+                if (!remote->oursource) continue;
+
+                const int layout = remote->sendChannels > 1 ? StereoMix : MonoMix;
+
+                if (hubmix) {
+                    hublayouts |= layout;
+                } else {
+                    for (int k=0; k < mSendRouteCount[dest]; ++k) {
+                        mixlayouts[mSendRouteSources[dest][k]] |= layout;
+                    }
+                }
+            }
+
+            if (hubmix) {
+                hubMixBuffer.clear(0, numSamples);
+            }
+
+            int src = 0;
+            for (auto & remote : mRemotePeers) {
+                const int layouts = hubmix ? hublayouts : mixlayouts[src++];
+                if (!remote->oursink || layouts == 0) continue;
+
+                if (remote->sendMixBuffer.getNumSamples() < numSamples) {
+                    // should be exceedingly rare
+                    remote->sendMixBuffer.setSize(3, currSamplesPerBlock, false, false, true);
+                }
+
+                remote->sendMixBuffer.clear(0, numSamples);
+
+                if (layouts & StereoMix) {
+                    addRemotePeerToSendMix(remote, remote->sendMixBuffer, 0, 2, numSamples, 1.0f);
+                }
+                if (layouts & MonoMix) {
+                    addRemotePeerToSendMix(remote, remote->sendMixBuffer, 2, 1, numSamples, 1.0f);
+                }
+
+                if (hubmix) {
+                    // the full mix, everyone gets this minus their own
+                    for (int ch=0; ch < 3; ++ch) {
+                        hubMixBuffer.addFrom(ch, 0, remote->sendMixBuffer, ch, 0, numSamples);
+                    }
+                }
+            }
+        }
+
         // send out final outputs
         int i=0;
         for (auto & remote : mRemotePeers) 
@@ -7980,46 +9172,35 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
                     workBuffer.addFrom(channel, 0, sendWorkBuffer, channel, 0, numSamples);
                 }
 
-                // now add any cross-routed input
-                int j=0;
-                for (auto & crossremote : mRemotePeers) 
-                {
-                    if (mRemoteSendMatrix[j][i]) {
-                        for (int channel = 0; channel < remote->sendChannels; ++channel) {
-
-                            // now apply panning
-
-                            if (crossremote->recvChannels > 0 && remote->sendChannels > 1) {
-                                for (int ch=0; ch < crossremote->recvChannels; ++ch) {
-                                    const float pan = crossremote->recvChannels == 2 ? crossremote->recvStereoPan[ch] : crossremote->recvPan[ch];
-                                    const float lastpan = crossremote->recvPanLast[ch];
-                                    
-                                    // apply pan law
-                                    // -1 is left, 1 is right
-                                    float pgain = channel == 0 ? (pan >= 0.0f ? (1.0f - pan) : 1.0f) : (pan >= 0.0f ? 1.0f : (1.0f+pan)) ;
-
-                                    if (pan != lastpan) {
-                                        float plastgain = channel == 0 ? (lastpan >= 0.0f ? (1.0f - lastpan) : 1.0f) : (lastpan >= 0.0f ? 1.0f : (1.0f+lastpan));
-                                        
-                                        workBuffer.addFromWithRamp(channel, 0, crossremote->workBuffer.getReadPointer(ch), numSamples, plastgain, pgain);
-                                    } else {
-                                        workBuffer.addFrom (channel, 0, crossremote->workBuffer, ch, 0, numSamples, pgain);                            
-                                    }
-
-                                    //remote->recvPanLast[ch] = pan;
-                                }
-                            } else {
-                                
-                                workBuffer.addFrom(channel, 0, crossremote->workBuffer, channel, 0, numSamples);
-                            }
-                            
-                        }                        
-                    }                    
-                    ++j;
+                if (hubmix) {
+                    // everyone else is the shared mix minus this participant's own contribution
+                    for (int channel = 0; channel < sendchans; ++channel) {
+                        const int mixch = remote->sendChannels > 1 ? jmin(channel, 1) : 2;
+                        workBuffer.addFrom(channel, 0, hubMixBuffer, mixch, 0, numSamples);
+                        if (remote->oursink) {
+                            workBuffer.addFrom(channel, 0, remote->sendMixBuffer, mixch, 0, numSamples, -1.0f);
+                        }
+                    }
+                }
+                else {
+                    // now add any cross-routed input, already panned into each source's send mix
+                    for (int k=0; k < mSendRouteCount[i]; ++k) {
+                        const int src = mSendRouteSources[i][k];
+                        if (src >= mRemotePeers.size()) continue;
+                        auto * crossremote = mRemotePeers.getUnchecked(src);
+                        if (!crossremote->oursink) continue;
+
+                        for (int channel = 0; channel < sendchans; ++channel) {
+                            const int mixch = remote->sendChannels > 1 ? jmin(channel, 1) : 2;
+                            workBuffer.addFrom(channel, 0, crossremote->sendMixBuffer, mixch, 0, numSamples);
+                        }
+                    }
                 }
                 
-                
-                remote->oursource->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
+                {
+                    SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePeerSourceProcess);
+                    remote->oursource->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
+                }
                 
                 //remote->sendMeterSource.measureBlock (workBuffer);
                 
@@ -8027,7 +9208,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
                 // now process echo and latency stuff
                 
                 workBuffer.clear(0, 0, numSamples);
-                if (remote->echosink->process((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
+                if (remote->echosink->process_add((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
                     //DBG("received something from our ECHO sink");
                     remote->echosource->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
                 }
@@ -8035,7 +9216,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
                 
                 if (remote->activeLatencyTest && remote->latencyMeasurer) {
                     workBuffer.clear(0, 0, numSamples);
-                    if (remote->latencysink->process((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
+                    if (remote->latencysink->process_add((float **)workBuffer.getArrayOfWritePointers(), numSamples, t)) {
                         //DBG("received something from our latency sink");
                     }
 
@@ -8064,6 +9245,19 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
             ++i;
         }
 
+        // the peers sharing the relay group stream all get the plain send mix
+        if (mRelayGroupSender && mRelayGroupSender->getNumMembers() > 0) {
+            workBuffer.clear(0, numSamples);
+
+            const int groupchans = mRelayGroupSender->getNumChannels();
+            for (int channel = 0; channel < groupchans && channel < sendWorkBuffer.getNumChannels() && channel < workBuffer.getNumChannels(); ++channel) {
+                workBuffer.addFrom(channel, 0, sendWorkBuffer, channel, 0, numSamples);
+            }
+
+            SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StagePeerSourceProcess);
+            mRelayGroupSender->getSource()->process((const float **)workBuffer.getArrayOfReadPointers(), numSamples, t);
+        }
+
         // update last state
         for (auto & remote : mRemotePeers) 
         {
@@ -8108,9 +9302,7 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
         float egain = mainReverbEnabled ? 1.0f : 0.0f;
         
         if (mainReverbEnabled) {
-            mMainReverb->reset();
-            mMReverb.reset();
-            mZitaReverb.instanceClear();
+            mMainReverbNeedsReset = true;
         }
 
         /*
@@ -8155,36 +9347,12 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
     
 
     if (doreverb) {
-        // assumes reverb is NO dry
-        
-        if (mReverbParamsChanged) {
-            mMainReverb->setParameters(mMainReverbParams);
-            mReverbParamsChanged = false;
-        }
-        
-        if (mLastReverbModel != mMainReverbModel.get()) {
-            mMReverb.reset();
-            mMainReverb->reset();
-            mZitaReverb.instanceClear();
-        }
-        
-        if (mMainReverbModel.get() == ReverbModelMVerb) {
-            if (mainBusOutputChannels > 1) {            
-                mMReverb.process((float **)mainFxBuffer.getArrayOfWritePointers(), (float **)mainFxBuffer.getArrayOfWritePointers(), numSamples);
-            } 
-        }
-        else if (mMainReverbModel.get() == ReverbModelZita) {
-            if (mainBusOutputChannels > 1) {            
-                mZitaReverb.compute(numSamples, (float **)mainFxBuffer.getArrayOfWritePointers(), (float **)mainFxBuffer.getArrayOfWritePointers());
-            }
-        }
-        else {
-            if (mainBusOutputChannels > 1) {            
-                mMainReverb->processStereo(mainFxBuffer.getWritePointer(0), mainFxBuffer.getWritePointer(1), numSamples);
-            } else {
-                mMainReverb->processMono(mainFxBuffer.getWritePointer(0), numSamples);
-            }            
-        }
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageMainReverb);
+
+        mFxPipeline->process(FxLaneMainReverb, mainFxBuffer, jmin(2, mainBusOutputChannels), numSamples);
+    }
+    else {
+        mFxPipeline->flush(FxLaneMainReverb);
     }
 
     if (mLastHasMainFx != hasmainfx) {
@@ -8196,7 +9364,6 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
 
     mLastHasMainFx = hasmainfx;
     mLastMainReverbEnabled = mainReverbEnabled;
-    mLastReverbModel = (ReverbModel) mMainReverbModel.get();
     
     // add from main FX
     if (hasmainfx) {
@@ -8263,10 +9430,11 @@ void SonobusAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer
     }
 
     
-    outputMeterSource.measureBlock (buffer, 0, numSamples);
+    outputMeterSource.measureBlock (buffer, 0, numSamples, meterTime);
 
     // output to file writer if necessary
     if (writingpossible) {
+        SONO_PROFILE_STAGE(mStageProfiler, ThreadAudio, StageRecording);
         const ScopedTryLock sl (writerLock);
         if (sl.isLocked())
         {
@@ -8545,6 +9713,14 @@ void SonobusAudioProcessor::getStateInformationWithOptions(MemoryBlock& destData
     extraTree.setProperty(lastWindowHeightKey, var((int)mPluginWindowHeight), nullptr);
     extraTree.setProperty(autoresizeDropRateThreshKey, var((float)mAutoresizeDropRateThresh), nullptr);
     extraTree.setProperty(reconnectServerLossKey, mReconnectAfterServerLoss.get(), nullptr);
+    extraTree.setProperty(hubMixMinusKey, mHubMixMinus.get(), nullptr);
+    extraTree.setProperty(serverRelayKey, mServerRelay.get(), nullptr);
+    extraTree.setProperty(reverbOnWorkerKey, mReverbOnWorkerThread, nullptr);
+    extraTree.setProperty(adaptiveRecvFormatKey, mDefaultAdaptiveRecvFormat, nullptr);
+    extraTree.setProperty(adaptiveFormatMinKey, var((int)mAdaptiveFormatMinIndex), nullptr);
+    extraTree.setProperty(adaptiveFormatMaxKey, var((int)mAdaptiveFormatMaxIndex), nullptr);
+    extraTree.setProperty(sendSilenceSuppressionKey, mSendSilenceSuppression, nullptr);
+    extraTree.setProperty(sendFecKey, mSendFec, nullptr);
 
     extraTree.appendChild(mVideoLinkInfo.getValueTree(), nullptr);
     
@@ -8716,6 +9892,16 @@ void SonobusAudioProcessor::setStateInformationWithOptions (const void* data, in
 
             setReconnectAfterServerLoss(extraTree.getProperty(reconnectServerLossKey, mReconnectAfterServerLoss.get()));
 
+            setHubMixMinusEnabled(extraTree.getProperty(hubMixMinusKey, mHubMixMinus.get()));
+            setServerRelayEnabled(extraTree.getProperty(serverRelayKey, mServerRelay.get()));
+            setReverbOnWorkerThread(extraTree.getProperty(reverbOnWorkerKey, mReverbOnWorkerThread));
+
+            setAdaptiveRecvFormatRange(extraTree.getProperty(adaptiveFormatMinKey, (int)mAdaptiveFormatMinIndex),
+                                       extraTree.getProperty(adaptiveFormatMaxKey, (int)mAdaptiveFormatMaxIndex));
+            setDefaultAdaptiveRecvFormat(extraTree.getProperty(adaptiveRecvFormatKey, mDefaultAdaptiveRecvFormat));
+            setSendSilenceSuppression(extraTree.getProperty(sendSilenceSuppressionKey, mSendSilenceSuppression));
+            setSendFecEnabled(extraTree.getProperty(sendFecKey, mSendFec));
+
             
             ValueTree videoinfo = extraTree.getChildWithName(videoLinkInfoKey);
             if (videoinfo.isValid()) {
@@ -8844,6 +10030,12 @@ void SonobusAudioProcessor::ServerReconnectTimer::timerCallback()
     }
 }
 
+void SonobusAudioProcessor::HubGroupCheckTimer::timerCallback()
+{
+    stopTimer();
+    processor.removeDirectPeersInHubGroups();
+}
+
 bool SonobusAudioProcessor::reconnectToMostRecent()
 {
     Array<AooServerConnectionInfo> recents;
@@ -9588,10 +10780,47 @@ void SonobusAudioProcessor::clearTransportURL()
     // unload the previous file source and delete it..
     mTransportSource.stop();
     mTransportSource.setSource (nullptr);
+    if (mMappedFileWarmer) {
+        mDiskThread.removeTimeSliceClient(mMappedFileWarmer.get());
+        mMappedFileWarmer.reset();
+    }
+    mPendingMappedReader.reset();
     mCurrentAudioFileSource.reset();
     mCurrTransportURL = URL();
 }
 
+void SonobusAudioProcessor::switchToMappedTransportReader()
+{
+    // setSource() stops the transport, so don't interrupt playback for this
+    if (!mPendingMappedReader || !mMappedFileWarmer || !mMappedFileWarmer->isFinished() || mTransportSource.isPlaying()) {
+        return;
+    }
+
+    mDiskThread.removeTimeSliceClient(mMappedFileWarmer.get());
+    mMappedFileWarmer.reset();
+
+    const double position = mTransportSource.getCurrentPosition();
+    const bool looping = mTransportSource.isLooping();
+    int64 loopstart = 0, looplength = 0;
+    mTransportSource.getLoopRange(loopstart, looplength);
+
+    DBG("Playing memory-mapped file: " << mCurrTransportURL.getLocalFile().getFullPathName());
+
+    auto * reader = mPendingMappedReader.release();
+
+    mTransportSource.setSource (nullptr);
+    mCurrentAudioFileSource.reset (new AudioFormatReaderSource (reader, true));
+    mTransportSource.setSource (mCurrentAudioFileSource.get(),
+                                0,                       // no read-ahead, it's all in memory
+                                nullptr,
+                                reader->sampleRate,     // allows for sample rate correction
+                                reader->numChannels);
+
+    mTransportSource.setLooping(looping);
+    mTransportSource.setLoopRange(loopstart, looplength);
+    mTransportSource.setPosition(position);
+}
+
 bool SonobusAudioProcessor::loadURLIntoTransport (const URL& audioURL)
 {
     if (!mDiskThread.isThreadRunning()) {
@@ -9607,6 +10836,12 @@ bool SonobusAudioProcessor::loadURLIntoTransport (const URL& audioURL)
     if (audioURL.isLocalFile())
     {
         reader = mFormatManager.createReaderFor (audioURL.getLocalFile());
+
+        // uncompressed files get played right out of memory once they're paged in,
+        // until then they go through the buffered reader like everything else
+        if (reader != nullptr) {
+            mPendingMappedReader.reset (SonoAudio::createMappedAudioReader(mFormatManager, audioURL.getLocalFile()));
+        }
     }
     else
 #endif
@@ -9653,6 +10888,13 @@ bool SonobusAudioProcessor::loadURLIntoTransport (const URL& audioURL)
                                     reader->sampleRate,     // allows for sample rate correction
                                     reader->numChannels);
 
+        if (mPendingMappedReader) {
+            // get the pages in before the audio thread reads them
+            mMappedFileWarmer = std::make_unique<SonoAudio::MappedReaderWarmer>(*mPendingMappedReader);
+            mMappedFileWarmer->addChangeListener(this);
+            mDiskThread.addTimeSliceClient(mMappedFileWarmer.get());
+        }
+
         return true;
     }
 
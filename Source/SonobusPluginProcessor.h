@@ -21,6 +21,12 @@
 #include "zitaRev.h"
 
 #include "SoundboardChannelProcessor.h"
+#include "StageProfiler.h"
+#include "MpscQueue.h"
+#include "FxPipeline.h"
+#include "MappedAudioReader.h"
+#include "PersistentThumbnailCache.h"
+#include "RelayGroupSender.h"
 
 typedef MVerb<float> MVerbFloat;
 
@@ -28,6 +34,8 @@ namespace SonoAudio {
 class Metronome;
 }
 
+class SonobusSessionHost;
+
 
 #define MAX_PEERS 32
 #define MAX_CHANGROUPS 64
@@ -117,7 +125,8 @@ class SonobusAudioProcessor  : public AudioProcessor, public AudioProcessorValue
 {
 public:
     //==============================================================================
-    SonobusAudioProcessor();
+    // with a session host, the udp socket and network threads are shared with its other sessions
+    SonobusAudioProcessor(SonobusSessionHost * sessionHost = nullptr, int sessionIndex = 0);
     ~SonobusAudioProcessor();
 
     enum AutoNetBufferMode {
@@ -324,6 +333,7 @@ public:
     EndpointState * findOrAddRawEndpoint(void * rawaddr);
 
     int getUdpLocalPort() const { return mUdpLocalPort; }
+    bool isHostedSession() const { return mSessionHost != nullptr; }
     IPAddress getLocalIPAddress() const { return mLocalIPAddress; }
     
 
@@ -445,6 +455,8 @@ public:
 
     int64_t getRemotePeerPacketsDropped(int index) const;
     int64_t getRemotePeerPacketsResent(int index) const;
+    int64_t getRemotePeerPacketsRecovered(int index) const;
+    int64_t getRemotePeerParityPacketsReceived(int index) const;
     void    resetRemotePeerPacketStats(int index);
 
     bool getRemotePeerSafetyMuted(int index) const;
@@ -457,6 +469,12 @@ public:
         float outgoingMs = 0.0f;
         float incomingMs = 0.0f;
         float jitterMs = 0.0f;
+        // remote clock minus ours, estimated from the pings
+        float clockOffsetMs = 0.0f;
+        float clockUncertaintyMs = 0.0f;
+        bool clockSynced = false;
+        // incoming/outgoing use the measured one-way delay instead of half the ping time
+        bool oneWayMeasured = false;
         bool isreal = false;
         bool estimated = false;
         bool legacy = false;
@@ -467,6 +485,49 @@ public:
     bool startRemotePeerLatencyTest(int index, float durationsec = 1.0);
     bool stopRemotePeerLatencyTest(int index);
     bool isRemotePeerLatencyTestActive(int index);
+
+    // plain-data copy of the per-peer status shown by the peer views,
+    // gathered once per event thread tick so the UI (or any other frontend)
+    // doesn't have to take the core lock for every individual getter
+    struct PeerStats
+    {
+        bool connected = false;
+        bool sendActive = false;
+        bool sendAllow = false;
+        bool recvActive = false;
+        bool recvAllow = false;
+        bool latencyTestActive = false;
+        bool safetyMuted = false;
+        bool blockedUs = false;
+        int recvChannels = 0;
+        int actualSendChannels = 0;
+        int64 bytesSent = 0;
+        int64 bytesReceived = 0;
+        int64 packetsDropped = 0;
+        int64 packetsResent = 0;
+        int64 packetsRecovered = 0;
+        int64 parityPacketsReceived = 0;
+        float fillRatio = 0.0f;
+        float fillRatioStdev = 0.0f;
+        float bufferTimeMs = 0.0f;
+        int autoBufferMode = 0; // AutoNetBufferMode
+        bool autoBufferInitCompleted = false;
+        int sendFormatIndex = -1;
+        int reqRemoteSendFormatIndex = -1;
+        char recvFormatName[32] = {0};
+        LatencyInfo latency;
+    };
+
+    struct PeerStatsSnapshot
+    {
+        uint32 version = 0;
+        int numPeers = 0;
+        PeerStats peers[MAX_PEERS];
+    };
+
+    // copies out the most recently published snapshot without locking, safe from any thread.
+    // returns false if nothing has been published yet. it's republished every 20 ms
+    bool getPeerStatsSnapshot(PeerStatsSnapshot & retsnap) const;
     
     
     bool isAnyRemotePeerRecording() const;
@@ -562,6 +623,24 @@ public:
     void setChangingDefaultRecvAudioCodecSetsExisting(bool flag) { mChangingDefaultRecvAudioCodecChangesAll = flag; }
     bool getChangingDefaultRecvAudioCodecSetsExisting() const { return mChangingDefaultRecvAudioCodecChangesAll;}
 
+    // also applies to all currently connected peers
+    void setDefaultAdaptiveRecvFormat(bool flag);
+    bool getDefaultAdaptiveRecvFormat() const { return mDefaultAdaptiveRecvFormat; }
+
+    // stop sending audio data to peers while our send signal is silent,
+    // also applies to all currently connected peers
+    void setSendSilenceSuppression(bool flag);
+    bool getSendSilenceSuppression() const { return mSendSilenceSuppression; }
+
+    // send parity packets to peers so they can rebuild a lost packet without waiting
+    // for a resend, also applies to all currently connected peers
+    void setSendFecEnabled(bool flag);
+    bool getSendFecEnabled() const { return mSendFec; }
+
+    // range of format indexes the adaptive quality will step within
+    void setAdaptiveRecvFormatRange(int minFormatIndex, int maxFormatIndex);
+    void getAdaptiveRecvFormatRange(int & retMinFormatIndex, int & retMaxFormatIndex) const { retMinFormatIndex = mAdaptiveFormatMinIndex; retMaxFormatIndex = mAdaptiveFormatMaxIndex; }
+
     
     String getAudioCodeFormatName(int formatIndex) const;
     bool getAudioCodeFormatInfo(int formatIndex, AudioCodecFormatInfo & retinfo) const;
@@ -615,13 +694,29 @@ public:
     bool getRemotePeerReceiveAudioCodecFormat(int index, AudioCodecFormatInfo & retinfo) const;
     bool setRequestRemotePeerSendAudioCodecFormat(int index, int formatIndex);
     int getRequestRemotePeerSendAudioCodecFormat(int index) const; // -1 is no preferences
+
+    // adaptive receive quality, automatically requests the remote end to step
+    // its send format up or down within the adaptive range based on loss and ping trends
+    void setRemotePeerAdaptiveRecvFormat(int index, bool flag);
+    bool getRemotePeerAdaptiveRecvFormat(int index) const;
+    // current estimate of available bandwidth in bits/s per channel, 0 if unknown
+    float getRemotePeerAdaptiveBandwidthEstimate(int index) const;
     
     int getRemotePeerSendPacketsize(int index) const;
     void setRemotePeerSendPacketsize(int index, int psize);
 
+    // parity FEC group size for sending to this peer, 0 is off
+    int getRemotePeerSendFecGroupSize(int index) const;
+    void setRemotePeerSendFecGroupSize(int index, int groupsize);
+
     int getRemotePeerOrderPriority(int index) const;
     void setRemotePeerOrderPriority(int index, int priority);
 
+    // send to this peer through the connection server's relay instead of directly,
+    // returns false if the server doesn't relay or the peer didn't come through it
+    bool getRemotePeerUseRelay(int index) const;
+    bool setRemotePeerUseRelay(int index, bool flag);
+
     // select by index or by peer, or don't specify for all
     void updateRemotePeerUserFormat(int index=-1, RemotePeer * onlypeer=nullptr);
 
@@ -773,6 +868,22 @@ public:
     bool getReconnectAfterServerLoss() const { return mReconnectAfterServerLoss.get(); }
     void setReconnectAfterServerLoss(bool flag) { mReconnectAfterServerLoss = flag; }
 
+    // act as a mixing hub: each peer is sent everyone else's audio (mix-minus) along with
+    // our own input, so participants only need to be connected to the hub. overrides the send matrix.
+    // participants that hear from a hub drop their direct connections to the rest of its group
+    bool getHubMixMinusEnabled() const { return mHubMixMinus.get(); }
+    void setHubMixMinusEnabled(bool flag);
+
+    // let our own connection server (standalone only) relay packets between group members
+    // that can't reach each other directly
+    bool getServerRelayEnabled() const { return mServerRelay.get(); }
+    void setServerRelayEnabled(bool flag);
+
+    // process the main and input reverbs on a separate thread, which adds the maximum
+    // block size of latency to the reverb output only
+    void setReverbOnWorkerThread(bool flag);
+    bool getReverbOnWorkerThread() const { return mReverbOnWorkerThread; }
+
 
     PeerDisplayMode getPeerDisplayMode() const { return mPeerDisplayMode; }
     void setPeerDisplayMode(PeerDisplayMode mode) { mPeerDisplayMode = mode; }
@@ -795,6 +906,7 @@ public:
     URL getCurrentLoadedTransportURL () const { return mCurrTransportURL; }
     AudioTransportSource & getTransportSource() { return mTransportSource; }
     AudioFormatManager & getFormatManager() { return mFormatManager; }
+    SonoAudio::PersistentThumbnailCache & getThumbnailCache() { return *mThumbnailCache; }
 
     // chat
     bool sendChatEvent(const SBChatEvent & event);
@@ -828,6 +940,11 @@ public:
     void setUseUniversalFont(bool flag) { mUseUniversalFont = flag; }
     bool getUseUniversalFont() const { return mUseUniversalFont; }
 
+    // per-stage timing instrumentation
+    void setStageProfilingEnabled(bool flag) { mStageProfiler.setEnabled(flag); }
+    bool getStageProfilingEnabled() const { return mStageProfiler.isEnabled(); }
+    SonoAudio::StageProfiler & getStageProfiler() { return mStageProfiler; }
+
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SonobusAudioProcessor)
@@ -859,28 +976,51 @@ private:
 
     
     void initializeAoo(int udpPort=0);
+    void startNetworkThreads();
     void cleanupAoo();
     
     void doReceiveData();
+    void handleReceivedPacket(const char * buf, int nbytes, const String & senderIP, int senderPort);
+    // only for aoo client/peer messages, doesn't add an endpoint for the sender.
+    // returns true if it was relayed data, which has been routed on through the session host
+    bool handleClientPacket(const char * buf, int nbytes, const String & senderIP, int senderPort);
+    // gets the packet a peer sent us through the connection server's relay, and who sent it
+    bool unwrapRelayedPacket(const char * buf, int nbytes, void * rawaddr,
+                             const char *& data, int32_t & size, String & peerIP, int & peerPort);
+    EndpointState * findEndpoint(const String & host, int port);
     void doSendData();
     void handleEvents();
 
     bool handleOtherMessage(EndpointState * endpoint, const char *msg, int32_t n);
+    // called on the recv thread, handles pings inline and queues the rest for the control thread
+    bool dispatchOtherMessage(EndpointState * endpoint, const char *msg, int32_t n);
+    void handleQueuedControlMessages();
 
     int32_t sendPeerMessage(RemotePeer * peer, const char *msg, int32_t n);
 
     void handleRemotePeerInfoUpdate(RemotePeer * peer, const juce::var & infodata);
     void sendRemotePeerInfoUpdate(int peerindex = -1, RemotePeer * topeer = nullptr);
+    void removeDirectPeersInHubGroups();
 
+    // message thread, swaps in the warmed up mapped reader while playback is stopped
+    void switchToMappedTransportReader();
 
     void handlePingEvent(EndpointState * endpoint, uint64_t tt1, uint64_t tt2, uint64_t tt3);
+    bool getRemotePeerTransitStats(RemotePeer * peer, aoo_transit_stats & retstats) const;
 
     void sendPingEvent(RemotePeer * peer);
 
     void updateSafetyMuting(RemotePeer * peer);
 
+    void updateAdaptiveRecvFormat(RemotePeer * peer, double nowtimems);
+    bool requestRemotePeerSendFormat(RemotePeer * peer, int formatIndex);
+    float getFormatBitrate(int formatIndex) const;
+
     void setupSourceFormat(RemotePeer * peer, aoo::isource * source, bool latencymode=false);
-    bool formatInfoToAooFormat(const AudioCodecFormatInfo & info, int channels, aoo_format_storage & retformat);
+    void updateRemoteSinkFlags(RemotePeer * peer, int32_t flags);
+    void updateRelayGroup();
+    // coupled: code a 2 channel Opus stream as one stereo stream (the receiver must support AOO_PROTOCOL_FLAG_OPUS_LAYOUT)
+    bool formatInfoToAooFormat(const AudioCodecFormatInfo & info, int channels, aoo_format_storage & retformat, bool coupled=false);
 
     void setupSourceUserFormat(RemotePeer * peer, aoo::isource * source);
 
@@ -896,6 +1036,10 @@ private:
     bool removeAllRemotePeersWithEndpoint(EndpointState * endpoint);
 
     void adjustRemoteSendMatrix(int index, bool removed);
+    // rebuilds the per destination source lists from mRemoteSendMatrix (audio thread)
+    void compileSendRoutes();
+    // adds the received audio of a peer, panned for the destination channel count
+    void addRemotePeerToSendMix(RemotePeer * source, AudioSampleBuffer & dest, int destStartChannel, int destChannels, int numSamples, float gain);
 
     void commitCompressorParams(RemotePeer * peer, int changroup);
     void commitInputCompressorParams(int changroup);
@@ -920,7 +1064,7 @@ private:
 
     int connectRemotePeerRaw(void * sockaddr, const String & username = "", const String & groupname = "", bool reciprocate=true);
 
-    int findFormatIndex(AudioCodecFormatCodec codec, int bitrate, int bitdepth);
+    int findFormatIndex(AudioCodecFormatCodec codec, int bitrate, int bitdepth) const; // -1 if not found
 
     void ensureBuffers(int samples);
 
@@ -947,6 +1091,7 @@ private:
     
     AudioSampleBuffer tempBuffer;
     AudioSampleBuffer mixBuffer;
+    AudioSampleBuffer hubMixBuffer;
     AudioSampleBuffer workBuffer;
     AudioSampleBuffer inputBuffer;
     AudioSampleBuffer monitorBuffer;
@@ -994,6 +1139,8 @@ private:
     Atomic<bool>   mSyncMetToHost  { false };
     Atomic<bool>   mSyncMetStartToPlayback  { false };
     Atomic<bool>   mReconnectAfterServerLoss  { true };
+    Atomic<bool>   mHubMixMinus  { false };
+    Atomic<bool>   mServerRelay  { false };
 
     Atomic<float>   mInputReverbLevel  { 1.0f };
     Atomic<float>   mInputReverbSize  { 0.15f };
@@ -1021,6 +1168,13 @@ private:
     bool mChangingDefaultAudioCodecChangesAll = false;
     bool mChangingDefaultRecvAudioCodecChangesAll = false;
 
+    bool mDefaultAdaptiveRecvFormat = false;
+    int mAdaptiveFormatMinIndex = 2; // 48 kbps/ch
+    int mAdaptiveFormatMaxIndex = 5; // 128 kbps/ch
+
+    bool mSendSilenceSuppression = true;
+    bool mSendFec = false;
+
     RangedAudioParameter * mDefaultAutoNetbufModeParam;
     RangedAudioParameter * mTempoParameter;
 
@@ -1080,6 +1234,13 @@ private:
 
     // AOO stuff
     aoo::isource::pointer mAooDummySource;
+    // one upload for all of the peers we reach through the relay, see updateRelayGroup()
+    std::unique_ptr<SonoAudio::RelayGroupSender> mRelayGroupSender;
+
+    // one time filter driven by the audio callback, shared by all our aoo sources and sinks.
+    // lives as long as the processor, and is only set up when no audio is processed
+    // (prepareToPlay) or from the audio thread itself
+    aoo_clock * mAudioClock = nullptr;
 
     aoo::net::iserver::pointer mAooServer;
     aoo::net::iclient::pointer mAooClient;
@@ -1101,12 +1262,18 @@ private:
     
     
     std::unique_ptr<DatagramSocket> mUdpSocket;
+    DatagramSocket * mSocket = nullptr; // our own, or the one shared by the session host
     int mUdpLocalPort;
     IPAddress mLocalIPAddress;
+
+    friend class SonobusSessionHost;
+    SonobusSessionHost * mSessionHost = nullptr;
+    int32_t mAooIdBase = 0; // our sink/source ids start here, so the session host can route by id
     
     class SendThread;
     class RecvThread;
     class EventThread;
+    class ControlThread;
     class ServerThread;
     class ClientThread;
     
@@ -1139,6 +1306,20 @@ private:
     };
 
     ServerReconnectTimer mReconnectTimer;
+
+    // coalesces the peer info updates that want removeDirectPeersInHubGroups()
+    class HubGroupCheckTimer : public Timer
+    {
+    public:
+        HubGroupCheckTimer(SonobusAudioProcessor & proc) : processor(proc) {
+        }
+        
+        void timerCallback() override;
+        
+        SonobusAudioProcessor & processor;
+    };
+
+    HubGroupCheckTimer mHubGroupCheckTimer;
     
     CriticalSection  mRemotesLock;
 
@@ -1162,20 +1343,35 @@ private:
     void initFormats();
     
     bool mRemoteSendMatrix[MAX_PEERS][MAX_PEERS];
+    // sparse version of the matrix, which sources go to each destination
+    int mSendRouteSources[MAX_PEERS][MAX_PEERS];
+    int mSendRouteCount[MAX_PEERS] = { 0 };
+    Atomic<bool> mSendRoutesDirty { true };
     
     
-    void notifySendThread() {
-        mNeedSendSentinel += 1;
-        mSendWaitable.signal();
-    }
+    void notifySendThread();
+    void notifyControlThread();
     
     WaitableEvent  mSendWaitable;
     Atomic<int>   mNeedSendSentinel  { 0 };
 
+    // non-audio /sb messages received on the recv thread, handled by the control thread.
+    // endpoint stays valid because mEndpoints is only cleared in cleanupAoo(), after the
+    // threads that push and pop these have stopped (or the session is out of its host) and the queue is drained
+    struct ControlMessage {
+        EndpointState * endpoint = nullptr;
+        int32_t size = 0;
+        char data[AOO_MAXPACKETSIZE];
+    };
+
+    SonoAudio::MpscQueue<ControlMessage, 64> mControlQueue;
+    WaitableEvent  mControlWaitable;
+
 
     std::unique_ptr<SendThread> mSendThread;
     std::unique_ptr<RecvThread> mRecvThread;
     std::unique_ptr<EventThread> mEventThread;
+    std::unique_ptr<ControlThread> mControlThread;
     std::unique_ptr<ServerThread> mServerThread;
     std::unique_ptr<ClientThread> mClientThread;
 
@@ -1196,6 +1392,17 @@ private:
     // input reverb
     MVerbFloat mInputReverb;
 
+    // the reverbs run from these, either inline or on the fx pipeline worker
+    void processMainReverb(AudioBuffer<float> & fxbuffer, int numChannels, int numSamples);
+    void processInputReverb(AudioBuffer<float> & revbuffer, int numChannels, int numSamples);
+    // set on the audio thread, consumed by whoever processes the next reverb block
+    std::atomic<bool> mMainReverbNeedsReset { false };
+    std::atomic<bool> mInputReverbNeedsReset { false };
+
+    enum { FxLaneMainReverb = 0, FxLaneInputReverb, FxLaneCount };
+    std::unique_ptr<SonoAudio::FxPipeline> mFxPipeline;
+    bool mReverbOnWorkerThread = false;
+
 
     // met and playback channel groups
     SonoAudio::ChannelGroup  mMetChannelGroup;
@@ -1241,7 +1448,13 @@ private:
     AudioTransportSource mTransportSource;
     std::unique_ptr<AudioFormatReaderSource> mCurrentAudioFileSource;
     AudioFormatManager mFormatManager;
+    // a memory-mapped reader for the loaded file, played instead of the buffered one once
+    // the warmer has paged it all in. Both declared before the thread so they outlive it
+    std::unique_ptr<MemoryMappedAudioFormatReader> mPendingMappedReader;
+    std::unique_ptr<SonoAudio::MappedReaderWarmer> mMappedFileWarmer;
     TimeSliceThread mDiskThread  { "audio file reader" };
+    // waveform thumbnails, shared by the editors and kept on disk in the support dir
+    std::unique_ptr<SonoAudio::PersistentThumbnailCache> mThumbnailCache;
     URL mCurrTransportURL;
     bool mTransportWasPlaying = false;
 
@@ -1250,6 +1463,18 @@ private:
 
     // metronome
     std::unique_ptr<SonoAudio::Metronome> mMetronome;
+
+    // stage timing, rings are drained by the event thread
+    SonoAudio::StageProfiler mStageProfiler;
+
+    // called from the event thread, fills the back buffer and flips it
+    void publishPeerStats();
+    void fillPeerStats(PeerStatsSnapshot & snap) const;
+
+    // double-buffered, the writer fills mPeerStats[(version+1) & 1] then
+    // bumps the version, readers retry if it changed at all while copying
+    PeerStatsSnapshot mPeerStats[2];
+    std::atomic<uint32> mPeerStatsVersion { 0 };
    
     // misc
     bool mSliderSnapToMouse = true;
@@ -0,0 +1,524 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "SonobusSessionHost.h"
+
+#include "aoo/aoo_net.h"
+
+// how many datagrams the recv thread drains before waiting on the socket again
+#define MAX_RECV_BATCH 64
+
+
+class SonobusSessionHost::SendThread : public juce::Thread
+{
+public:
+    SendThread(SonobusSessionHost & host) : Thread("SonoBusHostSendThread") , _host(host)
+    {}
+
+    void run() override {
+
+        setPriority(Thread::Priority::highest);
+
+        bool shouldwait = false;
+
+        while (!threadShouldExit()) {
+
+            if (shouldwait) {
+                _host.mSendWaitable.wait(20);
+            }
+
+            auto sentinel = _host.mNeedSendSentinel.get();
+
+            _host.doSendData();
+
+            shouldwait = (sentinel == _host.mNeedSendSentinel.get());
+        }
+        DBG("Host send thread finishing");
+    }
+
+    SonobusSessionHost & _host;
+};
+
+class SonobusSessionHost::RecvThread : public juce::Thread
+{
+public:
+    RecvThread(SonobusSessionHost & host) : Thread("SonoBusHostRecvThread") , _host(host)
+    {}
+
+    void run() override {
+
+        setPriority(Thread::Priority::highest);
+
+        while (!threadShouldExit()) {
+
+            if (_host.mUdpSocket->waitUntilReady(true, 20) == 1) {
+                _host.doReceiveData();
+            }
+        }
+
+        DBG("Host recv thread finishing");
+    }
+
+    SonobusSessionHost & _host;
+};
+
+class SonobusSessionHost::EventThread : public juce::Thread
+{
+public:
+    EventThread(SonobusSessionHost & host) : Thread("SonoBusHostEventThread") , _host(host)
+    {}
+
+    void run() override {
+
+        while (!threadShouldExit()) {
+
+            Thread::sleep(20);
+
+            _host.handleEvents();
+        }
+
+        DBG("Host event thread finishing");
+    }
+
+    SonobusSessionHost & _host;
+};
+
+class SonobusSessionHost::ControlThread : public juce::Thread
+{
+public:
+    ControlThread(SonobusSessionHost & host) : Thread("SonoBusHostControlThread") , _host(host)
+    {}
+
+    void run() override {
+
+        while (!threadShouldExit()) {
+
+            _host.mControlWaitable.wait(50);
+
+            _host.handleQueuedControlMessages();
+        }
+
+        DBG("Host control thread finishing");
+    }
+
+    SonobusSessionHost & _host;
+};
+
+
+SonobusSessionHost::SonobusSessionHost()
+{
+}
+
+SonobusSessionHost::~SonobusSessionHost()
+{
+    shutdown();
+}
+
+bool SonobusSessionHost::initialize(int udpPort)
+{
+    shutdown();
+
+    mUdpSocket = std::make_unique<DatagramSocket>();
+    mUdpSocket->setSendBufferSize(1048576);
+    mUdpSocket->setReceiveBufferSize(1048576);
+
+    if (!mUdpSocket->bindToPort(udpPort)) {
+        DBG("Session host could not bind to udp port " << udpPort);
+        mUdpSocket.reset();
+        return false;
+    }
+
+    mUdpLocalPort = mUdpSocket->getBoundPort();
+    DBG("Session host bound udp port " << mUdpLocalPort);
+
+    mSendThread = std::make_unique<SendThread>(*this);
+    mRecvThread = std::make_unique<RecvThread>(*this);
+    mEventThread = std::make_unique<EventThread>(*this);
+    mControlThread = std::make_unique<ControlThread>(*this);
+
+    uint32_t estWorkDurationMs = 10; // just a guess
+    int rtprio = 1; // all that is necessary
+
+#if JUCE_WINDOWS
+    mSendThread->startThread(Thread::Priority::highest);
+    mRecvThread->startThread(Thread::Priority::highest);
+#else
+    if (!mSendThread->startRealtimeThread( juce::Thread::RealtimeOptions{}.withPriority(rtprio).withMaximumProcessingTimeMs(estWorkDurationMs)))
+    {
+        DBG("Host send thread failed to start realtime: trying regular");
+        mSendThread->startThread(Thread::Priority::highest);
+    }
+
+    if (!mRecvThread->startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(rtprio).withMaximumProcessingTimeMs(estWorkDurationMs)))
+    {
+        DBG("Host recv thread failed to start realtime: trying regular");
+        mRecvThread->startThread(Thread::Priority::highest);
+    }
+#endif
+
+    mEventThread->startThread(Thread::Priority::normal);
+    mControlThread->startThread(Thread::Priority::normal);
+
+    return true;
+}
+
+void SonobusSessionHost::shutdown()
+{
+    // sessions first, while the socket is still there for their goodbyes
+    for (int i = 0; i < MaxSessions; ++i) {
+        removeSession(i);
+    }
+
+    if (mRecvThread) {
+        mRecvThread->stopThread(400);
+        mSendThread->stopThread(400);
+        mEventThread->stopThread(400);
+        mControlThread->signalThreadShouldExit();
+        mControlWaitable.signal();
+        mControlThread->stopThread(400);
+
+        mRecvThread.reset();
+        mSendThread.reset();
+        mEventThread.reset();
+        mControlThread.reset();
+    }
+
+    mUdpSocket.reset();
+    mUdpLocalPort = 0;
+}
+
+int SonobusSessionHost::addSession()
+{
+    if (!mUdpSocket) return -1;
+
+    const ScopedLock cl (mSessionsChangeLock);
+
+    int index = -1;
+    for (int i = 0; i < MaxSessions; ++i) {
+        if (!mSessions[i]) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        DBG("No free session slots");
+        return -1;
+    }
+
+    // construct and prepare it before any of our threads can see it
+    auto session = std::make_unique<SonobusAudioProcessor>(this, index);
+
+    if (mSampleRate > 0.0) {
+        prepareSession(*session, mSessionBuffers[index]);
+    }
+
+    {
+        const ScopedWriteLock sl (mSessionsLock);
+        mSessions[index] = std::move(session);
+    }
+
+    return index;
+}
+
+void SonobusSessionHost::removeSession(int index)
+{
+    if (index < 0 || index >= MaxSessions) return;
+
+    const ScopedLock cl (mSessionsChangeLock);
+
+    std::unique_ptr<SonobusAudioProcessor> session;
+
+    {
+        const ScopedWriteLock sl (mSessionsLock);
+        session = std::move(mSessions[index]);
+    }
+
+    if (session && mSampleRate > 0.0) {
+        session->releaseResources();
+    }
+
+    // destroyed here, outside the lock, its cleanup may take a while
+}
+
+SonobusAudioProcessor * SonobusSessionHost::getSession(int index) const
+{
+    if (index < 0 || index >= MaxSessions) return nullptr;
+    const ScopedReadLock sl (mSessionsLock);
+    return mSessions[index].get();
+}
+
+int SonobusSessionHost::getNumSessions() const
+{
+    const ScopedReadLock sl (mSessionsLock);
+    int count = 0;
+    for (auto & session : mSessions) {
+        if (session) ++count;
+    }
+    return count;
+}
+
+void SonobusSessionHost::doReceiveData()
+{
+    // relayed packets come wrapped
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
+    String senderIP;
+    int senderPort;
+
+    const ScopedReadLock sl (mSessionsLock);
+
+    // drain what is already waiting rather than going back through the wait for every datagram
+    for (int count = 0; count < MAX_RECV_BATCH; ++count) {
+        if (count > 0 && mUdpSocket->waitUntilReady(true, 0) != 1) {
+            break;
+        }
+
+        int nbytes = mUdpSocket->read(buf, (int) sizeof(buf), false, senderIP, senderPort);
+
+        if (nbytes == 0) break;
+        else if (nbytes < 0) {
+            DBG("Error receiving UDP");
+            break;
+        }
+
+        routePacket(buf, nbytes, senderIP, senderPort);
+    }
+}
+
+void SonobusSessionHost::routePacket(const char * buf, int nbytes, const String & senderIP, int senderPort)
+{
+    // assumes mSessionsLock is held for reading
+    int32_t type, id;
+
+    if (aoonet_parse_pattern(buf, nbytes, &type) > 0) {
+        // connection server replies and peer pings, each session's client ignores what isn't its own.
+        // relayed data is only unwrapped once, by the first session connected to that server
+        for (auto & session : mSessions) {
+            if (session && session->handleClientPacket(buf, nbytes, senderIP, senderPort)) {
+                break;
+            }
+        }
+        return;
+    }
+
+    SonobusAudioProcessor * target = nullptr;
+
+    if (aoo_parse_pattern(buf, nbytes, &type, &id) > 0 && id > 0) {
+        // addressed to one of our sinks or sources, which are numbered within their session's range
+        auto index = id / SessionIdRange;
+        if (index < MaxSessions) {
+            target = mSessions[index].get();
+        }
+    }
+    else {
+        // compact data, the dummy source (id 0), wildcards and /sb messages don't say which session,
+        // so they go to the one that already knows the sender
+        for (auto & session : mSessions) {
+            if (session && session->findEndpoint(senderIP, senderPort)) {
+                target = session.get();
+                break;
+            }
+        }
+
+        if (!target) {
+            // someone connecting to us directly, the first session takes it
+            for (auto & session : mSessions) {
+                if (session) {
+                    target = session.get();
+                    break;
+                }
+            }
+        }
+    }
+
+    if (target) {
+        target->handleReceivedPacket(buf, nbytes, senderIP, senderPort);
+    }
+}
+
+void SonobusSessionHost::doSendData()
+{
+    const ScopedReadLock sl (mSessionsLock);
+
+    for (auto & session : mSessions) {
+        if (session) {
+            session->doSendData();
+        }
+    }
+}
+
+void SonobusSessionHost::handleEvents()
+{
+    const ScopedReadLock sl (mSessionsLock);
+
+    for (auto & session : mSessions) {
+        if (!session) continue;
+
+        session->handleEvents();
+
+        session->publishPeerStats();
+
+        if (session->mStageProfiler.isEnabled()) {
+            session->mStageProfiler.update();
+        }
+    }
+}
+
+void SonobusSessionHost::handleQueuedControlMessages()
+{
+    const ScopedReadLock sl (mSessionsLock);
+
+    for (auto & session : mSessions) {
+        if (session) {
+            session->handleQueuedControlMessages();
+        }
+    }
+}
+
+
+void SonobusSessionHost::prepareSession(SonobusAudioProcessor & session, AudioBuffer<float> & scratch)
+{
+    session.setPlayConfigDetails(mNumInputs, mNumOutputs, mSampleRate, mBlockSize);
+    session.prepareToPlay(mSampleRate, mBlockSize);
+
+    scratch.setSize(jmax(1, session.getTotalNumInputChannels(), session.getTotalNumOutputChannels()), mBlockSize);
+}
+
+void SonobusSessionHost::prepareToPlay(double sampleRate, int blockSize, int numInputs, int numOutputs)
+{
+    const ScopedLock cl (mSessionsChangeLock);
+
+    mSampleRate = sampleRate;
+    mBlockSize = blockSize;
+    mNumInputs = numInputs;
+    mNumOutputs = numOutputs;
+
+    mInputBuffer.setSize(jmax(1, numInputs), blockSize);
+    mDeviceBuffer.setSize(jmax(1, numInputs, numOutputs), blockSize);
+    mSessionMidi.ensureSize(256);
+
+    for (int i = 0; i < MaxSessions; ++i) {
+        if (mSessions[i]) {
+            prepareSession(*mSessions[i], mSessionBuffers[i]);
+        }
+    }
+}
+
+void SonobusSessionHost::releaseResources()
+{
+    const ScopedLock cl (mSessionsChangeLock);
+
+    for (auto & session : mSessions) {
+        if (session) {
+            session->releaseResources();
+        }
+    }
+
+    mSampleRate = 0.0;
+}
+
+void SonobusSessionHost::processBlock(AudioBuffer<float> & buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    jassert(numSamples <= mBlockSize);
+
+    // only fails while a session is being swapped in or out
+    const ScopedTryReadLock sl (mSessionsLock);
+
+    if (!sl.isLocked() || numSamples > mBlockSize) {
+        buffer.clear();
+        return;
+    }
+
+    const int numIns = jmin(buffer.getNumChannels(), mNumInputs);
+
+    for (int ch = 0; ch < numIns; ++ch) {
+        mInputBuffer.copyFrom(ch, 0, buffer, ch, 0, numSamples);
+    }
+
+    buffer.clear();
+
+    for (int i = 0; i < MaxSessions; ++i) {
+        auto * session = mSessions[i].get();
+        if (!session) continue;
+
+        auto & scratch = mSessionBuffers[i];
+        AudioBuffer<float> sessbuf (scratch.getArrayOfWritePointers(), scratch.getNumChannels(), numSamples);
+
+        for (int ch = 0; ch < sessbuf.getNumChannels(); ++ch) {
+            if (ch < numIns) {
+                sessbuf.copyFrom(ch, 0, mInputBuffer, ch, 0, numSamples);
+            } else {
+                sessbuf.clear(ch, 0, numSamples);
+            }
+        }
+
+        {
+            const ScopedLock cbl (session->getCallbackLock());
+
+            if (session->isSuspended()) continue;
+
+            mSessionMidi.clear();
+            session->processBlock(sessbuf, mSessionMidi);
+        }
+
+        const int numOuts = jmin(buffer.getNumChannels(), session->getMainBusNumOutputChannels());
+
+        for (int ch = 0; ch < numOuts; ++ch) {
+            buffer.addFrom(ch, 0, sessbuf, ch, 0, numSamples);
+        }
+    }
+}
+
+void SonobusSessionHost::audioDeviceIOCallbackWithContext (const float* const* inputChannelData, int numInputChannels,
+                                                           float* const* outputChannelData, int numOutputChannels,
+                                                           int numSamples, const AudioIODeviceCallbackContext& context)
+{
+    ignoreUnused(context);
+
+    if (mBlockSize <= 0) {
+        for (int ch = 0; ch < numOutputChannels; ++ch) {
+            if (outputChannelData[ch]) FloatVectorOperations::clear(outputChannelData[ch], numSamples);
+        }
+        return;
+    }
+
+    // the device may give us more than it announced, work in prepared sized pieces
+    for (int pos = 0; pos < numSamples; pos += mBlockSize) {
+        const int nframes = jmin(mBlockSize, numSamples - pos);
+
+        AudioBuffer<float> iobuf (mDeviceBuffer.getArrayOfWritePointers(), mDeviceBuffer.getNumChannels(), nframes);
+
+        for (int ch = 0; ch < iobuf.getNumChannels(); ++ch) {
+            if (ch < numInputChannels && inputChannelData[ch]) {
+                iobuf.copyFrom(ch, 0, inputChannelData[ch] + pos, nframes);
+            } else {
+                iobuf.clear(ch, 0, nframes);
+            }
+        }
+
+        processBlock(iobuf);
+
+        for (int ch = 0; ch < numOutputChannels; ++ch) {
+            if (!outputChannelData[ch]) continue;
+
+            if (ch < iobuf.getNumChannels()) {
+                FloatVectorOperations::copy(outputChannelData[ch] + pos, iobuf.getReadPointer(ch), nframes);
+            } else {
+                FloatVectorOperations::clear(outputChannelData[ch] + pos, nframes);
+            }
+        }
+    }
+}
+
+void SonobusSessionHost::audioDeviceAboutToStart (AudioIODevice* device)
+{
+    prepareToPlay(device->getCurrentSampleRate(), device->getCurrentBufferSizeSamples(),
+                  device->getActiveInputChannels().countNumberOfSetBits(),
+                  device->getActiveOutputChannels().countNumberOfSetBits());
+}
+
+void SonobusSessionHost::audioDeviceStopped()
+{
+    releaseResources();
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "SonobusPluginProcessor.h"
+
+// Runs several independent sessions (rooms) in one process.
+// Each session is a full SonobusAudioProcessor with its own peers and mixer,
+// but they all share one UDP socket and one set of send/recv/event/control threads,
+// and a single audio device callback drives all of them.
+//
+// Incoming packets are routed by aoo id when they carry one (each session's sinks and
+// sources are numbered inside their own SessionIdRange), otherwise by which session
+// already has an endpoint for the sender.
+
+class SonobusSessionHost : public AudioIODeviceCallback
+{
+public:
+    static constexpr int MaxSessions = 16;
+    // must be larger than the highest id offset a session uses (the relay group source)
+    static constexpr int32_t SessionIdRange = 100000;
+
+    SonobusSessionHost();
+    ~SonobusSessionHost() override;
+
+    // binds the shared socket (0 lets the system choose) and starts the network threads
+    bool initialize(int udpPort = 0);
+    void shutdown();
+
+    int getUdpLocalPort() const { return mUdpLocalPort; }
+
+    // returns the new session's index, or -1 if all slots are taken
+    int addSession();
+    void removeSession(int index);
+
+    // the pointer is only valid until the session is removed
+    SonobusAudioProcessor * getSession(int index) const;
+    int getNumSessions() const;
+
+    // every session gets the same input, and their main outputs are summed
+    void prepareToPlay(double sampleRate, int blockSize, int numInputs, int numOutputs);
+    void releaseResources();
+    // numSamples must not exceed the prepared block size
+    void processBlock(AudioBuffer<float> & buffer);
+
+    // AudioIODeviceCallback
+    void audioDeviceIOCallbackWithContext (const float* const* inputChannelData, int numInputChannels,
+                                           float* const* outputChannelData, int numOutputChannels,
+                                           int numSamples, const AudioIODeviceCallbackContext& context) override;
+    void audioDeviceAboutToStart (AudioIODevice* device) override;
+    void audioDeviceStopped() override;
+
+private:
+    friend class SonobusAudioProcessor;
+
+    DatagramSocket * getSocket() const { return mUdpSocket.get(); }
+
+    void notifySendThread() {
+        mNeedSendSentinel += 1;
+        mSendWaitable.signal();
+    }
+
+    void notifyControlThread() {
+        mControlWaitable.signal();
+    }
+
+    void doReceiveData();
+    void routePacket(const char * buf, int nbytes, const String & senderIP, int senderPort);
+    void doSendData();
+    void handleEvents();
+    void handleQueuedControlMessages();
+
+    void prepareSession(SonobusAudioProcessor & session, AudioBuffer<float> & scratch);
+
+    class SendThread;
+    class RecvThread;
+    class EventThread;
+    class ControlThread;
+
+    std::unique_ptr<DatagramSocket> mUdpSocket;
+    int mUdpLocalPort = 0;
+
+    // held for reading by the network threads and (try-locked) by the audio callback,
+    // for writing only while a session pointer is swapped in or out
+    ReadWriteLock mSessionsLock;
+    // serializes adding and removing sessions
+    CriticalSection mSessionsChangeLock;
+
+    std::unique_ptr<SonobusAudioProcessor> mSessions[MaxSessions];
+    AudioBuffer<float> mSessionBuffers[MaxSessions];
+
+    WaitableEvent  mSendWaitable;
+    Atomic<int>   mNeedSendSentinel  { 0 };
+    WaitableEvent  mControlWaitable;
+
+    std::unique_ptr<SendThread> mSendThread;
+    std::unique_ptr<RecvThread> mRecvThread;
+    std::unique_ptr<EventThread> mEventThread;
+    std::unique_ptr<ControlThread> mControlThread;
+
+    // audio
+    double mSampleRate = 0.0;
+    int mBlockSize = 0;
+    int mNumInputs = 0;
+    int mNumOutputs = 0;
+    AudioBuffer<float> mInputBuffer;
+    AudioBuffer<float> mDeviceBuffer;
+    MidiBuffer mSessionMidi;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SonobusSessionHost)
+};
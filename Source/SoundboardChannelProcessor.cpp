@@ -364,7 +364,7 @@ void SoundboardChannelProcessor::processMonitor(AudioBuffer<float>& otherBuffer,
     (recordChannel ? recordChannelGroup : channelGroup).processMonitor(buffer, 0, otherBuffer, dstch, dstcnt, numSamples, fgain);
 }
 
-bool SoundboardChannelProcessor::processAudioBlock(int numSamples)
+bool SoundboardChannelProcessor::processAudioBlock(int numSamples, int64 meterTime)
 {
     AudioSourceChannelInfo info(&buffer, 0, numSamples);
     mixer.getNextAudioBlock(info);
@@ -373,13 +373,12 @@ bool SoundboardChannelProcessor::processAudioBlock(int numSamples)
         return false;
     }
 
-    meterSource.measureBlock(buffer);
+    meterSource.measureBlock(buffer, 0, numSamples, meterTime);
 
     int sourceChannels = getFileSourceNumberOfChannels();
+    // the monitor delay follows the channel count by itself
     channelGroup.params.numChannels = sourceChannels;
-    channelGroup.commitMonitorDelayParams();
     recordChannelGroup.params.numChannels = sourceChannels;
-    recordChannelGroup.commitMonitorDelayParams();
 
     return true;
 }
@@ -205,9 +205,11 @@ public:
     /**
      * Process an incoming audio block.
      *
+     * @param numSamples Number of samples in the block.
+     * @param meterTime Time of the block for the meter, in milliseconds (Time::currentTimeMillis()).
      * @return true whether an audio block was processed, false otherwise.
      */
-    bool processAudioBlock(int numSamples);
+    bool processAudioBlock(int numSamples, int64 meterTime);
     void sendAudioBlock(AudioBuffer<float>& sendWorkBuffer, int numSamples, int sendPanChannels, int startChannel);
 
     void releaseResources();
@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#include "StageProfiler.h"
+
+using namespace SonoAudio;
+
+static const char * stageNames[StageProfiler::NumStages] = {
+    "processBlock",
+    "inputGroups",
+    "metering",
+    "panMix",
+    "filePlayback",
+    "metronome",
+    "inputReverb",
+    "peerSinkProcess",
+    "peerChannelGroups",
+    "peerSourceProcess",
+    "mainReverb",
+    "recording",
+    "sendThread",
+    "recvThread"
+};
+
+static const char * threadNames[StageProfiler::NumThreadSlots] = {
+    "audio",
+    "send",
+    "recv"
+};
+
+
+void StageProfiler::Histogram::clear()
+{
+    for (auto & b : buckets) b = 0;
+    count = 0;
+    sumUs = 0.0;
+    maxUs = 0.0;
+}
+
+StageProfiler::StageProfiler()
+{
+    static_assert((RingSize & (RingSize - 1)) == 0, "RingSize must be a power of two");
+
+    for (auto & win : mHistograms) {
+        for (auto & hist : win) {
+            hist.clear();
+        }
+    }
+
+    mBaseTicks = Time::getHighResolutionTicks();
+    mWindowStartMs = Time::getMillisecondCounterHiRes();
+}
+
+const char * StageProfiler::getStageName(Stage stage)
+{
+    return (stage >= 0 && stage < NumStages) ? stageNames[stage] : "unknown";
+}
+
+const char * StageProfiler::getThreadName(ThreadSlot slot)
+{
+    return (slot >= 0 && slot < NumThreadSlots) ? threadNames[slot] : "unknown";
+}
+
+void StageProfiler::setEnabled(bool flag)
+{
+    if (flag && !mEnabled.load()) {
+        // start from a clean slate
+        reset();
+    }
+    mEnabled.store(flag);
+}
+
+void StageProfiler::reset()
+{
+    const ScopedLock sl (mReaderLock);
+
+    for (auto & ring : mRings) {
+        // only drop what has been written so far, the writer keeps going
+        ring.readIndex = ring.writeIndex.load(std::memory_order_acquire);
+    }
+
+    for (auto & win : mHistograms) {
+        for (auto & hist : win) {
+            hist.clear();
+        }
+    }
+
+    mCurrWindow = 0;
+    mWindowStartMs = Time::getMillisecondCounterHiRes();
+    mBaseTicks = Time::getHighResolutionTicks();
+}
+
+void StageProfiler::record(ThreadSlot slot, Stage stage, int64 startTicks, int64 endTicks) noexcept
+{
+    auto & ring = mRings[slot];
+    auto pos = ring.writeIndex.load(std::memory_order_relaxed);
+    auto & ev = ring.events[pos & (RingSize - 1)];
+
+    ev.stage = stage;
+    ev.startTicks = startTicks;
+    ev.endTicks = endTicks;
+
+    ring.writeIndex.store(pos + 1, std::memory_order_release);
+}
+
+bool StageProfiler::readEvent(const Ring & ring, uint32 pos, Event & retevent) const
+{
+    retevent = ring.events[pos & (RingSize - 1)];
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // if the writer has wrapped around onto this slot since, it may be torn
+    return (ring.writeIndex.load(std::memory_order_relaxed) - pos) < (uint32) RingSize;
+}
+
+int StageProfiler::bucketForMicros(double us)
+{
+    if (us <= 1.0) return 0;
+    int bucket = 1 + (int) (std::log2(us) * BucketsPerOctave);
+    return jlimit(0, (int)NumBuckets - 1, bucket);
+}
+
+double StageProfiler::microsForBucket(int bucket)
+{
+    // upper edge of the bucket
+    return std::exp2(bucket / (double) BucketsPerOctave);
+}
+
+void StageProfiler::update()
+{
+    const ScopedLock sl (mReaderLock);
+
+    auto nowms = Time::getMillisecondCounterHiRes();
+    if (nowms - mWindowStartMs > WindowMs) {
+        mCurrWindow = 1 - mCurrWindow;
+        for (auto & hist : mHistograms[mCurrWindow]) {
+            hist.clear();
+        }
+        mWindowStartMs = nowms;
+    }
+
+    const double ticksPerUs = Time::getHighResolutionTicksPerSecond() * 1e-6;
+
+    for (auto & ring : mRings) {
+        auto writepos = ring.writeIndex.load(std::memory_order_acquire);
+
+        if (writepos - ring.readIndex > (uint32) RingSize) {
+            // reader fell behind, skip what was overwritten
+            ring.readIndex = writepos - RingSize;
+        }
+
+        for ( ; ring.readIndex != writepos; ++ring.readIndex) {
+            Event ev;
+            if (!readEvent(ring, ring.readIndex, ev) || ev.stage < 0 || ev.stage >= NumStages) {
+                continue;
+            }
+
+            double us = (ev.endTicks - ev.startTicks) / ticksPerUs;
+            auto & hist = mHistograms[mCurrWindow][ev.stage];
+
+            hist.buckets[bucketForMicros(us)] += 1;
+            hist.count += 1;
+            hist.sumUs += us;
+            hist.maxUs = jmax(hist.maxUs, us);
+        }
+    }
+}
+
+StageProfiler::StageStats StageProfiler::getStageStats(Stage stage) const
+{
+    StageStats stats;
+
+    if (stage < 0 || stage >= NumStages) return stats;
+
+    const ScopedLock sl (mReaderLock);
+
+    const auto & curr = mHistograms[mCurrWindow][stage];
+    const auto & prev = mHistograms[1 - mCurrWindow][stage];
+
+    stats.count = curr.count + prev.count;
+    if (stats.count == 0) return stats;
+
+    stats.meanUs = (curr.sumUs + prev.sumUs) / stats.count;
+    stats.maxUs = jmax(curr.maxUs, prev.maxUs);
+
+    const int64 p50 = (int64) std::ceil(stats.count * 0.50);
+    const int64 p95 = (int64) std::ceil(stats.count * 0.95);
+    const int64 p99 = (int64) std::ceil(stats.count * 0.99);
+
+    int64 accum = 0;
+    for (int i = 0; i < NumBuckets; ++i) {
+        auto before = accum;
+        accum += curr.buckets[i] + prev.buckets[i];
+        // clamp to the observed max so the tail isn't overstated by the bucket width
+        auto edge = jmin(microsForBucket(i), stats.maxUs);
+
+        if (before < p50 && accum >= p50) stats.p50Us = edge;
+        if (before < p95 && accum >= p95) stats.p95Us = edge;
+        if (before < p99 && accum >= p99) {
+            stats.p99Us = edge;
+            break;
+        }
+    }
+
+    return stats;
+}
+
+String StageProfiler::getSummaryText() const
+{
+    String text;
+
+    text << String("stage").paddedRight(' ', 20)
+         << String("count").paddedLeft(' ', 8)
+         << String("mean").paddedLeft(' ', 10)
+         << String("p50").paddedLeft(' ', 10)
+         << String("p95").paddedLeft(' ', 10)
+         << String("p99").paddedLeft(' ', 10)
+         << String("max").paddedLeft(' ', 10) << " (us)\n";
+
+    for (int i = 0; i < NumStages; ++i) {
+        auto stats = getStageStats((Stage) i);
+        if (stats.count == 0) continue;
+
+        text << String(stageNames[i]).paddedRight(' ', 20)
+             << String(stats.count).paddedLeft(' ', 8)
+             << String(stats.meanUs, 1).paddedLeft(' ', 10)
+             << String(stats.p50Us, 1).paddedLeft(' ', 10)
+             << String(stats.p95Us, 1).paddedLeft(' ', 10)
+             << String(stats.p99Us, 1).paddedLeft(' ', 10)
+             << String(stats.maxUs, 1).paddedLeft(' ', 10) << "\n";
+    }
+
+    return text;
+}
+
+bool StageProfiler::exportChromeTrace(const File & file) const
+{
+    // reset() moves the base, so take one consistent copy of it
+    int64 baseticks;
+    {
+        const ScopedLock sl (mReaderLock);
+        baseticks = mBaseTicks;
+    }
+
+    FileOutputStream out (file);
+
+    if (!out.openedOk()) {
+        DBG("Could not open trace file for writing: " << file.getFullPathName());
+        return false;
+    }
+
+    out.setPosition(0);
+    out.truncate();
+
+    const double ticksPerUs = Time::getHighResolutionTicksPerSecond() * 1e-6;
+    const auto pid = 1;
+    bool first = true;
+
+    out << "{\"traceEvents\":[\n";
+
+    for (int slot = 0; slot < NumThreadSlots; ++slot) {
+        // thread name metadata
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << slot
+            << ",\"args\":{\"name\":\"" << threadNames[slot] << "\"}}";
+        first = false;
+
+        const auto & ring = mRings[slot];
+        auto writepos = ring.writeIndex.load(std::memory_order_acquire);
+        uint32 startpos = writepos > (uint32) RingSize ? writepos - RingSize : 0;
+
+        for (auto pos = startpos; pos != writepos; ++pos) {
+            Event ev;
+            if (!readEvent(ring, pos, ev) || ev.stage < 0 || ev.stage >= NumStages
+                || ev.startTicks < baseticks) {
+                continue;
+            }
+
+            auto ts = (ev.startTicks - baseticks) / ticksPerUs;
+            auto dur = (ev.endTicks - ev.startTicks) / ticksPerUs;
+
+            out << ",\n{\"name\":\"" << stageNames[ev.stage] << "\",\"cat\":\"" << threadNames[slot]
+                << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << slot
+                << ",\"ts\":" << String(ts, 3) << ",\"dur\":" << String(dur, 3) << "}";
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    out.flush();
+
+    return out.getStatus().wasOk();
+}
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+// compile-time switch for the per-stage timing instrumentation,
+// when 0 the SONO_PROFILE_STAGE macro expands to nothing
+#ifndef SONOBUS_STAGE_PROFILING
+#define SONOBUS_STAGE_PROFILING 1
+#endif
+
+namespace SonoAudio {
+
+// Records scoped timestamps for the stages of the realtime pipeline into
+// fixed-size per-thread rings (no allocation or locking on the writer side).
+// A non-realtime reader periodically drains the rings into rolling
+// log-scale histograms for percentile display, and the raw events
+// still in the rings can be exported as a Chrome trace-event JSON file.
+
+class StageProfiler
+{
+public:
+    enum Stage {
+        StageProcessBlock = 0,
+        StageInputGroups,
+        StageMetering,
+        StagePanMix,
+        StageFilePlayback,
+        StageMetronome,
+        StageInputReverb,
+        StagePeerSinkProcess,
+        StagePeerChannelGroups,
+        StagePeerSourceProcess,
+        StageMainReverb,
+        StageRecording,
+        StageSendThread,
+        StageRecvThread,
+        NumStages
+    };
+
+    // each slot must only ever be written by a single thread
+    enum ThreadSlot {
+        ThreadAudio = 0,
+        ThreadSend,
+        ThreadRecv,
+        NumThreadSlots
+    };
+
+    struct StageStats {
+        int64 count = 0;
+        double meanUs = 0.0;
+        double p50Us = 0.0;
+        double p95Us = 0.0;
+        double p99Us = 0.0;
+        double maxUs = 0.0;
+    };
+
+    StageProfiler();
+
+    void setEnabled(bool flag);
+    bool isEnabled() const noexcept { return mEnabled.load(std::memory_order_relaxed); }
+
+    // clears all rings and histograms, call from a non-realtime thread
+    void reset();
+
+    // realtime safe
+    void record(ThreadSlot slot, Stage stage, int64 startTicks, int64 endTicks) noexcept;
+
+    // drains new events into the histograms, call from a non-realtime thread (e.g. a timer)
+    void update();
+
+    StageStats getStageStats(Stage stage) const;
+
+    static const char * getStageName(Stage stage);
+    static const char * getThreadName(ThreadSlot slot);
+
+    // human readable table of the percentiles for every stage that has data
+    String getSummaryText() const;
+
+    // writes the events still held in the rings as Chrome trace-event JSON
+    // (load with chrome://tracing or ui.perfetto.dev)
+    bool exportChromeTrace(const File & file) const;
+
+
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(StageProfiler & prof, ThreadSlot slot, Stage stage) noexcept
+        : profiler(prof.isEnabled() ? &prof : nullptr), mSlot(slot), mStage(stage),
+          startTicks(profiler ? Time::getHighResolutionTicks() : 0) {}
+
+        ~ScopedTimer() {
+            if (profiler) {
+                profiler->record(mSlot, mStage, startTicks, Time::getHighResolutionTicks());
+            }
+        }
+
+    private:
+        StageProfiler * profiler;
+        ThreadSlot mSlot;
+        Stage mStage;
+        int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedTimer)
+    };
+
+    enum {
+        RingSize = 8192,      // events per thread slot, power of two
+        NumBuckets = 72,      // log-scale histogram buckets
+        BucketsPerOctave = 4,
+        WindowMs = 5000       // rolling window length for percentiles
+    };
+
+private:
+
+    struct Event {
+        int32 stage = 0;
+        int64 startTicks = 0;
+        int64 endTicks = 0;
+    };
+
+    struct Ring {
+        Event events[RingSize];
+        std::atomic<uint32> writeIndex { 0 };
+        uint32 readIndex = 0;
+    };
+
+    struct Histogram {
+        uint32 buckets[NumBuckets];
+        int64 count;
+        double sumUs;
+        double maxUs;
+        void clear();
+    };
+
+    static int bucketForMicros(double us);
+    static double microsForBucket(int bucket);
+
+    // copies out the event at index pos if it is still valid
+    bool readEvent(const Ring & ring, uint32 pos, Event & retevent) const;
+
+    std::atomic<bool> mEnabled { false };
+
+    Ring mRings[NumThreadSlots];
+
+    // two windows, current and previous, combined for the rolling percentiles
+    Histogram mHistograms[2][NumStages];
+    int mCurrWindow = 0;
+    double mWindowStartMs = 0.0;
+    int64 mBaseTicks = 0;
+
+    CriticalSection mReaderLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StageProfiler)
+};
+
+}
+
+#if SONOBUS_STAGE_PROFILING
+#define SONO_PROFILE_STAGE(profiler, slot, stage) \
+    SonoAudio::StageProfiler::ScopedTimer JUCE_JOIN_MACRO(stageTimer_, __LINE__) (profiler, SonoAudio::StageProfiler::slot, SonoAudio::StageProfiler::stage)
+#else
+#define SONO_PROFILE_STAGE(profiler, slot, stage)
+#endif
@@ -8,6 +8,8 @@
 
 #include "SonoUtility.h"
 #include "SonobusTypes.h"
+#include "MappedAudioReader.h"
+#include "PersistentThumbnailCache.h"
 
 //==============================================================================
 class WaveformTransportComponent  : public Component,
@@ -20,11 +22,14 @@ class WaveformTransportComponent  : public Component,
 public:
     WaveformTransportComponent (AudioFormatManager& formatManager,
                                 AudioTransportSource& source,
+                                SonoAudio::PersistentThumbnailCache& thumbCache,
                                 ApplicationCommandManager & cmdman)
                         //        Slider& slider);
         : transportSource (source),
+           formatManager (formatManager),
            commandManager (cmdman),
           //zoomSlider (slider),
+          thumbnailCache (thumbCache),
           thumbnail (512, formatManager, thumbnailCache)
     {
         posLabel.setFont(14);
@@ -79,11 +84,19 @@ public:
     void setURL (const URL& url)
     {
         InputSource* inputSource = nullptr;
+        MemoryMappedAudioFormatReader* mappedReader = nullptr;
 
        #if ! JUCE_IOS
         if (url.isLocalFile())
         {
-            inputSource = new FileInputSource (url.getLocalFile());
+            // only local files can tell if they changed, so only those are kept on disk
+            thumbnailCache.addPersistentHash (SonoAudio::PersistentThumbnailCache::getFileHash (url.getLocalFile()));
+
+            // shares its pages with the playback mapping of the same file
+            mappedReader = SonoAudio::createMappedAudioReader(formatManager, url.getLocalFile());
+
+            if (mappedReader == nullptr)
+                inputSource = new FileInputSource (url.getLocalFile(), true);
         }
         else
        #endif
@@ -92,9 +105,13 @@ public:
                 inputSource = new URLInputSource (url);
         }
 
-        if (inputSource != nullptr)
+        if (inputSource != nullptr || mappedReader != nullptr)
         {
-            thumbnail.setSource (inputSource);
+            if (mappedReader != nullptr)
+                // same hash the FileInputSource would have, so the cache still matches
+                thumbnail.setReader (mappedReader, SonoAudio::PersistentThumbnailCache::getFileHash (url.getLocalFile()));
+            else
+                thumbnail.setSource (inputSource);
 
             Range<double> newRange (0.0, thumbnail.getTotalLength());
             scrollbar.setRangeLimits (newRange);
@@ -541,6 +558,7 @@ public:
 
 private:
     AudioTransportSource& transportSource;
+    AudioFormatManager& formatManager;
     ApplicationCommandManager& commandManager;
     //Slider& zoomSlider;
     ScrollBar scrollbar  { false };
@@ -549,7 +567,7 @@ private:
     Label totLabel;
     Label nameLabel;
     
-    AudioThumbnailCache thumbnailCache  { 5 };
+    SonoAudio::PersistentThumbnailCache& thumbnailCache;
     AudioThumbnail thumbnail;
     Range<double> visibleRange;
     double zoomFactor = 0;
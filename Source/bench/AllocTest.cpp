@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Allocation test: replaces the global operator new with a counting one and checks
+// that the aoo block containers and a running source -> sink stream don't touch
+// the heap in steady state, even with packets reordered and lost along the way
+// (which exercises the resend requests and the block_ack_list).
+//
+// Exits with 1 if anything was allocated. Run with -v to print a backtrace of
+// each allocation, where available.
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+#include "src/common.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define HAVE_BACKTRACE 1
+#endif
+
+namespace {
+
+std::atomic<long> numAllocations { 0 };
+bool traceAllocations = false;
+bool verbose = false;
+
+void * countedAlloc(size_t n)
+{
+    numAllocations++;
+
+#if HAVE_BACKTRACE
+    if (traceAllocations) {
+        traceAllocations = false; // backtrace() may allocate itself
+        void * frames[16];
+        int count = backtrace(frames, 16);
+        backtrace_symbols_fd(frames, count, 2);
+        fprintf(stderr, "----\n");
+        traceAllocations = true;
+    }
+#endif
+
+    if (void * p = malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+}
+
+void * operator new(size_t n) { return countedAlloc(n); }
+void * operator new[](size_t n) { return countedAlloc(n); }
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+
+
+namespace {
+
+const int samplerate = 48000;
+const int blocksize = 256;
+const int numChannels = 2;
+
+aoo::isource * source = nullptr;
+aoo::isink * sink = nullptr;
+int sourceEndpoint = 0;
+int sinkEndpoint = 0;
+
+int numMessages = 0;
+char heldMessage[AOO_MAXPACKETSIZE];
+int heldSize = 0;
+
+int32_t sendToSink(void *, const char * data, int32_t n);
+
+int32_t sendToSource(void *, const char * data, int32_t n)
+{
+    source->handle_message(data, n, &sinkEndpoint, sendToSink);
+    return n;
+}
+
+void deliver(const char * data, int32_t n)
+{
+    sink->handle_message(data, n, &sourceEndpoint, sendToSource);
+}
+
+// swaps every 7th packet with the next one, and drops every 23rd
+int32_t sendToSink(void *, const char * data, int32_t n)
+{
+    ++numMessages;
+
+    if (numMessages % 23 == 0) {
+        return n;
+    }
+    if (numMessages % 7 == 0 && heldSize == 0 && n <= (int32_t) sizeof(heldMessage)) {
+        memcpy(heldMessage, data, n);
+        heldSize = n;
+        return n;
+    }
+
+    deliver(data, n);
+
+    if (heldSize > 0) {
+        const int size = heldSize;
+        heldSize = 0;
+        deliver(heldMessage, size);
+    }
+    return n;
+}
+
+int32_t ignoreEvents(void *, const aoo_event **, int32_t) { return 0; }
+
+long testContainers()
+{
+    const int maxblocksize = aoo::max_block_size(numChannels, blocksize);
+
+    aoo::block_queue queue;
+    aoo::history_buffer history;
+    queue.resize(32, maxblocksize);
+    history.resize(64, maxblocksize);
+
+    std::vector<char> data(maxblocksize, 1);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> size(1, maxblocksize), jitter(0, 5);
+
+    const long before = numAllocations;
+    traceAllocations = verbose;
+
+    for (int seq = 0; seq < 200000; ++seq) {
+        const int s = seq + jitter(rng); // out of order
+        if (!queue.find(s) && !queue.insert(s, samplerate, 0, size(rng), 1)) {
+            fprintf(stderr, "block_queue insert failed\n");
+            return -1;
+        }
+        if (queue.size() > 20) {
+            queue.pop_front();
+        }
+        history.push(seq, samplerate, data.data(), size(rng), 1, 1400);
+        history.find(seq - 10);
+    }
+
+    traceAllocations = false;
+    return numAllocations - before;
+}
+
+long testStream()
+{
+    source = aoo::isource::create(1);
+    sink = aoo::isink::create(2);
+    source->setup(samplerate, blocksize, numChannels);
+    sink->setup(samplerate, blocksize, numChannels);
+
+    int32_t buffersize = 60;
+    sink->set_option(aoo_opt_buffersize, &buffersize, sizeof(buffersize));
+
+    aoo_format_pcm format;
+    format.header.codec = AOO_CODEC_PCM;
+    format.header.nchannels = numChannels;
+    format.header.samplerate = samplerate;
+    format.header.blocksize = blocksize;
+    format.bitdepth = AOO_PCM_INT16;
+    source->set_format(format.header);
+    source->add_sink(&sinkEndpoint, 2, sendToSink);
+    source->start();
+
+    std::vector<float> in(blocksize * numChannels), out(blocksize * numChannels);
+    const aoo_sample * inputs[numChannels];
+    aoo_sample * outputs[numChannels];
+    for (int ch = 0; ch < numChannels; ++ch) {
+        inputs[ch] = in.data() + ch * blocksize;
+        outputs[ch] = out.data() + ch * blocksize;
+    }
+
+    uint64_t t = aoo_osctime_get();
+    double phase = 0.0;
+    long before = 0;
+
+    for (int block = 0; block < 6000; ++block) {
+        if (block == 1000) {
+            // everything is set up by now
+            before = numAllocations;
+            traceAllocations = verbose;
+        }
+
+        for (int i = 0; i < blocksize; ++i) {
+            in[i] = in[blocksize + i] = 0.3f * (float) std::sin(phase);
+            phase += 0.03;
+        }
+        t += aoo_osctime_fromseconds((double) blocksize / samplerate);
+
+        source->process(inputs, blocksize, t);
+        source->send();
+        sink->send();
+
+        std::fill(out.begin(), out.end(), 0.0f);
+        sink->process_add(outputs, blocksize, t);
+
+        sink->handle_events(ignoreEvents, nullptr);
+        source->handle_events(ignoreEvents, nullptr);
+    }
+
+    traceAllocations = false;
+    const long count = numAllocations - before;
+
+    aoo::isource::destroy(source);
+    aoo::isink::destroy(sink);
+    return count;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    verbose = argc > 1 && !strcmp(argv[1], "-v");
+
+    aoo_initialize();
+
+    const long containers = testContainers();
+    printf("containers: %ld allocations in steady state\n", containers);
+
+    const long stream = testStream();
+    printf("stream: %ld allocations over 5000 blocks in steady state (%d messages)\n", stream, numMessages);
+
+    aoo_terminate();
+
+    return (containers == 0 && stream == 0) ? 0 : 1;
+}
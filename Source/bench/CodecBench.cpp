@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Codec benchmark: runs every entry of the network format table (CodecFormatTable.h)
+// through an aoo encoder and decoder at a range of block sizes and channel counts,
+// and prints one CSV row per configuration on stdout, so results can be diffed
+// between releases. Progress and settings go to stderr.
+//
+// The block size axis is the audio callback size. Like formatInfoToAooFormat(),
+// the codec block is the callback size raised to the format's minimum preferred
+// block size (and for Opus rounded to a valid frame size by the codec).
+//
+// Columns:
+//   format,name,codec,layout,channels,samplerate,host_blocksize,codec_blocksize,
+//   enc_us,dec_us,max_us,us_per_block,realtime,bytes_per_block,packets_per_block,
+//   delay,snr_db
+//
+//   enc_us, dec_us     mean encode/decode time per codec block
+//   max_us             worst encode+decode of a single codec block
+//   us_per_block       mean encode+decode cost per host block
+//   realtime           seconds of audio coded per second of CPU time
+//   bytes_per_block    mean encoded bytes per codec block
+//   packets_per_block  mean data packets per codec block at the packet size
+//   delay              codec delay in samples (Opus' look ahead)
+//   snr_db             signal to noise ratio of the decoded audio over all channels,
+//                      after removing the delay, to compare layouts at equal quality
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_pcm.h"
+#if USE_CODEC_OPUS
+#include "aoo/aoo_opus.h"
+#endif
+#include "src/common.hpp"
+
+#include "../CodecFormatTable.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchSettings
+{
+    int samplerate = 48000;
+    int packetsize = 600; // RemotePeer default
+    double seconds = 5.0; // audio per configuration
+    int maxChannels = 8;
+    int onlyFormat = -1;
+    std::vector<int> blocksizes = { 64, 128, 256, 512, 1024 };
+};
+
+struct BenchResult
+{
+    int codecBlocksize = 0;
+    double encUs = 0.0;
+    double decUs = 0.0;
+    double maxUs = 0.0;
+    double bytes = 0.0;
+    double packets = 0.0;
+    int delay = 0;
+    double snrDb = 0.0;
+};
+
+const char * layoutName(int layout)
+{
+#if USE_CODEC_OPUS
+    switch (layout) {
+        case AOO_OPUS_LAYOUT_COUPLED: return "coupled";
+        case AOO_OPUS_LAYOUT_SURROUND: return "surround";
+        default: break;
+    }
+#else
+    (void) layout;
+#endif
+    return "discrete";
+}
+
+std::string formatName(const CodecFormatTableEntry & entry)
+{
+    char buf[64];
+    if (entry.opus) {
+        snprintf(buf, sizeof(buf), "%d kbps/ch", entry.bitrate / 1000);
+    } else {
+        snprintf(buf, sizeof(buf), "PCM %d bit%s", entry.bitdepth * 8, entry.bitdepth >= 4 ? " float" : "");
+    }
+    return buf;
+}
+
+// same mapping as SonobusAudioProcessor::formatInfoToAooFormat()
+bool makeFormat(const CodecFormatTableEntry & entry, int channels, int blocksize, int samplerate,
+                int layout, aoo_format_storage & retformat)
+{
+    std::memset(&retformat, 0, sizeof(retformat));
+
+    if (!entry.opus) {
+        aoo_format_pcm *fmt = (aoo_format_pcm *)&retformat;
+        fmt->header.codec = AOO_CODEC_PCM;
+        fmt->header.blocksize = blocksize >= entry.minPreferredBlocksize ? blocksize : entry.minPreferredBlocksize;
+        fmt->header.samplerate = samplerate;
+        fmt->header.nchannels = channels;
+        fmt->bitdepth = entry.bitdepth == 2 ? AOO_PCM_INT16 : entry.bitdepth == 3 ? AOO_PCM_INT24 : entry.bitdepth == 4 ? AOO_PCM_FLOAT32 : entry.bitdepth == 8 ? AOO_PCM_FLOAT64 : AOO_PCM_INT16;
+        return true;
+    }
+#if USE_CODEC_OPUS
+    aoo_format_opus *fmt = (aoo_format_opus *)&retformat;
+    fmt->header.codec = AOO_CODEC_OPUS;
+    fmt->header.blocksize = blocksize >= entry.minPreferredBlocksize ? blocksize : entry.minPreferredBlocksize;
+    fmt->header.samplerate = samplerate;
+    fmt->header.nchannels = channels;
+    fmt->bitrate = entry.bitrate * channels;
+    fmt->complexity = entry.complexity;
+    fmt->signal_type = entry.signalType;
+    fmt->application_type = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+    fmt->channel_layout = layout;
+    return true;
+#else
+    (void) layout;
+    return false;
+#endif
+}
+
+// deterministic test signal: each channel is part shared material and part its own,
+// roughly what a stereo mix or a few mics in one room look like
+void makeSignal(std::vector<aoo_sample> & buf, int channels, int frames, int samplerate)
+{
+    buf.resize((size_t) channels * frames);
+    uint32_t seed = 12345;
+    auto noise = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float) (int32_t) seed / 2147483648.0f;
+    };
+    const double twopi = 6.283185307179586;
+
+    for (int i = 0; i < frames; ++i) {
+        const double t = (double) i / samplerate;
+        const double shared = 0.2 * std::sin(twopi * 220.0 * t) + 0.1 * std::sin(twopi * 331.0 * t);
+        for (int c = 0; c < channels; ++c) {
+            const double own = 0.15 * std::sin(twopi * (440.0 + 97.0 * c) * t) + 0.02 * noise();
+            buf[(size_t) i * channels + c] = (aoo_sample) (shared + own);
+        }
+    }
+}
+
+// the delay (in frames) of the decoded audio: Opus' look ahead, which doesn't depend on
+// the bitrate, frame size or layout. searching for it doesn't work at low bitrates,
+// where the waveform isn't kept well enough to line up with the input
+int codecDelay(const aoo_format & fmt)
+{
+#if USE_CODEC_OPUS
+    if (!std::strcmp(fmt.codec, AOO_CODEC_OPUS)) {
+        int err = 0;
+        auto enc = opus_encoder_create(fmt.samplerate, 1, OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
+        if (err != OPUS_OK) return 0;
+        opus_int32 lookahead = 0;
+        opus_encoder_ctl(enc, OPUS_GET_LOOKAHEAD(&lookahead));
+        opus_encoder_destroy(enc);
+        return (int) lookahead;
+    }
+#else
+    (void) fmt;
+#endif
+    return 0;
+}
+
+double snrDb(const std::vector<aoo_sample> & in, const std::vector<aoo_sample> & out, int channels, int delay)
+{
+    const int frames = (int) (out.size() / channels);
+    double signal = 0.0, noise = 0.0;
+    for (int i = delay; i < frames; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            const double s = in[(size_t) (i - delay) * channels + c];
+            const double e = out[(size_t) i * channels + c] - s;
+            signal += s * s;
+            noise += e * e;
+        }
+    }
+    if (noise <= 0.0) return 999.0; // lossless
+    return 10.0 * std::log10(signal / noise);
+}
+
+bool runOne(const aoo::codec & codec, aoo_format_storage & fmt, const BenchSettings & settings, BenchResult & result)
+{
+    auto enc = codec.create_encoder();
+    auto dec = codec.create_decoder();
+    if (!enc || !dec) {
+        return false;
+    }
+
+    if (!enc->set_format(fmt.header)) {
+        return false;
+    }
+
+    // hand the format to the decoder the way it goes over the wire
+    aoo_format header;
+    char settingsbuf[AOO_CODEC_MAXSETTINGSIZE];
+    auto size = enc->write_format(header, settingsbuf, sizeof(settingsbuf));
+    if (size < 0 || dec->read_format(header, settingsbuf, size) < 0) {
+        return false;
+    }
+
+    const int nchannels = enc->nchannels();
+    const int blocksize = enc->blocksize();
+    const int samplerate = enc->samplerate();
+    const int nblocks = std::max(1, (int) (settings.seconds * samplerate / blocksize));
+    const int warmup = std::max(1, nblocks / 20);
+
+    std::vector<aoo_sample> input;
+    const int inframes = samplerate; // one second, looped
+    makeSignal(input, nchannels, inframes + blocksize, samplerate);
+
+    std::vector<char> encbuf(aoo::max_block_size(nchannels, blocksize));
+    std::vector<aoo_sample> output((size_t) nchannels * blocksize);
+
+    const int32_t maxpacketsize = settings.packetsize - AOO_DATA_HEADERSIZE;
+
+    using clock = std::chrono::steady_clock;
+    double enctotal = 0.0, dectotal = 0.0, maxus = 0.0;
+    double bytestotal = 0.0, packetstotal = 0.0;
+    int pos = 0;
+
+    // what went in and came out after the warm up, for the quality
+    std::vector<aoo_sample> sent, received;
+    sent.reserve((size_t) nblocks * blocksize * nchannels);
+    received.reserve((size_t) nblocks * blocksize * nchannels);
+
+    for (int i = 0; i < warmup + nblocks; ++i) {
+        const aoo_sample * in = input.data() + (size_t) pos * nchannels;
+        pos += blocksize;
+        if (pos >= inframes) pos -= inframes;
+
+        auto t0 = clock::now();
+        auto nbytes = enc->encode(in, nchannels * blocksize, encbuf.data(), (int32_t) encbuf.size());
+        auto t1 = clock::now();
+        if (nbytes <= 0) {
+            return false;
+        }
+        dec->decode(encbuf.data(), nbytes, output.data(), nchannels * blocksize);
+        auto t2 = clock::now();
+
+        if (i < warmup) continue;
+
+        sent.insert(sent.end(), in, in + nchannels * blocksize);
+        received.insert(received.end(), output.begin(), output.end());
+
+        const double encus = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        const double decus = std::chrono::duration<double, std::micro>(t2 - t1).count();
+        enctotal += encus;
+        dectotal += decus;
+        maxus = std::max(maxus, encus + decus);
+        bytestotal += nbytes;
+        packetstotal += (nbytes + maxpacketsize - 1) / maxpacketsize;
+    }
+
+    result.codecBlocksize = blocksize;
+    result.encUs = enctotal / nblocks;
+    result.decUs = dectotal / nblocks;
+    result.maxUs = maxus;
+    result.bytes = bytestotal / nblocks;
+    result.packets = packetstotal / nblocks;
+    result.delay = codecDelay(fmt.header);
+    result.snrDb = snrDb(sent, received, nchannels, result.delay);
+    return true;
+}
+
+std::vector<int> parseList(const char * arg)
+{
+    std::vector<int> list;
+    const char * p = arg;
+    while (*p) {
+        char * end = nullptr;
+        long val = std::strtol(p, &end, 10);
+        if (end == p) break;
+        if (val > 0) list.push_back((int) val);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return list;
+}
+
+void usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-s samplerate] [-p packetsize] [-t seconds] [-c maxchannels] [-b blocksizes] [-f formatindex]\n"
+                    "  -b takes a comma separated list, default 64,128,256,512,1024\n", name);
+}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    BenchSettings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        const bool hasval = i + 1 < argc;
+        if (!std::strcmp(argv[i], "-s") && hasval) settings.samplerate = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "-p") && hasval) settings.packetsize = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "-t") && hasval) settings.seconds = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "-c") && hasval) settings.maxChannels = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "-b") && hasval) settings.blocksizes = parseList(argv[++i]);
+        else if (!std::strcmp(argv[i], "-f") && hasval) settings.onlyFormat = std::atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (settings.samplerate <= 0 || settings.seconds <= 0.0 || settings.maxChannels <= 0
+        || settings.blocksizes.empty() || settings.packetsize <= AOO_DATA_HEADERSIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    aoo_initialize();
+
+    fprintf(stderr, "samplerate %d, packetsize %d, %g s of audio per row\n",
+            settings.samplerate, settings.packetsize, settings.seconds);
+
+    printf("format,name,codec,layout,channels,samplerate,host_blocksize,codec_blocksize,"
+           "enc_us,dec_us,max_us,us_per_block,realtime,bytes_per_block,packets_per_block,delay,snr_db\n");
+
+    int failures = 0;
+
+    for (int f = 0; f < codecFormatTableSize; ++f) {
+        if (settings.onlyFormat >= 0 && f != settings.onlyFormat) continue;
+
+        const auto & entry = codecFormatTable[f];
+        const std::string name = formatName(entry);
+        auto codec = aoo::find_codec(entry.opus ? "opus" : AOO_CODEC_PCM);
+        if (!codec) {
+            fprintf(stderr, "format %d (%s): codec not available in this build, skipped\n", f, name.c_str());
+            continue;
+        }
+
+        for (int channels = 1; channels <= settings.maxChannels; ++channels) {
+            // layouts only make a difference for Opus with more than one channel
+            std::vector<int> layouts = { 0 };
+#if USE_CODEC_OPUS
+            if (entry.opus && channels > 1) {
+                layouts = { AOO_OPUS_LAYOUT_DISCRETE, AOO_OPUS_LAYOUT_COUPLED, AOO_OPUS_LAYOUT_SURROUND };
+            }
+#endif
+            for (int layout : layouts) {
+                for (int blocksize : settings.blocksizes) {
+                    aoo_format_storage fmt;
+                    BenchResult res;
+                    if (!makeFormat(entry, channels, blocksize, settings.samplerate, layout, fmt)
+                        || !runOne(*codec, fmt, settings, res)) {
+                        fprintf(stderr, "format %d (%s) %s, %d ch, block %d: failed\n",
+                                f, name.c_str(), layoutName(layout), channels, blocksize);
+                        ++failures;
+                        continue;
+                    }
+
+                    const double codecus = res.encUs + res.decUs;
+                    const double perhostblock = codecus * blocksize / res.codecBlocksize;
+                    const double audious = 1e6 * res.codecBlocksize / settings.samplerate;
+                    const double realtime = codecus > 0.0 ? audious / codecus : 0.0;
+
+                    printf("%d,%s,%s,%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.2f,%d,%.1f\n",
+                           f, name.c_str(), codec->name(), layoutName(layout), channels,
+                           settings.samplerate, blocksize, res.codecBlocksize,
+                           res.encUs, res.decUs, res.maxUs, perhostblock, realtime,
+                           res.bytes, res.packets, res.delay, res.snrDb);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    aoo_terminate();
+
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Stress test for the control message handoff: several producer threads (standing in
+// for the recv threads) push packet sized messages into an MpscQueue the same way
+// dispatchOtherMessage() does, dropping them when it's full, while a consumer
+// thread woken by a WaitableEvent drains it like the ControlThread.
+//
+// Checks that every message that was queued comes out exactly once, intact and in
+// order per producer, and that the queue is empty once the consumer has stopped and
+// the rest is drained. That last step is what cleanupAoo() relies on before it frees
+// the endpoints the queued messages point at.
+
+#include "JuceHeader.h"
+#include "../MpscQueue.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const int numProducers = 4;
+const int messagesPerProducer = 100000;
+const int maxPacketSize = 4096;
+
+struct Endpoint
+{
+    int producer = 0;
+};
+
+struct Message
+{
+    Endpoint * endpoint = nullptr;
+    int32 sequence = 0;
+    int32 size = 0;
+    char data[maxPacketSize];
+};
+
+using Queue = SonoAudio::MpscQueue<Message, 64>;
+
+char payloadByte(int producer, int sequence, int i)
+{
+    return (char) ((producer * 31 + sequence * 7 + i) & 0x7f);
+}
+
+struct Results
+{
+    int64 received[numProducers] = {};
+    int64 outOfOrder = 0;
+    int64 corrupt = 0;
+    int32 lastSequence[numProducers];
+
+    Results()
+    {
+        for (auto & s : lastSequence) {
+            s = -1;
+        }
+    }
+
+    void check(const Message & msg)
+    {
+        const int p = msg.endpoint->producer;
+        ++received[p];
+
+        if (msg.sequence <= lastSequence[p]) {
+            ++outOfOrder;
+        }
+        lastSequence[p] = msg.sequence;
+
+        for (int i = 0; i < msg.size; ++i) {
+            if (msg.data[i] != payloadByte(p, msg.sequence, i)) {
+                ++corrupt;
+                break;
+            }
+        }
+    }
+};
+
+class Consumer : public Thread
+{
+public:
+    Consumer(Queue & q, WaitableEvent & w, Results & r) : Thread("ControlQueueTestConsumer"), queue(q), waitable(w), results(r) {}
+
+    void run() override
+    {
+        while (!threadShouldExit()) {
+            waitable.wait(50);
+
+            while (queue.tryPop([this](Message & msg) { results.check(msg); })) {}
+        }
+    }
+
+    Queue & queue;
+    WaitableEvent & waitable;
+    Results & results;
+};
+
+class Producer : public Thread
+{
+public:
+    Producer(int index_, Queue & q, WaitableEvent & w) : Thread("ControlQueueTestProducer"), index(index_), queue(q), waitable(w)
+    {
+        endpoint.producer = index;
+    }
+
+    void run() override
+    {
+        Random rng (index + 1);
+
+        for (int seq = 0; seq < messagesPerProducer; ++seq) {
+            const int size = 16 + rng.nextInt(maxPacketSize - 16);
+
+            const bool queued = queue.tryPush([&](Message & msg) {
+                msg.endpoint = &endpoint;
+                msg.sequence = seq;
+                msg.size = size;
+                for (int i = 0; i < size; ++i) {
+                    msg.data[i] = payloadByte(index, seq, i);
+                }
+            });
+
+            if (queued) {
+                ++sent;
+                waitable.signal();
+            }
+            else {
+                ++dropped;
+                Thread::yield();
+            }
+        }
+    }
+
+    int index;
+    Queue & queue;
+    WaitableEvent & waitable;
+    Endpoint endpoint;
+    int64 sent = 0;
+    int64 dropped = 0;
+};
+
+}
+
+int main()
+{
+    auto queue = std::make_unique<Queue>();
+    WaitableEvent waitable;
+    Results results;
+
+    Consumer consumer(*queue, waitable, results);
+    consumer.startThread();
+
+    std::vector<std::unique_ptr<Producer>> producers;
+    for (int p = 0; p < numProducers; ++p) {
+        producers.push_back(std::make_unique<Producer>(p, *queue, waitable));
+    }
+    for (auto & p : producers) {
+        p->startThread();
+    }
+    for (auto & p : producers) {
+        p->waitForThreadToExit(-1);
+    }
+
+    // same shutdown order as cleanupAoo(): stop the consumer, then drain what's left
+    consumer.signalThreadShouldExit();
+    waitable.signal();
+    consumer.stopThread(2000);
+
+    int64 drained = 0;
+    while (queue->tryPop([&](Message & msg) { results.check(msg); ++drained; })) {}
+
+    bool ok = results.outOfOrder == 0 && results.corrupt == 0 && queue->isEmpty();
+
+    for (int p = 0; p < numProducers; ++p) {
+        const auto & prod = *producers[(size_t) p];
+        printf("producer %d: sent %lld dropped %lld received %lld\n", p,
+               (long long) prod.sent, (long long) prod.dropped, (long long) results.received[p]);
+        ok = ok && prod.sent == results.received[p] && prod.sent + prod.dropped == messagesPerProducer;
+    }
+
+    printf("drained after stop: %lld, out of order: %lld, corrupt: %lld\n",
+           (long long) drained, (long long) results.outOfOrder, (long long) results.corrupt);
+
+    return ok ? 0 : 1;
+}
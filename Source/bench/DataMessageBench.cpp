@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Data message benchmark: how many data messages per second the source can write,
+// by hand (data_header::write() and write_compact_data()) against the
+// osc::OutboundPacketStream versions in DataMessageReference.h:
+//
+//   data      /aoo/sink/<id>/data, with data_header::update() once per message too,
+//             the way copy_sinks() checks it for every sink
+//   compact   /d with the samplerate and a time stamp
+//   silence   /d without a blob (DTX)
+//
+// for a small opus sized blob and a larger PCM sized one. The test that they write the
+// same bytes is DataMessageTest.cpp.
+// Usage: sonobus_datamessagebench [runs]
+
+#include "DataMessageReference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const long numMessages = 2000000;
+
+// keeps the compiler from dropping the writes
+volatile int32_t sink = 0;
+
+template<typename Fn>
+double messagesPerSecond(Fn && write)
+{
+    char buf[AOO_MAXPACKETSIZE];
+    int32_t total = 0;
+
+    const auto start = Clock::now();
+    for (long i = 0; i < numMessages; ++i) {
+        total += write(buf, (int32_t) i);
+        total += buf[i & 63];
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    sink = total;
+    return numMessages / seconds;
+}
+
+void run(int32_t size)
+{
+    std::vector<char> payload (size, 0x5a);
+
+    aoo::data_packet d;
+    d.samplerate = 48000.0;
+    d.channel = 0;
+    d.totalsize = size;
+    d.nframes = 1;
+    d.framenum = 0;
+    d.data = payload.data();
+    d.size = size;
+    d.timestamp = 0xe3a1b2c3d4e5f607ULL;
+
+    const int32_t sinkId = 100042;
+    const int32_t src = 100001;
+    const int32_t salt = 1234567;
+
+    aoo::data_header header;
+
+    const double dataHand = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        header.update(sinkId, src, salt);
+        return header.write(buf, AOO_MAXPACKETSIZE, d);
+    });
+    const double dataOsc = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        return DataMessageReference::writeData(buf, AOO_MAXPACKETSIZE, sinkId, src, salt, d);
+    });
+
+    const double compactHand = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        return aoo::write_compact_data(buf, AOO_MAXPACKETSIZE, salt, d, true, true);
+    });
+    const double compactOsc = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        return DataMessageReference::writeCompactData(buf, AOO_MAXPACKETSIZE, salt, d, true, true);
+    });
+
+    const double silenceHand = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        return aoo::write_compact_data(buf, AOO_MAXPACKETSIZE, salt, d, false, false);
+    });
+    const double silenceOsc = messagesPerSecond([&] (char * buf, int32_t seq) {
+        d.sequence = seq;
+        return DataMessageReference::writeCompactData(buf, AOO_MAXPACKETSIZE, salt, d, false, false);
+    });
+
+    printf("%4d byte blob   data: %6.2f M/s by hand, %6.2f M/s osc   compact: %6.2f M/s by hand, %6.2f M/s osc   silence: %6.2f M/s by hand, %6.2f M/s osc\n",
+           size, dataHand * 1e-6, dataOsc * 1e-6, compactHand * 1e-6, compactOsc * 1e-6, silenceHand * 1e-6, silenceOsc * 1e-6);
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    const int runs = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+
+    for (int r = 0; r < runs; ++r) {
+        // 2.5 ms of 96 kbit/s opus, and 64 stereo samples of 16 bit PCM
+        run(30);
+        run(256);
+    }
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// The aoo data messages written the straightforward way, through endpoint::send_data()
+// and osc::OutboundPacketStream, for the packet test and benchmark to compare the hand
+// written ones against.
+
+#pragma once
+
+#include "src/source.hpp"
+
+#include <cstring>
+
+namespace DataMessageReference {
+
+// endpoint::send_data() hands the message to a reply function, this one copies it out
+struct Capture
+{
+    char * buf;
+    int32_t bufsize;
+    int32_t size = 0;
+
+    static int32_t reply(void * user, const char * data, int32_t n)
+    {
+        auto * self = static_cast<Capture*>(user);
+        self->size = n <= self->bufsize ? n : 0;
+        if (self->size > 0) {
+            memcpy(self->buf, data, self->size);
+        }
+        return n;
+    }
+};
+
+// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data> [<timestamp>]
+inline int32_t writeData(char * buf, int32_t bufsize, int32_t sink, int32_t src, int32_t salt, const aoo::data_packet & d)
+{
+    Capture capture { buf, bufsize };
+    aoo::endpoint ep (&capture, Capture::reply, sink);
+    ep.send_data(src, salt, d);
+    return capture.size;
+}
+
+// /d <salt> <seq> [<srate>] [<data>] [<timestamp>], the way the source wrote it before write_compact_data()
+inline int32_t writeCompactData(char * buf, int32_t bufsize, int32_t salt, const aoo::data_packet & d, bool sendrate, bool blob)
+{
+    try {
+        osc::OutboundPacketStream msg(buf, bufsize);
+
+        msg << osc::BeginMessage(AOO_MSG_COMPACT_DATA) << salt << d.sequence;
+        if (sendrate) {
+            msg << d.samplerate;
+        }
+        if (blob) {
+            msg << osc::Blob(d.data, d.size);
+        }
+        if (d.timestamp) {
+            msg << osc::TimeTag(d.timestamp);
+        }
+        msg << osc::EndMessage;
+
+        return (int32_t) msg.Size();
+    }
+    catch (const osc::Exception &) {
+        return 0;
+    }
+}
+
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Data message test: the source writes its /aoo/sink/<id>/data messages from a cached
+// data_header and its compact /d messages with write_compact_data(), both by hand. This
+// checks that they come out byte for byte the same as the osc::OutboundPacketStream
+// versions (see DataMessageReference.h) for
+//
+//   - every blob padding length, and the empty blob
+//   - sink IDs of every address padding length, and the wildcard ID
+//   - with and without a time stamp, and with and without the samplerate (compact only)
+//   - one header reused across all of them, so a stale longer address can't leak through
+//
+// Exits with 1 if any of them differ.
+
+#include "DataMessageReference.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int numChecked = 0;
+int numFailed = 0;
+
+void check(const char * what, const char * expected, int32_t expectedSize, const char * actual, int32_t actualSize,
+           int32_t sink, int32_t size, bool sendrate, uint64_t timestamp)
+{
+    ++numChecked;
+
+    if (expectedSize > 0 && expectedSize == actualSize && memcmp(expected, actual, expectedSize) == 0) {
+        return;
+    }
+
+    if (++numFailed <= 10) {
+        fprintf(stderr, "%s differs: sink %d, blob size %d, samplerate %d, time stamp %d (%d bytes, expected %d)\n",
+                what, sink, size, (int) sendrate, (int) (timestamp != 0), actualSize, expectedSize);
+    }
+}
+
+}
+
+int main()
+{
+    // ID lengths from 1 to 10 digits, so the address pads every way, and the wildcard
+    const int32_t sinks[] = { 1234567890, 123456789, 12345678, 1234567, 123456, 12345, 1234, 123, 12, 1, 0,
+                              -12, AOO_ID_WILDCARD };
+    const double samplerates[] = { 48000.0, 44100.00723 };
+    const uint64_t timestamps[] = { 0, 0xe3a1b2c3d4e5f607ULL };
+
+    std::vector<char> payload (AOO_MAXPACKETSIZE / 2);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = (char) (i * 37 + 11);
+    }
+
+    // 0 to 16 covers every padding length a few times over, then some larger ones
+    std::vector<int32_t> sizes;
+    for (int32_t n = 0; n <= 16; ++n) {
+        sizes.push_back(n);
+    }
+    for (int32_t n : { 253, 254, 255, 256, 1021, 1022, 1023, 1024 }) {
+        sizes.push_back(n);
+    }
+
+    char expected[AOO_MAXPACKETSIZE];
+    char actual[AOO_MAXPACKETSIZE];
+
+    aoo::data_header header;
+
+    for (int32_t sink : sinks) {
+        for (int32_t size : sizes) {
+            for (double samplerate : samplerates) {
+                for (uint64_t timestamp : timestamps) {
+                    aoo::data_packet d;
+                    d.sequence = 0x01020304 + size;
+                    d.samplerate = samplerate;
+                    d.channel = 3;
+                    d.totalsize = size * 3 + 1;
+                    d.nframes = 4;
+                    d.framenum = 2;
+                    d.data = payload.data();
+                    d.size = size;
+                    d.timestamp = timestamp;
+
+                    const int32_t src = 0x7fff0000 + size;
+                    const int32_t salt = -98765 - size;
+
+                    header.update(sink, src, salt);
+
+                    // poison the output, the hand written messages have to set every byte
+                    memset(actual, 0xa5, sizeof(actual));
+                    int32_t n = header.write(actual, sizeof(actual), d);
+                    int32_t m = DataMessageReference::writeData(expected, sizeof(expected), sink, src, salt, d);
+                    check("data message", expected, m, actual, n, sink, size, true, timestamp);
+
+                    for (bool sendrate : { false, true }) {
+                        memset(actual, 0xa5, sizeof(actual));
+                        n = aoo::write_compact_data(actual, sizeof(actual), salt, d, sendrate, true);
+                        m = DataMessageReference::writeCompactData(expected, sizeof(expected), salt, d, sendrate, true);
+                        check("compact data message", expected, m, actual, n, sink, size, sendrate, timestamp);
+
+                        // the silent block doesn't depend on the blob, only check it once
+                        if (size == 0) {
+                            memset(actual, 0xa5, sizeof(actual));
+                            n = aoo::write_compact_data(actual, sizeof(actual), salt, d, sendrate, false);
+                            m = DataMessageReference::writeCompactData(expected, sizeof(expected), salt, d, sendrate, false);
+                            check("silent block message", expected, m, actual, n, sink, size, sendrate, timestamp);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%d messages compared, %d differ\n", numChecked, numFailed);
+
+    return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Stands in for the generated JuceHeader.h when the Source files that only need the
+// non-GUI modules are built into the tests here (see CMakeLists.txt).
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+using namespace juce;
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Monitor delay line test: an audio thread runs a MonitorDelayLine on a sine while
+// the main thread changes the delay, re-prepares it with more channels and turns it
+// off and on again, the way the channel group monitor delays get driven. Checks that
+//
+//   - process() never allocates or frees memory, or takes a mutex, on the audio thread
+//     (counted with a replaced operator new/delete and, on glibc, an interposed
+//     pthread_mutex_lock)
+//   - the output never jumps further than the sine itself does, so there are no clicks
+//   - a fixed delay comes out exact
+//   - a channel that wasn't processed for a while starts over from silence instead of
+//     playing what was left in the ring from before
+//
+// Exits with 1 if any of them fail.
+
+#include "JuceHeader.h"
+#include "../MonitorDelayLine.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#define HAVE_MUTEX_INTERPOSE 1
+#endif
+
+namespace {
+
+// only what happens on the audio thread inside process() is counted
+thread_local bool watching = false;
+std::atomic<long> numAllocations { 0 };
+std::atomic<long> numLocks { 0 };
+
+void * countedAlloc(size_t n)
+{
+    if (watching) {
+        ++numAllocations;
+    }
+
+    if (void * p = malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void countedFree(void * p)
+{
+    if (watching) {
+        ++numAllocations;
+    }
+    free(p);
+}
+
+}
+
+void * operator new(size_t n) { return countedAlloc(n); }
+void * operator new[](size_t n) { return countedAlloc(n); }
+void operator delete(void * p) noexcept { countedFree(p); }
+void operator delete[](void * p) noexcept { countedFree(p); }
+void operator delete(void * p, size_t) noexcept { countedFree(p); }
+void operator delete[](void * p, size_t) noexcept { countedFree(p); }
+
+#if HAVE_MUTEX_INTERPOSE
+extern "C" int pthread_mutex_lock(pthread_mutex_t * mutex)
+{
+    using LockFn = int (*)(pthread_mutex_t *);
+    static const auto realLock = (LockFn) dlsym(RTLD_NEXT, "pthread_mutex_lock");
+
+    if (watching) {
+        ++numLocks;
+    }
+    return realLock(mutex);
+}
+#endif
+
+
+namespace {
+
+using SonoAudio::MonitorDelayLine;
+
+const double samplerate = 48000.0;
+const int blocksize = 128;
+const double frequency = 220.0;
+
+// the most a 220 Hz sine of amplitude 1 moves in one sample is about 0.029
+const float maxJump = 0.1f;
+
+// returns the largest jump between consecutive output samples
+float runThreaded()
+{
+    MonitorDelayLine delay;
+    delay.setCrossfadeSamples(960);
+    delay.setDelaySamples(4800);
+
+    std::atomic<bool> running { true };
+    float largest = 0.0f;
+
+    std::thread audio([&] {
+        AudioBuffer<float> in (2, blocksize);
+        int64 position = 0;
+        float last = 0.0f;
+
+        while (running) {
+            for (int ch = 0; ch < 2; ++ch) {
+                for (int i = 0; i < blocksize; ++i) {
+                    in.setSample(ch, i, (float) std::sin(2.0 * MathConstants<double>::pi * frequency * (position + i) / samplerate));
+                }
+            }
+
+            watching = true;
+            const bool delayed = delay.process(in, 0, 2, blocksize);
+            watching = false;
+
+            const float * out = delayed ? delay.getOutput().getReadPointer(0) : in.getReadPointer(0);
+            for (int i = 0; i < blocksize; ++i) {
+                if (position + i > 0) {
+                    largest = jmax(largest, std::abs(out[i] - last));
+                }
+                last = out[i];
+            }
+
+            position += blocksize;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    delay.prepare(2, 240000, 4096);
+    Thread::sleep(20);
+    delay.setEnabled(true);
+    Thread::sleep(300);
+
+    for (int k = 0; k < 30; ++k) {
+        delay.setDelaySamples(1000 + (k * 3777) % 90000);
+        if (k == 10) {
+            delay.prepare(4, 240000, 4096);
+        }
+        Thread::sleep(15);
+        if (k == 20) {
+            delay.setEnabled(false);
+        }
+        else if (k == 25) {
+            delay.setEnabled(true);
+        }
+    }
+
+    delay.setEnabled(false);
+    Thread::sleep(200);
+
+    running = false;
+    audio.join();
+
+    return largest;
+}
+
+// input sample n is n + 1, so the expected delayed output is easy to work out
+void fillRamp(AudioBuffer<float> & buffer, int numChannels, int64 position)
+{
+    for (int ch = 0; ch < numChannels; ++ch) {
+        for (int i = 0; i < buffer.getNumSamples(); ++i) {
+            buffer.setSample(ch, i, (float) (position + i + 1));
+        }
+    }
+}
+
+const int exactDelay = 100;
+const int exactBlock = 64;
+
+// returns the number of samples that didn't come out exactly delayed
+int runExact()
+{
+    MonitorDelayLine delay;
+    delay.prepare(1, 1000, exactBlock);
+    delay.setCrossfadeSamples(1);
+    delay.setDelaySamples(exactDelay);
+    delay.setEnabled(true);
+
+    AudioBuffer<float> in (1, exactBlock);
+    int64 position = 0;
+    int wrong = 0;
+
+    for (int block = 0; block < 40; ++block) {
+        fillRamp(in, 1, position);
+        delay.process(in, 0, 1, exactBlock);
+
+        // the first block crossfades from the dry signal
+        if (block > 0) {
+            for (int i = 0; i < exactBlock; ++i) {
+                const int64 source = position + i - exactDelay;
+                // the very first sample written is faded in from nothing
+                const float expected = source > 0 ? (float) (source + 1) : 0.0f;
+                if (delay.getOutput().getSample(0, i) != expected) {
+                    ++wrong;
+                }
+            }
+        }
+
+        position += exactBlock;
+    }
+
+    return wrong;
+}
+
+// returns the number of samples of the second channel that weren't silence or the new input
+int runChannelGrowth()
+{
+    MonitorDelayLine delay;
+    delay.prepare(2, 1000, exactBlock);
+    delay.setCrossfadeSamples(1);
+    delay.setDelaySamples(exactDelay);
+    delay.setEnabled(true);
+
+    AudioBuffer<float> in (2, exactBlock);
+    int64 position = 0;
+
+    // both channels, then only the first for a bit, so the second channel's part of the
+    // ring still holds old input where the delay will read it
+    for (int block = 0; block < 40; ++block) {
+        const int chans = block < 30 ? 2 : 1;
+        fillRamp(in, chans, position);
+        if (chans == 2) {
+            in.applyGain(1, 0, exactBlock, -1.0f);
+        }
+        delay.process(in, 0, chans, exactBlock);
+        position += exactBlock;
+    }
+
+    const int64 grownAt = position;
+    int wrong = 0;
+
+    for (int block = 0; block < 10; ++block) {
+        fillRamp(in, 2, position);
+        delay.process(in, 0, 2, exactBlock);
+
+        for (int i = 0; i < exactBlock; ++i) {
+            const int64 source = position + i - exactDelay;
+            // silence until the delay has caught up with the first new sample, which is faded in
+            const float expected = source > grownAt ? (float) (source + 1) : 0.0f;
+            if (delay.getOutput().getSample(1, i) != expected) {
+                ++wrong;
+            }
+        }
+
+        position += exactBlock;
+    }
+
+    return wrong;
+}
+
+}
+
+int main()
+{
+    const float largest = runThreaded();
+    const int exactWrong = runExact();
+    const int growthWrong = runChannelGrowth();
+
+    printf("audio thread: %ld allocations, %ld mutex locks%s\n", numAllocations.load(), numLocks.load(),
+#if HAVE_MUTEX_INTERPOSE
+           ""
+#else
+           " (not counted here)"
+#endif
+           );
+    printf("largest output jump: %.4f (limit %.4f)\n", largest, maxJump);
+    printf("exact delay: %d wrong samples, channel growth: %d wrong samples\n", exactWrong, growthWrong);
+
+    const bool ok = numAllocations == 0 && numLocks == 0 && largest < maxJump && exactWrong == 0 && growthWrong == 0;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Group relay fan out test: one source streams to several sinks that are all marked
+// as reached through the group relay. The group function stands in for the connection
+// server's /relay/group, counting what gets uploaded and handing every packet to all
+// of the sinks.
+//
+// Checks that each block is uploaded once for the whole group instead of once per
+// sink, and that every sink still plays the stream.
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const int samplerate = 48000;
+const int blocksize = 256;
+const int numChannels = 2;
+const int numSinks = 3;
+const int numBlocks = 4000;
+
+aoo::isource * source = nullptr;
+aoo::isink * sinks[numSinks] = {};
+int sourceEndpoint = 0;
+int sinkEndpoints[numSinks] = { 0, 1, 2 };
+
+long groupPackets = 0;
+long directPackets[numSinks] = {};
+
+template<int index>
+int32_t sendToSource(void *, const char * data, int32_t n)
+{
+    source->handle_message(data, n, &sinkEndpoints[index], nullptr);
+    return n;
+}
+
+const aoo_replyfn replyFns[numSinks] = { sendToSource<0>, sendToSource<1>, sendToSource<2> };
+
+// format, pings and anything else that isn't fanned out
+int32_t sendToSink(void * user, const char * data, int32_t n)
+{
+    const int index = *static_cast<int *>(user);
+    ++directPackets[index];
+    sinks[index]->handle_message(data, n, &sourceEndpoint, replyFns[index]);
+    return n;
+}
+
+// the relay: one upload, delivered to every member
+int32_t sendToGroup(void *, const char * data, int32_t n)
+{
+    ++groupPackets;
+    for (int i = 0; i < numSinks; ++i) {
+        sinks[i]->handle_message(data, n, &sourceEndpoint, replyFns[i]);
+    }
+    return n;
+}
+
+}
+
+int main()
+{
+    aoo_initialize();
+
+    source = aoo::isource::create(1);
+    source->setup(samplerate, blocksize, numChannels);
+
+    aoo_format_pcm format;
+    format.header.codec = AOO_CODEC_PCM;
+    format.header.nchannels = numChannels;
+    format.header.samplerate = samplerate;
+    format.header.blocksize = blocksize;
+    format.bitdepth = AOO_PCM_INT16;
+    source->set_format(format.header);
+    // a whole block per packet, compact data is only used for single frame blocks
+    source->set_packetsize(AOO_MAXPACKETSIZE);
+
+    aoo_relay_group group = { sendToGroup, nullptr };
+    source->set_option(aoo_opt_relay_group, &group, sizeof(group));
+
+    for (int i = 0; i < numSinks; ++i) {
+        sinks[i] = aoo::isink::create(10 + i);
+        sinks[i]->setup(samplerate, blocksize, numChannels);
+        int32_t buffersize = 60;
+        sinks[i]->set_option(aoo_opt_buffersize, &buffersize, sizeof(buffersize));
+
+        source->add_sink(&sinkEndpoints[i], 10 + i, sendToSink);
+        // what the sinks would tell us in their invitation, as SonoBus peers do
+        int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+        source->set_sinkoption(&sinkEndpoints[i], 10 + i, aoo_opt_protocol_flags, &flags, sizeof(flags));
+        int32_t relayed = 1;
+        source->set_sinkoption(&sinkEndpoints[i], 10 + i, aoo_opt_relay_group, &relayed, sizeof(relayed));
+    }
+    source->start();
+
+    std::vector<std::vector<float>> in(numChannels, std::vector<float>(blocksize));
+    std::vector<std::vector<float>> out(numChannels, std::vector<float>(blocksize));
+    const aoo_sample * inputs[numChannels];
+    aoo_sample * outputs[numChannels];
+    for (int ch = 0; ch < numChannels; ++ch) {
+        inputs[ch] = in[ch].data();
+        outputs[ch] = out[ch].data();
+    }
+
+    double energy[numSinks] = {};
+    long position = 0;
+    uint64_t t = aoo_osctime_get();
+
+    for (int block = 0; block < numBlocks; ++block) {
+        for (int i = 0; i < blocksize; ++i) {
+            const float v = 0.5f * std::sin(2.0 * M_PI * 440.0 * (position + i) / samplerate);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                in[ch][i] = v;
+            }
+        }
+        position += blocksize;
+        t += aoo_osctime_fromseconds((double) blocksize / samplerate);
+
+        source->process(inputs, blocksize, t);
+        source->send();
+
+        for (int s = 0; s < numSinks; ++s) {
+            sinks[s]->send();
+
+            for (auto & o : out) {
+                std::fill(o.begin(), o.end(), 0.0f);
+            }
+            sinks[s]->process_add(outputs, blocksize, t);
+
+            // only the second half counts, after the stream has settled
+            if (block >= numBlocks / 2) {
+                for (int i = 0; i < blocksize; ++i) {
+                    energy[s] += out[0][i] * out[0][i];
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+
+    // every block goes up once for the group, give or take the start up
+    const long expected = numBlocks;
+    printf("blocks: %d, group uploads: %ld\n", numBlocks, groupPackets);
+    ok = ok && groupPackets > expected * 9 / 10 && groupPackets <= expected;
+
+    // a sine of amplitude 0.5 has a mean square of 0.125
+    const double expectedEnergy = 0.125 * blocksize * (numBlocks / 2);
+    for (int s = 0; s < numSinks; ++s) {
+        printf("sink %d: direct packets %ld, energy %.2f of %.2f\n", s, directPackets[s], energy[s], expectedEnergy);
+        ok = ok && directPackets[s] < expected / 10 && energy[s] > expectedEnergy * 0.9;
+    }
+
+    for (auto * sink : sinks) {
+        aoo::isink::destroy(sink);
+    }
+    aoo::isource::destroy(source);
+    aoo_terminate();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Relay group sender test: four peers, each with its own source and a remote sink, the
+// way the processor has them. Three are reached through the relay and one directly.
+// The processor's RelayGroupSender decides who shares the group source, and the group
+// function stands in for the connection server's /relay/group, handing every packet to
+// all of the other members (including the direct one, which has to ignore it).
+//
+// Goes through the group forming, one peer leaving it when its format differs, the
+// group breaking up when only one peer is left, and a peer going away. Checks that
+//
+//   - while peers share the group, their audio goes up once per block for all of them,
+//     and their own sources send them (next to) nothing
+//   - every remote sink keeps playing the stream through all of that, and only once
+//     (a sink that left the group must not also play what the relay still hands it)
+//   - a codec change request sent to the group source goes to the requesting peer's
+//     own source instead, with its sink handed back, and leaves the group source alone
+//
+// Exits with 1 if any of them fail.
+
+#include "JuceHeader.h"
+#include "../RelayGroupSender.h"
+
+#include "aoo/aoo_pcm.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using SonoAudio::RelayGroupSender;
+
+const int samplerate = 48000;
+const int blocksize = 256;
+const int numChannels = 2;
+const int numPeers = 4;
+const int blocksPerPhase = 2000;
+const int32_t groupSourceId = 60000;
+
+struct Peer
+{
+    aoo::isource * source = nullptr; // ours, for this peer
+    aoo::isink * sink = nullptr;     // theirs
+    int32_t sinkId = 0;
+    bool relayed = false;
+    int formatIndex = 0;
+};
+
+Peer peers[numPeers];
+RelayGroupSender * groupSender = nullptr;
+
+// our endpoint as the remote sinks know it, and theirs as we know them
+int ourEndpoint = 0;
+int peerEndpoints[numPeers] = { 0, 1, 2, 3 };
+
+// what went up, per peer through its own source, and once for the group
+long peerPackets[numPeers] = {};
+long groupPackets = 0;
+long redirectedCodecChanges = 0;
+
+// from a remote sink to us, dispatched by source id like handleReceivedPacket() does
+template<int index>
+int32_t sendToUs(void *, const char * data, int32_t n);
+
+// from us to one remote sink
+template<int index>
+int32_t sendToPeer(void *, const char * data, int32_t n)
+{
+    ++peerPackets[index];
+    peers[index].sink->handle_message(data, n, &ourEndpoint, sendToUs<index>);
+    return n;
+}
+
+const aoo_replyfn sendFns[numPeers] = { sendToPeer<0>, sendToPeer<1>, sendToPeer<2>, sendToPeer<3> };
+
+template<int index>
+int32_t sendToUs(void *, const char * data, int32_t n)
+{
+    int32_t type, id;
+    if (!aoo_parse_pattern(data, n, &type, &id) || type != AOO_TYPE_SOURCE) {
+        return n;
+    }
+
+    if (id == groupSourceId) {
+        char readdressed[AOO_MAXPACKETSIZE];
+        int32_t sinkId = AOO_ID_NONE;
+        const int32_t size = RelayGroupSender::readdressCodecChange(data, n, index + 1, readdressed, sizeof(readdressed), sinkId);
+
+        if (size > 0 && sinkId == peers[index].sinkId) {
+            ++redirectedCodecChanges;
+
+            RelayGroupSender::Candidate candidate;
+            candidate.endpoint = &peerEndpoints[index];
+            candidate.sendFn = sendFns[index];
+            candidate.peerSource = peers[index].source;
+            candidate.sinkId = peers[index].sinkId;
+            candidate.sinkFlags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+            groupSender->returnSink(candidate);
+
+            peers[index].source->handle_message(readdressed, size, &peerEndpoints[index], sendFns[index]);
+        } else {
+            groupSender->getSource()->handle_message(data, n, &peerEndpoints[index], sendFns[index]);
+        }
+    }
+    else {
+        peers[index].source->handle_message(data, n, &peerEndpoints[index], sendFns[index]);
+    }
+    return n;
+}
+
+// the server's relay: one upload, delivered to everyone else in the group
+bool sendToGroup(const char * group, const char * data, int32_t n)
+{
+    if (strcmp(group, "band") != 0) {
+        return false;
+    }
+
+    ++groupPackets;
+
+    const aoo_replyfn replies[numPeers] = { sendToUs<0>, sendToUs<1>, sendToUs<2>, sendToUs<3> };
+    for (int i = 0; i < numPeers; ++i) {
+        peers[i].sink->handle_message(data, n, &ourEndpoint, replies[i]);
+    }
+    return true;
+}
+
+void setFormat(aoo::isource & source, int formatIndex)
+{
+    aoo_format_pcm format;
+    format.header.codec = AOO_CODEC_PCM;
+    format.header.nchannels = numChannels;
+    format.header.samplerate = samplerate;
+    format.header.blocksize = blocksize;
+    format.bitdepth = formatIndex == 0 ? AOO_PCM_INT16 : AOO_PCM_INT24;
+    source.set_format(format.header);
+}
+
+int getBitDepth(aoo::isource & source)
+{
+    aoo_format_storage format;
+    if (source.get_format(format) <= 0) {
+        return -1;
+    }
+    return ((aoo_format_pcm *) &format)->bitdepth;
+}
+
+// what updateRelayGroup() does with the processor's peers
+void updateGroup(const bool eligible[numPeers], const bool present[numPeers])
+{
+    RelayGroupSender::Candidate candidates[numPeers];
+    int candidatePeers[numPeers];
+    int numCandidates = 0;
+
+    for (int i = 0; i < numPeers; ++i) {
+        if (!present[i]) continue;
+
+        auto & candidate = candidates[numCandidates];
+        candidate.endpoint = &peerEndpoints[i];
+        candidate.sendFn = sendFns[i];
+        candidate.peerSource = peers[i].source;
+        candidate.sinkId = peers[i].sinkId;
+        candidate.sinkFlags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+        candidate.sending = true;
+        candidate.eligible = peers[i].relayed && eligible[i];
+        candidate.settings.numChannels = numChannels;
+        candidate.settings.formatIndex = peers[i].formatIndex;
+        candidate.settings.packetSize = AOO_MAXPACKETSIZE;
+
+        candidatePeers[numCandidates++] = i;
+    }
+
+    groupSender->update("band", candidates, numCandidates, [&](aoo::isource & source, int index) {
+        source.setup(samplerate, blocksize, numChannels);
+        setFormat(source, peers[candidatePeers[index]].formatIndex);
+        // a whole block per packet, compact data is only used for single frame blocks
+        source.set_packetsize(AOO_MAXPACKETSIZE);
+    });
+}
+
+struct PhaseResult
+{
+    long groupPackets = 0;
+    long peerPackets[numPeers] = {};
+    double energy[numPeers] = {};
+};
+
+long position = 0;
+uint64_t now = 0;
+
+// runs blocks through everything like processBlock() and the send thread do, returns
+// what got sent and played in the second half, after things have settled
+PhaseResult runPhase(const bool present[numPeers])
+{
+    std::vector<std::vector<float>> in(numChannels, std::vector<float>(blocksize));
+    std::vector<std::vector<float>> out(numChannels, std::vector<float>(blocksize));
+    const aoo_sample * inputs[numChannels];
+    aoo_sample * outputs[numChannels];
+    for (int ch = 0; ch < numChannels; ++ch) {
+        inputs[ch] = in[ch].data();
+        outputs[ch] = out[ch].data();
+    }
+
+    PhaseResult result;
+
+    for (int block = 0; block < blocksPerPhase; ++block) {
+        if (block == blocksPerPhase / 2) {
+            result.groupPackets = -groupPackets;
+            for (int i = 0; i < numPeers; ++i) {
+                result.peerPackets[i] = -peerPackets[i];
+            }
+        }
+
+        for (int i = 0; i < blocksize; ++i) {
+            const float v = 0.5f * std::sin(2.0 * M_PI * 440.0 * (position + i) / samplerate);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                in[ch][i] = v;
+            }
+        }
+        position += blocksize;
+        now += aoo_osctime_fromseconds((double) blocksize / samplerate);
+
+        for (int i = 0; i < numPeers; ++i) {
+            if (present[i]) {
+                peers[i].source->process(inputs, blocksize, now);
+            }
+        }
+        if (groupSender->getNumMembers() > 0) {
+            groupSender->getSource()->process(inputs, blocksize, now);
+        }
+
+        for (int i = 0; i < numPeers; ++i) {
+            if (present[i]) {
+                peers[i].source->send();
+            }
+        }
+        groupSender->getSource()->send();
+
+        for (int i = 0; i < numPeers; ++i) {
+            if (!present[i]) continue;
+
+            peers[i].sink->send();
+
+            for (auto & o : out) {
+                std::fill(o.begin(), o.end(), 0.0f);
+            }
+            peers[i].sink->process_add(outputs, blocksize, now);
+
+            if (block >= blocksPerPhase / 2) {
+                for (int k = 0; k < blocksize; ++k) {
+                    result.energy[i] += out[0][k] * out[0][k];
+                }
+            }
+        }
+    }
+
+    result.groupPackets += groupPackets;
+    for (int i = 0; i < numPeers; ++i) {
+        result.peerPackets[i] += peerPackets[i];
+    }
+
+    return result;
+}
+
+// a sine of amplitude 0.5 has a mean square of 0.125
+const double expectedEnergy = 0.125 * blocksize * (blocksPerPhase / 2);
+const long measuredBlocks = blocksPerPhase / 2;
+
+// the stream once, not twice from two sources
+bool plays(const PhaseResult & result, int index)
+{
+    return result.energy[index] > expectedEnergy * 0.9 && result.energy[index] < expectedEnergy * 1.1;
+}
+
+// about one packet per block
+bool streams(long packets)
+{
+    return packets > measuredBlocks * 9 / 10 && packets <= measuredBlocks * 11 / 10;
+}
+
+// pings and such, but no audio
+bool quiet(long packets)
+{
+    return packets < measuredBlocks / 10;
+}
+
+bool check(const char * name, const PhaseResult & result, const bool present[numPeers],
+           const bool inGroup[numPeers], bool groupStreams)
+{
+    bool ok = groupStreams ? streams(result.groupPackets) : quiet(result.groupPackets);
+
+    printf("%s: group uploads %ld\n", name, result.groupPackets);
+
+    for (int i = 0; i < numPeers; ++i) {
+        if (!present[i]) continue;
+
+        const bool member = groupSender->isMember(&peerEndpoints[i], peers[i].sinkId);
+        const bool peerOk = member == inGroup[i] && plays(result, i)
+            && (inGroup[i] ? quiet(result.peerPackets[i]) : streams(result.peerPackets[i]));
+
+        printf("  peer %d (%s): %s, own source packets %ld, energy %.2f of %.2f%s\n", i,
+               peers[i].relayed ? "relayed" : "direct", member ? "in group" : "own stream",
+               result.peerPackets[i], result.energy[i], expectedEnergy, peerOk ? "" : "  <- wrong");
+
+        ok = ok && peerOk;
+    }
+
+    return ok;
+}
+
+}
+
+int main()
+{
+    aoo_initialize();
+
+    auto sender = std::make_unique<RelayGroupSender>(groupSourceId, sendToGroup);
+    groupSender = sender.get();
+
+    for (int i = 0; i < numPeers; ++i) {
+        auto & peer = peers[i];
+        peer.relayed = i < 3;
+        peer.sinkId = 100 + i;
+
+        peer.source = aoo::isource::create(i + 1);
+        peer.source->setup(samplerate, blocksize, numChannels);
+        setFormat(*peer.source, peer.formatIndex);
+        peer.source->set_packetsize(AOO_MAXPACKETSIZE);
+        peer.source->set_respect_codec_change_requests(1);
+
+        peer.sink = aoo::isink::create(peer.sinkId);
+        peer.sink->setup(samplerate, blocksize, numChannels);
+        int32_t buffersize = 60;
+        peer.sink->set_option(aoo_opt_buffersize, &buffersize, sizeof(buffersize));
+
+        // what the invite from their sink sets up
+        peer.source->add_sink(&peerEndpoints[i], peer.sinkId, sendFns[i]);
+        int32_t flags = AOO_PROTOCOL_FLAG_COMPACT_DATA;
+        peer.source->set_sinkoption(&peerEndpoints[i], peer.sinkId, aoo_opt_protocol_flags, &flags, sizeof(flags));
+        peer.source->start();
+    }
+
+    bool ok = true;
+    const bool everyone[numPeers] = { true, true, true, true };
+
+    // the three relayed peers share the group
+    {
+        updateGroup(everyone, everyone);
+        const bool inGroup[numPeers] = { true, true, true, false };
+        ok = check("all relayed in the group", runPhase(everyone), everyone, inGroup, true) && ok;
+    }
+
+    // peer 1 asks the group source for another codec, which its own source takes,
+    // and then it doesn't match the group any more
+    {
+        aoo_format_pcm format;
+        format.header.codec = AOO_CODEC_PCM;
+        format.header.nchannels = numChannels;
+        format.header.samplerate = samplerate;
+        format.header.blocksize = blocksize;
+        format.bitdepth = AOO_PCM_INT24;
+        peers[1].sink->request_source_codec_change(&ourEndpoint, groupSourceId, format.header);
+        peers[1].sink->send();
+
+        const bool changed = getBitDepth(*peers[1].source) == AOO_PCM_INT24 && getBitDepth(*sender->getSource()) == AOO_PCM_INT16;
+        printf("codec change request: %ld redirected, peer source %s, group source %s\n", redirectedCodecChanges,
+               getBitDepth(*peers[1].source) == AOO_PCM_INT24 ? "changed" : "unchanged",
+               getBitDepth(*sender->getSource()) == AOO_PCM_INT16 ? "unchanged" : "changed");
+        ok = ok && redirectedCodecChanges == 1 && changed;
+
+        peers[1].formatIndex = 1;
+        updateGroup(everyone, everyone);
+        const bool inGroup[numPeers] = { true, false, true, false };
+        ok = check("one peer with another format", runPhase(everyone), everyone, inGroup, true) && ok;
+    }
+
+    // peer 2 gets something routed to it as well, one member is no group
+    {
+        const bool eligible[numPeers] = { true, true, false, true };
+        updateGroup(eligible, everyone);
+        const bool inGroup[numPeers] = { false, false, false, false };
+        ok = check("group broken up", runPhase(everyone), everyone, inGroup, false) && ok;
+    }
+
+    // back together, then peer 0 goes away without telling anyone
+    {
+        peers[1].formatIndex = 0;
+        setFormat(*peers[1].source, 0);
+        updateGroup(everyone, everyone);
+        const bool inGroup[numPeers] = { true, true, true, false };
+        ok = check("regrouped", runPhase(everyone), everyone, inGroup, true) && ok;
+
+        const bool present[numPeers] = { false, true, true, true };
+        sender->removeSink(&peerEndpoints[0], peers[0].sinkId);
+        updateGroup(everyone, present);
+        const bool inGroupAfter[numPeers] = { false, true, true, false };
+        ok = check("one peer gone", runPhase(present), present, inGroupAfter, true) && ok;
+        ok = ok && !sender->isMember(&peerEndpoints[0], peers[0].sinkId) && sender->getNumMembers() == 2;
+    }
+
+    for (auto & peer : peers) {
+        aoo::isink::destroy(peer.sink);
+        aoo::isource::destroy(peer.source);
+    }
+    sender.reset();
+    groupSender = nullptr;
+    aoo_terminate();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Send routing benchmark: every peer's received audio is cross-routed to every other
+// peer, the way processBlock builds what it sends to each peer, done both ways:
+//
+//   direct   each destination walks the whole send matrix and pans every routed
+//            source into its own send buffer (what processBlock used to do)
+//   routes   the matrix is compiled into per-destination source lists, each routed
+//            source is panned once into its send mix, and the destinations just add
+//            those (what compileSendRoutes() and processBlock do now)
+//
+// Runs with steady pans and with pans that move every block, prints the time per
+// block for both and the largest difference between their outputs, which should
+// only come from the order of summation.
+// Usage: sonobus_sendroutingbench [peers] [blocks]
+
+#include "JuceHeader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const int maxPeers = 32;
+const int blocksize = 256;
+const int maxChannels = 2;
+
+struct Peer
+{
+    AudioSampleBuffer workBuffer;
+    // stereo, then mono
+    AudioSampleBuffer sendMixBuffer;
+    AudioSampleBuffer out;
+    int recvChannels = 2;
+    int sendChannels = 2;
+    float recvPan[maxChannels] = { 0.0f, 0.0f };
+    float recvStereoPan[maxChannels] = { -1.0f, 1.0f };
+    float recvPanLast[maxChannels] = { -1.0f, 1.0f };
+};
+
+// same as SonobusAudioProcessor::addRemotePeerToSendMix()
+void addToSendMix(Peer & source, AudioSampleBuffer & dest, int destStartChannel, int destChannels, int numSamples, float gain)
+{
+    for (int channel = 0; channel < destChannels; ++channel) {
+        if (source.recvChannels > 0 && destChannels > 1) {
+            for (int ch=0; ch < source.recvChannels; ++ch) {
+                const float pan = source.recvChannels == 2 ? source.recvStereoPan[ch] : source.recvPan[ch];
+                const float lastpan = source.recvPanLast[ch];
+
+                float pgain = channel == 0 ? (pan >= 0.0f ? (1.0f - pan) : 1.0f) : (pan >= 0.0f ? 1.0f : (1.0f+pan)) ;
+
+                if (pan != lastpan) {
+                    float plastgain = channel == 0 ? (lastpan >= 0.0f ? (1.0f - lastpan) : 1.0f) : (lastpan >= 0.0f ? 1.0f : (1.0f+lastpan));
+                    dest.addFromWithRamp(destStartChannel + channel, 0, source.workBuffer.getReadPointer(ch), numSamples, plastgain * gain, pgain * gain);
+                } else {
+                    dest.addFrom (destStartChannel + channel, 0, source.workBuffer, ch, 0, numSamples, pgain * gain);
+                }
+            }
+        } else if (channel < source.workBuffer.getNumChannels()) {
+            dest.addFrom(destStartChannel + channel, 0, source.workBuffer, channel, 0, numSamples, gain);
+        }
+    }
+}
+
+struct Router
+{
+    std::vector<Peer> peers;
+    bool matrix[maxPeers][maxPeers] = {};
+    int routeSources[maxPeers][maxPeers];
+    int routeCount[maxPeers] = {};
+
+    Router(int numPeers) : peers((size_t) numPeers)
+    {
+        Random rng (1);
+        for (int i = 0; i < numPeers; ++i) {
+            auto & p = peers[(size_t) i];
+            p.workBuffer.setSize(maxChannels, blocksize);
+            p.sendMixBuffer.setSize(3, blocksize);
+            p.out.setSize(maxChannels, blocksize);
+            for (int ch = 0; ch < maxChannels; ++ch) {
+                for (int s = 0; s < blocksize; ++s) {
+                    p.workBuffer.setSample(ch, s, rng.nextFloat() * 2.0f - 1.0f);
+                }
+            }
+            for (int j = 0; j < numPeers; ++j) {
+                matrix[i][j] = i != j;
+            }
+        }
+        compileRoutes();
+    }
+
+    void compileRoutes()
+    {
+        for (int dest = 0; dest < maxPeers; ++dest) {
+            int count = 0;
+            for (int src = 0; src < maxPeers; ++src) {
+                if (matrix[src][dest]) {
+                    routeSources[dest][count++] = src;
+                }
+            }
+            routeCount[dest] = count;
+        }
+    }
+
+    void movePans(int block)
+    {
+        for (auto & p : peers) {
+            for (int ch = 0; ch < maxChannels; ++ch) {
+                p.recvPanLast[ch] = p.recvStereoPan[ch];
+            }
+            p.recvStereoPan[0] = -1.0f + 0.5f * (float) (block % 3) / 3.0f;
+            p.recvStereoPan[1] = 1.0f - 0.5f * (float) (block % 5) / 5.0f;
+        }
+    }
+
+    void settlePans()
+    {
+        for (auto & p : peers) {
+            for (int ch = 0; ch < maxChannels; ++ch) {
+                p.recvPanLast[ch] = p.recvStereoPan[ch];
+            }
+        }
+    }
+
+    void processDirect()
+    {
+        const int n = (int) peers.size();
+        for (int i = 0; i < n; ++i) {
+            auto & remote = peers[(size_t) i];
+            remote.out.clear(0, blocksize);
+            for (int j = 0; j < n; ++j) {
+                if (matrix[j][i]) {
+                    addToSendMix(peers[(size_t) j], remote.out, 0, remote.sendChannels, blocksize, 1.0f);
+                }
+            }
+        }
+    }
+
+    void processRoutes()
+    {
+        enum { StereoMix = 1, MonoMix = 2 };
+        int mixlayouts[maxPeers] = { 0 };
+        const int n = (int) peers.size();
+
+        for (int dest = 0; dest < n; ++dest) {
+            const int layout = peers[(size_t) dest].sendChannels > 1 ? StereoMix : MonoMix;
+            for (int k = 0; k < routeCount[dest]; ++k) {
+                mixlayouts[routeSources[dest][k]] |= layout;
+            }
+        }
+
+        for (int src = 0; src < n; ++src) {
+            auto & remote = peers[(size_t) src];
+            if (mixlayouts[src] == 0) continue;
+            remote.sendMixBuffer.clear(0, blocksize);
+            if (mixlayouts[src] & StereoMix) {
+                addToSendMix(remote, remote.sendMixBuffer, 0, 2, blocksize, 1.0f);
+            }
+            if (mixlayouts[src] & MonoMix) {
+                addToSendMix(remote, remote.sendMixBuffer, 2, 1, blocksize, 1.0f);
+            }
+        }
+
+        for (int i = 0; i < n; ++i) {
+            auto & remote = peers[(size_t) i];
+            remote.out.clear(0, blocksize);
+            for (int k = 0; k < routeCount[i]; ++k) {
+                auto & cross = peers[(size_t) routeSources[i][k]];
+                for (int channel = 0; channel < remote.sendChannels; ++channel) {
+                    const int mixch = remote.sendChannels > 1 ? jmin(channel, 1) : 2;
+                    remote.out.addFrom(channel, 0, cross.sendMixBuffer, mixch, 0, blocksize);
+                }
+            }
+        }
+    }
+
+    std::vector<float> outputs() const
+    {
+        std::vector<float> all;
+        for (auto & p : peers) {
+            for (int ch = 0; ch < p.sendChannels; ++ch) {
+                all.insert(all.end(), p.out.getReadPointer(ch), p.out.getReadPointer(ch) + blocksize);
+            }
+        }
+        return all;
+    }
+};
+
+template<typename Fn>
+double microsPerBlock(Router & router, int blocks, bool ramping, Fn && process)
+{
+    double total = 0.0;
+    for (int b = 0; b < blocks; ++b) {
+        if (ramping) {
+            router.movePans(b);
+        } else {
+            router.settlePans();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        process();
+        total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    return total / blocks;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    const int numPeers = argc > 1 ? jlimit(2, maxPeers, atoi(argv[1])) : 16;
+    const int blocks = argc > 2 ? jmax(1, atoi(argv[2])) : 5000;
+
+    Router router (numPeers);
+
+    printf("%d peers, fully cross-routed (%d sources per destination), %d samples per block\n",
+           numPeers, numPeers - 1, blocksize);
+
+    for (int ramping = 0; ramping < 2; ++ramping) {
+        const double direct = microsPerBlock(router, blocks, ramping, [&] { router.processDirect(); });
+        const double routes = microsPerBlock(router, blocks, ramping, [&] { router.processRoutes(); });
+        printf("%s pans:  direct %7.1f us/block   routes %7.1f us/block\n",
+               ramping ? "ramping" : "steady ", direct, routes);
+    }
+
+    // compare the outputs of one ramping block
+    router.movePans(1);
+    router.processDirect();
+    const auto expected = router.outputs();
+    router.processRoutes();
+    const auto actual = router.outputs();
+
+    float maxdiff = 0.0f;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        maxdiff = jmax(maxdiff, std::abs(expected[i] - actual[i]));
+    }
+    printf("output difference: max %g\n", maxdiff);
+
+    return maxdiff < 1e-4f ? 0 : 1;
+}
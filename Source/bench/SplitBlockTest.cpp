@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Split block test: feeds a source -> sink stream a ramp, handing the source each
+// host block either whole or split into odd sized pieces (as hosts with varying
+// buffer sizes do), and checks that what comes out of the sink is still a gapless
+// ramp on every channel.
+//
+// Usage: sonobus_splittest [mode] [channels] [codec blocksize]
+//   mode 0  whole blocks
+//        1  odd splits throughout
+//        2  odd splits for a while, then whole blocks again
+//
+// Prints the number of discontinuities and exits with 1 if there were any.
+
+#include "aoo/aoo.hpp"
+#include "aoo/aoo_pcm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const int samplerate = 48000;
+const int blocksize = 256;
+const int maxChannels = 8;
+const int rampLength = 4096;
+const float rampScale = 16384.0f;
+
+aoo::isource * source = nullptr;
+aoo::isink * sink = nullptr;
+int sourceEndpoint = 0;
+int sinkEndpoint = 0;
+
+int32_t sendToSource(void *, const char * data, int32_t n)
+{
+    source->handle_message(data, n, &sinkEndpoint, nullptr);
+    return n;
+}
+
+int32_t sendToSink(void *, const char * data, int32_t n)
+{
+    sink->handle_message(data, n, &sourceEndpoint, sendToSource);
+    return n;
+}
+
+// channel c carries the same ramp offset by c * 2 * rampLength
+float rampValue(long pos, int channel)
+{
+    return (float) ((pos % rampLength) + 1 + channel * 2 * rampLength) / rampScale;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    const int mode = argc > 1 ? atoi(argv[1]) : 0;
+    const int numChannels = argc > 2 ? std::max(1, std::min(maxChannels, atoi(argv[2]))) : 2;
+    const int codecBlocksize = argc > 3 ? std::max(1, atoi(argv[3])) : blocksize;
+
+    aoo_initialize();
+
+    source = aoo::isource::create(1);
+    sink = aoo::isink::create(2);
+    source->setup(samplerate, blocksize, numChannels);
+    sink->setup(samplerate, blocksize, numChannels);
+
+    int32_t buffersize = 60;
+    sink->set_option(aoo_opt_buffersize, &buffersize, sizeof(buffersize));
+    // keep the resampler out of it, so the ramp comes out exactly
+    int32_t dynamicResampling = 0;
+    sink->set_option(aoo_opt_dynamic_resampling, &dynamicResampling, sizeof(dynamicResampling));
+    source->set_option(aoo_opt_dynamic_resampling, &dynamicResampling, sizeof(dynamicResampling));
+
+    aoo_format_pcm format;
+    format.header.codec = AOO_CODEC_PCM;
+    format.header.nchannels = numChannels;
+    format.header.samplerate = samplerate;
+    format.header.blocksize = codecBlocksize;
+    format.bitdepth = AOO_PCM_FLOAT32;
+    source->set_format(format.header);
+    source->add_sink(&sinkEndpoint, 2, sendToSink);
+    source->start();
+
+    std::vector<std::vector<float>> in(numChannels, std::vector<float>(blocksize));
+    std::vector<std::vector<float>> out(numChannels, std::vector<float>(blocksize));
+    std::vector<aoo_sample *> outputs(numChannels);
+    for (int ch = 0; ch < numChannels; ++ch) {
+        outputs[ch] = out[ch].data();
+    }
+
+    const int splits[] = { 100, 37, 1, 118, 200, 13, 255, 7 };
+    const int numSplits = sizeof(splits) / sizeof(splits[0]);
+    int splitIndex = 0;
+
+    long position = 0, received = 0, discontinuities = 0;
+    double last = -1.0;
+    double processTime = 0.0;
+    long processCalls = 0;
+
+    uint64_t t = aoo_osctime_get();
+
+    for (int block = 0; block < 6000; ++block) {
+        for (int i = 0; i < blocksize; ++i) {
+            for (int ch = 0; ch < numChannels; ++ch) {
+                in[ch][i] = rampValue(position + i, ch);
+            }
+        }
+        position += blocksize;
+
+        const bool split = mode == 1 || (mode == 2 && block >= 1000 && block < 3000);
+
+        for (int done = 0; done < blocksize; ) {
+            const int n = split ? std::min(splits[splitIndex++ % numSplits], blocksize - done) : blocksize;
+
+            const aoo_sample * inputs[maxChannels];
+            for (int ch = 0; ch < numChannels; ++ch) {
+                inputs[ch] = in[ch].data() + done;
+            }
+
+            t += aoo_osctime_fromseconds((double) n / samplerate);
+
+            const auto start = std::chrono::steady_clock::now();
+            source->process(inputs, n, t);
+            processTime += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            ++processCalls;
+
+            done += n;
+        }
+
+        source->send();
+        sink->send();
+
+        for (auto & o : out) {
+            std::fill(o.begin(), o.end(), 0.0f);
+        }
+        sink->process_add(outputs.data(), blocksize, t);
+
+        for (int i = 0; i < blocksize; ++i) {
+            const double v = out[0][i] * rampScale;
+            if (v == 0.0) {
+                continue; // not started yet, or an underrun
+            }
+            // let the stream settle first
+            if (++received < 2048) {
+                last = v;
+                continue;
+            }
+
+            for (int ch = 1; ch < numChannels; ++ch) {
+                if (std::fabs(out[ch][i] * rampScale - v - ch * 2 * rampLength) > 1e-2) {
+                    ++discontinuities;
+                }
+            }
+
+            const bool next = std::fabs(v - last - 1.0) < 1e-2;
+            const bool wrapped = last > rampLength - 0.5 && std::fabs(v - 1.0) < 1e-2;
+            if (last >= 0.0 && !next && !wrapped) {
+                ++discontinuities;
+            }
+            last = v;
+        }
+    }
+
+    printf("mode %d, %d channels, codec blocksize %d: %ld samples, %ld discontinuities, process %.2f us/call\n",
+           mode, numChannels, codecBlocksize, received, discontinuities, processTime / processCalls);
+
+    aoo::isource::destroy(source);
+    aoo::isink::destroy(sink);
+    aoo_terminate();
+
+    // most of the stream has to have made it through, too
+    return (discontinuities == 0 && received > (long) blocksize * 5000) ? 0 : 1;
+}
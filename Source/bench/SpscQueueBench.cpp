@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPLv3-or-later WITH Appstore-exception
+// Copyright (C) 2021 Jesse Chappell
+
+// Contention benchmark for the aoo lock-free queues: a producer and a consumer
+// thread hammer the same queue, once with the original lockfree::queue and once
+// with lockfree::spsc_queue, in the ways the audio paths use them:
+//
+//   blocks   audio blocks written and read in place (audioqueue_)
+//   items    small items copied in and out one at a time (infoqueue_, eventqueue_)
+//   bulk     several items per call (spsc_queue only)
+//
+// Prints the mean time per block/item. Both threads spin (with yield) on a full
+// or empty queue, so this measures the cost of the shared state, not the waiting.
+// Usage: sonobus_spscbench [runs]
+
+#include "src/lockfree.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace aoo::lockfree;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double nanosPer(Clock::time_point start, long count)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+}
+
+template<typename Q>
+double runBlocks(int blocksize, int nblocks, long total)
+{
+    Q q;
+    q.resize(nblocks * blocksize, blocksize);
+
+    const auto start = Clock::now();
+
+    std::thread producer([&]{
+        for (long n = 0; n < total; ) {
+            if (q.write_available()) {
+                auto p = q.write_data();
+                for (int i = 0; i < blocksize; ++i) {
+                    p[i] = (float) n;
+                }
+                q.write_commit();
+                ++n;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    long bad = 0;
+    for (long n = 0; n < total; ) {
+        if (q.read_available()) {
+            auto p = q.read_data();
+            bad += p[0] != (float) n || p[blocksize - 1] != (float) n;
+            q.read_commit();
+            ++n;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    if (bad) {
+        fprintf(stderr, "%ld blocks out of order!\n", bad);
+    }
+    return nanosPer(start, total);
+}
+
+template<typename Q>
+double runItems(int capacity, long total)
+{
+    Q q;
+    q.resize(capacity, 1);
+
+    const auto start = Clock::now();
+
+    std::thread producer([&]{
+        for (long n = 0; n < total; ) {
+            if (q.write_available()) {
+                q.write(n++);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    long bad = 0, value = 0;
+    for (long n = 0; n < total; ) {
+        if (q.read_available()) {
+            q.read(value);
+            bad += value != n++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    if (bad) {
+        fprintf(stderr, "%ld items out of order!\n", bad);
+    }
+    return nanosPer(start, total);
+}
+
+double runBulk(int capacity, int chunk, long total)
+{
+    spsc_queue<long> q;
+    q.resize(capacity, 1);
+
+    const auto start = Clock::now();
+
+    std::thread producer([&]{
+        std::vector<long> buf(chunk);
+        for (long n = 0; n < total; ) {
+            const int count = (int) std::min<long>(chunk, total - n);
+            for (int i = 0; i < count; ++i) {
+                buf[i] = n + i;
+            }
+            const int written = q.write(buf.data(), count);
+            if (written > 0) {
+                n += written;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<long> buf(chunk);
+    long bad = 0;
+    for (long n = 0; n < total; ) {
+        const int count = q.read(buf.data(), (int) std::min<long>(chunk, total - n));
+        if (count > 0) {
+            for (int i = 0; i < count; ++i) {
+                bad += buf[i] != n++;
+            }
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    if (bad) {
+        fprintf(stderr, "%ld items out of order!\n", bad);
+    }
+    return nanosPer(start, total);
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    const int runs = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+
+    for (int r = 0; r < runs; ++r) {
+        printf("blocks (64 floats x 12):  queue %6.1f ns/block   spsc_queue %6.1f ns/block\n",
+               runBlocks<queue<float>>(64, 12, 500000), runBlocks<spsc_queue<float>>(64, 12, 500000));
+        printf("items (capacity 64):      queue %6.1f ns/item    spsc_queue %6.1f ns/item\n",
+               runItems<queue<long>>(64, 2000000), runItems<spsc_queue<long>>(64, 2000000));
+        printf("bulk (8 items per call):                          spsc_queue %6.1f ns/item\n",
+               runBulk(64, 8, 4000000));
+    }
+
+    return 0;
+}
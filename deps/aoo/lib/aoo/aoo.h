@@ -18,6 +18,10 @@ extern "C"
 
 // these are bit masks to go in the least significant byte of the version
 #define AOO_PROTOCOL_FLAG_COMPACT_DATA 0x1 // supports compact data message
+#define AOO_PROTOCOL_FLAG_FEC 0x2 // supports parity (FEC) message
+#define AOO_PROTOCOL_FLAG_DTX 0x4 // supports silent block markers
+#define AOO_PROTOCOL_FLAG_TIMESTAMP 0x8 // wants send time stamps on data messages
+#define AOO_PROTOCOL_FLAG_OPUS_LAYOUT 0x10 // can decode coupled/surround Opus layouts
 
 #ifndef AOO_DEBUG_DLL
  #define AOO_DEBUG_DLL 0
@@ -83,6 +87,32 @@ extern "C"
  #define AOO_SEND_REDUNDANCY 1
 #endif
 
+// parity FEC group size (0 = off)
+#ifndef AOO_FEC_GROUPSIZE
+ #define AOO_FEC_GROUPSIZE 0
+#endif
+
+// max. parity FEC group size
+#ifndef AOO_FEC_MAXGROUPSIZE
+ #define AOO_FEC_MAXGROUPSIZE 16
+#endif
+
+// silence detection threshold (linear peak amplitude, 0 = off)
+#ifndef AOO_DTX_THRESHOLD
+ #define AOO_DTX_THRESHOLD 0
+#endif
+
+// silence detection hangover time in ms
+#ifndef AOO_DTX_HANGOVER
+ #define AOO_DTX_HANGOVER 200
+#endif
+
+// time in ms after which a prepared format change is applied on the
+// network thread if the audio thread hasn't picked it up (e.g. it is stopped)
+#ifndef AOO_STANDBY_TIMEOUT
+ #define AOO_STANDBY_TIMEOUT 500
+#endif
+
 // max. number of resend attempts per packet
 #ifndef AOO_RESEND_LIMIT
  #define AOO_RESEND_LIMIT 5
@@ -126,6 +156,8 @@ AOO_API void aoo_terminate(void);
 #define AOO_MSG_COMPACT_DATA_LEN 2
 #define AOO_MSG_CODEC_CHANGE "/codecchange"
 #define AOO_MSG_CODEC_CHANGE_LEN 12
+#define AOO_MSG_PARITY "/parity"
+#define AOO_MSG_PARITY_LEN 7
 
 // id: the source or sink ID
 // returns: the offset to the remaining address pattern
@@ -186,7 +218,11 @@ typedef enum aoo_event_type
     // sink: blocks have been resent
     AOO_BLOCK_RESENT_EVENT,
     // sink: large gap between blocks
-    AOO_BLOCK_GAP_EVENT
+    AOO_BLOCK_GAP_EVENT,
+    // sink: blocks have been recovered from parity
+    AOO_BLOCK_RECOVERED_EVENT,
+    // sink: parity packets have been received (FEC overhead)
+    AOO_BLOCK_PARITY_EVENT
 } aoo_event_type;
 
 #define AOO_ENDPOINT_EVENT  \
@@ -231,6 +267,8 @@ typedef struct _aoo_block_event aoo_block_lost_event;
 typedef struct _aoo_block_event aoo_block_reordered_event;
 typedef struct _aoo_block_event aoo_block_resent_event;
 typedef struct _aoo_block_event aoo_block_gap_event;
+typedef struct _aoo_block_event aoo_block_recovered_event;
+typedef struct _aoo_block_event aoo_block_parity_event;
 
 // ping event
 typedef struct aoo_ping_event {
@@ -358,12 +396,111 @@ typedef enum aoo_option
     // For sources, send an optional userformat blob along with the format messages
     // ---
     // Could be used for any purpose (channel layouts, labels, etc)
-    aoo_opt_userformat
+    aoo_opt_userformat,
+    // Parity FEC group size (int32_t)
+    // ---
+    // If > 0, the source sends an additional parity block
+    // (the XOR of the encoded payloads) after every N data blocks
+    // to sinks which support AOO_PROTOCOL_FLAG_FEC. The sink can
+    // then rebuild a single missing block per group without
+    // having to wait for a resend. The overhead is 1/N of the
+    // data bandwidth. 0 disables FEC (default).
+    aoo_opt_fec_groupsize,
+    // Silence detection threshold (float)
+    // ---
+    // If > 0, blocks whose peak amplitude stays below this (linear)
+    // threshold for longer than the hangover time are not encoded.
+    // Instead the source sends a tiny silent block marker to sinks
+    // which support AOO_PROTOCOL_FLAG_DTX, and the sink fills in zeros
+    // without decoding. Sequence numbers keep running, so the jitter
+    // buffer and time DLL are not disturbed. 0 disables (default).
+    aoo_opt_dtx_threshold,
+    // Silence detection hangover (int32_t)
+    // ---
+    // Time in ms the input has to stay below the silence threshold
+    // before the source stops sending audio data, so that decaying
+    // tails are not cut off.
+    aoo_opt_dtx_hangover,
+    // Transit statistics (aoo_transit_stats)
+    // ---
+    // This is a read-only option used for sink::get_sourceoption().
+    // If the sink announces AOO_PROTOCOL_FLAG_TIMESTAMP, the source stamps
+    // each data block with its send time and the sink keeps track of the
+    // transit time (receive time - send time) and the interarrival jitter.
+    // NOTE: the transit time includes the clock offset between the two
+    // machines, so the caller has to subtract its own offset estimate.
+    aoo_opt_transit_stats,
+    // Shared clock (aoo_clock *)
+    // ---
+    // Use the time DLL filter of a shared clock (see aoo_clock_new())
+    // instead of running an own one. The clock must have the same
+    // samplerate and blocksize as the source resp. sink, otherwise
+    // the own filter is used. NULL unsubscribes (default).
+    aoo_opt_clock,
+    // Group relay (source: aoo_relay_group, sink option: int32_t 0 or 1)
+    // ---
+    // Sinks which are reached through a connection server's relay
+    // can all be served by a single upload: set the function which
+    // sends a packet to every other member of the group on the
+    // source (see aoonet_client_send_relay_group), and mark those
+    // sinks with the sink option. Compact data messages and silent
+    // block markers are then sent once through that function instead
+    // of once per sink. Everything else (format, larger blocks, resends,
+    // parity) still goes to each sink. A NULL function disables (default).
+    aoo_opt_relay_group
 } aoo_option;
 
+typedef struct aoo_relay_group
+{
+    aoo_replyfn fn;
+    void *user;
+} aoo_relay_group;
+
+typedef struct aoo_transit_stats
+{
+    double transit; // last transit time in seconds
+    double min_transit; // minimum transit time over the last few seconds
+    double jitter; // smoothed interarrival jitter in seconds (RFC 3550)
+    int32_t count; // number of time stamped blocks received so far
+} aoo_transit_stats;
+
 #define AOO_ARG(x) &x, sizeof(x)
 #define AOO_ARG_NULL 0, 0
 
+/*//////////////////// AoO clock /////////////////////*/
+
+// All sources and sinks driven by the same audio callback see the same
+// time stamps, so instead of each running its own time DLL filter they
+// can subscribe to a shared clock (aoo_opt_clock) which is updated once
+// per block.
+
+#ifdef __cplusplus
+namespace aoo {
+    class audio_clock;
+}
+using aoo_clock = aoo::audio_clock;
+#else
+typedef struct aoo_clock aoo_clock;
+#endif
+
+// create a new clock
+AOO_API aoo_clock * aoo_clock_new(void);
+
+// destroy the clock (unsubscribe all sources and sinks first!)
+AOO_API void aoo_clock_free(aoo_clock *c);
+
+// setup the clock and reset the time filter
+// (bandwidth: see aoo_opt_timefilter_bandwidth)
+AOO_API int32_t aoo_clock_setup(aoo_clock *c, int32_t samplerate,
+                                int32_t blocksize, float bandwidth);
+
+// update the clock with the current NTP time stamp (see aoo_osctime_get).
+// Call once per block *before* processing the subscribed sources and sinks.
+AOO_API int32_t aoo_clock_update(aoo_clock *c, uint64_t t);
+
+// get the samplerate as measured by the time filter
+AOO_API double aoo_clock_get_samplerate(aoo_clock *c);
+
 /*//////////////////// AoO source /////////////////////*/
 
 #ifdef __cplusplus
@@ -475,6 +612,10 @@ static inline int32_t aoo_source_get_buffersize(aoo_source *src, int32_t *n) {
     return aoo_source_get_option(src, aoo_opt_buffersize, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_source_set_clock(aoo_source *src, aoo_clock *c) {
+    return aoo_source_set_option(src, aoo_opt_clock, AOO_ARG(c));
+}
+
 static inline int32_t aoo_source_set_timefilter_bandwith(aoo_source *src, float n) {
     return aoo_source_set_option(src, aoo_opt_timefilter_bandwidth, AOO_ARG(n));
 }
@@ -515,6 +656,30 @@ static inline int32_t aoo_source_get_redundancy(aoo_source *src, int32_t *n) {
     return aoo_source_get_option(src, aoo_opt_redundancy, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_source_set_fec_groupsize(aoo_source *src, int32_t n) {
+    return aoo_source_set_option(src, aoo_opt_fec_groupsize, AOO_ARG(n));
+}
+
+static inline int32_t aoo_source_get_fec_groupsize(aoo_source *src, int32_t *n) {
+    return aoo_source_get_option(src, aoo_opt_fec_groupsize, AOO_ARG(*n));
+}
+
+static inline int32_t aoo_source_set_dtx_threshold(aoo_source *src, float f) {
+    return aoo_source_set_option(src, aoo_opt_dtx_threshold, AOO_ARG(f));
+}
+
+static inline int32_t aoo_source_get_dtx_threshold(aoo_source *src, float *f) {
+    return aoo_source_get_option(src, aoo_opt_dtx_threshold, AOO_ARG(*f));
+}
+
+static inline int32_t aoo_source_set_dtx_hangover(aoo_source *src, int32_t ms) {
+    return aoo_source_set_option(src, aoo_opt_dtx_hangover, AOO_ARG(ms));
+}
+
+static inline int32_t aoo_source_get_dtx_hangover(aoo_source *src, int32_t *ms) {
+    return aoo_source_get_option(src, aoo_opt_dtx_hangover, AOO_ARG(*ms));
+}
+
 static inline int32_t aoo_source_set_sink_channelonset(aoo_source *src, void *endpoint, int32_t id, int32_t onset) {
     return aoo_source_set_sinkoption(src, endpoint, id, aoo_opt_channelonset, AOO_ARG(onset));
 }
@@ -561,9 +726,18 @@ AOO_API int32_t aoo_sink_handle_message(aoo_sink *sink, const char *data, int32_
 AOO_API int32_t aoo_sink_send(aoo_sink *sink);
 
 // process audio (threadsafe, but not reentrant)
+// returns 1 if any audio has been written, 0 if the output is silent
+// (no active sources or only silent blocks) and hasn't been touched.
 AOO_API int32_t aoo_sink_process(aoo_sink *sink, aoo_sample **data,
                                  int32_t nsamples, uint64_t t);
 
+// like aoo_sink_process(), but adds the sources directly to the existing
+// content of 'data' instead of going through an internal mix buffer.
+// the caller is responsible for clearing the outputs beforehand.
+// returns 1 if any audio has been added, 0 otherwise.
+AOO_API int32_t aoo_sink_process_add(aoo_sink *sink, aoo_sample **data,
+                                     int32_t nsamples, uint64_t t);
+
 // get number of pending events (always thread safe)
 AOO_API int32_t aoo_sink_events_available(aoo_sink *sink);
 
@@ -605,6 +779,10 @@ static inline int32_t aoo_sink_get_buffersize(aoo_sink *sink, int32_t *n) {
     return aoo_sink_get_option(sink, aoo_opt_buffersize, AOO_ARG(*n));
 }
 
+static inline int32_t aoo_sink_set_clock(aoo_sink *sink, aoo_clock *c) {
+    return aoo_sink_set_option(sink, aoo_opt_clock, AOO_ARG(c));
+}
+
 static inline int32_t aoo_sink_set_timefilter_bandwith(aoo_sink *sink, float n) {
     return aoo_sink_set_option(sink, aoo_opt_timefilter_bandwidth, AOO_ARG(n));
 }
@@ -653,6 +831,10 @@ static inline int32_t aoo_sink_get_source_format(aoo_sink *sink, void *endpoint,
     return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_format, AOO_ARG(*f));
 }
 
+static inline int32_t aoo_sink_get_source_transit_stats(aoo_sink *sink, void *endpoint, int32_t id, aoo_transit_stats *s) {
+    return aoo_sink_get_sourceoption(sink, endpoint, id, aoo_opt_transit_stats, AOO_ARG(*s));
+}
+
 /*//////////////////// Codec API //////////////////////////*/
 
 #define AOO_CODEC_MAXSETTINGSIZE 256
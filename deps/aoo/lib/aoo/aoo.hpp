@@ -123,6 +123,10 @@ public:
         return get_option(aoo_opt_dynamic_resampling, AOO_ARG(n));
     }
 
+    int32_t set_clock(aoo_clock *c){
+        return set_option(aoo_opt_clock, AOO_ARG(c));
+    }
+
     int32_t set_timefilter_bandwidth(float f){
         return set_option(aoo_opt_timefilter_bandwidth, AOO_ARG(f));
     }
@@ -155,6 +159,30 @@ public:
         return get_option(aoo_opt_redundancy, AOO_ARG(n));
     }
 
+    int32_t set_fec_groupsize(int32_t n){
+        return set_option(aoo_opt_fec_groupsize, AOO_ARG(n));
+    }
+
+    int32_t get_fec_groupsize(int32_t& n){
+        return get_option(aoo_opt_fec_groupsize, AOO_ARG(n));
+    }
+
+    int32_t set_dtx_threshold(float f){
+        return set_option(aoo_opt_dtx_threshold, AOO_ARG(f));
+    }
+
+    int32_t get_dtx_threshold(float& f){
+        return get_option(aoo_opt_dtx_threshold, AOO_ARG(f));
+    }
+
+    int32_t set_dtx_hangover(int32_t ms){
+        return set_option(aoo_opt_dtx_hangover, AOO_ARG(ms));
+    }
+
+    int32_t get_dtx_hangover(int32_t& ms){
+        return get_option(aoo_opt_dtx_hangover, AOO_ARG(ms));
+    }
+
     int32_t set_ping_interval(int32_t n){
         return set_option(aoo_opt_ping_interval, AOO_ARG(n));
     }
@@ -243,6 +271,10 @@ public:
     // process audio (threadsafe, but not reentrant)
     virtual int32_t process(aoo_sample **data, int32_t nsamples, uint64_t t) = 0;
 
+    // like process(), but sums into the existing content of 'data'
+    // (threadsafe, but not reentrant)
+    virtual int32_t process_add(aoo_sample **data, int32_t nsamples, uint64_t t) = 0;
+
     // get number of pending events (always thread safe)
     virtual int32_t events_available() = 0;
 
@@ -281,6 +313,10 @@ public:
         return get_option(aoo_opt_dynamic_resampling, AOO_ARG(n));
     }
 
+    int32_t set_clock(aoo_clock *c){
+        return set_option(aoo_opt_clock, AOO_ARG(c));
+    }
+
     int32_t set_timefilter_bandwidth(float f){
         return set_option(aoo_opt_timefilter_bandwidth, AOO_ARG(f));
     }
@@ -335,6 +371,10 @@ public:
         return get_sourceoption(endpoint, id, aoo_opt_format, AOO_ARG(f));
     }
 
+    int32_t get_source_transit_stats(void *endpoint, int32_t id, aoo_transit_stats& s){
+        return get_sourceoption(endpoint, id, aoo_opt_transit_stats, AOO_ARG(s));
+    }
+
     virtual int32_t request_source_codec_change(void *endpoint, int32_t id, aoo_format & f) = 0;
     
     virtual int32_t set_sourceoption(void *endpoint, int32_t id,
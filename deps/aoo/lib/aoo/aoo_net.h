@@ -77,6 +77,14 @@ extern "C"
 #define AOONET_MSG_LEAVE "/leave"
 #define AOONET_MSG_LEAVE_LEN 6
 
+#define AOONET_MSG_RELAY "/relay"
+#define AOONET_MSG_RELAY_LEN 6
+
+// max. number of bytes a relay message adds around the relayed packet:
+// the address pattern and type tags (~24), the address string (up to 46 bytes
+// for IPv6, padded), the port, the blob size and up to 3 bytes of blob padding.
+#define AOONET_RELAY_OVERHEAD 128
+
 typedef enum aoonet_type
 {
     AOO_TYPE_SERVER = 1000,
@@ -158,6 +166,7 @@ typedef struct aoonet_client_peer_event
     const char *user;
     void *address;
     int32_t length;
+    int32_t relayed; // the peer can only be reached through the server's relay
 } aoonet_client_peer_event;
 
 
@@ -194,6 +203,26 @@ AOO_API int32_t aoonet_server_events_available(aoonet_server *server);
 AOO_API int32_t aoonet_server_handle_events(aoonet_server *server,
                                             aoo_eventhandler fn, void *user);
 
+// let group members send UDP packets to each other through the server, either to
+// a single peer (e.g. when both are behind symmetric NATs) or once for the whole
+// group, which the server then fans out without looking at the contents.
+// off by default (always thread safe)
+AOO_API int32_t aoonet_server_set_relay(aoonet_server *server, bool enable);
+
+typedef struct aoonet_relay_stats
+{
+    // the bytes count the relayed packets only, not the relay message around them
+    int64_t bytes_in;       // received from group members
+    int64_t bytes_out;      // forwarded to group members
+    int64_t packets_in;
+    int64_t packets_out;
+} aoonet_relay_stats;
+
+// get the relayed traffic of a group since it was created (always thread safe)
+// returns 0 if there is no such group
+AOO_API int32_t aoonet_server_get_relay_stats(aoonet_server *server, const char *group,
+                                              aoonet_relay_stats *stats);
+
 // LATER add methods to add/remove users and groups
 // and set/get server options, group options and user options
 
@@ -257,6 +286,30 @@ AOO_API int32_t aoonet_client_events_available(aoonet_client *client);
 AOO_API int32_t aoonet_client_handle_events(aoonet_client *client,
                                             aoo_eventhandler fn, void *user);
 
+// send a packet to a peer through the server's relay (threadsafe)
+// 'addr' is the peer's sockaddr as reported in the peer event.
+// returns 0 if we are not connected or the server doesn't relay
+AOO_API int32_t aoonet_client_send_relay(aoonet_client *client, const char *data,
+                                         int32_t n, const void *addr);
+
+// send a packet once, the server forwards it to all other members of the group (threadsafe)
+AOO_API int32_t aoonet_client_send_relay_group(aoonet_client *client, const char *group,
+                                               const char *data, int32_t n);
+
+// get the packet inside a relay message from our server, i.e. data a peer sent us
+// through the relay (peer handshakes are handled by aoonet_client_handle_message
+// and return 0 here). on success 'data' points into 'msg', 'peeraddr' should be
+// (at least) a sockaddr_storage and receives the peer's address.
+AOO_API int32_t aoonet_client_unwrap_relay(aoonet_client *client, const char *msg, int32_t n,
+                                           void *addr, const char **data, int32_t *size,
+                                           void *peeraddr, int32_t *peerlen);
+
+// use the relay or the direct connection for a peer (threadsafe).
+// peers are direct by default and only fall back to the relay if the handshake fails.
+// returns 0 if there is no such peer, or relaying was requested but isn't available
+AOO_API int32_t aoonet_client_set_peer_relay(aoonet_client *client, const char *group,
+                                             const char *user, bool relay);
+
 // LATER add API functions to set options and do additional peer communication (chat, OSC messages, etc.)
 
 #ifdef __cplusplus
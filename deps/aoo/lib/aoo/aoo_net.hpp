@@ -70,6 +70,14 @@ public:
     // get number of currently active users
     virtual int32_t get_user_count() const = 0;
 
+    // let group members send UDP packets to each other through the server,
+    // off by default (always thread safe)
+    virtual int32_t set_relay(bool enable) = 0;
+
+    // get the relayed traffic of a group since it was created (always thread safe)
+    // returns 0 if there is no such group
+    virtual int32_t get_relay_stats(const char *group, aoonet_relay_stats *stats) = 0;
+
 protected:
     ~iserver(){} // non-virtual!
 };
@@ -137,6 +145,21 @@ public:
     // will call the event handler function one or more times
     virtual int32_t handle_events(aoo_eventhandler fn, void *user) = 0;
 
+    // send a packet to a peer through the server's relay (threadsafe)
+    // 'addr' is the peer's sockaddr as reported in the peer event
+    virtual int32_t send_relay(const char *data, int32_t n, const void *addr) = 0;
+
+    // send a packet once, the server forwards it to all other members of the group (threadsafe)
+    virtual int32_t send_relay_group(const char *group, const char *data, int32_t n) = 0;
+
+    // get the packet inside a relay message from our server (see aoonet_client_unwrap_relay)
+    virtual int32_t unwrap_relay(const char *msg, int32_t n, void *addr,
+                                 const char **data, int32_t *size,
+                                 void *peeraddr, int32_t *peerlen) = 0;
+
+    // use the relay or the direct connection for a peer (threadsafe)
+    virtual int32_t set_peer_relay(const char *group, const char *user, bool relay) = 0;
+
     // LATER add API functions to set options and do additional peer communication (chat, OSC messages, etc.)
 protected:
     ~iclient(){} // non-virtual!
@@ -17,6 +17,16 @@ extern "C"
 
 #define AOO_CODEC_OPUS "opus"
 
+// channel layouts
+// one mono stream per channel
+#define AOO_OPUS_LAYOUT_DISCRETE 0
+// channels (0,1), (2,3), ... are coded as coupled stereo streams,
+// an odd last channel gets a mono stream
+#define AOO_OPUS_LAYOUT_COUPLED 1
+// Vorbis channel order with surround masking (mapping family 1, RFC 7845)
+// for 1-8 channels, otherwise the same as AOO_OPUS_LAYOUT_COUPLED
+#define AOO_OPUS_LAYOUT_SURROUND 2
+
 typedef struct aoo_format_opus
 {
     aoo_format header;
@@ -24,6 +34,9 @@ typedef struct aoo_format_opus
     int32_t complexity; // 0: default
     int32_t signal_type;
     int32_t application_type; 
+    // AOO_OPUS_LAYOUT_*, anything but the default requires sinks
+    // that announce AOO_PROTOCOL_FLAG_OPUS_LAYOUT
+    int32_t channel_layout;
 } aoo_format_opus;
 
 AOO_API void aoo_codec_opus_setup(aoo_codec_registerfn fn);
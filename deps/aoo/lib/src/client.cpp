@@ -39,6 +39,15 @@
 #define AOONET_MSG_SERVER_GROUP_PUBLIC \
     AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_GROUP AOONET_MSG_PUBLIC
 
+#define AOONET_MSG_SERVER_RELAY \
+    AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_RELAY
+
+#define AOONET_MSG_SERVER_RELAY_GROUP \
+    AOO_MSG_DOMAIN AOONET_MSG_SERVER AOONET_MSG_RELAY AOONET_MSG_GROUP
+
+#define AOONET_MSG_CLIENT_RELAY \
+    AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_RELAY
+
 
 #define AOONET_MSG_GROUP_JOIN \
     AOONET_MSG_GROUP AOONET_MSG_JOIN
@@ -94,12 +103,12 @@ char * copy_string(const char * s){
 
 void * copy_sockaddr(const void * sa){
     if (sa){
-        if (static_cast<const sockaddr *>(sa)->sa_family == AF_INET){
-            auto result = new char[sizeof(sockaddr_in)];
-            memcpy(result, sa, sizeof(sockaddr_in));
+        auto len = ip_address::length_of(static_cast<const sockaddr *>(sa));
+        if (len > 0){
+            auto result = new char[len];
+            memcpy(result, sa, len);
             return result;
         } else {
-            // LATER IPv6
             return nullptr;
         }
     } else {
@@ -111,6 +120,26 @@ void free_sockaddr(const void * sa){
     delete static_cast<const sockaddr *>(sa);
 }
 
+// get the relayed packet and the address of the peer who sent it
+static bool parse_relay_message(const osc::ReceivedMessage& msg,
+                                const char *& data, int32_t& size, ip_address& addr)
+{
+    auto it = msg.ArgumentsBegin();
+    std::string ip = (it++)->AsString();
+    int32_t port = (it++)->AsInt32();
+    const void *blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+
+    addr = ip_address(ip, port);
+    if (!addr.valid()){
+        return false;
+    }
+    data = (const char *)blobdata;
+    size = blobsize;
+    return true;
+}
+
 } // net
 } // aoo
 
@@ -351,9 +380,6 @@ int32_t aoonet_client_handle_message(aoonet_client *client, const char *data,
 }
 
 int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr){
-    if (static_cast<struct sockaddr *>(addr)->sa_family != AF_INET){
-        return 0;
-    }
     try {
         osc::ReceivedPacket packet(data, n);
         osc::ReceivedMessage msg(packet);
@@ -365,7 +391,11 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
             return 0;
         }
 
-        ip_address address((struct sockaddr *)addr, sizeof(sockaddr_in)); // FIXME
+        auto addrlen = ip_address::length_of((struct sockaddr *)addr);
+        if (!addrlen){
+            return 0;
+        }
+        ip_address address((struct sockaddr *)addr, addrlen);
 
         LOG_DEBUG("aoo_client: handle UDP message " << msg.AddressPattern()
             << " from " << address.name() << ":" << address.port());
@@ -376,7 +406,11 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
                 LOG_WARNING("aoo_client: not a server message!");
                 return 0;
             }
-            handle_server_message_udp(msg, onset);
+            if (!strcmp(msg.AddressPattern() + onset, AOONET_MSG_RELAY)){
+                handle_relay_message(msg);
+            } else {
+                handle_server_message_udp(msg, onset);
+            }
             return 1;
         } else {
             // peer message
@@ -384,49 +418,7 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
                 LOG_WARNING("aoo_client: not a peer message!");
                 return 0;
             }
-            bool success = false;
-            {
-                shared_lock lock(peerlock_);
-                // NOTE: we have to loop over *all* peers because there can
-                // be more than 1 peer on a given IP endpoint, because a single
-                // user can join multiple groups.
-                // LATER make this more efficient, e.g. by associating IP endpoints
-                // with peers instead of having them all in a single vector.
-
-                auto pattern = msg.AddressPattern() + onset;
-                int64_t token = 0;
-                if (!strcmp(pattern, AOONET_MSG_PING) && msg.ArgumentCount() > 0){
-                    token = msg.ArgumentsBegin()->AsInt64();
-                }
-                        
-                for (auto& p : peers_){
-                    if (p->match(address)){
-                        p->handle_message(msg, onset, address);
-                        success = true;
-                    } else if (!p->has_real_address() && token > 0 && p->match_token(token)) {
-                        // this message doesn't match one of the addresses given by the server for this peer
-                        // but it DOES match the random token for the peer, which means we might be dealing
-                        // with a symmetric NAT for that peer. so we will assign the address here as the *real* address
-
-                        LOG_VERBOSE("aoo_client: found matching token, changing public address for endpoint "
-                                    << p->address().name() << ":" << p->address().port() << " TO "
-                                    << address.name() << ":" << address.port());
-
-                        p->set_public_address(address);
-                        p->handle_message(msg, onset, address);
-                        success = true;
-                    }
-                }
-            }
-            // NOTE: during the handshake process it is expected that
-            // we receive UDP messages which we have to ignore:
-            // a) pings from a peer which we haven't had the chance to add yet
-            // b) pings sent to the other endpoint address
-            if (!success){
-                LOG_VERBOSE("aoo_client: ignoring UDP message "
-                            << msg.AddressPattern() << " from endpoint "
-                            << address.name() << ":" << address.port());
-            }
+            return handle_peer_message(msg, onset, address, false);
         }
     } catch (const osc::Exception& e){
         LOG_ERROR("aoo_client: exception in handle_message: " << e.what());
@@ -435,6 +427,118 @@ int32_t aoo::net::client::handle_message(const char *data, int32_t n, void *addr
     return 0;
 }
 
+int32_t aoonet_client_send_relay(aoonet_client *client, const char *data,
+                                 int32_t n, const void *addr)
+{
+    return client->send_relay(data, n, addr);
+}
+
+int32_t aoo::net::client::send_relay(const char *data, int32_t n, const void *addr){
+    if (state_.load() != client_state::connected || !relay_available_.load()
+            || n > AOO_MAXPACKETSIZE){
+        return 0;
+    }
+    auto addrlen = ip_address::length_of((const struct sockaddr *)addr);
+    if (!addrlen){
+        return 0;
+    }
+    ip_address address((const struct sockaddr *)addr, addrlen);
+    send_relay_message(data, n, address);
+    return 1;
+}
+
+int32_t aoonet_client_send_relay_group(aoonet_client *client, const char *group,
+                                       const char *data, int32_t n)
+{
+    return client->send_relay_group(group, data, n);
+}
+
+int32_t aoo::net::client::send_relay_group(const char *group, const char *data, int32_t n){
+    if (state_.load() != client_state::connected || !relay_available_.load()
+            || n > AOO_MAXPACKETSIZE || strlen(group) > 32){
+        return 0;
+    }
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage(AOONET_MSG_SERVER_RELAY_GROUP)
+        << group << osc::Blob(data, n) << osc::EndMessage;
+
+    send_server_message_udp(msg.Data(), (int32_t) msg.Size());
+    return 1;
+}
+
+int32_t aoonet_client_unwrap_relay(aoonet_client *client, const char *msg, int32_t n,
+                                   void *addr, const char **data, int32_t *size,
+                                   void *peeraddr, int32_t *peerlen)
+{
+    return client->unwrap_relay(msg, n, addr, data, size, peeraddr, peerlen);
+}
+
+int32_t aoo::net::client::unwrap_relay(const char *data, int32_t n, void *addr,
+                                       const char **inner, int32_t *innersize,
+                                       void *peeraddr, int32_t *peerlen)
+{
+    auto addrlen = ip_address::length_of((const struct sockaddr *)addr);
+    if (!addrlen){
+        return 0;
+    }
+    ip_address address((struct sockaddr *)addr, addrlen);
+    if (!(address == remote_addr_)){
+        return 0;
+    }
+    try {
+        osc::ReceivedPacket packet(data, n);
+        osc::ReceivedMessage msg(packet);
+
+        if (strcmp(msg.AddressPattern(), AOONET_MSG_CLIENT_RELAY)){
+            return 0;
+        }
+
+        const char *d;
+        int32_t size;
+        ip_address peer;
+        if (!parse_relay_message(msg, d, size, peer)){
+            return 0;
+        }
+        // peer handshakes go through handle_message()
+        int32_t type;
+        if (aoonet_parse_pattern(d, size, &type) > 0 && type == AOO_TYPE_PEER){
+            return 0;
+        }
+        if (*peerlen < (int32_t)peer.length){
+            return 0;
+        }
+        memcpy(peeraddr, &peer.address, peer.length);
+        *peerlen = peer.length;
+        *inner = d;
+        *innersize = size;
+        return 1;
+    } catch (const osc::Exception& e){
+        LOG_ERROR("aoo_client: exception in unwrap_relay: " << e.what());
+    }
+    return 0;
+}
+
+int32_t aoonet_client_set_peer_relay(aoonet_client *client, const char *group,
+                                     const char *user, bool relay)
+{
+    return client->set_peer_relay(group, user, relay);
+}
+
+int32_t aoo::net::client::set_peer_relay(const char *group, const char *user, bool relay){
+    if (relay && !relay_available_.load()){
+        return 0;
+    }
+    shared_lock lock(peerlock_);
+    for (auto& p : peers_){
+        if (p->match(group, user)){
+            p->set_relayed(relay);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int32_t aoonet_client_send(aoonet_client *client){
     return client->send();
 }
@@ -574,6 +678,8 @@ void client::do_disconnect(command_reason reason, int error){
         peers_.clear();
     }
 
+    relay_available_ = false;
+
     // event
     if (reason != command_reason::none){
         if (reason == command_reason::user){
@@ -714,6 +820,17 @@ void client::send_message_udp(const char *data, int32_t size, const ip_address&
     sendfn_(udpsocket_, data, size, (void *)&addr.address);
 }
 
+void client::send_relay_message(const char *data, int32_t size, const ip_address& addr)
+{
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage(AOONET_MSG_SERVER_RELAY)
+        << addr.name().c_str() << addr.port() << osc::Blob(data, size)
+        << osc::EndMessage;
+
+    send_server_message_udp(msg.Data(), (int32_t) msg.Size());
+}
+
 void client::push_event(std::unique_ptr<ievent> e)
 {
     scoped_lock<spinlock> lock(event_lock_);
@@ -1015,9 +1132,15 @@ void client::handle_login(const osc::ReceivedMessage& msg){
         auto it = msg.ArgumentsBegin();
         int32_t status = (it++)->AsInt32();
         if (status > 0){
+            // older servers don't send the relay flag
+            if (msg.ArgumentCount() > 2){
+                it++; // skip error message
+                relay_available_ = (it++)->AsInt32() != 0;
+            }
             // connected!
             state_ = client_state::connected;
-            LOG_VERBOSE("aoo_client: successfully logged in");
+            LOG_VERBOSE("aoo_client: successfully logged in"
+                        << (relay_available_.load() ? " (server relays)" : ""));
             // event
             auto e = std::make_unique<event>(
                 AOONET_CLIENT_CONNECT_EVENT, 1);
@@ -1214,6 +1337,80 @@ void client::handle_server_message_udp(const osc::ReceivedMessage &msg, int onse
     }
 }
 
+bool client::handle_peer_message(const osc::ReceivedMessage& msg, int onset,
+                                 const ip_address& address, bool relayed)
+{
+    bool success = false;
+    {
+        shared_lock lock(peerlock_);
+        // NOTE: we have to loop over *all* peers because there can
+        // be more than 1 peer on a given IP endpoint, because a single
+        // user can join multiple groups.
+        // LATER make this more efficient, e.g. by associating IP endpoints
+        // with peers instead of having them all in a single vector.
+
+        auto pattern = msg.AddressPattern() + onset;
+        int64_t token = 0;
+        if (!strcmp(pattern, AOONET_MSG_PING) && msg.ArgumentCount() > 0){
+            token = msg.ArgumentsBegin()->AsInt64();
+        }
+
+        for (auto& p : peers_){
+            if (relayed){
+                // the server tells us the sender's public address
+                if (p->match_relay(address)){
+                    p->handle_message(msg, onset, address, true);
+                    success = true;
+                }
+            } else if (p->match(address)){
+                p->handle_message(msg, onset, address);
+                success = true;
+            } else if (!p->has_real_address() && token > 0 && p->match_token(token)) {
+                // this message doesn't match one of the addresses given by the server for this peer
+                // but it DOES match the random token for the peer, which means we might be dealing
+                // with a symmetric NAT for that peer. so we will assign the address here as the *real* address
+
+                LOG_VERBOSE("aoo_client: found matching token, changing public address for endpoint "
+                            << p->address().name() << ":" << p->address().port() << " TO "
+                            << address.name() << ":" << address.port());
+
+                p->set_public_address(address);
+                p->handle_message(msg, onset, address);
+                success = true;
+            }
+        }
+    }
+    // NOTE: during the handshake process it is expected that
+    // we receive UDP messages which we have to ignore:
+    // a) pings from a peer which we haven't had the chance to add yet
+    // b) pings sent to the other endpoint address
+    if (!success){
+        LOG_VERBOSE("aoo_client: ignoring UDP message "
+                    << msg.AddressPattern() << " from endpoint "
+                    << address.name() << ":" << address.port());
+    }
+    return success;
+}
+
+void client::handle_relay_message(const osc::ReceivedMessage& msg){
+    const char *data;
+    int32_t size;
+    ip_address addr;
+    if (!parse_relay_message(msg, data, size, addr)){
+        LOG_ERROR("aoo_client: bad relay message");
+        return;
+    }
+    // only peer handshakes are handled here,
+    // everything else is for the application (see unwrap_relay())
+    int32_t type;
+    auto onset = aoonet_parse_pattern(data, size, &type);
+    if (onset > 0 && type == AOO_TYPE_PEER){
+        osc::ReceivedPacket packet(data, size);
+        osc::ReceivedMessage inner(packet);
+        handle_peer_message(inner, onset, addr, true);
+    }
+}
+
 void client::signal(){
 #ifdef _WIN32
     SetEvent(waitevent_);
@@ -1255,7 +1452,7 @@ client::group_event::~group_event()
 
 client::peer_event::peer_event(int32_t type,
                                const char *group, const char *user,
-                               const void *address, int32_t length)
+                               const void *address, int32_t length, bool relayed)
 {
     peer_event_.type = type;
     peer_event_.result = 1;
@@ -1264,6 +1461,7 @@ client::peer_event::peer_event(int32_t type,
     peer_event_.user = copy_string(user);
     peer_event_.address = copy_sockaddr(address);
     peer_event_.length = length;
+    peer_event_.relayed = relayed;
 }
 
 client::peer_event::~peer_event()
@@ -1281,7 +1479,8 @@ peer::peer(client& client,
            const std::string& group, const std::string& user,
            const ip_address& public_addr, const ip_address& local_addr, int64_t token)
     : client_(&client), group_(group), user_(user),
-      public_address_(public_addr), local_address_(local_addr), token_(token)
+      public_address_(public_addr), local_address_(local_addr), token_(token),
+      relay_address_(public_addr)
 {
     start_time_ = time_tag::now();
 
@@ -1335,7 +1534,11 @@ void peer::send(time_tag now){
             osc::OutboundPacketStream msg(buf, sizeof(buf));
             msg << osc::BeginMessage(AOONET_MSG_PEER_PING) << osc::EndMessage;
 
-            client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), *real_addr);
+            if (relayed_.load()){
+                client_->send_relay_message(msg.Data(), (int32_t) msg.Size(), relay_address_);
+            } else {
+                client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), *real_addr);
+            }
             LOG_DEBUG("send regular ping to " << *this);
 
             last_pingtime_ = elapsed_time;
@@ -1343,6 +1546,16 @@ void peer::send(time_tag now){
     } else if (!timeout_) {
         // try to establish UDP connection with peer
         if (elapsed_time > client_->request_timeout()){
+            if (!relayed_.load() && client_->relay_available()){
+                // e.g. both peers are behind symmetric NATs, so neither address
+                // works; start over and do the handshake through the server.
+                LOG_VERBOSE("aoo_client: couldn't reach " << *this
+                            << " directly, trying relay");
+                relayed_ = true;
+                start_time_ = now;
+                last_pingtime_ = 0;
+                return;
+            }
             // couldn't establish peer connection!
             LOG_ERROR("aoo_client: couldn't establish UDP connection to "
                       << *this << "; timed out after "
@@ -1365,8 +1578,12 @@ void peer::send(time_tag now){
             osc::OutboundPacketStream msg(buf, sizeof(buf));
             msg << osc::BeginMessage(AOONET_MSG_PEER_PING) << client_->get_token() << osc::EndMessage;
 
-            client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), local_address_);
-            client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), public_address_);
+            if (relayed_.load()){
+                client_->send_relay_message(msg.Data(), (int32_t) msg.Size(), relay_address_);
+            } else {
+                client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), local_address_);
+                client_->send_message_udp(msg.Data(), (int32_t) msg.Size(), public_address_);
+            }
 
             LOG_DEBUG("send ping to " << *this);
 
@@ -1376,14 +1593,18 @@ void peer::send(time_tag now){
 }
 
 void peer::handle_message(const osc::ReceivedMessage &msg, int onset,
-                          const ip_address& addr)
+                          const ip_address& addr, bool relayed)
 {
     auto pattern = msg.AddressPattern() + onset;
     try {
         if (!strcmp(pattern, AOONET_MSG_PING)){
             if (!address_.load()){
                 // this is the first ping!
-                if (addr == public_address_){
+                if (relayed){
+                    // the other side couldn't reach us directly
+                    relayed_ = true;
+                    address_.store(const_cast<ip_address *>(&relay_address_));
+                } else if (addr == public_address_){
                     address_.store(&public_address_);
                 } else if (addr == local_address_){
                     address_.store(&local_address_);
@@ -1395,10 +1616,13 @@ void peer::handle_message(const osc::ReceivedMessage &msg, int onset,
                 // push event
                 auto e = std::make_unique<client::peer_event>(
                             AOONET_CLIENT_PEER_JOIN_EVENT,
-                            group().c_str(), user().c_str(), &addr.address, addr.length);
+                            group().c_str(), user().c_str(), &addr.address, addr.length,
+                            relayed_.load());
                 client_->push_event(std::move(e));
 
-                LOG_VERBOSE("aoo_client: successfully established connection with " << *this);
+                LOG_VERBOSE("aoo_client: successfully established "
+                            << (relayed_.load() ? "relayed " : "")
+                            << "connection with " << *this);
                 
                 // force last_pingtime_ to zero to make sure we ping them back immediately, avoiding race condition
                 last_pingtime_ = 0;
@@ -37,6 +37,15 @@ public:
     bool match(const std::string& group, const std::string& user);
 
     bool match_token(int64_t token) const;
+
+    // the peer's address as known by the server, i.e. the one to relay to
+    bool match_relay(const ip_address& addr) const {
+        return relay_address_ == addr;
+    }
+
+    bool relayed() const { return relayed_.load(); }
+
+    void set_relayed(bool relay) { relayed_.store(relay); }
     
     void set_public_address(const ip_address & addr);
     
@@ -61,7 +70,7 @@ public:
     void send(time_tag now);
 
     void handle_message(const osc::ReceivedMessage& msg, int onset,
-                        const ip_address& addr);
+                        const ip_address& addr, bool relayed = false);
 
     friend std::ostream& operator << (std::ostream& os, const peer& p);
 private:
@@ -71,7 +80,9 @@ private:
     ip_address public_address_;
     ip_address local_address_;
     int64_t token_;
+    const ip_address relay_address_;
     std::atomic<ip_address *> address_{nullptr};
+    std::atomic<bool> relayed_{false};
     time_tag start_time_;
     double last_pingtime_ = 0;
     bool timeout_ = false;
@@ -137,6 +148,16 @@ public:
 
     int32_t handle_events(aoo_eventhandler fn, void *user) override;
 
+    int32_t send_relay(const char *data, int32_t n, const void *addr) override;
+
+    int32_t send_relay_group(const char *group, const char *data, int32_t n) override;
+
+    int32_t unwrap_relay(const char *msg, int32_t n, void *addr,
+                         const char **data, int32_t *size,
+                         void *peeraddr, int32_t *peerlen) override;
+
+    int32_t set_peer_relay(const char *group, const char *user, bool relay) override;
+
     void do_connect(const std::string& host, int port);
 
     int try_connect(const std::string& host, int port);
@@ -159,6 +180,11 @@ public:
 
     void send_message_udp(const char *data, int32_t size, const ip_address& addr);
 
+    // wrap a packet in a relay message for the server
+    void send_relay_message(const char *data, int32_t size, const ip_address& addr);
+
+    bool relay_available() const { return relay_available_.load(); }
+
     void push_event(std::unique_ptr<ievent> e);
     
     int64_t get_token() const { return token_; }
@@ -188,6 +214,8 @@ private:
     double last_udp_ping_time_ = 0;
     double first_udp_ping_time_ = 0;
     int64_t token_ = 0;
+    // the server relays packets between peers (see handle_login())
+    std::atomic<bool> relay_available_{false};
     
     // commands
     lockfree::queue<std::unique_ptr<icommand>> commands_;
@@ -230,6 +258,11 @@ private:
 
     void handle_server_message_udp(const osc::ReceivedMessage& msg, int onset);
 
+    void handle_relay_message(const osc::ReceivedMessage& msg);
+
+    bool handle_peer_message(const osc::ReceivedMessage& msg, int onset,
+                             const ip_address& addr, bool relayed);
+
     void handle_login(const osc::ReceivedMessage& msg);
 
     void handle_group_join(const osc::ReceivedMessage& msg);
@@ -267,7 +300,7 @@ public:
     {
         peer_event(int32_t type,
                    const char *group, const char *user,
-                   const void *address, int32_t length);
+                   const void *address, int32_t length, bool relayed = false);
         ~peer_event();
     };
 
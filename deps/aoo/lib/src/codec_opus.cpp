@@ -12,6 +12,7 @@
 namespace {
 
 void print_settings(const aoo_format_opus& f){
+#if LOGLEVEL >= 2
     const char *type;
     switch (f.signal_type){
     case OPUS_SIGNAL_MUSIC:
@@ -25,6 +26,19 @@ void print_settings(const aoo_format_opus& f){
         break;
     }
 
+    const char *layout;
+    switch (f.channel_layout){
+    case AOO_OPUS_LAYOUT_COUPLED:
+        layout = "coupled";
+        break;
+    case AOO_OPUS_LAYOUT_SURROUND:
+        layout = "surround";
+        break;
+    default:
+        layout = "discrete";
+        break;
+    }
+
     const char *apptype;
     switch (f.application_type){
     case OPUS_APPLICATION_RESTRICTED_LOWDELAY:
@@ -47,7 +61,56 @@ void print_settings(const aoo_format_opus& f){
                 << ", bitrate = " << f.bitrate
                 << ", complexity = " << f.complexity
                 << ", application = " << apptype
-                << ", signal type = " << type);
+                << ", signal type = " << type
+                << ", layout = " << layout);
+#else
+    (void)f; // same level as LOG_VERBOSE
+#endif
+}
+
+/*/////////////////////// channel layout ////////////////////*/
+
+struct channel_layout {
+    int streams;
+    int coupled_streams;
+    unsigned char mapping[256];
+};
+
+// Vorbis channel order for 1-8 channels (RFC 7845, section 5.1.1.2),
+// the same table opus_multistream_surround_encoder_create() uses.
+const struct {
+    int streams;
+    int coupled_streams;
+    unsigned char mapping[8];
+} vorbis_mappings[8] = {
+    { 1, 0, { 0 } },
+    { 1, 1, { 0, 1 } },
+    { 2, 1, { 0, 2, 1 } },
+    { 2, 2, { 0, 1, 2, 3 } },
+    { 3, 2, { 0, 4, 1, 2, 3 } },
+    { 4, 2, { 0, 4, 1, 2, 3, 5 } },
+    { 4, 3, { 0, 4, 1, 2, 3, 5, 6 } },
+    { 5, 3, { 0, 6, 1, 2, 3, 4, 5, 7 } }
+};
+
+// the format must have been validated
+void make_channel_layout(const aoo_format_opus& f, channel_layout& l){
+    auto nchannels = f.header.nchannels;
+    memset(l.mapping, 255, sizeof(l.mapping));
+    if (f.channel_layout == AOO_OPUS_LAYOUT_SURROUND){
+        auto& v = vorbis_mappings[nchannels - 1];
+        l.streams = v.streams;
+        l.coupled_streams = v.coupled_streams;
+        memcpy(l.mapping, v.mapping, nchannels);
+    } else {
+        // coupled streams come first, so channel i simply maps to
+        // decoded channel i in both the coupled and the discrete layout.
+        l.coupled_streams = (f.channel_layout == AOO_OPUS_LAYOUT_COUPLED) ? nchannels / 2 : 0;
+        l.streams = nchannels - l.coupled_streams;
+        for (int i = 0; i < nchannels; ++i){
+            l.mapping[i] = i;
+        }
+    }
 }
 
 /*/////////////////////// codec base ////////////////////////*/
@@ -100,6 +163,24 @@ void validate_format(aoo_format_opus& f)
     if (f.application_type == 0) {
         f.application_type = OPUS_APPLICATION_AUDIO;
     }
+    // validate channel layout
+    switch (f.channel_layout){
+    case AOO_OPUS_LAYOUT_DISCRETE:
+    case AOO_OPUS_LAYOUT_COUPLED:
+        break;
+    case AOO_OPUS_LAYOUT_SURROUND:
+        if (f.header.nchannels > 8){
+            LOG_VERBOSE("Opus: no surround layout for " << f.header.nchannels
+                        << " channels - using coupled layout");
+            f.channel_layout = AOO_OPUS_LAYOUT_COUPLED;
+        }
+        break;
+    default:
+        LOG_WARNING("Opus: unknown channel layout " << f.channel_layout
+                    << " - using discrete layout");
+        f.channel_layout = AOO_OPUS_LAYOUT_DISCRETE;
+        break;
+    }
     // bitrate, complexity and signal type should be validated by opus
 }
 
@@ -165,17 +246,22 @@ int32_t encoder_setformat(void *enc, aoo_format *f){
         opus_multistream_encoder_destroy(c->state);
     }
     // setup channel mapping
-    // only use decoupled streams (what's the point of coupled streams?)
+    // coupled streams code a channel pair in one pass and spend
+    // the bits on what the two channels don't have in common.
     auto nchannels = fmt->header.nchannels;
-    unsigned char mapping[256];
-    for (int i = 0; i < nchannels; ++i){
-        mapping[i] = i;
-    }
-    memset(mapping + nchannels, 255, 256 - nchannels);
+    channel_layout layout;
     // create state
-    c->state = opus_multistream_encoder_create(fmt->header.samplerate,
-                                       nchannels, nchannels, 0, mapping,
-                                       fmt->application_type, &error);
+    if (fmt->channel_layout == AOO_OPUS_LAYOUT_SURROUND){
+        // also enables the surround masking analysis
+        c->state = opus_multistream_surround_encoder_create(fmt->header.samplerate,
+                                       nchannels, 1, &layout.streams, &layout.coupled_streams,
+                                       layout.mapping, fmt->application_type, &error);
+    } else {
+        make_channel_layout(*fmt, layout);
+        c->state = opus_multistream_encoder_create(fmt->header.samplerate,
+                                       nchannels, layout.streams, layout.coupled_streams,
+                                       layout.mapping, fmt->application_type, &error);
+    }
     if (error == OPUS_OK){
         assert(c->state != nullptr);
         // apply settings
@@ -212,7 +298,7 @@ int32_t encoder_setformat(void *enc, aoo_format *f){
 
 int32_t encoder_writeformat(void *enc, aoo_format *fmt,
                             char *buf, int32_t size){
-    if (size >= 16){
+    if (size >= 20){
         // if encoder is null we assume the format passed in
         // is actually a reference to an aoo_format_opus,
         // and this call is used for serialization purposes
@@ -229,7 +315,9 @@ int32_t encoder_writeformat(void *enc, aoo_format *fmt,
         aoo::to_bytes<int32_t>(ofmt->complexity, buf + 4);
         aoo::to_bytes<int32_t>(ofmt->signal_type, buf + 8);
         aoo::to_bytes<int32_t>(ofmt->application_type, buf + 12);
-        return 16;
+        // older peers ignore this
+        aoo::to_bytes<int32_t>(ofmt->channel_layout, buf + 16);
+        return 20;
     } else {
         LOG_WARNING("Opus: couldn't write settings");
         return -1;
@@ -257,6 +345,13 @@ int32_t encoder_readformat(void *enc, aoo_format *fmt,
         } else {
             f.application_type = OPUS_APPLICATION_AUDIO;
         }
+        // older peers only know the discrete layout
+        if (size >= 20) {
+            f.channel_layout = aoo::from_bytes<int32_t>(buf + 16);
+            retsize = 20;
+        } else {
+            f.channel_layout = AOO_OPUS_LAYOUT_DISCRETE;
+        }
         
         if (encoder_setformat(c, reinterpret_cast<aoo_format *>(&f))){
             // it could have been modified during validation, need to re-write the base format of 
@@ -326,9 +421,6 @@ bool decoder_dosetformat(decoder *c, aoo_format_opus& f){
         opus_multistream_decoder_destroy(c->state);
     }
     int error = 0;
-    // setup channel mapping
-    // only use decoupled streams (what's the point of coupled streams?)
-
     // validate nchannels (we might not call validate_format())
     // the rest is validated by opus
     auto nchannels = f.header.nchannels;
@@ -336,15 +428,20 @@ bool decoder_dosetformat(decoder *c, aoo_format_opus& f){
         LOG_WARNING("Opus: channel count " << nchannels << " out of range");
         return false;
     }
-    unsigned char mapping[256];
-    for (int i = 0; i < nchannels; ++i){
-        mapping[i] = i;
+    if (f.channel_layout < AOO_OPUS_LAYOUT_DISCRETE || f.channel_layout > AOO_OPUS_LAYOUT_SURROUND){
+        LOG_WARNING("Opus: unknown channel layout " << f.channel_layout);
+        return false;
+    }
+    if (f.channel_layout == AOO_OPUS_LAYOUT_SURROUND && nchannels > 8){
+        f.channel_layout = AOO_OPUS_LAYOUT_COUPLED; // see validate_format()
     }
-    memset(mapping + nchannels, 255, 256 - nchannels);
+    // setup channel mapping (must match the encoder)
+    channel_layout layout;
+    make_channel_layout(f, layout);
     // create state
     c->state = opus_multistream_decoder_create(f.header.samplerate,
-                                       nchannels, nchannels, 0, mapping,
-                                       &error);
+                                       nchannels, layout.streams, layout.coupled_streams,
+                                       layout.mapping, &error);
     if (error == OPUS_OK){
         assert(c->state != nullptr);
         // these are actually encoder settings and do anything on the decoder
@@ -407,6 +504,13 @@ int32_t decoder_readformat(void *dec, aoo_format *fmt,
         } else {
             f.application_type = OPUS_APPLICATION_AUDIO;
         }
+        // older peers only know the discrete layout
+        if (size >= 20) {
+            f.channel_layout = aoo::from_bytes<int32_t>(buf + 16);
+            retsize = 20;
+        } else {
+            f.channel_layout = AOO_OPUS_LAYOUT_DISCRETE;
+        }
         
         if (decoder_dosetformat(c, f)){
             return retsize; // number of bytes
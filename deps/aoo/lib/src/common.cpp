@@ -14,6 +14,14 @@
 #include <cassert>
 #include <cstring>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+  #define AOO_USE_SSE
+  #include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #define AOO_USE_NEON
+  #include <arm_neon.h>
+#endif
+
 /*/////////////// version ////////////////////*/
 
 namespace aoo {
@@ -209,13 +217,18 @@ std::unique_ptr<decoder> codec::create_decoder() const {
 void block::set(int32_t seq, double sr, int32_t chn,
              int32_t nbytes, int32_t nframes)
 {
+    if (nframes == 0){
+        set_silent(seq, sr, chn);
+        return;
+    }
     sequence = seq;
     samplerate = sr;
     channel = chn;
     numframes_ = nframes;
     framesize_ = 0;
-    assert(nbytes > 0);
-    buffer_.resize(nbytes);
+    silent_ = false;
+    assert(nbytes > 0 && nbytes <= capacity_);
+    size_ = nbytes;
     // set missing frame bits to 1
     frames_ = 0;
     for (int i = 0; i < nframes; ++i){
@@ -233,28 +246,46 @@ void block::set(int32_t seq, double sr, int32_t chn,
     channel = chn;
     numframes_ = nframes;
     framesize_ = framesize;
+    silent_ = false;
     frames_ = 0; // no frames missing
-    buffer_.assign(data, data + nbytes);
+    assert(nbytes <= capacity_);
+    size_ = nbytes;
+    std::copy(data, data + nbytes, data_);
+}
+
+void block::set_silent(int32_t seq, double sr, int32_t chn)
+{
+    sequence = seq;
+    samplerate = sr;
+    channel = chn;
+    numframes_ = 0;
+    framesize_ = 0;
+    silent_ = true;
+    frames_ = 0; // nothing to receive
+    size_ = 0;
 }
 
 bool block::complete() const {
-    if (buffer_.data() == nullptr){
+    if (silent_){
+        return true;
+    }
+    if (data_ == nullptr){
         LOG_ERROR("buffer is 0!");
     }
-    assert(buffer_.data() != nullptr);
+    assert(data_ != nullptr);
     assert(sequence >= 0);
     return frames_ == 0;
 }
 
 void block::add_frame(int32_t which, const char *data, int32_t n){
     assert(data != nullptr);
-    assert(buffer_.data() != nullptr);
+    assert(data_ != nullptr);
     if (which == numframes_ - 1){
         LOG_DEBUG("copy last frame with " << n << " bytes");
-        std::copy(data, data + n, buffer_.end() - n);
+        std::copy(data, data + n, data_ + size_ - n);
     } else {
         LOG_DEBUG("copy frame " << which << " with " << n << " bytes");
-        std::copy(data, data + n, buffer_.begin() + which * n);
+        std::copy(data, data + n, data_ + which * n);
         framesize_ = n; // LATER allow varying framesizes
     }
     frames_ &= ~((uint64_t)1 << which);
@@ -273,7 +304,7 @@ int32_t block::get_frame(int32_t which, char *data, int32_t n){
             } else {
                 nbytes = framesize_;
             }
-            auto ptr = buffer_.data() + onset;
+            auto ptr = data_ + onset;
             std::copy(ptr, ptr + n, data);
             return nbytes;
         } else {
@@ -345,6 +376,20 @@ void block_ack_list::set_limit(int32_t limit){
     limit_ = limit;
 }
 
+void block_ack_list::reserve(int32_t n){
+    // n items only take up a quarter, so deleted items can pile up
+    // to the load limit before they have to be purged (see get())
+    size_t newsize = data_.size();
+    while ((int32_t)newsize < n * 4){
+        newsize <<= 1;
+    }
+    if (newsize > data_.size()){
+        rehash(newsize);
+    }
+    // same size for purging in place
+    temp_.reserve(newsize);
+}
+
 void block_ack_list::clear(){
     for (auto& b : data_){
         b.sequence = block_ack::EMPTY;
@@ -403,9 +448,11 @@ block_ack& block_ack_list::get(int32_t seq){
             // put in empty bucket
             data_[index] = block_ack { seq, limit_ };
             size_++;
-            // rehash if the table is more than 50% full
+            // rehash if the table is more than 50% full. only grow if the
+            // items themselves take up more than a quarter, otherwise just
+            // purge the deleted items (which doesn't allocate).
             if ((size_ + deleted_) > (int32_t)(data_.size() >> 1)){
-                rehash();
+                rehash(size_ > (int32_t)(data_.size() >> 2) ? data_.size() << 1 : data_.size());
                 auto b = find(seq);
                 assert(b != nullptr);
                 return *b;
@@ -457,10 +504,10 @@ int32_t block_ack_list::remove_before(int32_t seq){
     return count;
 }
 
-void block_ack_list::rehash(){
-    auto newsize = data_.size() << 1; // double the size
+void block_ack_list::rehash(size_t newsize){
     auto mask = newsize - 1;
-    std::vector<block_ack> temp(newsize);
+    auto& temp = temp_;
+    temp.assign(newsize, block_ack{});
     // use this chance to find oldest item
     oldest_ = INT32_MAX;
     // we skip all deleted items; 'size_' stays the same
@@ -473,15 +520,15 @@ void block_ack_list::rehash(){
             while (temp[index].sequence >= 0){
                 index = (index + 1) & mask;
             }
-            // insert item
-            temp[index] = block_ack { b.sequence, limit_ };
+            // insert item (keeping its resend state)
+            temp[index] = b;
             // update oldest
             if (b.sequence < oldest_){
                 oldest_ = b.sequence;
             }
         }
     }
-    data_ = std::move(temp);
+    std::swap(data_, temp);
 }
 
 std::ostream& operator<<(std::ostream& os, const block_ack_list& b){
@@ -502,6 +549,10 @@ void block_ack_list::setup(int32_t limit){
     limit_ = limit;
 }
 
+void block_ack_list::reserve(int32_t n){
+    data_.reserve(n);
+}
+
 void block_ack_list::clear(){
     data_.clear();
 }
@@ -624,8 +675,13 @@ int32_t history_buffer::capacity() const {
     return buffer_.size();
 }
 
-void history_buffer::resize(int32_t n){
+void history_buffer::resize(int32_t n, int32_t maxblocksize){
     buffer_.resize(n);
+    slab_.resize((size_t)n * maxblocksize);
+    slotsize_ = maxblocksize;
+    for (int32_t i = 0; i < n; ++i){
+        buffer_[i].set_storage(&slab_[(size_t)i * maxblocksize], maxblocksize);
+    }
     clear();
 }
 
@@ -672,6 +728,10 @@ void history_buffer::push(int32_t seq, double sr,
         return;
     }
     assert(data != nullptr && nbytes > 0);
+    if (nbytes > slotsize_){
+        LOG_ERROR("history_buffer: block " << seq << " too large (" << nbytes << " bytes)");
+        return;
+    }
     // check if we're going to overwrite an existing block
     if (buffer_[head_].sequence >= 0){
         oldest_ = buffer_[head_].sequence;
@@ -682,14 +742,83 @@ void history_buffer::push(int32_t seq, double sr,
     }
 }
 
+void history_buffer::push_silent(int32_t seq, double sr)
+{
+    if (buffer_.empty()){
+        return;
+    }
+    // check if we're going to overwrite an existing block
+    if (buffer_[head_].sequence >= 0){
+        oldest_ = buffer_[head_].sequence;
+    }
+    buffer_[head_].set_silent(seq, sr, 0);
+    if (++head_ >= (int32_t)buffer_.size()){
+        head_ = 0;
+    }
+}
+
+/*////////////////////////// parity_group ///////////////////////////*/
+
+void parity_group::reset(int32_t first, int32_t count){
+    assert(count <= AOO_FEC_MAXGROUPSIZE);
+    // only clear the part we have actually used
+    std::fill(buffer_.begin(), buffer_.begin() + size_, 0);
+    sizes_.fill(0);
+    blocks_ = 0;
+    first_ = first;
+    count_ = count;
+    numblocks_ = 0;
+    size_ = 0;
+}
+
+bool parity_group::has_block(int32_t seq) const {
+    return contains(seq) && (blocks_ & ((uint32_t)1 << (seq - first_)));
+}
+
+int32_t parity_group::missing() const {
+    for (int32_t i = 0; i < count_; ++i){
+        if (!(blocks_ & ((uint32_t)1 << i))){
+            return first_ + i;
+        }
+    }
+    return -1;
+}
+
+bool parity_group::add(int32_t seq, const char *data, int32_t nbytes){
+    if (!contains(seq) || has_block(seq)){
+        return false;
+    }
+    if (nbytes > size_){
+        // the buffer is always zeroed beyond size_
+        if (nbytes > (int32_t)buffer_.size()){
+            buffer_.resize(nbytes);
+        }
+        size_ = nbytes;
+    }
+    for (int32_t i = 0; i < nbytes; ++i){
+        buffer_[i] ^= data[i];
+    }
+    sizes_[seq - first_] = nbytes;
+    blocks_ |= ((uint32_t)1 << (seq - first_));
+    numblocks_++;
+    return true;
+}
+
 /*////////////////////////// block_queue /////////////////////////////*/
 
 void block_queue::clear(){
     size_ = 0;
 }
 
-void block_queue::resize(int32_t n){
+void block_queue::resize(int32_t n, int32_t maxblocksize){
     blocks_.resize(n);
+    slab_.resize((size_t)n * maxblocksize);
+    slotsize_ = maxblocksize;
+    // each block keeps pointing to its slot, the slots just
+    // get shuffled around together with the blocks
+    for (int32_t i = 0; i < n; ++i){
+        blocks_[i].set_storage(&slab_[(size_t)i * maxblocksize], maxblocksize);
+    }
     size_ = 0;
 }
 
@@ -712,6 +841,10 @@ int32_t block_queue::capacity() const {
 block* block_queue::insert(int32_t seq, double sr, int32_t chn,
               int32_t nbytes, int32_t nframes){
     assert(capacity() > 0);
+    if (nbytes > slotsize_){
+        LOG_ERROR("block_queue: block " << seq << " too large (" << nbytes << " bytes)");
+        return nullptr;
+    }
     // find pos to insert
     block * it;
     // first try the end, as it is the most likely position
@@ -848,6 +981,108 @@ std::ostream& operator<<(std::ostream& os, const block_queue& b){
 
 #define AOO_RESAMPLER_SPACE 2.5 // was 3 // jlc was 8
 
+/*////////////////////// deinterleave ///////////////////////*/
+
+static void add_mono(const aoo_sample *in, aoo_sample *out, int32_t n){
+    int32_t i = 0;
+#if defined(AOO_USE_SSE)
+    for (; i + 4 <= n; i += 4){
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+    }
+#elif defined(AOO_USE_NEON)
+    for (; i + 4 <= n; i += 4){
+        vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vld1q_f32(in + i)));
+    }
+#endif
+    for (; i < n; ++i){
+        out[i] += in[i];
+    }
+}
+
+static void deinterleave_add_stereo(const aoo_sample *in, aoo_sample *left,
+                                    aoo_sample *right, int32_t n){
+    int32_t i = 0;
+#if defined(AOO_USE_SSE)
+    for (; i + 4 <= n; i += 4){
+        auto a = _mm_loadu_ps(in + i * 2);     // l0 r0 l1 r1
+        auto b = _mm_loadu_ps(in + i * 2 + 4); // l2 r2 l3 r3
+        auto l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        auto r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), l));
+        _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), r));
+    }
+#elif defined(AOO_USE_NEON)
+    for (; i + 4 <= n; i += 4){
+        auto lr = vld2q_f32(in + i * 2);
+        vst1q_f32(left + i, vaddq_f32(vld1q_f32(left + i), lr.val[0]));
+        vst1q_f32(right + i, vaddq_f32(vld1q_f32(right + i), lr.val[1]));
+    }
+#endif
+    for (; i < n; ++i){
+        left[i] += in[i * 2];
+        right[i] += in[i * 2 + 1];
+    }
+}
+
+void interleave(const aoo_sample **in, int32_t nchannels, int32_t offset,
+                aoo_sample *out, int32_t nframes){
+    if (nchannels == 1){
+        std::copy(in[0] + offset, in[0] + offset + nframes, out);
+    } else if (nchannels == 2){
+        auto left = in[0] + offset;
+        auto right = in[1] + offset;
+        int32_t i = 0;
+    #if defined(AOO_USE_SSE)
+        for (; i + 4 <= nframes; i += 4){
+            auto l = _mm_loadu_ps(left + i);
+            auto r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+    #elif defined(AOO_USE_NEON)
+        for (; i + 4 <= nframes; i += 4){
+            float32x4x2_t lr;
+            lr.val[0] = vld1q_f32(left + i);
+            lr.val[1] = vld1q_f32(right + i);
+            vst2q_f32(out + i * 2, lr);
+        }
+    #endif
+        for (; i < nframes; ++i){
+            out[i * 2] = left[i];
+            out[i * 2 + 1] = right[i];
+        }
+    } else {
+        for (int i = 0; i < nchannels; ++i){
+            auto chn = in[i] + offset;
+            for (int j = 0; j < nframes; ++j){
+                out[j * nchannels + i] = chn[j];
+            }
+        }
+    }
+}
+
+void deinterleave_add(const aoo_sample *in, int32_t nchannels,
+                      aoo_sample **out, int32_t nframes){
+    if (nchannels == 1){
+        if (out[0]){
+            add_mono(in, out[0], nframes);
+        }
+    } else if (nchannels == 2 && out[0] && out[1]){
+        deinterleave_add_stereo(in, out[0], out[1], nframes);
+    } else {
+        for (int i = 0; i < nchannels; ++i){
+            auto chn = out[i];
+            if (chn){
+                for (int j = 0; j < nframes; ++j){
+                    chn[j] += in[j * nchannels + i];
+                }
+            }
+        }
+    }
+}
+
+/*////////////////////// resampler ///////////////////////*/
+
 void dynamic_resampler::setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels){
     nchannels_ = nchannels;
     auto blocksize = std::max<int32_t>(nfrom, nto);
@@ -961,6 +1196,72 @@ void dynamic_resampler::read(aoo_sample *data, int32_t n){
     }
 }
 
+void dynamic_resampler::read_add(aoo_sample **out, int32_t nframes){
+    auto size = (int32_t)buffer_.size();
+    auto limit = size / nchannels_;
+    int32_t intpos = (int32_t)rdpos_;
+    if (ratio_ != 1.0 || (rdpos_ - intpos) != 0.0){
+        // interpolating version
+        double incr = 1. / ratio_;
+        assert(incr > 0);
+        for (int i = 0; i < nframes; ++i){
+            int32_t index = (int32_t)rdpos_;
+            double fract = rdpos_ - (double)index;
+            for (int j = 0; j < nchannels_; ++j){
+                if (out[j]){
+                    double a = buffer_[index * nchannels_ + j];
+                    double b = buffer_[((index + 1) * nchannels_ + j) % size];
+                    out[j][i] += a + (b - a) * fract;
+                }
+            }
+            rdpos_ += incr;
+            if (rdpos_ >= limit){
+                rdpos_ -= limit;
+            }
+        }
+        balance_ -= nframes * nchannels_ * incr;
+    } else {
+        // non-interpolating (faster) version, straight from the ring buffer
+        int32_t n1 = std::min<int32_t>(nframes, limit - intpos);
+        int32_t n2 = nframes - n1;
+        deinterleave_add(&buffer_[intpos * nchannels_], nchannels_, out, n1);
+        if (n2 > 0){
+            auto out2 = (aoo_sample **)alloca(nchannels_ * sizeof(aoo_sample *));
+            for (int j = 0; j < nchannels_; ++j){
+                out2[j] = out[j] ? out[j] + n1 : nullptr;
+            }
+            deinterleave_add(&buffer_[0], nchannels_, out2, n2);
+        }
+        rdpos_ += nframes;
+        if (rdpos_ >= limit){
+            rdpos_ -= limit;
+        }
+        balance_ -= nframes * nchannels_;
+    }
+}
+
+void dynamic_resampler::skip(int32_t n){
+    auto limit = (int32_t)buffer_.size() / nchannels_;
+    int32_t intpos = (int32_t)rdpos_;
+    if (ratio_ != 1.0 || (rdpos_ - intpos) != 0.0){
+        // step the same way as read() so the fractional position matches
+        double incr = 1. / ratio_;
+        for (int i = 0; i < n; i += nchannels_){
+            rdpos_ += incr;
+            if (rdpos_ >= limit){
+                rdpos_ -= limit;
+            }
+        }
+        balance_ -= n * incr;
+    } else {
+        rdpos_ += n / nchannels_;
+        if (rdpos_ >= limit){
+            rdpos_ -= limit;
+        }
+        balance_ -= n;
+    }
+}
+
 /*//////////////////////// timer //////////////////////*/
 
 timer::timer(const timer& other){
@@ -1084,6 +1385,81 @@ timer::state timer::update(time_tag t, double& error){
 
 } // aoo
 
+/*////////////////////////// clock /////////////////////////////*/
+
+aoo_clock * aoo_clock_new(void){
+    return new aoo::audio_clock();
+}
+
+void aoo_clock_free(aoo_clock *c){
+    delete c;
+}
+
+int32_t aoo_clock_setup(aoo_clock *c, int32_t samplerate,
+                        int32_t blocksize, float bandwidth){
+    if (samplerate > 0 && blocksize > 0){
+        c->setup(samplerate, blocksize, bandwidth);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void aoo::audio_clock::setup(int32_t sr, int32_t blocksize, double bandwidth){
+    bandwidth_ = std::max<double>(0, std::min<double>(1, bandwidth));
+    timer_.setup(sr, blocksize);
+    samplerate_ = sr;
+    blocksize_ = blocksize;
+}
+
+int32_t aoo_clock_update(aoo_clock *c, uint64_t t){
+    double error;
+    return c->update(t, error) != aoo::timer::state::error;
+}
+
+aoo::timer::state aoo::audio_clock::update(time_tag t, double& error){
+    // same as in source::process() resp. sink::process()
+    error = 0;
+    auto state = timer_.update(t, error);
+    if (state == timer::state::reset){
+        LOG_DEBUG("setup time DLL filter for clock");
+        dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
+    } else if (state == timer::state::error){
+        error_ = error;
+        error_count_ = count_ + 1;
+        timer_.reset();
+    } else {
+        auto elapsed = timer_.get_elapsed();
+        dll_.update(elapsed);
+    #if AOO_DEBUG_DLL
+        DO_LOG("time elapsed: " << elapsed << ", period: " << dll_.period()
+               << ", samplerate: " << dll_.samplerate());
+    #endif
+    }
+    real_samplerate_ = dll_.samplerate();
+    count_++;
+    return state;
+}
+
+bool aoo::audio_clock::check_error(uint64_t& count, double& error) const {
+    auto current = count_.load();
+    if (current == count){
+        return false;
+    }
+    // only report an error in the most recent update, because
+    // the subscriber is processed in the same block
+    bool result = error_count_.load() == current;
+    count = current;
+    if (result){
+        error = error_.load();
+    }
+    return result;
+}
+
+double aoo_clock_get_samplerate(aoo_clock *c){
+    return c->real_samplerate();
+}
+
 void aoo_initialize(){
     static bool initialized = false;
     if (!initialized){
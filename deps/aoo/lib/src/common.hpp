@@ -8,12 +8,20 @@
 
 #include "time.hpp"
 #include "sync.hpp"
+#include "time_dll.hpp"
 
 #include <vector>
 #include <array>
 #include <memory>
 #include <atomic>
 
+// upper bound for the non-blob part of a data message,
+// a block is split into frames of (packetsize - AOO_DATA_HEADERSIZE) bytes
+#define AOO_DATA_HEADERSIZE 88
+// address pattern string: max 32 bytes
+// typetag string: max. 12 bytes
+// args (without blob data): 36 bytes
+// optional time stamp: 8 bytes
 
 namespace aoo {
 
@@ -21,6 +29,16 @@ bool check_version(uint32_t version);
 
 uint32_t make_version(uint8_t protocolflags = 0);
 
+// non-interleaved -> interleaved, copies 'nframes' frames
+// starting at frame 'offset' of each input channel.
+void interleave(const aoo_sample **in, int32_t nchannels, int32_t offset,
+                aoo_sample *out, int32_t nframes);
+
+// sum interleaved frames into non-interleaved outputs.
+// 'out' holds one pointer per input channel, nullptr entries are skipped.
+void deinterleave_add(const aoo_sample *in, int32_t nchannels,
+                      aoo_sample **out, int32_t nframes);
+
 class dynamic_resampler {
 public:
     void setup(int32_t nfrom, int32_t nto, int32_t srfrom, int32_t srto, int32_t nchannels);
@@ -30,6 +48,11 @@ public:
     void write(const aoo_sample* data, int32_t n);
     int32_t read_available();
     void read(aoo_sample* data, int32_t n);
+    // like read(), but sums 'nframes' frames straight into the
+    // non-interleaved outputs (see deinterleave_add)
+    void read_add(aoo_sample **out, int32_t nframes);
+    // advance like read() without producing any output
+    void skip(int32_t n);
 private:
     std::vector<aoo_sample> buffer_;
     int32_t nchannels_ = 0;
@@ -136,18 +159,38 @@ struct data_packet {
     int32_t framenum;
     const char *data;
     int32_t size;
+    bool silent = false; // silent block marker (DTX)
+    uint64_t timestamp = 0; // send time (NTP), 0 = not stamped
 };
 
+// upper bound for the size of an encoded block, used for preallocating
+// block storage (no codec encodes to more than 64-bit samples)
+inline int32_t max_block_size(int32_t nchannels, int32_t blocksize){
+    return sizeof(double) * nchannels * blocksize;
+}
+
+// A block doesn't own its data, it points into a fixed size slot of a
+// preallocated slab (see block_queue and history_buffer), so blocks can
+// be moved around cheaply and never touch the heap.
 class block {
 public:
+    void set_storage(char *data, int32_t capacity){
+        data_ = data;
+        capacity_ = capacity;
+        size_ = 0;
+    }
+    int32_t capacity() const { return capacity_; }
     // methods
     void set(int32_t seq, double sr, int32_t chn,
           int32_t nbytes, int32_t nframes);
     void set(int32_t seq, double sr, int32_t chn,
              const char *data, int32_t nbytes,
              int32_t nframes, int32_t framesize);
-    const char* data() const { return buffer_.data(); }
-    int32_t size() const { return buffer_.size(); }
+    // a silent block has no data and is always complete
+    void set_silent(int32_t seq, double sr, int32_t chn);
+    bool silent() const { return silent_; }
+    const char* data() const { return data_; }
+    int32_t size() const { return size_; }
     bool complete() const;
     void add_frame(int32_t which, const char *data, int32_t n);
     int32_t get_frame(int32_t which, char * data, int32_t n);
@@ -159,20 +202,26 @@ public:
     double samplerate = 0;
     int32_t channel = 0;
 protected:
-    std::vector<char> buffer_;
+    char *data_ = nullptr;
+    int32_t capacity_ = 0;
+    int32_t size_ = 0;
     uint64_t frames_ = 0; // bitfield (later expand)
     int32_t numframes_ = 0;
     int32_t framesize_ = 0;
+    bool silent_ = false;
 };
 
 class block_queue {
 public:
     void clear();
-    void resize(int32_t n);
+    // allocates storage for n blocks of up to 'maxblocksize' bytes
+    void resize(int32_t n, int32_t maxblocksize);
     bool empty() const;
     bool full() const;
     int32_t size() const;
     int32_t capacity() const;
+    int32_t max_block_size() const { return slotsize_; }
+    // returns nullptr if 'nbytes' exceeds max_block_size()
     block* insert(int32_t seq, double sr, int32_t chn,
                   int32_t nbytes, int32_t nframes);
     block* find(int32_t seq);
@@ -188,6 +237,8 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const block_queue& b);
 private:
     std::vector<block> blocks_;
+    std::vector<char> slab_;
+    int32_t slotsize_ = 0;
     int32_t size_ = 0;
 };
 
@@ -215,6 +266,8 @@ public:
     block_ack_list();
 
     void set_limit(int32_t limit);
+    // makes room for n items, so that get() doesn't need to allocate
+    void reserve(int32_t n);
     block_ack* find(int32_t seq);
     block_ack& get(int32_t seq);
     bool remove(int32_t seq);
@@ -230,10 +283,12 @@ private:
     std::vector<block_ack>::iterator lower_bound(int32_t seq);
 #endif
 #else
-    void rehash();
+    void rehash(size_t newsize);
 
     static const int32_t initial_size_ = 16;
 
+    std::vector<block_ack> temp_; // for rehashing
+
     int32_t size_;
     int32_t deleted_;
     int32_t oldest_;
@@ -246,17 +301,54 @@ class history_buffer {
 public:
     void clear();
     int32_t capacity() const;
-    void resize(int32_t n);
+    // allocates storage for n blocks of up to 'maxblocksize' bytes
+    void resize(int32_t n, int32_t maxblocksize);
     block * find(int32_t seq);
     void push(int32_t seq, double sr,
              const char *data, int32_t nbytes,
              int32_t nframes, int32_t framesize);
+    // silent block marker, so it can be resent like any other block
+    void push_silent(int32_t seq, double sr);
 private:
     std::vector<block> buffer_;
+    std::vector<char> slab_;
+    int32_t slotsize_ = 0;
     int32_t oldest_ = 0;
     int32_t head_ = 0;
 };
 
+// XOR parity over a group of consecutive encoded blocks.
+// A group covers the sequence numbers [first, first + count)
+// and is always aligned to a multiple of 'count'.
+class parity_group {
+public:
+    void reset(int32_t first, int32_t count);
+    void clear() { reset(-1, 0); }
+    int32_t first() const { return first_; }
+    int32_t count() const { return count_; }
+    bool contains(int32_t seq) const {
+        return first_ >= 0 && seq >= first_ && seq < (first_ + count_);
+    }
+    bool has_block(int32_t seq) const;
+    int32_t num_blocks() const { return numblocks_; }
+    // returns the first sequence number which hasn't been added yet (or -1)
+    int32_t missing() const;
+    // XOR the block data into the parity (ignored if the block has already been added)
+    bool add(int32_t seq, const char *data, int32_t nbytes);
+    int32_t block_size(int32_t seq) const { return sizes_[seq - first_]; }
+    const int32_t *block_sizes() const { return sizes_.data(); }
+    const char *data() const { return buffer_.data(); }
+    int32_t size() const { return size_; }
+private:
+    std::vector<char> buffer_;
+    std::array<int32_t, AOO_FEC_MAXGROUPSIZE> sizes_;
+    uint32_t blocks_ = 0; // bitfield
+    int32_t first_ = -1;
+    int32_t count_ = 0;
+    int32_t numblocks_ = 0;
+    int32_t size_ = 0;
+};
+
 /*//////////////////////// timer //////////////////////*/
 
 class timer {
@@ -291,4 +383,35 @@ private:
     spinlock lock_;
 };
 
+// Time DLL filter shared by several sources and sinks (see aoo_clock_new()).
+// The host updates it once per block, subscribers only read the result.
+class audio_clock {
+public:
+    void setup(int32_t sr, int32_t blocksize, double bandwidth);
+
+    timer::state update(time_tag t, double& error);
+
+    bool matches(int32_t sr, int32_t blocksize) const {
+        return sr == samplerate_.load() && blocksize == blocksize_.load();
+    }
+
+    // returns true if the timer ran into an error in the most recent
+    // update and the caller hasn't seen it yet ('count' is the caller's bookkeeping)
+    bool check_error(uint64_t& count, double& error) const;
+
+    double real_samplerate() const { return real_samplerate_.load(); }
+
+    const timer& get_timer() const { return timer_; }
+private:
+    timer timer_;
+    time_dll dll_;
+    double bandwidth_ = AOO_TIMEFILTER_BANDWIDTH;
+    std::atomic<int32_t> samplerate_{0};
+    std::atomic<int32_t> blocksize_{0};
+    std::atomic<double> real_samplerate_{0};
+    std::atomic<uint64_t> count_{0}; // number of updates
+    std::atomic<uint64_t> error_count_{0}; // update with the last error
+    std::atomic<double> error_{0};
+};
+
 } // aoo
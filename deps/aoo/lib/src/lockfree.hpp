@@ -8,6 +8,7 @@
 #include <atomic>
 #include <vector>
 #include <cassert>
+#include <algorithm>
 
 namespace aoo {
 namespace lockfree {
@@ -117,6 +118,188 @@ class queue {
     std::vector<T> data_;
 };
 
+/*////////////////////// spsc_queue /////////////////////////*/
+
+#ifndef AOO_CACHELINE_SIZE
+#define AOO_CACHELINE_SIZE 64
+#endif
+
+// a single-producer/single-consumer variant of queue (same interface).
+// The number of blocks is rounded up to a power of two in memory, so the
+// heads wrap with a mask instead of a modulo; the requested capacity
+// is still respected. The read and write positions live on separate
+// cache lines and each side keeps a cached copy of the other side's
+// position, so try_read()/try_write() and the bulk methods only fetch
+// the shared line when the cache says the queue is empty resp. full.
+// NOTE: read_available() and write_available() always return the
+// exact numbers and may be called from any thread.
+template<typename T>
+class spsc_queue {
+ public:
+    spsc_queue() = default;
+    // we need a move constructor so we can
+    // put it in STL containers
+    spsc_queue(spsc_queue&& other)
+        : stride_(other.stride_),
+          nblocks_(other.nblocks_),
+          mask_(other.mask_),
+          data_(std::move(other.data_)),
+          rdpos_(other.rdpos_.load()),
+          wrcache_(other.wrcache_),
+          wrpos_(other.wrpos_.load()),
+          rdcache_(other.rdcache_)
+    {}
+    spsc_queue& operator=(spsc_queue&& other){
+        stride_ = other.stride_;
+        nblocks_ = other.nblocks_;
+        mask_ = other.mask_;
+        data_ = std::move(other.data_);
+        rdpos_ = other.rdpos_.load();
+        wrcache_ = other.wrcache_;
+        wrpos_ = other.wrpos_.load();
+        rdcache_ = other.rdcache_;
+        return *this;
+    }
+
+    void resize(int32_t size, int32_t blocksize) {
+        assert(size >= blocksize);
+        assert((size % blocksize) == 0);
+        nblocks_ = size / blocksize;
+        uint32_t n = 1;
+        while (n < nblocks_){
+            n <<= 1;
+        }
+        mask_ = n - 1;
+    #if 1
+        data_.clear(); // force zero
+    #endif
+        data_.resize(n * blocksize);
+        stride_ = blocksize;
+        reset();
+    }
+
+    int32_t blocksize() const { return stride_; }
+
+    // the requested capacity (not the allocated size)
+    int32_t capacity() const { return nblocks_ * stride_; }
+
+    void reset() {
+        rdpos_ = wrpos_ = 0;
+        rdcache_ = wrcache_ = 0;
+    }
+    // returns: the number of available *blocks* for reading
+    int32_t read_available() const {
+        return wrpos_.load(std::memory_order_acquire) - rdpos_.load(std::memory_order_acquire);
+    }
+
+    void read(T& out) {
+        assert(stride_ == 1);
+        auto pos = rdpos_.load(std::memory_order_relaxed);
+        assert(pos != wrpos_.load(std::memory_order_relaxed));
+        out = std::move(data_[pos & mask_]);
+        rdpos_.store(pos + 1, std::memory_order_release);
+    }
+
+    bool try_read(T& out) {
+        auto pos = rdpos_.load(std::memory_order_relaxed);
+        if (pos == wrcache_ && pos == (wrcache_ = wrpos_.load(std::memory_order_acquire))){
+            return false;
+        }
+        read(out);
+        return true;
+    }
+
+    // copies up to n blocks to 'out' and returns the number of blocks read
+    int32_t read(T *out, int32_t n) {
+        auto pos = rdpos_.load(std::memory_order_relaxed);
+        if ((int32_t)(wrcache_ - pos) < n){
+            wrcache_ = wrpos_.load(std::memory_order_acquire);
+            n = std::min<int32_t>(n, wrcache_ - pos);
+        }
+        for (int32_t i = 0; i < n; ++i, ++pos){
+            auto src = &data_[(pos & mask_) * stride_];
+            std::move(src, src + stride_, out);
+            out += stride_;
+        }
+        rdpos_.store(pos, std::memory_order_release);
+        return n;
+    }
+
+    const T* read_data() const {
+        return &data_[(rdpos_.load(std::memory_order_relaxed) & mask_) * stride_];
+    }
+
+    void read_commit() {
+        auto pos = rdpos_.load(std::memory_order_relaxed);
+        assert(pos != wrpos_.load(std::memory_order_relaxed));
+        rdpos_.store(pos + 1, std::memory_order_release);
+    }
+    // returns: the number of available *blocks* for writing
+    int32_t write_available() const {
+        return nblocks_ - (wrpos_.load(std::memory_order_acquire) - rdpos_.load(std::memory_order_acquire));
+    }
+
+    template<typename U>
+    void write(U&& value) {
+        assert(stride_ == 1);
+        auto pos = wrpos_.load(std::memory_order_relaxed);
+        assert((pos - rdpos_.load(std::memory_order_relaxed)) < nblocks_);
+        data_[pos & mask_] = std::forward<U>(value);
+        wrpos_.store(pos + 1, std::memory_order_release);
+    }
+
+    template<typename U>
+    bool try_write(U&& value) {
+        auto pos = wrpos_.load(std::memory_order_relaxed);
+        if ((pos - rdcache_) >= nblocks_
+                && (pos - (rdcache_ = rdpos_.load(std::memory_order_acquire))) >= nblocks_){
+            return false;
+        }
+        write(std::forward<U>(value));
+        return true;
+    }
+
+    // copies up to n blocks from 'in' and returns the number of blocks written
+    int32_t write(const T *in, int32_t n) {
+        auto pos = wrpos_.load(std::memory_order_relaxed);
+        if ((int32_t)(nblocks_ - (pos - rdcache_)) < n){
+            rdcache_ = rdpos_.load(std::memory_order_acquire);
+            n = std::min<int32_t>(n, nblocks_ - (pos - rdcache_));
+        }
+        for (int32_t i = 0; i < n; ++i, ++pos){
+            std::copy(in, in + stride_, &data_[(pos & mask_) * stride_]);
+            in += stride_;
+        }
+        wrpos_.store(pos, std::memory_order_release);
+        return n;
+    }
+
+    T* write_data() {
+        return &data_[(wrpos_.load(std::memory_order_relaxed) & mask_) * stride_];
+    }
+
+    void write_commit() {
+        auto pos = wrpos_.load(std::memory_order_relaxed);
+        assert((pos - rdpos_.load(std::memory_order_relaxed)) < nblocks_);
+        wrpos_.store(pos + 1, std::memory_order_release);
+    }
+ private:
+    // shared, only changed in resize()
+    int32_t stride_{0};
+    uint32_t nblocks_{0};
+    uint32_t mask_{0};
+    std::vector<T> data_;
+    char pad0_[AOO_CACHELINE_SIZE];
+    // consumer
+    std::atomic<uint32_t> rdpos_{0};
+    uint32_t wrcache_{0}; // last seen write position
+    char pad1_[AOO_CACHELINE_SIZE];
+    // producer
+    std::atomic<uint32_t> wrpos_{0};
+    uint32_t rdcache_{0}; // last seen read position
+    char pad2_[AOO_CACHELINE_SIZE];
+};
+
 /*///////////////////////// list ////////////////////////*/
 
 // a lock-free singly-linked list which supports adding items and iteration.
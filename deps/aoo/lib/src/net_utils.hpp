@@ -4,6 +4,7 @@
 
 #ifdef _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 typedef int socklen_t;
 #else
 #include <sys/socket.h>
@@ -44,14 +45,42 @@ struct ip_address {
         memcpy(&address, &sa, sizeof(sa));
         length = sizeof(sa);
     }
+    // a numeric IPv4 or IPv6 address, see valid()
     ip_address(const std::string& host, int port){
+        memset(&address, 0, sizeof(address));
         struct sockaddr_in sa;
         memset(&sa, 0, sizeof(sa));
-        sa.sin_family = AF_INET;
-        sa.sin_addr.s_addr = inet_addr(host.c_str());
-        sa.sin_port = htons(port);
-        memcpy(&address, &sa, sizeof(sa));
-        length = sizeof(sa);
+        struct sockaddr_in6 sa6;
+        memset(&sa6, 0, sizeof(sa6));
+        if (inet_pton(AF_INET, host.c_str(), &sa.sin_addr) == 1){
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons(port);
+            memcpy(&address, &sa, sizeof(sa));
+            length = sizeof(sa);
+        } else if (inet_pton(AF_INET6, host.c_str(), &sa6.sin6_addr) == 1){
+            sa6.sin6_family = AF_INET6;
+            sa6.sin6_port = htons(port);
+            memcpy(&address, &sa6, sizeof(sa6));
+            length = sizeof(sa6);
+        } else {
+            // like the default constructor
+            length = sizeof(address);
+        }
+    }
+
+    // the length of an IPv4 or IPv6 socket address, 0 for anything else
+    static socklen_t length_of(const struct sockaddr *sa){
+        if (sa->sa_family == AF_INET){
+            return sizeof(struct sockaddr_in);
+        } else if (sa->sa_family == AF_INET6){
+            return sizeof(struct sockaddr_in6);
+        } else {
+            return 0;
+        }
+    }
+
+    bool valid() const {
+        return address.ss_family == AF_INET || address.ss_family == AF_INET6;
     }
 
     ip_address(const ip_address& other){
@@ -72,8 +101,12 @@ struct ip_address {
                 auto b = (const struct sockaddr_in *)&other.address;
                 return (a->sin_addr.s_addr == b->sin_addr.s_addr)
                         && (a->sin_port == b->sin_port);
-            } else  {
-                // IPv6 not supported yet
+            } else if (address.ss_family == AF_INET6){
+                auto a = (const struct sockaddr_in6 *)&address;
+                auto b = (const struct sockaddr_in6 *)&other.address;
+                return !memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr))
+                        && (a->sin6_port == b->sin6_port);
+            } else {
                 return false;
             }
         #else
@@ -88,6 +121,13 @@ struct ip_address {
     std::string name() const {
         if (address.ss_family == AF_INET){
             return inet_ntoa(reinterpret_cast<const struct sockaddr_in *>(&address)->sin_addr);
+        } else if (address.ss_family == AF_INET6){
+            char buf[INET6_ADDRSTRLEN];
+            if (inet_ntop(AF_INET6, &reinterpret_cast<const struct sockaddr_in6 *>(&address)->sin6_addr,
+                          buf, sizeof(buf))){
+                return buf;
+            }
+            return "";
         } else {
             return "";
         }
@@ -96,6 +136,8 @@ struct ip_address {
     int port() const {
         if (address.ss_family == AF_INET){
             return ntohs(reinterpret_cast<const struct sockaddr_in *>(&address)->sin_port);
+        } else if (address.ss_family == AF_INET6){
+            return ntohs(reinterpret_cast<const struct sockaddr_in6 *>(&address)->sin6_port);
         } else {
             return -1;
         }
@@ -39,6 +39,12 @@
 #define AOONET_MSG_CLIENT_PEER_LEAVE \
     AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_PEER AOONET_MSG_LEAVE
 
+#define AOONET_MSG_CLIENT_RELAY \
+    AOO_MSG_DOMAIN AOONET_MSG_CLIENT AOONET_MSG_RELAY
+
+#define AOONET_MSG_RELAY_GROUP \
+    AOONET_MSG_RELAY AOONET_MSG_GROUP
+
 #define AOONET_MSG_GROUP_JOIN \
     AOONET_MSG_GROUP AOONET_MSG_JOIN
 
@@ -245,6 +251,34 @@ int32_t aoo::net::server::events_available(){
     return 0;
 }
 
+int32_t aoonet_server_set_relay(aoonet_server *server, bool enable){
+    return server->set_relay(enable);
+}
+
+int32_t aoo::net::server::set_relay(bool enable){
+    relay_.store(enable);
+    return 1;
+}
+
+int32_t aoonet_server_get_relay_stats(aoonet_server *server, const char *group,
+                                      aoonet_relay_stats *stats){
+    return server->get_relay_stats(group, stats);
+}
+
+int32_t aoo::net::server::get_relay_stats(const char *group, aoonet_relay_stats *stats){
+    shared_lock lock(group_lock_);
+    for (auto& grp : groups_){
+        if (grp->name == group){
+            stats->bytes_in = grp->relay_bytes_in.load();
+            stats->bytes_out = grp->relay_bytes_out.load();
+            stats->packets_in = grp->relay_packets_in.load();
+            stats->packets_out = grp->relay_packets_out.load();
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int32_t aoonet_server_handle_events(aoonet_server *server, aoo_eventhandler fn, void *user){
     return server->handle_events(fn, user);
 }
@@ -353,6 +387,7 @@ std::shared_ptr<group> server::get_group(const std::string& name,
         // create new group (LATER add option to disallow this)
         if (true){
             grp = std::make_shared<group>(name, pwd, is_public);
+            unique_lock lock(group_lock_);
             groups_.push_back(grp);
             e = error::none;
             return grp;
@@ -694,6 +729,7 @@ void server::update(){
                 on_public_group_removed(*(*it));
             }
 
+            unique_lock lock(group_lock_);
             it = groups_.erase(it);
         } else {
             ++it;
@@ -707,7 +743,7 @@ void server::receive_udp(){
     }
     // read as much data as possible until recv() would block
     while (true){
-        char buf[AOO_MAXPACKETSIZE];
+        char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
         ip_address addr;
         int32_t result = recvfrom(udpsocket_, buf, sizeof(buf), 0,
                                (struct sockaddr *)&addr.address, &addr.length);
@@ -798,6 +834,8 @@ void server::handle_udp_message(const osc::ReceivedMessage &msg, int onset,
                   << addr.name().c_str() << addr.port() << osc::EndMessage;
 
             send_udp_message(reply.Data(), (int32_t) reply.Size(), addr);
+        } else if (!strncmp(pattern, AOONET_MSG_RELAY, AOONET_MSG_RELAY_LEN)){
+            handle_relay_message(msg, onset, addr);
         } else {
             LOG_ERROR("aoo_server: unknown message " << pattern);
         }
@@ -807,6 +845,98 @@ void server::handle_udp_message(const osc::ReceivedMessage &msg, int onset,
     }
 }
 
+client_endpoint * server::find_client(const ip_address& public_addr){
+    for (auto& c : clients_){
+        if (c->is_active() && c->get_user() && c->public_address == public_addr){
+            return c.get();
+        }
+    }
+    return nullptr;
+}
+
+void server::handle_relay_message(const osc::ReceivedMessage& msg, int onset,
+                                  const ip_address& addr)
+{
+    if (!relay_.load()){
+        LOG_DEBUG("aoo_server: relay disabled, ignoring message");
+        return;
+    }
+    // only logged in users may relay, and only to members of their groups,
+    // otherwise we would be an open reflector.
+    auto client = find_client(addr);
+    if (!client){
+        LOG_DEBUG("aoo_server: relay message from unknown address " << addr.name()
+                  << ":" << addr.port());
+        return;
+    }
+    auto& usr = client->get_user();
+
+    auto pattern = msg.AddressPattern() + onset;
+    auto it = msg.ArgumentsBegin();
+
+    if (!strcmp(pattern, AOONET_MSG_RELAY_GROUP)){
+        // fan out to all other group members
+        std::string name = (it++)->AsString();
+        const void *data;
+        osc::osc_bundle_element_size_t size;
+        (it++)->AsBlob(data, size);
+
+        for (auto& grp : usr->groups()){
+            if (grp->name == name){
+                grp->relay_packets_in++;
+                grp->relay_bytes_in += size;
+                for (auto& member : grp->users()){
+                    if (member != usr && member->endpoint){
+                        relay_packet(*grp, addr, data, size,
+                                     member->endpoint->public_address);
+                    }
+                }
+                return;
+            }
+        }
+        LOG_DEBUG("aoo_server: relay: " << usr->name << " is not in group " << name);
+    } else if (!strcmp(pattern, AOONET_MSG_RELAY)){
+        // forward to a single peer
+        std::string ip = (it++)->AsString();
+        int32_t port = (it++)->AsInt32();
+        const void *data;
+        osc::osc_bundle_element_size_t size;
+        (it++)->AsBlob(data, size);
+
+        ip_address dest(ip, port);
+        for (auto& grp : usr->groups()){
+            for (auto& member : grp->users()){
+                if (member != usr && member->endpoint
+                        && member->endpoint->public_address == dest){
+                    grp->relay_packets_in++;
+                    grp->relay_bytes_in += size;
+                    relay_packet(*grp, addr, data, size, dest);
+                    return;
+                }
+            }
+        }
+        LOG_DEBUG("aoo_server: relay: " << ip << ":" << port
+                  << " doesn't share a group with " << usr->name);
+    } else {
+        LOG_ERROR("aoo_server: unknown message " << pattern);
+    }
+}
+
+void server::relay_packet(group& grp, const ip_address& src,
+                          const void *data, int32_t size, const ip_address& dest)
+{
+    char buf[AOO_MAXPACKETSIZE + AOONET_RELAY_OVERHEAD];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
+    msg << osc::BeginMessage(AOONET_MSG_CLIENT_RELAY)
+        << src.name().c_str() << src.port() << osc::Blob(data, size)
+        << osc::EndMessage;
+
+    send_udp_message(msg.Data(), (int32_t) msg.Size(), dest);
+
+    grp.relay_packets_out++;
+    grp.relay_bytes_out += size;
+}
+
 void server::signal(){
 #ifdef _WIN32
     SetEvent(waitevent_);
@@ -1199,7 +1329,8 @@ void client_endpoint::handle_login(const osc::ReceivedMessage& msg)
     char buf[AOO_MAXPACKETSIZE];
     osc::OutboundPacketStream reply(buf, sizeof(buf));
     reply << osc::BeginMessage(AOONET_MSG_CLIENT_LOGIN)
-          << result << errmsg.c_str() << osc::EndMessage;
+          << result << errmsg.c_str() << (int32_t)server_->relay_enabled()
+          << osc::EndMessage;
 
     send_message(reply.Data(), (int32_t)reply.Size());
 }
@@ -7,6 +7,7 @@
 #include "aoo/aoo_net.hpp"
 #include "aoo/aoo_utils.hpp"
 
+#include "sync.hpp"
 #include "lockfree.hpp"
 #include "net_utils.hpp"
 #include "SLIP.hpp"
@@ -52,6 +53,8 @@ public:
     ip_address public_address;
     ip_address local_address;
     int64_t token;
+
+    const std::shared_ptr<user>& get_user() const { return user_; }
 private:
     std::shared_ptr<user> user_;
     ip_address addr_;
@@ -114,6 +117,12 @@ struct group {
     int32_t num_users() const { return (int32_t)users_.size(); }
 
     const user_list& users() { return users_; }
+
+    // relayed traffic, read by get_relay_stats()
+    std::atomic<int64_t> relay_bytes_in{0};
+    std::atomic<int64_t> relay_bytes_out{0};
+    std::atomic<int64_t> relay_packets_in{0};
+    std::atomic<int64_t> relay_packets_out{0};
 private:
     user_list users_;
 };
@@ -168,7 +177,13 @@ public:
 
     int32_t get_group_count() const override;
     int32_t get_user_count() const override;
-    
+
+    int32_t set_relay(bool enable) override;
+
+    bool relay_enabled() const { return relay_.load(); }
+
+    int32_t get_relay_stats(const char *group, aoonet_relay_stats *stats) override;
+
     void on_user_joined(user& usr);
 
     void on_user_left(user& usr);
@@ -193,6 +208,10 @@ private:
     std::vector<std::unique_ptr<client_endpoint>> clients_;
     user_list users_;
     group_list groups_;
+    // only protects groups_ against get_relay_stats(),
+    // the server thread itself doesn't need to lock for reading.
+    shared_mutex group_lock_;
+    std::atomic<bool> relay_{false};
     // queues
     lockfree::queue<std::unique_ptr<icommand>> commands_;
     lockfree::queue<std::unique_ptr<ievent>> events_;
@@ -221,6 +240,14 @@ private:
     void handle_udp_message(const osc::ReceivedMessage& msg, int onset,
                             const ip_address& addr);
 
+    void handle_relay_message(const osc::ReceivedMessage& msg, int onset,
+                              const ip_address& addr);
+
+    void relay_packet(group& grp, const ip_address& src,
+                      const void *data, int32_t size, const ip_address& dest);
+
+    client_endpoint * find_client(const ip_address& public_addr);
+
     void signal();
 
     /*/////////////////// events //////////////////////*/
@@ -165,6 +165,13 @@ int32_t aoo::sink::set_option(int32_t opt, void *ptr, int32_t size)
         bandwidth_ = std::max<double>(0, std::min<double>(1, as<float>(ptr)));
         timer_.reset(); // will update time DLL and reset timer
         break;
+    // shared clock
+    case aoo_opt_clock:
+        CHECKARG(aoo_clock *);
+        if (clock_.exchange(as<aoo_clock *>(ptr)) != as<aoo_clock *>(ptr)){
+            timer_.reset();
+        }
+        break;
     // packetsize
     case aoo_opt_packetsize:
     {
@@ -232,6 +239,10 @@ int32_t aoo::sink::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(float);
         as<float>(ptr) = bandwidth_;
         break;
+    case aoo_opt_clock:
+        CHECKARG(aoo_clock *);
+        as<aoo_clock *>(ptr) = clock_.load();
+        break;
     // resend packetsize
     case aoo_opt_packetsize:
         CHECKARG(int32_t);
@@ -310,6 +321,9 @@ int32_t aoo::sink::get_sourceoption(void *endpoint, int32_t id,
         case aoo_opt_buffer_fill_ratio:
             CHECKARG(float);
             return src->get_buffer_fill_ratio(as<float>(p));
+        case aoo_opt_transit_stats:
+            CHECKARG(aoo_transit_stats);
+            return src->get_transit_stats(as<aoo_transit_stats>(p));
         case aoo_opt_userformat:
             return src->get_userformat(static_cast<char*>(p), size);
         // unsupported
@@ -375,6 +389,8 @@ int32_t aoo::sink::handle_message(const char *data, int32_t n,
             return handle_format_message(endpoint, fn, msg);
         } else if (!strcmp(pattern, AOO_MSG_DATA)){
             return handle_data_message(endpoint, fn, msg);
+        } else if (!strcmp(pattern, AOO_MSG_PARITY)){
+            return handle_parity_message(endpoint, fn, msg);
         } else if (!strcmp(pattern, AOO_MSG_PING)){
             return handle_ping_message(endpoint, fn, msg);
         } else {
@@ -407,41 +423,77 @@ int32_t aoo_sink_process(aoo_sink *sink, aoo_sample **data,
 
 #define AOO_MAXNUMEVENTS 256
 
+int32_t aoo_sink_process_add(aoo_sink *sink, aoo_sample **data,
+                             int32_t nsamples, uint64_t t) {
+    return sink->process_add(data, nsamples, t);
+}
+
 int32_t aoo::sink::process(aoo_sample **data, int32_t nsampframes, uint64_t t){
     // we need to respect the nframes passed in here, which may be smaller than
     // the blocksize (the host may be splitting the processing, etc)
-    std::fill(buffer_.begin(), buffer_.end(), 0);
+    auto buffers = (aoo_sample **)alloca(nchannels_ * sizeof(aoo_sample *));
+    for (int i = 0; i < nchannels_; ++i){
+        buffers[i] = &buffer_[i * blocksize_];
+        std::fill(buffers[i], buffers[i] + nsampframes, 0);
+    }
 
+    if (process_sources(buffers, nsampframes, t)){
+        // copy buffers
+        for (int i = 0; i < nchannels_; ++i){
+            std::copy(buffers[i], buffers[i] + nsampframes, data[i]);
+        }
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+int32_t aoo::sink::process_add(aoo_sample **data, int32_t nsampframes, uint64_t t){
+    return process_sources(data, nsampframes, t);
+}
+
+bool aoo::sink::process_sources(aoo_sample **data, int32_t nsampframes, uint64_t t){
     bool didsomething = false;
 
     // update time DLL filter
     // TODO deal with when we are called with less than the blocksize for this
     double error;
-    auto state = timer_.update(t, error);
-    
-   
-    if (state == timer::state::reset){
-        LOG_DEBUG("setup time DLL filter for sink");
-        dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
-    } else if (state == timer::state::error){
-        // recover sources
-        for (auto& s : sources_){
-            s.request_recover();
+    if (auto clock = shared_clock()){
+        // the host has already updated the shared clock for this block
+        if (clock->check_error(clock_count_, error)){
+            // recover sources
+            for (auto& s : sources_){
+                s.request_recover();
+            }
         }
-        timer_.reset();
+        realsr_ = clock->real_samplerate();
     } else {
-        auto elapsed = timer_.get_elapsed();
-        dll_.update(elapsed);
-    #if AOO_DEBUG_DLL
-        DO_LOG("time elapsed: " << elapsed << ", period: " << dll_.period()
-               << ", samplerate: " << dll_.samplerate());
-    #endif
+        auto state = timer_.update(t, error);
+
+        if (state == timer::state::reset){
+            LOG_DEBUG("setup time DLL filter for sink");
+            dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
+        } else if (state == timer::state::error){
+            // recover sources
+            for (auto& s : sources_){
+                s.request_recover();
+            }
+            timer_.reset();
+        } else {
+            auto elapsed = timer_.get_elapsed();
+            dll_.update(elapsed);
+        #if AOO_DEBUG_DLL
+            DO_LOG("time elapsed: " << elapsed << ", period: " << dll_.period()
+                   << ", samplerate: " << dll_.samplerate());
+        #endif
+        }
+        realsr_ = dll_.samplerate();
     }
 
     // if the DLL samplerate is any more than +/- 10% of our nominal, we'll ignore it
     // some shenanigans are going on
     bool ignoredll = !dynamic_resampling_.load();
-    if (!ignoredll && fabs(dll_.samplerate() - ((double)samplerate_)) > 0.1*samplerate_) {
+    if (!ignoredll && fabs(realsr_ - ((double)samplerate_)) > 0.1*samplerate_) {
         ignoredll = true;
     }
     ignore_dll_ = ignoredll;
@@ -449,30 +501,22 @@ int32_t aoo::sink::process(aoo_sample **data, int32_t nsampframes, uint64_t t){
     // the mutex is uncontended most of the time, but LATER we might replace
     // this with a lockless and/or waitfree solution
     for (auto& src : sources_){
-        if (src.process(*this, buffer_.data(), blocksize_, nsampframes)){
+        if (src.process(*this, data, nsampframes)){
             didsomething = true;
         }
     }
 
+#if AOO_CLIP_OUTPUT
     if (didsomething){
-    #if AOO_CLIP_OUTPUT
-        for (auto it = buffer_.begin(); it != buffer_.end(); ++it){
-            if (*it > 1.0){
-                *it = 1.0;
-            } else if (*it < -1.0){
-                *it = -1.0;
-            }
-        }
-    #endif
-        // copy buffers
         for (int i = 0; i < nchannels_; ++i){
-            auto buf = &buffer_[i * blocksize_];
-            std::copy(buf, buf + nsampframes, data[i]);
+            for (int j = 0; j < nsampframes; ++j){
+                data[i][j] = std::max<aoo_sample>(-1.0, std::min<aoo_sample>(1.0, data[i][j]));
+            }
         }
-        return 1;
-    } else {
-        return 0;
     }
+#endif
+
+    return didsomething;
 }
 int32_t aoo_sink_events_available(aoo_sink *sink){
     return sink->events_available();
@@ -604,6 +648,10 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
     (it++)->AsBlob(blobdata, blobsize);
     d.data = (const char *)blobdata;
     d.size = blobsize;
+    // optional send time stamp
+    if (it != msg.ArgumentsEnd() && it->IsTimeTag()){
+        d.timestamp = (it++)->AsTimeTag();
+    }
 
     if (id < 0){
         LOG_WARNING("bad ID for " << AOO_MSG_DATA << " message");
@@ -626,30 +674,44 @@ int32_t sink::handle_data_message(void *endpoint, aoo_replyfn fn,
 int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
                                           const osc::ReceivedMessage& msg)
 {
-    // /d <i:salt> <i:seq> <b:data>
-    // /d <i:salt> <i:seq> <f:srate> <b:data>
+    // /d <i:salt> <i:seq> <b:data> [<t:timestamp>]
+    // /d <i:salt> <i:seq> <f:srate> <b:data> [<t:timestamp>]
+    // silent block (no data):
+    // /d <i:salt> <i:seq> [<t:timestamp>]
+    // /d <i:salt> <i:seq> <f:srate> [<t:timestamp>]
     auto it = msg.ArgumentsBegin();
 
     aoo::data_packet d;
 
     auto salt = (it++)->AsInt32();
     d.sequence = (it++)->AsInt32();
-    if (msg.ArgumentCount() == 4) {
+    if (it != msg.ArgumentsEnd() && it->IsDouble()) {
         d.samplerate = (it++)->AsDouble();
     }
     else {
         d.samplerate = 0; // marker to use last
     }
-    const void *blobdata;
-    osc::osc_bundle_element_size_t blobsize;
-    (it++)->AsBlob(blobdata, blobsize);
     // reconstruct the rest from prior format
     d.channel = 0 ;
-    d.nframes = 1;
     d.framenum = 0;
-    d.data = (const char *)blobdata;
-    d.size = blobsize;
+    if (it != msg.ArgumentsEnd() && it->IsBlob()) {
+        const void *blobdata;
+        osc::osc_bundle_element_size_t blobsize;
+        (it++)->AsBlob(blobdata, blobsize);
+        d.nframes = 1;
+        d.data = (const char *)blobdata;
+        d.size = blobsize;
+    } else {
+        d.nframes = 0;
+        d.data = nullptr;
+        d.size = 0;
+        d.silent = true;
+    }
     d.totalsize = d.size;
+    // optional send time stamp
+    if (it != msg.ArgumentsEnd() && it->IsTimeTag()){
+        d.timestamp = (it++)->AsTimeTag();
+    }
 
     // try to find existing source by salt
     auto src = find_source_by_salt(endpoint, salt);
@@ -661,6 +723,53 @@ int32_t sink::handle_compact_data_message(void *endpoint, aoo_replyfn fn,
     }
 }
 
+int32_t sink::handle_parity_message(void *endpoint, aoo_replyfn fn,
+                                    const osc::ReceivedMessage& msg)
+{
+    auto it = msg.ArgumentsBegin();
+
+    auto id = (it++)->AsInt32();
+    auto salt = (it++)->AsInt32();
+    aoo::data_packet d;
+    d.sequence = (it++)->AsInt32();
+    d.samplerate = (it++)->AsDouble();
+    d.channel = (it++)->AsInt32();
+    auto count = (it++)->AsInt32();
+    const void *sizedata;
+    osc::osc_bundle_element_size_t sizesize;
+    (it++)->AsBlob(sizedata, sizesize);
+    d.totalsize = (it++)->AsInt32();
+    d.nframes = (it++)->AsInt32();
+    d.framenum = (it++)->AsInt32();
+    const void *blobdata;
+    osc::osc_bundle_element_size_t blobsize;
+    (it++)->AsBlob(blobdata, blobsize);
+    d.data = (const char *)blobdata;
+    d.size = blobsize;
+
+    if (id < 0){
+        LOG_WARNING("bad ID for " << AOO_MSG_PARITY << " message");
+        return 0;
+    }
+    if (count < 2 || count > AOO_FEC_MAXGROUPSIZE
+            || sizesize != count * (int32_t)sizeof(int32_t)){
+        LOG_WARNING("bad group size for " << AOO_MSG_PARITY << " message");
+        return 0;
+    }
+    int32_t sizes[AOO_FEC_MAXGROUPSIZE];
+    for (int32_t i = 0; i < count; ++i){
+        sizes[i] = aoo::from_bytes<int32_t>((const char *)sizedata + i * sizeof(int32_t));
+    }
+    // try to find existing source
+    auto src = find_source(endpoint, id);
+    if (src){
+        return src->handle_parity(*this, salt, d, sizes, count);
+    } else {
+        // the source will be added with the next data message
+        return 0;
+    }
+}
+
 int32_t sink::handle_ping_message(void *endpoint, aoo_replyfn fn,
                                   const osc::ReceivedMessage& msg)
 {
@@ -731,6 +840,14 @@ int32_t source_desc::get_buffer_fill_ratio(float &ratio){
     return 1;
 }
 
+int32_t source_desc::get_transit_stats(aoo_transit_stats &stats){
+    stats.transit = transit_.load();
+    stats.min_transit = min_transit_.load();
+    stats.jitter = jitter_.load();
+    stats.count = transit_count_.load();
+    return 1;
+}
+
 int32_t source_desc::get_userformat(char *buf, int32_t size){
     shared_lock lock(mutex_);
     if (userformat_.empty()) return 0;
@@ -745,59 +862,196 @@ int32_t source_desc::get_userformat(char *buf, int32_t size){
 
 
 void source_desc::update(const sink &s){
-    // take writer lock!
-    unique_lock lock(mutex_);
-    do_update(s);
-}
-
-void source_desc::do_update(const sink &s){
-    // resize audio ring buffer
-    if (decoder_ && decoder_->blocksize() > 0 && decoder_->samplerate() > 0){
-        // recalculate buffersize from ms to samples
-        double bufsize = (double)s.buffersize() * decoder_->samplerate() * 0.001;
-        bufsize = std::max(bufsize, (double)s.blocksize()); // needs to be at least one processing blocksize worth!
-        auto d = div(bufsize, decoder_->blocksize());
-        int32_t nbuffers = d.quot + (d.rem != 0); // round up
-        nbuffers = std::max<int32_t>(1, nbuffers); // e.g. if buffersize_ is 0
-        // resize audio buffer and initially fill with zeros.
-        auto nsamples = decoder_->nchannels() * decoder_->blocksize();
-        audioqueue_.resize(nbuffers * nsamples, nsamples);
-        infoqueue_.resize(nbuffers, 1);
-        int count = 0;
-        while (audioqueue_.write_available() && infoqueue_.write_available()){
-            audioqueue_.write_commit();
-            // push nominal samplerate + default channel (0)
-            block_info i;
-            i.sr = decoder_->samplerate();
-            i.channel = 0;
-            infoqueue_.write(i);
-            count++;
-        };
-        LOG_VERBOSE("reset source queues to " << nbuffers << " buffers");
-    #if 0
-        // don't touch the event queue once constructed
-        eventqueue_.reset();
-    #endif
-        // setup resampler
-        resampler_.setup(decoder_->blocksize(), s.blocksize(),
-                            decoder_->samplerate(), s.samplerate(), decoder_->nchannels());
-        // resize block queue
-        blockqueue_.resize(nbuffers + 8); // (32) extra capacity for network jitter (allows lower buffersizes) (should be option?)
-        newest_ = 0;
-        next_ = -1;
-        nextneedsfadein_ = 0;
-        channel_ = 0;
-        samplerate_ = decoder_->samplerate();
-        streamstate_.reset();
-        ack_list_.set_limit(s.resend_limit());
-        ack_list_.clear();
+    // recreate the current stream with the new sink settings
+    stream st;
+    prepare_stream(s, st);
+}
 
-        // start in a need recovery state so the buffer is re-filled when we get the first data
-        streamstate_.request_recover();
+// Like on the source side, a new format or new sink settings mean a new decoder
+// and new buffers. We build them on the calling thread while the current stream
+// keeps playing, and process() fades it out and switches over at the next block
+// boundary (see adopt_stream()), so the audio thread never waits for us.
+// If 'st' has no decoder, the most recent one is recreated.
+bool source_desc::prepare_stream(const sink& s, stream& st){
+    unique_lock prepare_lock(prepare_mutex_);
+
+    if (!st.decoder){
+        // start from the most recent format
+        aoo_format_storage fmt;
+        bool havefmt = false;
+        {
+            scoped_lock<spinlock> l(standby_lock_);
+            if (standby_ready_.load()){
+                havefmt = standby_.decoder->get_format(fmt);
+                st.salt = standby_.salt;
+                st.protocol_flags = standby_.protocol_flags;
+                st.format_changed = standby_.format_changed;
+                st.userformat = standby_.userformat;
+                st.userformat_changed = standby_.userformat_changed;
+            }
+        }
+        if (!havefmt){
+            shared_lock lock(mutex_);
+            if (!decoder_ || !decoder_->get_format(fmt)){
+                return false; // nothing to update
+            }
+            st.salt = salt_;
+            st.protocol_flags = protocol_flags_;
+        }
+        auto c = aoo::find_codec(fmt.header.codec);
+        if (!c || !(st.decoder = c->create_decoder())){
+            LOG_ERROR("couldn't create decoder!");
+            return false;
+        }
+        st.decoder->set_format(fmt.header);
+    }
+
+    make_stream(s, st);
+
+    {
+        scoped_lock<spinlock> l(standby_lock_);
+        std::swap(standby_, st);
+        standby_salt_ = standby_.salt;
+        standby_time_ = time_tag::now();
+        standby_retired_ = false;
+        standby_ready_.store(true, std::memory_order_release);
+    }
+    LOG_DEBUG("source " << id_ << ": prepared new stream");
+    // 'st' now holds a stream that has never been adopted
+    // or a retired stream, which is freed by the caller.
+    return true;
+}
+
+// allocate the queues for a new stream
+void source_desc::make_stream(const sink& s, stream& st){
+    auto& dec = *st.decoder;
+    st.resend_limit = s.resend_limit();
+    if (dec.blocksize() <= 0 || dec.samplerate() <= 0){
+        return;
+    }
+    // recalculate buffersize from ms to samples
+    double bufsize = (double)s.buffersize() * dec.samplerate() * 0.001;
+    bufsize = std::max(bufsize, (double)s.blocksize()); // needs to be at least one processing blocksize worth!
+    auto d = div(bufsize, dec.blocksize());
+    int32_t nbuffers = d.quot + (d.rem != 0); // round up
+    nbuffers = std::max<int32_t>(1, nbuffers); // e.g. if buffersize_ is 0
+    // resize audio buffer and initially fill with zeros.
+    auto nsamples = dec.nchannels() * dec.blocksize();
+    st.audioqueue.resize(nbuffers * nsamples, nsamples);
+    st.infoqueue.resize(nbuffers, 1);
+    while (st.audioqueue.write_available() && st.infoqueue.write_available()){
+        st.audioqueue.write_commit();
+        // push nominal samplerate + default channel (0)
+        block_info i;
+        i.sr = dec.samplerate();
+        i.channel = 0;
+        st.infoqueue.write(i);
+    };
+    LOG_VERBOSE("reset source queues to " << nbuffers << " buffers");
+    // setup resampler
+    st.resampler.setup(dec.blocksize(), s.blocksize(),
+                       dec.samplerate(), s.samplerate(), dec.nchannels());
+    // resize block queue
+    // (32) extra capacity for network jitter (allows lower buffersizes) (should be option?)
+    st.blockqueue.resize(nbuffers + 8, max_block_size(dec.nchannels(), dec.blocksize()));
+    // resend requests are only kept for blocks that fit into the queue
+    st.acklist.reserve(st.blockqueue.capacity());
+    // incoming parity blocks are bounded like the data blocks they protect
+    st.paritystorage.resize(st.blockqueue.max_block_size() * AOO_FEC_NUMGROUPS);
+
+    LOG_DEBUG("update source " << id_ << ": sr = " << dec.samplerate()
+                << ", blocksize = " << dec.blocksize() << ", nchannels = "
+                << dec.nchannels() << ", bufsize = " << nbuffers * nsamples);
+}
+
+// call with mutex_ locked exclusively!
+// Swaps in the standby stream and resets the stream state.
+// Doesn't allocate or block, so it can run on the audio thread.
+bool source_desc::adopt_stream(){
+    if (!standby_lock_.try_lock()){
+        return false;
+    }
+    if (!standby_ready_.load()){
+        standby_lock_.unlock();
+        return false;
+    }
+    std::swap(decoder_, standby_.decoder);
+    std::swap(blockqueue_, standby_.blockqueue);
+    std::swap(ack_list_, standby_.acklist);
+    std::swap(paritystorage_, standby_.paritystorage);
+    std::swap(audioqueue_, standby_.audioqueue);
+    std::swap(infoqueue_, standby_.infoqueue);
+    std::swap(resampler_, standby_.resampler);
+    if (standby_.userformat_changed){
+        std::swap(userformat_, standby_.userformat);
+    }
+    salt_ = standby_.salt;
+    protocol_flags_ = standby_.protocol_flags;
+    bool format_changed = standby_.format_changed;
+    ack_list_.set_limit(standby_.resend_limit);
+    standby_ready_ = false;
+    // the old stream is freed by the send thread (see free_standby())
+    standby_retired_ = true;
+    standby_lock_.unlock();
+
+    newest_ = 0;
+    next_ = -1;
+    nextneedsfadein_ = 0;
+    // sequence numbers start over, but the statistics stay valid
+    last_stamped_ = -1;
+    audible_ = 0;
+    channel_ = 0;
+    samplerate_ = decoder_->samplerate();
+    faded_out_ = false;
+    streamstate_.reset();
+    ack_list_.clear();
+    auto maxblocksize = blockqueue_.max_block_size();
+    for (int i = 0; i < AOO_FEC_NUMGROUPS; ++i){
+        auto& p = parity_[i];
+        p.blocks.clear();
+        p.parity.set_storage(paritystorage_.data() + i * maxblocksize, maxblocksize);
+        p.parity.sequence = -1;
+    }
+    paritycount_ = 0;
+
+    // start in a need recovery state so the buffer is re-filled when we get the first data
+    streamstate_.request_recover();
+
+    if (format_changed){
+        // push event
+        event e;
+        e.type = AOO_SOURCE_FORMAT_EVENT;
+        e.source.endpoint = endpoint_;
+        e.source.id = id_;
+        push_event(e);
+    }
+
+    return true;
+}
 
-        LOG_DEBUG("update source " << id_ << ": sr = " << decoder_->samplerate()
-                    << ", blocksize = " << decoder_->blocksize() << ", nchannels = "
-                    << decoder_->nchannels() << ", bufsize = " << nbuffers * nsamples);
+// called on the send thread
+void source_desc::free_standby(){
+    if (standby_retired_.load(std::memory_order_acquire)){
+        stream st;
+        {
+            scoped_lock<spinlock> l(standby_lock_);
+            if (standby_retired_.exchange(false)){
+                std::swap(st, standby_);
+            }
+        }
+        // free outside the lock
+    } else if (standby_ready_.load(std::memory_order_acquire)){
+        // process() might not be called at all, e.g. while the audio device
+        // is stopped, so adopt the standby stream ourselves after a while.
+        double elapsed;
+        {
+            scoped_lock<spinlock> l(standby_lock_);
+            elapsed = time_tag::duration(standby_time_, time_tag::now());
+        }
+        if (elapsed > AOO_STANDBY_TIMEOUT * 0.001){
+            unique_lock lock(mutex_); // writer lock!
+            adopt_stream();
+        }
     }
 }
 
@@ -806,45 +1060,36 @@ void source_desc::do_update(const sink &s){
 int32_t source_desc::handle_format(const sink& s, int32_t salt, const aoo_format& f,
                                    const char *settings, int32_t size, int32_t version,
                                    const char *userformat, int32_t ufsize){
-    // take writer lock!
-    unique_lock lock(mutex_);
-
-    salt_ = salt;
-
-    // create/change decoder if needed
-    if (!decoder_ || strcmp(decoder_->name(), f.codec)){
-        auto c = aoo::find_codec(f.codec);
-        if (c){
-            decoder_ = c->create_decoder();
-        } else {
-            LOG_ERROR("codec '" << f.codec << "' not supported!");
-            return 0;
-        }
-        if (!decoder_){
-            LOG_ERROR("couldn't create decoder!");
-            return 0;
-        }
+    // always create a new decoder, the current one keeps
+    // playing until the new stream is adopted
+    auto c = aoo::find_codec(f.codec);
+    if (!c){
+        LOG_ERROR("codec '" << f.codec << "' not supported!");
+        return 0;
+    }
+    stream st;
+    st.decoder = c->create_decoder();
+    if (!st.decoder){
+        LOG_ERROR("couldn't create decoder!");
+        return 0;
     }
 
-    // see what protocol flags are in the LSB of the version
-    protocol_flags_ = (0xFF & version);
-    
     // read format
-    decoder_->read_format(f, settings, size);
+    st.decoder->read_format(f, settings, size);
 
+    st.salt = salt;
+    // see what protocol flags are in the LSB of the version
+    st.protocol_flags = (0xFF & version);
+    
     // user format
     if (userformat) {
-        userformat_.assign(userformat, userformat+ufsize);
+        st.userformat.assign(userformat, userformat+ufsize);
+        st.userformat_changed = true;
     }
 
-    do_update(s);
+    st.format_changed = true;
 
-    // push event
-    event e;
-    e.type = AOO_SOURCE_FORMAT_EVENT;
-    e.source.endpoint = endpoint_;
-    e.source.id = id_;
-    push_event(e);
+    prepare_stream(s, st);
 
     return 1;
 }
@@ -858,7 +1103,10 @@ int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_pa
     // the source format might have changed and we haven't noticed,
     // e.g. because of dropped UDP packets.
     if (salt != salt_){
-        streamstate_.request_format();
+        // the data might belong to a new stream that process() is about to adopt
+        if (!standby_ready_.load() || salt != standby_salt_.load()){
+            streamstate_.request_format();
+        }
         return 0;
     }
 
@@ -879,6 +1127,15 @@ int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_pa
         nextneedsfadein_ = next_;
     }
 
+    if (d.totalsize == 0 && !d.silent){
+        // empty blocks (= skipped) are still part of the parity group
+        add_parity_block(d.sequence, nullptr, 0);
+    }
+
+    if (d.timestamp){
+        update_transit(d);
+    }
+
     // check data packet
     if (!check_packet(d)){
         return 0;
@@ -906,6 +1163,105 @@ int32_t source_desc::handle_data(const sink& s, int32_t salt, const aoo::data_pa
     return 1;
 }
 
+// The source stamps the first frame of each block with its send time,
+// so (receive time - send time) is the network transit time plus the
+// (unknown) clock offset between the two machines. The offset cancels out
+// in the interarrival jitter, which is estimated as in RFC 3550, and the
+// caller can subtract its own offset estimate from the minimum transit time.
+// The minimum is taken over two alternating windows, so that it can follow
+// route changes and clock drift.
+#define AOO_TRANSIT_WINDOW 5.0
+
+void source_desc::update_transit(const data_packet& d){
+    // ignore reordered (or duplicate) blocks
+    if (last_stamped_ >= 0 && d.sequence <= last_stamped_){
+        return;
+    }
+    time_tag now = aoo_osctime_get(); // use real system time
+    double transit = time_tag::duration(time_tag(d.timestamp), now);
+
+    if (transit_count_.load() == 0){
+        // first block
+        min_transit_window_[0] = min_transit_window_[1] = transit;
+        transit_window_start_ = now;
+        jitter_.store(0);
+    } else {
+        // J = J + (|D| - J) / 16
+        auto delta = std::abs(transit - last_transit_);
+        auto jitter = jitter_.load();
+        jitter_.store(jitter + (delta - jitter) / 16.0);
+
+        if (time_tag::duration(transit_window_start_, now) > AOO_TRANSIT_WINDOW){
+            // start new window
+            min_transit_window_[1] = min_transit_window_[0];
+            min_transit_window_[0] = transit;
+            transit_window_start_ = now;
+        } else if (transit < min_transit_window_[0]){
+            min_transit_window_[0] = transit;
+        }
+    }
+    last_stamped_ = d.sequence;
+    last_transit_ = transit;
+
+    transit_.store(transit);
+    min_transit_.store(std::min(min_transit_window_[0], min_transit_window_[1]));
+    transit_count_++;
+}
+
+// /aoo/sink/<id>/parity <src> <salt> <seq> <sr> <channel_onset> <count> <sizes> <totalsize> <nframes> <frame> <data>
+
+int32_t source_desc::handle_parity(const sink& s, int32_t salt, const aoo::data_packet& d,
+                                   const int32_t *sizes, int32_t count){
+    // synchronize with update()!
+    shared_lock lock(mutex_);
+
+    if (salt != salt_ || !decoder_ || next_ < 0){
+        return 0;
+    }
+
+    // record FEC overhead
+    streamstate_.add_parity(1);
+
+    if (count != paritycount_){
+        LOG_VERBOSE("parity group size changed to " << count);
+        paritycount_ = count;
+        for (auto& p : parity_){
+            p.blocks.clear();
+            p.parity.sequence = -1;
+        }
+    }
+
+    if (d.sequence + count <= next_){
+        // all blocks have already been processed
+        return 0;
+    }
+
+    auto p = get_parity(d.sequence);
+    if (!p || d.totalsize <= 0){
+        return 0;
+    }
+    if (d.totalsize > p->parity.capacity()){
+        LOG_WARNING("parity block " << d.sequence << " too large for format (" << d.totalsize << " bytes)");
+        return 0;
+    }
+
+    if (p->parity.sequence != d.sequence){
+        p->parity.set(d.sequence, d.samplerate, d.channel, d.totalsize, d.nframes);
+        std::copy(sizes, sizes + count, p->sizes.begin());
+    } else if (p->parity.has_frame(d.framenum)){
+        return 0;
+    }
+    p->parity.add_frame(d.framenum, d.data, d.size);
+
+    if (p->parity.complete() && recover_block(*p)){
+        process_blocks();
+
+        check_outdated_blocks();
+    }
+
+    return 1;
+}
+
 // /aoo/sink/<id>/ping <src> <time>
 
 int32_t source_desc::handle_ping(const sink &s, time_tag tt){
@@ -937,6 +1293,8 @@ int32_t source_desc::handle_ping(const sink &s, time_tag tt){
 }
 
 bool source_desc::send(const sink& s){
+    free_standby();
+
     bool didsomething = false;
 
     if (send_format_request(s)){
@@ -954,11 +1312,36 @@ bool source_desc::send(const sink& s){
     return didsomething;
 }
 
-bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int32_t numsampleframes){
-    // synchronize with handle_format() and update()!
-    // the mutex should be uncontended most of the time.
-    // NOTE: We could use try_lock() and skip the block if we couldn't aquire the lock.
-    shared_lock lock(mutex_);
+bool source_desc::process(const sink& s, aoo_sample **data, int32_t numsampleframes){
+    // if a new stream is waiting (see prepare_stream()), fade out
+    // the current stream in this block and switch over afterwards.
+    bool switching = standby_ready_.load(std::memory_order_acquire);
+
+    bool result = do_process(s, data, numsampleframes, switching);
+
+    if (switching){
+        // never wait for the lock; if the network thread holds it,
+        // we stay silent and try again in the next block.
+        unique_lock lock(mutex_, std::try_to_lock);
+        if (lock.owns_lock()){
+            adopt_stream();
+        }
+    }
+
+    return result;
+}
+
+bool source_desc::do_process(const sink& s, aoo_sample **data,
+                             int32_t numsampleframes, bool fadeout){
+    // synchronize with adopt_stream()!
+    // the mutex is locked exclusively by the audio thread itself, and by free_standby()
+    // on the send thread when a standby stream hasn't been adopted after
+    // AOO_STANDBY_TIMEOUT (i.e. process() isn't being called). Never wait for it;
+    // if process() resumes just then, this block stays silent.
+    shared_lock lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()){
+        return false;
+    }
 
     if (!decoder_){
         return false;
@@ -969,6 +1352,8 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
     int32_t reordered = streamstate_.get_reordered();
     int32_t resent = streamstate_.get_resent();
     int32_t gap = streamstate_.get_gap();
+    int32_t recovered = streamstate_.get_recovered();
+    int32_t parity = streamstate_.get_parity();
 
     event e;
     e.source.endpoint = endpoint_;
@@ -997,6 +1382,24 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
         e.block_gap.count = gap;
         push_event(e);
     }
+    if (recovered > 0){
+        // push block recovered event
+        e.type = AOO_BLOCK_RECOVERED_EVENT;
+        e.block_recover.count = recovered;
+        push_event(e);
+    }
+    if (parity > 0){
+        // push parity event
+        e.type = AOO_BLOCK_PARITY_EVENT;
+        e.block_parity.count = parity;
+        push_event(e);
+    }
+
+    if (faded_out_){
+        // waiting for adopt_stream()
+        return false;
+    }
+    faded_out_ = fadeout;
 
     // don't process anything until the first few blocks are recv'd into the blockqueue
     // after a reset to keep the jitter buffer as full as possible at the start
@@ -1030,6 +1433,12 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
         // write audio into resampler
         resampler_.write(audioqueue_.read_data(), nsamples);
 
+        if (!info.silent){
+            // everything in the resampler might contain audio now
+            // (plus one frame for the interpolation)
+            audible_ = resampler_.read_available() + nchannels;
+        }
+
         audioqueue_.read_commit();
 
 
@@ -1041,22 +1450,37 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
     //LOG_VERBOSE("s.blocksize: " << s.blocksize() << "  size: " << numsampleframes << "  stride: " << stride << " readsamp: " << readsamples << " ravail: " << resampler_.read_available() << " wavail: " << resampler_.write_available());
     
     if (resampler_.read_available() >= readsamples){
-        auto buf = (aoo_sample *)alloca(readsamples * sizeof(aoo_sample));
-        resampler_.read(buf, readsamples);
-
-        // sum source into sink (interleaved -> non-interleaved),
-        // starting at the desired sink channel offset.
-        // out of bound source channels are silently ignored.
-        for (int i = 0; i < nchannels; ++i){
-            auto chn = i + channel_;
-            // ignore out-of-bound source channels!
-            if (chn < s.nchannels()){
-                auto n = numsampleframes;
-                auto out = buffer + stride * chn;
-                for (int j = 0; j < n; ++j){
-                    out[j] += buf[j * nchannels + i];
+        // only silent blocks left -> nothing to sum
+        bool audible = audible_ > 0;
+        audible_ = std::max<int32_t>(0, audible_ - readsamples);
+
+        if (audible){
+            // sum source into sink (interleaved -> non-interleaved),
+            // starting at the desired sink channel offset.
+            // out of bound source channels are silently ignored.
+            auto out = (aoo_sample **)alloca(nchannels * sizeof(aoo_sample *));
+            for (int i = 0; i < nchannels; ++i){
+                auto chn = i + channel_;
+                out[i] = (chn < s.nchannels()) ? data[chn] : nullptr;
+            }
+            if (fadeout){
+                // fade out before switching to the new stream
+                auto buf = (aoo_sample *)alloca(readsamples * sizeof(aoo_sample));
+                resampler_.read(buf, readsamples);
+                const float delta = -1.0f / numsampleframes;
+                float gain = 1.0f;
+                for (int j = 0; j < numsampleframes; ++j){
+                    for (int i = 0; i < nchannels; ++i){
+                        buf[j * nchannels + i] *= gain;
+                    }
+                    gain += delta;
                 }
+                deinterleave_add(buf, nchannels, out, numsampleframes);
+            } else {
+                resampler_.read_add(out, numsampleframes);
             }
+        } else {
+            resampler_.skip(readsamples);
         }
 
         // LOG_DEBUG("read samples from source " << id_);
@@ -1071,7 +1495,7 @@ bool source_desc::process(const sink& s, aoo_sample *buffer, int32_t stride, int
             push_event(e);
         }
 
-        return true;
+        return audible;
     } else {
         // buffer ran out -> push "stop" event
         if (streamstate_.update_state(AOO_SOURCE_STATE_STOP)){
@@ -1097,9 +1521,7 @@ int32_t source_desc::handle_events(aoo_eventhandler fn, void *user){
     auto n = eventqueue_.read_available();
     if (n > 0){
         auto events = (event *)alloca(sizeof(event) * n);
-        for (int i = 0; i < n; ++i){
-            eventqueue_.read(events[i]);
-        }
+        eventqueue_.read(events, n);
         auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n);
         for (int i = 0; i < n; ++i){
             vec[i] = (aoo_event *)&events[i];
@@ -1125,7 +1547,7 @@ bool source_desc::check_packet(const data_packet &d){
     bool recover = streamstate_.need_recover();
 
     // check for empty block (= skipped)
-    bool dropped = d.totalsize == 0;
+    bool dropped = d.totalsize == 0 && !d.silent;
 
     // check for buffer underrun
     bool underrun = streamstate_.have_underrun();
@@ -1199,6 +1621,10 @@ bool source_desc::check_packet(const data_packet &d){
 }
 
 bool source_desc::add_packet(const data_packet& d){
+    if (d.totalsize > blockqueue_.max_block_size()){
+        LOG_WARNING("block " << d.sequence << " too large for format (" << d.totalsize << " bytes)");
+        return false;
+    }
     auto block = blockqueue_.find(d.sequence);
     if (!block){
         if (blockqueue_.full()){
@@ -1259,13 +1685,24 @@ bool source_desc::add_packet(const data_packet& d){
         int chan = d.channel >= 0 ? d.channel : channel_;
         block = blockqueue_.insert(d.sequence, srate,
                                    chan, d.totalsize, d.nframes);
+    } else if (d.silent || block->complete()){
+        // also for blocks recovered from parity, which have a single frame
+        LOG_VERBOSE("block " << d.sequence << " already received!");
+        return false;
     } else if (block->has_frame(d.framenum)){
         LOG_VERBOSE("frame " << d.framenum << " of block " << d.sequence << " already received!");
         return false;
     }
 
-    // add frame to block
-    block->add_frame(d.framenum, (const char *)d.data, d.size);
+    // add frame to block (silent blocks are complete already)
+    if (!d.silent){
+        block->add_frame(d.framenum, (const char *)d.data, d.size);
+    }
+
+    if (block->complete()){
+        // NOTE: this might insert a recovered block, so 'block' is not valid afterwards!
+        add_parity_block(block->sequence, block->data(), block->size());
+    }
 
 #if 0
     if (block->complete()){
@@ -1299,10 +1736,11 @@ void source_desc::process_blocks(){
             size = b->size();
             i.sr = b->samplerate;
             i.channel = b->channel;
+            i.silent = b->silent();
 
             b++;
-        } else if (!ack_list_.get(next).remaining()){
-            // block won't be resent, just drop it
+        } else if (!ack_list_.get(next).remaining() && !parity_pending(next)){
+            // block won't be resent or recovered, just drop it
             data = nullptr;
             size = 0;
             i.sr = decoder_->samplerate();
@@ -1324,8 +1762,16 @@ void source_desc::process_blocks(){
         // decode data and push samples
         auto ptr = audioqueue_.write_data();
         auto nsamples = audioqueue_.blocksize();
+        if (i.silent){
+            // silent block, no need to decode
+            std::fill(ptr, ptr + nsamples, 0);
+            if (dofadein){
+                // nothing to fade, try the next block
+                nextneedsfadein_ = next;
+            }
+        }
         // decode audio data
-        if (decoder_->decode(data, size, ptr, nsamples) < 0){
+        else if (decoder_->decode(data, size, ptr, nsamples) < 0){
             LOG_WARNING("aoo_sink: couldn't decode block!");
             // decoder failed - fill with zeros
             std::fill(ptr, ptr + nsamples, 0);
@@ -1386,6 +1832,106 @@ void source_desc::check_outdated_blocks(){
     }
 }
 
+parity_state * source_desc::get_parity(int32_t seq){
+    // groups are aligned to the group size
+    auto first = seq - seq % paritycount_;
+    auto& p = parity_[(first / paritycount_) % AOO_FEC_NUMGROUPS];
+    if (p.blocks.first() != first){
+        if (first < p.blocks.first()){
+            // don't replace a more recent group
+            return nullptr;
+        }
+        p.blocks.reset(first, paritycount_);
+        p.parity.sequence = -1;
+    }
+    return &p;
+}
+
+void source_desc::add_parity_block(int32_t seq, const char *data, int32_t nbytes){
+    if (paritycount_ > 0){
+        auto p = get_parity(seq);
+        if (p && p->blocks.add(seq, data, nbytes)){
+            recover_block(*p);
+        }
+    }
+}
+
+// check if a missing block might still be recovered from parity
+bool source_desc::parity_pending(int32_t seq){
+    if (paritycount_ > 0){
+        auto first = seq - seq % paritycount_;
+        auto& p = parity_[(first / paritycount_) % AOO_FEC_NUMGROUPS];
+        if (p.parity.sequence == first && p.parity.complete()){
+            // parity has arrived, but we can't recover the block
+            return false;
+        }
+        // the parity block is sent right after the last block of the group,
+        // so we give up once we've received a block from the following group
+        // (allowing for one reordered packet).
+        return newest_ <= first + paritycount_;
+    }
+    return false;
+}
+
+// rebuild a single missing block from the parity and the other blocks in the group
+bool source_desc::recover_block(parity_state& p){
+    auto first = p.blocks.first();
+    auto count = p.blocks.count();
+    if (p.parity.sequence != first || !p.parity.complete()
+            || p.blocks.num_blocks() != (count - 1)){
+        return false;
+    }
+    auto seq = p.blocks.missing();
+    auto nbytes = p.sizes[seq - first];
+    if (seq < next_ || nbytes < 0 || nbytes > p.parity.size()
+        || nbytes > blockqueue_.max_block_size()){
+        // too late or bad size
+        return false;
+    }
+    if (blockqueue_.find(seq) || blockqueue_.full()){
+        // a partially received block is left to resending, because the recovered
+        // one wouldn't have the same frame layout for the frames still to come.
+        return false;
+    }
+    auto b = blockqueue_.insert(seq, p.parity.samplerate, p.parity.channel,
+                                nbytes, nbytes > 0 ? 1 : 0);
+    // no need to ask for it anymore
+    ack_list_.remove(seq);
+
+    if (nbytes == 0){
+        // skipped or silent block, there's nothing to rebuild
+        b->set_silent(seq, p.parity.samplerate, p.parity.channel);
+        p.blocks.add(seq, nullptr, 0);
+
+        if (seq > newest_){
+            newest_ = seq;
+        }
+        LOG_VERBOSE("recovered silent block " << seq << " from parity");
+        return true;
+    }
+    // missing block = parity XOR all other blocks
+    paritybuffer_.resize(nbytes);
+    auto parity = p.parity.data();
+    auto blocks = p.blocks.data();
+    auto blocksize = p.blocks.size();
+    for (int32_t i = 0; i < nbytes; ++i){
+        paritybuffer_[i] = i < blocksize ? (parity[i] ^ blocks[i]) : parity[i];
+    }
+    b->set(seq, p.parity.samplerate, p.parity.channel,
+           paritybuffer_.data(), nbytes, 1, nbytes);
+    // mark as received
+    p.blocks.add(seq, paritybuffer_.data(), nbytes);
+
+    if (seq > newest_){
+        newest_ = seq;
+    }
+
+    LOG_VERBOSE("recovered block " << seq << " from parity");
+    streamstate_.add_recovered(1);
+
+    return true;
+}
+
 #define AOO_BLOCKQUEUE_CHECK_THRESHOLD 3
 
 // deal with "holes" in block queue
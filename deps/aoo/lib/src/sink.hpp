@@ -28,6 +28,8 @@ struct stream_state {
         reordered_ = 0;
         resent_ = 0;
         gap_ = 0;
+        recovered_ = 0;
+        parity_ = 0;
         state_ = AOO_SOURCE_STATE_STOP;
         underrun_ = false;
         recover_ = false;
@@ -51,6 +53,12 @@ struct stream_state {
     void add_gap(int32_t n) { gap_ += n; }
     int32_t get_gap() { return gap_.exchange(0); }
 
+    void add_recovered(int32_t n) { recovered_ += n; }
+    int32_t get_recovered() { return recovered_.exchange(0); }
+
+    void add_parity(int32_t n) { parity_ += n; }
+    int32_t get_parity() { return parity_.exchange(0); }
+
     bool update_state(aoo_source_state state){
         auto last = state_.exchange(state);
         return state != last;
@@ -109,6 +117,8 @@ private:
     std::atomic<int32_t> reordered_{0};
     std::atomic<int32_t> resent_{0};
     std::atomic<int32_t> gap_{0};
+    std::atomic<int32_t> recovered_{0};
+    std::atomic<int32_t> parity_{0};
     std::atomic<aoo_source_state> state_{AOO_SOURCE_STATE_STOP};
     std::atomic<invitation_state> invite_{NONE};
     std::atomic<bool> underrun_{false};
@@ -125,6 +135,16 @@ private:
 struct block_info {
     double sr;
     int32_t channel;
+    bool silent = false; // silent block (DTX), nothing has been decoded
+};
+
+// number of parity groups which can be in flight at the same time
+#define AOO_FEC_NUMGROUPS 4
+
+struct parity_state {
+    parity_group blocks; // XOR of the blocks received so far
+    block parity; // incoming parity block
+    std::array<int32_t, AOO_FEC_MAXGROUPSIZE> sizes;
 };
 
 class sink;
@@ -141,6 +161,8 @@ public:
         aoo_block_reordered_event block_reorder;
         aoo_block_resent_event block_resend;
         aoo_block_gap_event block_gap;
+        aoo_block_recovered_event block_recover;
+        aoo_block_parity_event block_parity;
     } event;
 
     source_desc(void *endpoint, aoo_replyfn fn, int32_t id, int32_t salt);
@@ -158,6 +180,8 @@ public:
     
     int32_t get_buffer_fill_ratio(float &ratio);
 
+    int32_t get_transit_stats(aoo_transit_stats &stats);
+
     int32_t get_userformat(char * buf, int32_t size);
 
     int32_t get_current_salt() const { return salt_; }
@@ -173,13 +197,17 @@ public:
     int32_t handle_data(const sink& s, int32_t salt,
                                      const aoo::data_packet& d);
 
+    int32_t handle_parity(const sink& s, int32_t salt, const aoo::data_packet& d,
+                          const int32_t *sizes, int32_t count);
+
     int32_t handle_ping(const sink& s, time_tag tt);
 
     int32_t handle_events(aoo_eventhandler fn, void *user);
 
     bool send(const sink& s);
 
-    bool process(const sink& s, aoo_sample *buffer, int32_t stride, int32_t numsampleframes);
+    // sums into the sink's non-interleaved output channels
+    bool process(const sink& s, aoo_sample **data, int32_t numsampleframes);
 
     void request_recover(){ streamstate_.request_recover(); }
 
@@ -195,10 +223,38 @@ private:
         int32_t sequence;
         int32_t frame;
     };
-    void do_update(const sink& s);
+    // standby stream (see prepare_stream())
+    struct stream {
+        std::unique_ptr<aoo::decoder> decoder;
+        block_queue blockqueue;
+        block_ack_list acklist;
+        std::vector<char> paritystorage;
+        lockfree::spsc_queue<aoo_sample> audioqueue;
+        lockfree::spsc_queue<block_info> infoqueue;
+        dynamic_resampler resampler;
+        std::vector<char> userformat;
+        bool userformat_changed = false;
+        bool format_changed = false; // push a format event when adopted
+        int32_t salt = 0;
+        int32_t protocol_flags = 0;
+        int32_t resend_limit = 0;
+    };
+
+    bool prepare_stream(const sink& s, stream& st);
+
+    void make_stream(const sink& s, stream& st);
+
+    bool adopt_stream();
+
+    void free_standby();
+
+    bool do_process(const sink& s, aoo_sample **data,
+                    int32_t numsampleframes, bool fadeout);
     // handle messages
     bool check_packet(const data_packet& d);
 
+    void update_transit(const data_packet& d);
+
     bool add_packet(const data_packet& d);
 
     void process_blocks();
@@ -206,6 +262,14 @@ private:
     void check_outdated_blocks();
 
     void check_missing_blocks(const sink& s);
+
+    parity_state * get_parity(int32_t seq);
+
+    void add_parity_block(int32_t seq, const char *data, int32_t nbytes);
+
+    bool parity_pending(int32_t seq);
+
+    bool recover_block(parity_state& p);
     // send messages
     bool send_format_request(const sink& s);
     bool send_codec_change_request(const sink& s);
@@ -228,27 +292,49 @@ private:
     int32_t newest_ = 0; // sequence number of most recent incoming block
     int32_t next_ = 0; // next outgoing block
     int32_t nextneedsfadein_ = -1; // sequence number that needs fadein
+    int32_t audible_ = 0; // resampler output samples which might contain non-silent audio
     int32_t channel_ = 0; // recent channel onset
     double samplerate_ = 0; // recent samplerate
     int32_t protocol_flags_ = 0; // protocol flags sent from the remote source
+    // transit time of time stamped blocks (see update_transit())
+    int32_t last_stamped_ = -1; // sequence number of most recent stamped block
+    double last_transit_ = 0;
+    double min_transit_window_[2] = { 0, 0 }; // current and previous window
+    time_tag transit_window_start_;
+    std::atomic<double> transit_{0};
+    std::atomic<double> min_transit_{0};
+    std::atomic<double> jitter_{0};
+    std::atomic<int32_t> transit_count_{0};
     stream_state streamstate_;
     std::vector<char> userformat_;
     // queues and buffers
     block_queue blockqueue_;
     block_ack_list ack_list_;
-    lockfree::queue<aoo_sample> audioqueue_;
-    lockfree::queue<block_info> infoqueue_;
-    lockfree::queue<data_request> resendqueue_;
-    lockfree::queue<event> eventqueue_;
+    std::array<parity_state, AOO_FEC_NUMGROUPS> parity_;
+    std::vector<char> paritystorage_;
+    std::vector<char> paritybuffer_;
+    int32_t paritycount_ = 0; // parity group size of the source (0 = no FEC)
+    lockfree::spsc_queue<aoo_sample> audioqueue_;
+    lockfree::spsc_queue<block_info> infoqueue_;
+    lockfree::spsc_queue<data_request> resendqueue_;
+    lockfree::spsc_queue<event> eventqueue_;
     spinlock eventqueuelock_;
     void push_event(const event& e){
         scoped_lock<spinlock> l(eventqueuelock_);
-        if (eventqueue_.write_available()){
-            eventqueue_.write(e);
-        }
+        eventqueue_.try_write(e);
     }
     dynamic_resampler resampler_;
+    // standby stream
+    stream standby_;
+    time_tag standby_time_;
+    spinlock standby_lock_;
+    aoo::shared_mutex prepare_mutex_; // serializes prepare_stream()
+    std::atomic<bool> standby_ready_{false}; // waiting to be adopted
+    std::atomic<bool> standby_retired_{false}; // holds the previous stream
+    std::atomic<int32_t> standby_salt_{0};
+    bool faded_out_ = false; // the current stream has been faded out
     // thread synchronization
+    // locked exclusively for adopt_stream(), by the audio thread or by free_standby()
     aoo::shared_mutex mutex_; // LATER replace with a spinlock?
 };
 
@@ -274,6 +360,8 @@ public:
 
     int32_t process(aoo_sample **data, int32_t nsampframes, uint64_t t) override;
 
+    int32_t process_add(aoo_sample **data, int32_t nsampframes, uint64_t t) override;
+
     int32_t events_available() override;
 
     int32_t handle_events(aoo_eventhandler fn, void *user) override;
@@ -298,7 +386,7 @@ public:
 
     int32_t samplerate() const { return samplerate_; }
 
-    double real_samplerate() const { return ignore_dll_ ? samplerate_ : dll_.samplerate(); }
+    double real_samplerate() const { return ignore_dll_ ? samplerate_ : realsr_; }
 
     int32_t blocksize() const { return blocksize_; }
 
@@ -312,9 +400,9 @@ public:
 
     int32_t resend_maxnumframes() const { return resend_maxnumframes_; }
 
-    double elapsed_time() const { return timer_.get_elapsed(); }
+    double elapsed_time() const { return get_timer().get_elapsed(); }
 
-    time_tag absolute_time() const { return timer_.get_absolute(); }
+    time_tag absolute_time() const { return get_timer().get_absolute(); }
 
     int32_t protocol_flags() const { return protocol_flags_; }
 
@@ -340,13 +428,28 @@ private:
     std::atomic<float> bandwidth_{ AOO_TIMEFILTER_BANDWIDTH };
     time_dll dll_;
     bool ignore_dll_ = false;
+    double realsr_ = 0; // from our own or the shared time DLL
     timer timer_;
+    std::atomic<audio_clock *> clock_{nullptr}; // shared clock (optional)
+    uint64_t clock_count_ = 0;
     // helper methods
     source_desc *find_source(void *endpoint, int32_t id);
+
+    audio_clock * shared_clock() const {
+        auto c = clock_.load();
+        return (c && c->matches(samplerate_, blocksize_)) ? c : nullptr;
+    }
+
+    const timer& get_timer() const {
+        auto c = shared_clock();
+        return c ? c->get_timer() : timer_;
+    }
     source_desc *find_source_by_salt(void *endpoint, int32_t salt);
 
     void update_sources();
 
+    bool process_sources(aoo_sample **data, int32_t nsampframes, uint64_t t);
+
     int32_t handle_format_message(void *endpoint, aoo_replyfn fn,
                                   const osc::ReceivedMessage& msg);
 
@@ -356,6 +459,9 @@ private:
     int32_t handle_compact_data_message(void *endpoint, aoo_replyfn fn,
                                         const osc::ReceivedMessage& msg);
 
+    int32_t handle_parity_message(void *endpoint, aoo_replyfn fn,
+                                  const osc::ReceivedMessage& msg);
+
     int32_t handle_ping_message(void *endpoint, aoo_replyfn fn,
                                 const osc::ReceivedMessage& msg);
 };
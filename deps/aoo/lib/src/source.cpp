@@ -12,11 +12,6 @@
 
 /*//////////////////// AoO source /////////////////////*/
 
-#define AOO_DATA_HEADERSIZE 80
-// address pattern string: max 32 bytes
-// typetag string: max. 12 bytes
-// args (without blob data): 36 bytes
-
 aoo_source * aoo_source_new(int32_t id) {
     return new aoo::source(id);
 }
@@ -87,8 +82,7 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         auto bufsize = std::max<int32_t>(as<int32_t>(ptr), 0);
         if (bufsize != buffersize_){
             buffersize_ = bufsize;
-            unique_lock lock(update_mutex_); // writer lock!
-            update();
+            prepare_stream(nullptr);
         }
         break;
     }
@@ -145,6 +139,33 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
         // limit it somehow, 16 times is already very high
         redundancy_ = std::max<int32_t>(1, std::min<int32_t>(16, as<int32_t>(ptr)));
         break;
+    // parity FEC group size
+    case aoo_opt_fec_groupsize:
+    {
+        CHECKARG(int32_t);
+        // a group size of 1 would just duplicate every block (see redundancy)
+        auto n = std::min<int32_t>(AOO_FEC_MAXGROUPSIZE, as<int32_t>(ptr));
+        fec_groupsize_ = n > 1 ? n : 0;
+        break;
+    }
+    // silence detection
+    case aoo_opt_dtx_threshold:
+        CHECKARG(float);
+        dtx_threshold_ = std::max<float>(0, as<float>(ptr));
+        break;
+    case aoo_opt_dtx_hangover:
+        CHECKARG(int32_t);
+        dtx_hangover_ = std::max<int32_t>(0, as<int32_t>(ptr));
+        break;
+    // shared clock
+    case aoo_opt_clock:
+        CHECKARG(aoo_clock *);
+        if (clock_.exchange(as<aoo_clock *>(ptr)) != as<aoo_clock *>(ptr)){
+            // the elapsed time jumps
+            timer_.reset();
+            lastpingtime_ = -1000;
+        }
+        break;
     case aoo_opt_respect_codec_change_requests:
         CHECKARG(int32_t);
         respect_codec_change_req_ = as<int32_t>(ptr);
@@ -152,6 +173,15 @@ int32_t aoo::source::set_option(int32_t opt, void *ptr, int32_t size)
     // format
     case aoo_opt_userformat:
         return set_userformat(ptr, size);
+    // group relay
+    case aoo_opt_relay_group:
+    {
+        CHECKARG(aoo_relay_group);
+        auto& group = as<aoo_relay_group>(ptr);
+        unique_lock lock(sink_mutex_); // writer lock!
+        relay_group_ = endpoint(group.user, group.fn, AOO_ID_NONE);
+        break;
+    }
     // unknown
     default:
         LOG_WARNING("aoo_source: unsupported option " << opt);
@@ -176,6 +206,13 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
     // format
     case aoo_opt_format:
         CHECKARG(aoo_format_storage);
+        if (standby_ready_.load()){
+            // the format that will be used from the next block on
+            scoped_lock<spinlock> l(standby_lock_);
+            if (standby_ready_.load()){
+                return standby_.encoder->get_format(as<aoo_format_storage>(ptr));
+            }
+        }
         if (encoder_){
             shared_lock lock(update_mutex_); // read lock!
             return encoder_->get_format(as<aoo_format_storage>(ptr));
@@ -213,6 +250,32 @@ int32_t aoo::source::get_option(int32_t opt, void *ptr, int32_t size)
         CHECKARG(int32_t);
         as<int32_t>(ptr) = redundancy_;
         break;
+    // parity FEC group size
+    case aoo_opt_fec_groupsize:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = fec_groupsize_;
+        break;
+    // silence detection
+    case aoo_opt_dtx_threshold:
+        CHECKARG(float);
+        as<float>(ptr) = dtx_threshold_;
+        break;
+    case aoo_opt_dtx_hangover:
+        CHECKARG(int32_t);
+        as<int32_t>(ptr) = dtx_hangover_;
+        break;
+    case aoo_opt_clock:
+        CHECKARG(aoo_clock *);
+        as<aoo_clock *>(ptr) = clock_.load();
+        break;
+    case aoo_opt_relay_group:
+    {
+        CHECKARG(aoo_relay_group);
+        shared_lock lock(sink_mutex_); // reader lock!
+        as<aoo_relay_group>(ptr).fn = relay_group_.fn;
+        as<aoo_relay_group>(ptr).user = relay_group_.user;
+        break;
+    }
     // unknown
     default:
         LOG_WARNING("aoo_source: unsupported option " << opt);
@@ -283,6 +346,14 @@ int32_t aoo::source::set_sinkoption(void *endpoint, int32_t id,
                             << " flags " << flags);
                 break;
             }
+            case aoo_opt_relay_group:
+            {
+                CHECKARG(int32_t);
+                sink->relay_group = as<int32_t>(ptr) != 0;
+                LOG_VERBOSE("aoo_source: sink " << sink->id << (sink->relay_group ?
+                            " is reached through the group relay" : " is reached directly"));
+                break;
+            }
             // unknown
             default:
                 LOG_WARNING("aoo_source: unknown sink option " << opt);
@@ -320,6 +391,10 @@ int32_t aoo::source::get_sinkoption(void *endpoint, int32_t id,
             CHECKARG(int32_t);
             as<int32_t>(p) = sink->channel;
             break;
+        case aoo_opt_relay_group:
+            CHECKARG(int32_t);
+            as<int32_t>(p) = sink->relay_group;
+            break;
         // unknown
         default:
             LOG_WARNING("aoo_source: unsupported sink option " << opt);
@@ -340,17 +415,19 @@ int32_t aoo_source_setup(aoo_source *src, int32_t samplerate,
 
 int32_t aoo::source::setup(int32_t samplerate,
                            int32_t blocksize, int32_t nchannels){
-    unique_lock lock(update_mutex_); // writer lock!
     if (samplerate > 0 && blocksize > 0 && nchannels > 0)
     {
-        nchannels_ = nchannels;
-        samplerate_ = samplerate;
-        blocksize_ = blocksize;
-
-        // reset timer + time DLL filter
-        timer_.setup(samplerate_, blocksize_);
+        // switch to the new settings at the next block boundary
+        if (!prepare_stream(nullptr, samplerate, blocksize, nchannels)){
+            // no format yet, so nothing can be running
+            unique_lock lock(update_mutex_); // writer lock!
+            nchannels_ = nchannels;
+            samplerate_ = samplerate;
+            blocksize_ = blocksize;
 
-        update();
+            // reset timer + time DLL filter
+            timer_.setup(samplerate_, blocksize_);
+        }
 
         return 1;
     }
@@ -501,6 +578,8 @@ int32_t aoo_source_send(aoo_source *src) {
 // We have to make a local copy of the sink list, but this should be
 // rather cheap in comparison to encoding and sending the audio data.
 int32_t aoo::source::send(){
+    free_standby();
+
     if (!play_.load() && !activeplay_.load()){
         return false;
     }
@@ -531,36 +610,59 @@ int32_t aoo_source_process(aoo_source *src, const aoo_sample **data, int32_t n,
 }
 
 int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
+    // switch to a prepared stream at the block boundary. never wait for the lock;
+    // if the send thread holds it, we simply try again in the next block.
+    if (standby_ready_.load(std::memory_order_acquire)){
+        unique_lock lock(update_mutex_, std::try_to_lock);
+        if (lock.owns_lock()){
+            adopt_stream();
+        }
+    }
+
     if (!play_ && !activeplay_){
         return 0; // pausing
     }
 
     // update time DLL filter
     double error;
-    auto state = timer_.update(t, error);
-    if (state == timer::state::reset){
-        LOG_DEBUG("setup time DLL filter for source");
-        dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
-    } else if (state == timer::state::error){
-        // skip blocks
-        double period = (double)blocksize_ / (double)samplerate_;
-        int nblocks = error / period + 0.5;
-        LOG_VERBOSE("skip " << nblocks << " blocks");
-        dropped_ += nblocks;
-        timer_.reset();
+    double realsr;
+    if (auto clock = shared_clock()){
+        // the host has already updated the shared clock for this block
+        if (clock->check_error(clock_count_, error)){
+            // skip blocks
+            double period = (double)blocksize_ / (double)samplerate_;
+            int nblocks = error / period + 0.5;
+            LOG_VERBOSE("skip " << nblocks << " blocks");
+            dropped_ += nblocks;
+        }
+        realsr = clock->real_samplerate();
     } else {
-        auto elapsed = timer_.get_elapsed();
-        dll_.update(elapsed);
-    #if AOO_DEBUG_DLL
-        DO_LOG("time elapsed: " << elapsed << ", period: " << dll_.period()
-               << ", samplerate: " << dll_.samplerate());
-    #endif
+        auto state = timer_.update(t, error);
+        if (state == timer::state::reset){
+            LOG_DEBUG("setup time DLL filter for source");
+            dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
+        } else if (state == timer::state::error){
+            // skip blocks
+            double period = (double)blocksize_ / (double)samplerate_;
+            int nblocks = error / period + 0.5;
+            LOG_VERBOSE("skip " << nblocks << " blocks");
+            dropped_ += nblocks;
+            timer_.reset();
+        } else {
+            auto elapsed = timer_.get_elapsed();
+            dll_.update(elapsed);
+        #if AOO_DEBUG_DLL
+            DO_LOG("time elapsed: " << elapsed << ", period: " << dll_.period()
+                   << ", samplerate: " << dll_.samplerate());
+        #endif
+        }
+        realsr = dll_.samplerate();
     }
 
     // if the DLL samplerate is any more than +/- 10% of our nominal, we'll ignore it
     // some shenanigans are going on
     bool ignoredll = !dynamic_resampling_.load();;
-    if (fabs(dll_.samplerate() - (double)samplerate_) > 0.1*samplerate_) {
+    if (fabs(realsr - (double)samplerate_) > 0.1*samplerate_) {
         ignoredll = true;
     }
     
@@ -609,34 +711,69 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
     //auto insamples = blocksize_ * nchannels_;
     auto insamples = n * nchannels_;
     auto outsamples = audioqueue_.blocksize(); // encoder_->blocksize() * nchannels_;
-    auto *buf = (aoo_sample *)alloca(insamples * sizeof(aoo_sample));
+    auto outframes = encoder_->blocksize();
+    bool dofade = n > 0 && (dofadein || dofadeout || pushingSilence);
+    const float fadedelta = dofadeout ? (-1.0f / n) : pushingSilence ? 0.0f : (1.0f / n);
+    const float fadestart = dofadeout ? 1.0f : 0.0f;
 
-    if (n > 0 && (dofadein || dofadeout || pushingSilence)) {
-        const float fadedelta = dofadeout ? (-1.0f / n) : pushingSilence ? 0.0f : (1.0f / n);
-        
+    // interleave with the fade ramp applied, frames [offset, offset + nframes)
+    auto interleave_fade = [&](aoo_sample *out, int32_t offset, int32_t nframes){
         for (int i = 0; i < nchannels_; ++i){
-            float gain = dofadeout ? 1.0f : 0.0f;
-            for (int j = 0; j < n; ++j){
-                buf[j * nchannels_ + i] = data[i][j] * gain;
+            float gain = fadestart + fadedelta * offset;
+            for (int j = 0; j < nframes; ++j){
+                out[j * nchannels_ + i] = data[i][offset + j] * gain;
                 gain += fadedelta;
             }
         }
-    } else {
-        for (int i = 0; i < nchannels_; ++i){
-            for (int j = 0; j < n; ++j){
-                buf[j * nchannels_ + i] = data[i][j];
-            }
+    };
+
+    auto push_samplerate = [&](){
+        if (!ignoredll) {
+            auto ratio = (double)encoder_->samplerate() / (double)samplerate_;
+            srqueue_.write(realsr * ratio);
+        } else {
+            srqueue_.write(encoder_->samplerate());
         }
-    }
+    };
 
-    // ALWAYS use resampling buffer, just in case the caller needs to call us 
+    // We normally go through the resampling buffer, because the caller may call us
     // with varying sample counts on occasion. This can happen for various reasons
     // including being used within an audio plugin where the host may split the audio call
-    // back calling with fewer samples. More importantly, this allows us to better decouple 
-    // the audio process blocksize from the audioqueue blocksize (which matches the codec blocksize).
+    // back calling with fewer samples. It also decouples the audio process blocksize
+    // from the audioqueue blocksize (which matches the codec blocksize).
+    // If the rates match, the resampler is drained and this call covers whole
+    // codec blocks we can write straight into the audio queue instead.
+    // As soon as a split call leaves a partial block in the resampler we stay
+    // on that path until it runs empty again, so the stream order never changes.
+    int32_t nblocks = (outframes > 0 && n > 0 && (n % outframes) == 0) ? n / outframes : 0;
+    bool bypass = nblocks > 0
+        && encoder_->samplerate() == samplerate_
+        && resampler_.read_available() == 0
+        && audioqueue_.write_available() >= nblocks
+        && srqueue_.write_available() >= nblocks;
+
+    if (bypass) {
+        for (int k = 0; k < nblocks; ++k){
+            auto out = audioqueue_.write_data();
+            if (dofade){
+                interleave_fade(out, k * outframes, outframes);
+            } else {
+                interleave(data, nchannels_, k * outframes, out, outframes);
+            }
+            audioqueue_.write_commit();
+
+            push_samplerate();
+        }
+    }
+    else {
+        auto *buf = (aoo_sample *)alloca(insamples * sizeof(aoo_sample));
+
+        if (dofade) {
+            interleave_fade(buf, 0, n);
+        } else {
+            interleave(data, nchannels_, 0, buf, n);
+        }
 
-    //if (encoder_->blocksize() != blocksize_ || encoder_->samplerate() != samplerate_)
-    {
         // go through resampler
         auto samplesleft = insamples;
         auto * pbuf = buf;
@@ -662,12 +799,7 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
                 audioqueue_.write_commit();
                 
                 // push samplerate
-                if (!ignoredll) {
-                    auto ratio = (double)encoder_->samplerate() / (double)samplerate_;
-                    srqueue_.write(dll_.samplerate() * ratio);
-                } else {
-                    srqueue_.write(encoder_->samplerate());
-                }
+                push_samplerate();
 
                 didconsume = true;
             }
@@ -681,22 +813,7 @@ int32_t aoo::source::process(const aoo_sample **data, int32_t n, uint64_t t){
                 break;
             }
         }
-    } 
-#if 0
-    else {
-        // bypass resampler
-        if (audioqueue_.write_available() && srqueue_.write_available()){
-            // copy audio samples
-            std::copy(buf, buf + outsamples, audioqueue_.write_data());
-            audioqueue_.write_commit();
-
-            // push samplerate
-            srqueue_.write(dll_.samplerate());
-        } else {
-            // LOG_DEBUG("couldn't process");
-        }
     }
-#endif
     
     if (pushing_silent_frames_ > 0) {
         pushing_silent_frames_ -= n;
@@ -724,9 +841,7 @@ int32_t aoo::source::handle_events(aoo_eventhandler fn, void *user){
     if (n > 0){
         // copy events
         auto events = (event *)alloca(sizeof(event) * n);
-        for (int i = 0; i < n; ++i){
-            eventqueue_.read(events[i]);
-        }
+        eventqueue_.read(events, n);
         auto vec = (const aoo_event **)alloca(sizeof(aoo_event *) * n);
         for (int i = 0; i < n; ++i){
             vec[i] = (aoo_event *)&events[i];
@@ -741,7 +856,7 @@ namespace aoo {
 
 /*//////////////////////////////// endpoint /////////////////////////////////////*/
 
-// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data>
+// /aoo/sink/<id>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data> [<timestamp>]
 
 void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) const{
     // call without lock!
@@ -763,7 +878,13 @@ void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) c
 
     msg << src << salt << d.sequence << d.samplerate << d.channel
         << d.totalsize << d.nframes << d.framenum
-        << osc::Blob(d.data, d.size) << osc::EndMessage;
+        << osc::Blob(d.data, d.size);
+
+    if (d.timestamp){
+        msg << osc::TimeTag(d.timestamp);
+    }
+
+    msg << osc::EndMessage;
 
     LOG_DEBUG("send block: seq = " << d.sequence << ", sr = " << d.samplerate
               << ", chn = " << d.channel << ", totalsize = " << d.totalsize
@@ -773,32 +894,218 @@ void endpoint::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) c
     send(msg.Data(), (int32_t)msg.Size());
 }
 
-// /d <salt> <seq> <data>
-// /d <salt> <seq> <srate> <data>
+// The data messages are sent for every frame to every sink, so we
+// write them by hand instead of going through osc::OutboundPacketStream.
+
+static inline int32_t osc_padded(int32_t n){
+    return (n + 3) & ~3;
+}
+
+// /aoo/sink/<id>/data <src> <salt> | <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data> [<timestamp>]
+
+bool data_header::update(int32_t sink, int32_t src, int32_t salt){
+    if (matches(sink, src, salt)){
+        return false;
+    }
+    memset(data, 0, sizeof(data));
+    // address pattern
+    int32_t n;
+    if (sink != AOO_ID_WILDCARD){
+        n = snprintf(data, sizeof(data), "%s%s/%d%s",
+                     AOO_MSG_DOMAIN, AOO_MSG_SINK, sink, AOO_MSG_DATA);
+    } else {
+        n = snprintf(data, sizeof(data), "%s",
+                     AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_DATA);
+    }
+    typetag_onset = osc_padded(n + 1);
+    // type tags, with room for the optional time stamp:
+    // ",iiidiiiib" + 't' + '\0' = 12 bytes
+    memcpy(data + typetag_onset, ",iiidiiiib", 10);
+    auto onset = typetag_onset + 12;
+    aoo::to_bytes<int32_t>(src, data + onset);
+    aoo::to_bytes<int32_t>(salt, data + onset + 4);
+    size = onset + 8;
+
+    sink_ = sink;
+    src_ = src;
+    salt_ = salt;
+    return true;
+}
+
+int32_t data_header::write(char *buf, int32_t bufsize, const data_packet& d) const {
+    auto blobsize = osc_padded(d.size);
+    auto total = size + 28 + 4 + blobsize + (d.timestamp ? 8 : 0);
+    if (total > bufsize){
+        return 0;
+    }
+    memcpy(buf, data, size);
+    buf[typetag_onset + 10] = d.timestamp ? 't' : '\0';
+
+    auto p = buf + size;
+    aoo::to_bytes<int32_t>(d.sequence, p);
+    aoo::to_bytes<double>(d.samplerate, p + 4);
+    aoo::to_bytes<int32_t>(d.channel, p + 12);
+    aoo::to_bytes<int32_t>(d.totalsize, p + 16);
+    aoo::to_bytes<int32_t>(d.nframes, p + 20);
+    aoo::to_bytes<int32_t>(d.framenum, p + 24);
+    aoo::to_bytes<int32_t>(d.size, p + 28);
+    p += 32;
+    if (d.size > 0){
+        memcpy(p, d.data, d.size);
+    }
+    memset(p + d.size, 0, blobsize - d.size);
+    p += blobsize;
+    if (d.timestamp){
+        aoo::to_bytes<uint64_t>(d.timestamp, p);
+    }
+    return total;
+}
 
-void endpoint::send_data_compact(int32_t src, int32_t salt, const aoo::data_packet& d, bool sendrate) {
+void sink_desc::send_data(int32_t src, int32_t salt, const aoo::data_packet& d) const {
     // call without lock!
 
+    if (!header.matches(id, src, salt)){
+        endpoint::send_data(src, salt, d);
+        return;
+    }
+
     char buf[AOO_MAXPACKETSIZE];
-    osc::OutboundPacketStream msg(buf, sizeof(buf));
-    
-    msg << osc::BeginMessage(AOO_MSG_COMPACT_DATA);
+    auto n = header.write(buf, sizeof(buf), d);
+    if (n > 0){
+        LOG_DEBUG("send block: seq = " << d.sequence << ", sr = " << d.samplerate
+                  << ", chn = " << d.channel << ", totalsize = " << d.totalsize
+                  << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << n);
 
-    // the salt is how we identify both ourselves and our target
-    
-    msg << salt << d.sequence;
-    
+        send(buf, n);
+    } else {
+        LOG_ERROR("data message too large for packet buffer");
+    }
+}
+
+// /d <salt> <seq> <data> [<timestamp>]
+// /d <salt> <seq> <srate> <data> [<timestamp>]
+// silent block (no data):
+// /d <salt> <seq> [<srate>] [<timestamp>]
+
+int32_t write_compact_data(char *buf, int32_t bufsize, int32_t salt,
+                           const aoo::data_packet& d, bool sendrate, bool blob)
+{
+    // type tags (at most ",iidbt")
+    char typetags[8] = { ',', 'i', 'i' };
+    int32_t ntags = 3;
+    if (sendrate){
+        typetags[ntags++] = 'd';
+    }
+    if (blob){
+        typetags[ntags++] = 'b';
+    }
+    if (d.timestamp){
+        typetags[ntags++] = 't';
+    }
+    auto onset = 4 + osc_padded(ntags + 1);
+    auto blobsize = blob ? 4 + osc_padded(d.size) : 0;
+    auto total = onset + 8 + (sendrate ? 8 : 0) + blobsize + (d.timestamp ? 8 : 0);
+    if (total > bufsize){
+        return 0;
+    }
+    // address pattern (AOO_MSG_COMPACT_DATA) and type tags
+    memset(buf, 0, onset);
+    memcpy(buf, AOO_MSG_COMPACT_DATA, AOO_MSG_COMPACT_DATA_LEN);
+    memcpy(buf + 4, typetags, ntags);
+    // arguments
+    auto p = buf + onset;
+    aoo::to_bytes<int32_t>(salt, p);
+    aoo::to_bytes<int32_t>(d.sequence, p + 4);
+    p += 8;
+    if (sendrate){
+        aoo::to_bytes<double>(d.samplerate, p);
+        p += 8;
+    }
+    if (blob){
+        aoo::to_bytes<int32_t>(d.size, p);
+        p += 4;
+        if (d.size > 0){
+            memcpy(p, d.data, d.size);
+        }
+        memset(p + d.size, 0, osc_padded(d.size) - d.size);
+        p += osc_padded(d.size);
+    }
+    if (d.timestamp){
+        aoo::to_bytes<uint64_t>(d.timestamp, p);
+    }
+    return total;
+}
+
+void endpoint::send_data_compact(int32_t salt, const aoo::data_packet& d, bool sendrate) {
+    // call without lock!
+
+    // the salt is how we identify both ourselves and our target.
     // only use the 4 argument version (with samplerate as double) if there is big enough divergence from prior samplerate
-    if (sendrate) {
-        msg << d.samplerate;
+    char buf[AOO_MAXPACKETSIZE];
+    auto n = write_compact_data(buf, sizeof(buf), salt, d, sendrate, true);
+    if (n > 0){
+        LOG_DEBUG("send compact block: seq = " << d.sequence << ", sr = " << d.samplerate
+                  << ", chn = " << d.channel << ", totalsize = " << d.totalsize
+                  << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << n << "  overhead = " << (int) (100 * (1.0 - d.size/(double)n)) << "%");
+
+        send(buf, n);
+    } else {
+        LOG_ERROR("compact data message too large for packet buffer");
     }
-    
-    msg << osc::Blob(d.data, d.size) << osc::EndMessage;
+}
 
-    LOG_DEBUG("send compact block: seq = " << d.sequence << ", sr = " << d.samplerate
-              << ", chn = " << d.channel << ", totalsize = " << d.totalsize
-              << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size << " msgsize: " << msg.Size() << "  overhead = " << (int) (100 * (1.0 - d.size/(double)msg.Size())) << "%");
+void endpoint::send_silence(int32_t salt, const aoo::data_packet& d, bool sendrate) {
+    // call without lock!
+
+    char buf[64];
+    auto n = write_compact_data(buf, sizeof(buf), salt, d, sendrate, false);
+
+    LOG_DEBUG("send silent block: seq = " << d.sequence << ", sr = " << d.samplerate);
+
+    send(buf, n);
+}
+
+// /aoo/sink/<id>/parity <src> <salt> <seq> <sr> <channel_onset> <count> <sizes> <totalsize> <nframes> <frame> <data>
+
+void endpoint::send_parity(int32_t src, int32_t salt, const aoo::data_packet& d,
+                           const int32_t *sizes, int32_t count) const {
+    // call without lock!
+
+    char buf[AOO_MAXPACKETSIZE];
+    osc::OutboundPacketStream msg(buf, sizeof(buf));
 
+    if (id != AOO_ID_WILDCARD){
+        const int32_t max_addr_size = AOO_MSG_DOMAIN_LEN
+                + AOO_MSG_SINK_LEN + 16 + AOO_MSG_PARITY_LEN;
+        char address[max_addr_size];
+        snprintf(address, sizeof(address), "%s%s/%d%s",
+                 AOO_MSG_DOMAIN, AOO_MSG_SINK, id, AOO_MSG_PARITY);
+
+        msg << osc::BeginMessage(address);
+    } else {
+        msg << osc::BeginMessage(AOO_MSG_DOMAIN AOO_MSG_SINK AOO_MSG_WILDCARD AOO_MSG_PARITY);
+    }
+
+    // the sizes of the individual blocks (needed to restore a missing block)
+    char sizebuf[AOO_FEC_MAXGROUPSIZE * sizeof(int32_t)];
+    for (int32_t i = 0; i < count; ++i){
+        aoo::to_bytes<int32_t>(sizes[i], sizebuf + i * sizeof(int32_t));
+    }
+
+    msg << src << salt << d.sequence << d.samplerate << d.channel
+        << count << osc::Blob(sizebuf, count * sizeof(int32_t))
+        << d.totalsize << d.nframes << d.framenum
+        << osc::Blob(d.data, d.size);
+
+    if (d.timestamp){
+        msg << osc::TimeTag(d.timestamp);
+    }
+
+    msg << osc::EndMessage;
+
+    LOG_DEBUG("send parity: seq = " << d.sequence << ", count = " << count
+              << ", totalsize = " << d.totalsize << ", nframes = " << d.nframes
+              << ", frame = " << d.framenum << ", size " << d.size);
 
     send(msg.Data(), (int32_t)msg.Size());
 }
@@ -877,23 +1184,21 @@ sink_desc * source::find_sink(void *endpoint, int32_t id){
 }
 
 int32_t source::set_format(aoo_format &f){
-    unique_lock lock(update_mutex_); // writer lock!
-    if (!encoder_ || strcmp(encoder_->name(), f.codec)){
-        auto codec = aoo::find_codec(f.codec);
-        if (codec){
-            encoder_ = codec->create_encoder();
-        } else {
-            LOG_ERROR("codec '" << f.codec << "' not supported!");
-            return 0;
-        }
-        if (!encoder_){
-            LOG_ERROR("couldn't create encoder!");
-            return 0;
-        }
+    // always create a new encoder, the current one stays in use
+    // until the new stream is adopted (see prepare_stream())
+    auto codec = aoo::find_codec(f.codec);
+    if (!codec){
+        LOG_ERROR("codec '" << f.codec << "' not supported!");
+        return 0;
+    }
+    auto enc = codec->create_encoder();
+    if (!enc){
+        LOG_ERROR("couldn't create encoder!");
+        return 0;
     }
-    encoder_->set_format(f);
+    enc->set_format(f);
 
-    update();
+    prepare_stream(std::move(enc));
 
     return 1;
 }
@@ -969,6 +1274,8 @@ void source::update(){
         salt_ = make_salt();
         sequence_ = 0;
         dropped_ = 0;
+        dtx_silent_blocks_ = 0;
+        parity_.clear();
         {
             shared_lock lock2(sink_mutex_);
             for (auto& sink : sinks_){
@@ -985,11 +1292,182 @@ void source::update_historybuffer(){
         double bufsize = (double)resend_buffersize_ * 0.001 * samplerate_;
         auto d = div(bufsize, encoder_->blocksize());
         int32_t nbuffers = d.quot + (d.rem != 0); // round up
-        history_.resize(nbuffers);
+        history_.resize(nbuffers, max_block_size(encoder_->nchannels(), encoder_->blocksize()));
+    }
+}
+
+// Changing the format or the setup means a new encoder and new buffers.
+// Instead of doing this under the update lock - which would block process()
+// and send_data() while the codec is created and the buffers are allocated -
+// we build a complete standby stream on the calling thread and let process()
+// switch over at the next block boundary (see adopt_stream()).
+// 'enc' may be null to recreate the current encoder, and the current
+// setup is kept if the other arguments are 0.
+bool source::prepare_stream(std::unique_ptr<encoder> enc, int32_t sr,
+                            int32_t blocksize, int32_t nchannels){
+    unique_lock prepare_lock(prepare_mutex_);
+
+    // start from the most recent settings
+    stream s;
+    aoo_format_storage fmt;
+    bool havefmt = false;
+    {
+        scoped_lock<spinlock> l(standby_lock_);
+        if (standby_ready_.load()){
+            s.nchannels = standby_.nchannels;
+            s.blocksize = standby_.blocksize;
+            s.samplerate = standby_.samplerate;
+            havefmt = !enc && standby_.encoder->get_format(fmt);
+        }
+    }
+    if (s.blocksize == 0){
+        shared_lock lock(update_mutex_); // reader lock!
+        s.nchannels = nchannels_;
+        s.blocksize = blocksize_;
+        s.samplerate = samplerate_;
+        havefmt = !enc && encoder_ && encoder_->get_format(fmt);
+    }
+    if (sr > 0 && blocksize > 0 && nchannels > 0){
+        s.nchannels = nchannels;
+        s.blocksize = blocksize;
+        s.samplerate = sr;
+    }
+
+    if (!enc){
+        if (!havefmt){
+            return false;
+        }
+        auto codec = aoo::find_codec(fmt.header.codec);
+        if (!codec || !(enc = codec->create_encoder())){
+            LOG_ERROR("couldn't create encoder!");
+            return false;
+        }
+        enc->set_format(fmt.header);
+    }
+
+    if (s.blocksize <= 0){
+        // not set up yet, so nothing can be running
+        unique_lock lock(update_mutex_); // writer lock!
+        encoder_ = std::move(enc);
+        return true;
+    }
+
+    s.encoder = std::move(enc);
+    make_stream(s);
+
+    {
+        scoped_lock<spinlock> l(standby_lock_);
+        std::swap(standby_, s);
+        standby_time_ = time_tag::now();
+        standby_retired_ = false;
+        standby_ready_.store(true, std::memory_order_release);
+    }
+    LOG_DEBUG("aoo::source: id " << id() << ": prepared new stream");
+    // 's' is either empty, a stream that has never been adopted
+    // or a retired stream; either way it is freed here.
+    return true;
+}
+
+// allocate the buffers for a new stream, see update()
+void source::make_stream(stream& s){
+    auto& enc = *s.encoder;
+    assert(enc.blocksize() > 0 && enc.samplerate() > 0);
+    auto nsamples = enc.blocksize() * s.nchannels;
+    double bufsize = (double)buffersize_ * enc.samplerate() * 0.001;
+    bufsize = std::max(bufsize, (double)s.blocksize); // needs to be at least one processing blocksize worth!
+    auto d = div(bufsize, enc.blocksize());
+    int32_t nbuffers = d.quot + (d.rem != 0); // round up
+    nbuffers = std::max<int32_t>(nbuffers, 1); // need at least 1 buffer!
+    s.audioqueue.resize(nbuffers * nsamples, nsamples);
+    s.srqueue.resize(nbuffers, 1);
+
+    s.resampler.setup(s.blocksize, enc.blocksize(),
+                      s.samplerate, enc.samplerate(), s.nchannels);
+    s.resampler.update(s.samplerate, enc.samplerate());
+
+    double histsize = (double)resend_buffersize_ * 0.001 * s.samplerate;
+    auto d2 = div(histsize, enc.blocksize());
+    int32_t nhist = d2.quot + (d2.rem != 0); // round up
+    s.history.resize(nhist, max_block_size(enc.nchannels(), enc.blocksize()));
+
+    // make_salt() is not realtime safe
+    s.salt = make_salt();
+}
+
+// call with update_mutex_ locked exclusively!
+// Swaps in the standby stream and starts a new sequence, like update(),
+// but without allocating or blocking, so it can run on the audio thread.
+bool source::adopt_stream(){
+    if (!standby_lock_.try_lock()){
+        return false;
+    }
+    if (!standby_ready_.load()){
+        standby_lock_.unlock();
+        return false;
+    }
+    std::swap(encoder_, standby_.encoder);
+    std::swap(resampler_, standby_.resampler);
+    std::swap(audioqueue_, standby_.audioqueue);
+    std::swap(srqueue_, standby_.srqueue);
+    std::swap(history_, standby_.history);
+    std::swap(nchannels_, standby_.nchannels);
+    std::swap(blocksize_, standby_.blocksize);
+    std::swap(samplerate_, standby_.samplerate);
+    salt_ = standby_.salt;
+    standby_ready_ = false;
+    // the old stream is freed by the send thread (see free_standby())
+    standby_retired_ = true;
+    standby_lock_.unlock();
+
+    timer_.setup(samplerate_, blocksize_);
+    lastpingtime_ = -1000; // force first ping
+    lastplay_ = false; // fade in
+    sequence_ = 0;
+    dropped_ = 0;
+    dtx_silent_blocks_ = 0;
+    parity_.clear();
+    // notify send_format()
+    stream_changed_ = true;
+
+    return true;
+}
+
+// called on the send thread
+void source::free_standby(){
+    if (standby_retired_.load(std::memory_order_acquire)){
+        stream s;
+        {
+            scoped_lock<spinlock> l(standby_lock_);
+            if (standby_retired_.exchange(false)){
+                std::swap(s, standby_);
+            }
+        }
+        // free outside the lock
+    } else if (standby_ready_.load(std::memory_order_acquire)){
+        // process() might not be called at all, e.g. while the audio device
+        // is stopped, so adopt the standby stream ourselves after a while.
+        double elapsed;
+        {
+            scoped_lock<spinlock> l(standby_lock_);
+            elapsed = time_tag::duration(standby_time_, time_tag::now());
+        }
+        if (elapsed > AOO_STANDBY_TIMEOUT * 0.001){
+            unique_lock lock(update_mutex_); // writer lock!
+            adopt_stream();
+        }
     }
 }
 
 bool source::send_format(){
+    if (stream_changed_.exchange(false)){
+        // the stream has been switched by adopt_stream()
+        shared_lock lock(sink_mutex_);
+        for (auto& sink : sinks_){
+            sink.format_changed = true;
+        }
+        format_changed_ = true;
+    }
+
     bool format_changed = format_changed_.exchange(false);
     bool format_requested = formatrequestqueue_.read_available();
 
@@ -1021,7 +1499,7 @@ bool source::send_format(){
     if (format_changed){
         // only copy sinks which require a format update!
         shared_lock sinklock(sink_mutex_);
-        auto sinks = (aoo::sink_desc *)alloca((sinks_.size() + 1) * sizeof(aoo::endpoint)); // avoid alloca(0)
+        auto sinks = (aoo::endpoint *)alloca((sinks_.size() + 1) * sizeof(aoo::endpoint)); // avoid alloca(0)
         int numsinks = 0;
         for (auto& sink : sinks_){
             if (sink.format_changed.exchange(false)){
@@ -1067,7 +1545,27 @@ bool source::resend_data(){
         }
 
         auto block = history_.find(request.sequence);
-        if (block){
+        if (block && block->silent()){
+            aoo::data_packet d;
+            d.sequence = block->sequence;
+            d.samplerate = block->samplerate;
+            d.channel = 0;
+            d.totalsize = 0;
+            d.nframes = 0;
+            d.framenum = 0;
+            d.data = nullptr;
+            d.size = 0;
+            // unlock before sending
+            updatelock.unlock();
+
+            // the whole marker, whatever frame was asked for
+            request.send_silence(salt, d, true);
+
+            // lock again
+            updatelock.lock();
+
+            didsomething = true;
+        } else if (block){
             aoo::data_packet d;
             d.sequence = block->sequence;
             d.samplerate = block->samplerate;
@@ -1134,6 +1632,18 @@ bool source::resend_data(){
     return didsomething;
 }
 
+// call with sink_mutex_ locked (reader lock is enough, because
+// the data headers are only touched by the send thread)
+void source::copy_sinks(sink_desc *dest, int32_t salt){
+    auto src = id();
+    for (auto& s : sinks_){
+        if (s.header.update(s.id, src, salt)){
+            LOG_DEBUG("aoo_source: rebuilt data header for sink " << s.id);
+        }
+    }
+    std::copy(sinks_.begin(), sinks_.end(), dest);
+}
+
 bool source::send_data(){
     shared_lock updatelock(update_mutex_); // reader lock!
     if (!encoder_){
@@ -1154,6 +1664,8 @@ bool source::send_data(){
         d.framenum = 0;
         d.data = nullptr;
         d.size = 0;
+        // the empty block is still part of the parity group
+        auto paritysize = update_parity(d.sequence, nullptr, 0);
         // now we can unlock
         updatelock.unlock();
 
@@ -1161,7 +1673,7 @@ bool source::send_data(){
         shared_lock listlock(sink_mutex_);
         int32_t numsinks = (int32_t) sinks_.size();
         auto sinks = (sink_desc *)alloca((numsinks + 1) * sizeof(sink_desc)); // avoid alloca(0)
-        std::copy(sinks_.begin(), sinks_.end(), sinks);
+        copy_sinks(sinks, salt);
 
         // unlock before sending!
         listlock.unlock();
@@ -1170,13 +1682,17 @@ bool source::send_data(){
         for (int i = 0; i < numsinks; ++i){
             sinks[i].send_data(id(), salt, d);            
         }
+        if (paritysize > 0){
+            send_parity(sinks, numsinks, salt, d.sequence, d.samplerate, paritysize);
+        }
         --dropped_;
     } else if (audioqueue_.read_available() && srqueue_.read_available()){
         // make local copy of sink descriptors
         shared_lock listlock(sink_mutex_);
         int32_t numsinks = (int32_t) sinks_.size();
         auto sinks = (sink_desc *)alloca((numsinks + 1) * sizeof(sink_desc)); // avoid alloca(0)
-        std::copy(sinks_.begin(), sinks_.end(), sinks);
+        copy_sinks(sinks, salt);
+        endpoint group = relay_group_;
 
         // unlock before sending!
         listlock.unlock();
@@ -1191,11 +1707,55 @@ bool source::send_data(){
             prev_sent_samplerate_ = d.samplerate;
         }
         
-        if (numsinks){
+        if (numsinks && check_silence(sinks, numsinks)){
+            // don't encode, just send a silent block marker
+            audioqueue_.read_commit();
+
+            d.totalsize = 0;
+            d.nframes = 0;
+            d.framenum = 0;
+            d.channel = 0;
+            d.data = nullptr;
+            d.size = 0;
+            // save the marker, a lost one is resent like any other block
+            history_.push_silent(d.sequence, d.samplerate);
+            // silent blocks are part of the parity group (with zero size)
+            auto paritysize = update_parity(d.sequence, nullptr, 0);
+
+            // unlock before sending!
+            updatelock.unlock();
+
+            // stamp the first copy, so that redundant copies can't
+            // be mistaken for late arrivals
+            uint64_t now = aoo_osctime_get();
+            auto ntimes = redundancy_.load();
+            for (auto i = 0; i < ntimes; ++i){
+                bool grouped = false, groupstamp = false;
+                for (int j = 0; j < numsinks; ++j){
+                    bool stamp = i == 0 && (sinks[j].protocol_flags & AOO_PROTOCOL_FLAG_TIMESTAMP);
+                    if (sinks[j].in_relay_group(group)){
+                        grouped = true;
+                        groupstamp |= stamp;
+                        continue;
+                    }
+                    d.timestamp = stamp ? now : 0;
+                    sinks[j].send_silence(salt, d, sendrate);
+                }
+                if (grouped){
+                    // a single copy, the relay fans it out
+                    d.timestamp = groupstamp ? now : 0;
+                    group.send_silence(salt, d, sendrate);
+                }
+            }
+
+            if (paritysize > 0){
+                send_parity(sinks, numsinks, salt, d.sequence, d.samplerate, paritysize);
+            }
+        } else if (numsinks){
             // copy and convert audio samples to blob data
             auto nchannels = encoder_->nchannels();
             auto blocksize = encoder_->blocksize();
-            sendbuffer_.resize(sizeof(double) * nchannels * blocksize); // overallocate
+            sendbuffer_.resize(max_block_size(nchannels, blocksize)); // overallocate
 
             d.totalsize = encoder_->encode(audioqueue_.read_data(), audioqueue_.blocksize(),
                                            sendbuffer_.data(), (int32_t) sendbuffer_.size());
@@ -1211,6 +1771,9 @@ bool source::send_data(){
                 history_.push(d.sequence, d.samplerate, sendbuffer_.data(),
                               d.totalsize, d.nframes, maxpacketsize);
 
+                // add to parity group
+                auto paritysize = update_parity(d.sequence, sendbuffer_.data(), d.totalsize);
+
                 // unlock before sending!
                 updatelock.unlock();
 
@@ -1218,19 +1781,35 @@ bool source::send_data(){
 
                 // send a single frame to all sinks
                 // /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
-                auto dosend = [&](int32_t frame, const char* data, auto n){
+                // only the first copy of the first frame is time stamped
+                uint64_t now = aoo_osctime_get();
+                auto dosend = [&](int32_t frame, const char* data, auto n, bool stamp){
                     d.framenum = frame;
                     d.data = data;
                     d.size = n;
+                    bool grouped = false, groupstamp = false;
                     for (int i = 0; i < numsinks; ++i){
                         d.channel = sinks[i].channel;
+                        bool sinkstamp = stamp && (sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_TIMESTAMP);
+                        d.timestamp = sinkstamp ? now : 0;
                         // if the protocol_flags allow using the compact data message, use it if appropriate
                         if (d.nframes == 1 && d.channel == 0 && sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_COMPACT_DATA) {
-                            sinks[i].send_data_compact(id(), salt, d, sendrate);                
+                            if (sinks[i].in_relay_group(group)){
+                                // compact messages don't name the sink, so one copy serves them all
+                                grouped = true;
+                                groupstamp |= sinkstamp;
+                            } else {
+                                sinks[i].send_data_compact(salt, d, sendrate);
+                            }
                         } else {
                             sinks[i].send_data(id(), salt, d);
                         }
                     }
+                    if (grouped){
+                        d.channel = 0;
+                        d.timestamp = groupstamp ? now : 0;
+                        group.send_data_compact(salt, d, sendrate);
+                    }
                 };
 
                 auto ntimes = redundancy_.load();
@@ -1238,13 +1817,18 @@ bool source::send_data(){
                     auto ptr = sendbuffer_.data();
                     // send large frames (might be 0)
                     for (int32_t j = 0; j < dv.quot; ++j, ptr += maxpacketsize){
-                        dosend(j, ptr, maxpacketsize);
+                        dosend(j, ptr, maxpacketsize, i == 0 && j == 0);
                     }
                     // send remaining bytes as a single frame (might be the only one!)
                     if (dv.rem){
-                        dosend(dv.quot, ptr, dv.rem);
+                        dosend(dv.quot, ptr, dv.rem, i == 0 && dv.quot == 0);
                     }
                 }
+
+                // send parity block after the last block of a group
+                if (paritysize > 0){
+                    send_parity(sinks, numsinks, salt, d.sequence, d.samplerate, paritysize);
+                }
             } else {
                 LOG_WARNING("aoo_source: couldn't encode audio data!");
             }
@@ -1272,9 +1856,115 @@ bool source::send_data(){
     return 1;
 }
 
+// call with update lock!
+// checks the next block in the audio queue and returns true
+// if it may be replaced by a silent block marker.
+bool source::check_silence(const sink_desc *sinks, int32_t numsinks){
+    auto threshold = dtx_threshold_.load();
+    if (threshold <= 0){
+        dtx_silent_blocks_ = 0;
+        return false;
+    }
+    // check peak amplitude (bail out early on the first loud sample)
+    auto ptr = audioqueue_.read_data();
+    auto n = audioqueue_.blocksize();
+    for (int32_t i = 0; i < n; ++i){
+        if (std::abs(ptr[i]) >= threshold){
+            dtx_silent_blocks_ = 0;
+            return false;
+        }
+    }
+    if (dtx_silent_blocks_ < INT32_MAX){
+        dtx_silent_blocks_++;
+    }
+    // wait for the hangover time, so that decaying tails are still sent
+    auto hangover = dtx_hangover_.load() * 0.001 * encoder_->samplerate() / encoder_->blocksize();
+    if (dtx_silent_blocks_ <= hangover){
+        return false;
+    }
+    // the silent marker is a compact data message, so all sinks need to support both
+    for (int32_t i = 0; i < numsinks; ++i){
+        auto flags = sinks[i].protocol_flags.load();
+        if (!(flags & AOO_PROTOCOL_FLAG_DTX) || !(flags & AOO_PROTOCOL_FLAG_COMPACT_DATA)
+                || sinks[i].channel != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+// call with update lock!
+// returns the size of the parity block if the group is complete.
+int32_t source::update_parity(int32_t seq, const char *data, int32_t nbytes){
+    auto groupsize = fec_groupsize_.load();
+    if (groupsize < 2){
+        if (parity_.count() > 0){
+            parity_.clear();
+        }
+        return 0;
+    }
+    if (!parity_.contains(seq) || parity_.count() != groupsize){
+        // groups are aligned, so the sink can find the group of any block
+        parity_.reset(seq - seq % groupsize, groupsize);
+    }
+    parity_.add(seq, data, nbytes);
+
+    if (seq != parity_.first() + groupsize - 1){
+        return 0;
+    }
+    // last block in group
+    int32_t result = 0;
+    // skip incomplete groups (e.g. FEC has been enabled in the middle of a group)
+    if (parity_.num_blocks() == groupsize && parity_.size() > 0){
+        // copy parity data, so we can send it without holding the lock
+        paritybuffer_.assign(parity_.data(), parity_.data() + parity_.size());
+        std::copy(parity_.block_sizes(), parity_.block_sizes() + groupsize,
+                  paritysizes_.begin());
+        paritycount_ = groupsize;
+        result = parity_.size();
+    }
+    parity_.clear();
+    return result;
+}
+
+// call without lock!
+void source::send_parity(const sink_desc *sinks, int32_t numsinks,
+                         int32_t salt, int32_t seq, double sr, int32_t nbytes){
+    data_packet d;
+    d.sequence = seq - (seq % paritycount_); // first block in group
+    d.samplerate = sr;
+    d.totalsize = nbytes;
+    // the parity message has a slightly larger header
+    auto maxpacketsize = std::max<int32_t>(64, packetsize_ - AOO_DATA_HEADERSIZE
+                                           - 16 - paritycount_ * sizeof(int32_t));
+    auto dv = div(nbytes, maxpacketsize);
+    d.nframes = dv.quot + (dv.rem != 0);
+
+    auto dosend = [&](int32_t frame, const char* data, auto n){
+        d.framenum = frame;
+        d.data = data;
+        d.size = n;
+        for (int i = 0; i < numsinks; ++i){
+            // only send to sinks which know how to handle it
+            if (sinks[i].protocol_flags & AOO_PROTOCOL_FLAG_FEC){
+                d.channel = sinks[i].channel;
+                sinks[i].send_parity(id(), salt, d, paritysizes_.data(), paritycount_);
+            }
+        }
+    };
+
+    auto ptr = paritybuffer_.data();
+    for (int32_t j = 0; j < dv.quot; ++j, ptr += maxpacketsize){
+        dosend(j, ptr, maxpacketsize);
+    }
+    if (dv.rem){
+        dosend(dv.quot, ptr, dv.rem);
+    }
+}
+
 bool source::send_ping(){
     // if stream is stopped, the timer won't increment anyway
-    auto elapsed = timer_.get_elapsed();
+    auto elapsed = get_timer().get_elapsed();
     auto pingtime = lastpingtime_.load();
     auto interval = ping_interval_.load(); // 0: no ping
     if (interval > 0 && (elapsed - pingtime) >= interval){
@@ -1285,7 +1975,7 @@ bool source::send_ping(){
         std::copy(sinks_.begin(), sinks_.end(), sinks);
         sinklock.unlock();
 
-        auto tt = timer_.get_absolute();
+        auto tt = get_timer().get_absolute();
 
         for (int i = 0; i < numsinks; ++i){
             sinks[i].send_ping(id(), tt);
@@ -1443,7 +2133,7 @@ void source::handle_ping(void *endpoint, aoo_replyfn fn,
             e.ping.tt2 = tt2.to_uint64();
             e.ping.lost_blocks = lost_blocks;
         #if 0
-            e.ping.tt3 = timer_.get_absolute().to_uint64(); // use last stream time
+            e.ping.tt3 = get_timer().get_absolute().to_uint64(); // use last stream time
         #else
             e.ping.tt3 = aoo_osctime_get(); // use real system time
         #endif
@@ -1497,24 +2187,20 @@ void source::handle_codec_change(void *endpoint, aoo_replyfn fn,
     if (sink){
         { // only if the requesting sink exists we will respect this request
             LOG_DEBUG("handle codec change");
-            unique_lock lock(update_mutex_); // writer lock!
-            
-            if (!encoder_ || strcmp(encoder_->name(), f.codec)){
-                auto codec = aoo::find_codec(f.codec);
-                if (codec){
-                    encoder_ = codec->create_encoder();
-                } else {
-                    LOG_ERROR("codec '" << f.codec << "' not supported!");
-                    return;
-                }
-                if (!encoder_){
-                    LOG_ERROR("couldn't create encoder!");
-                    return;
-                }
+
+            auto codec = aoo::find_codec(f.codec);
+            if (!codec){
+                LOG_ERROR("codec '" << f.codec << "' not supported!");
+                return;
             }
-        
-            encoder_->read_format(f, (const char *)settings, size);
-            update();
+            auto enc = codec->create_encoder();
+            if (!enc){
+                LOG_ERROR("couldn't create encoder!");
+                return;
+            }
+            enc->read_format(f, (const char *)settings, size);
+
+            prepare_stream(std::move(enc));
         }
                
         
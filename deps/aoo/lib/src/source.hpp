@@ -29,7 +29,11 @@ struct endpoint {
     
     // methods
     void send_data(int32_t src, int32_t salt, const data_packet& data) const;
-    void send_data_compact(int32_t src, int32_t salt, const data_packet& data, bool sendrate=false);
+    void send_data_compact(int32_t salt, const data_packet& data, bool sendrate=false);
+    void send_silence(int32_t salt, const data_packet& data, bool sendrate=false);
+
+    void send_parity(int32_t src, int32_t salt, const data_packet& data,
+                     const int32_t *sizes, int32_t count) const;
 
     void send_format(int32_t src, int32_t salt, const aoo_format& f,
                      const char *options, int32_t size, const char * userformat = nullptr, int32_t ufsize=0) const;
@@ -66,14 +70,44 @@ struct invite_request : endpoint {
     int32_t type = 0;
 };
 
+// The start of a /aoo/sink/<id>/data message (address pattern, type tags,
+// source ID and salt) serialized once, so that only the arguments which
+// change have to be written for every frame.
+struct data_header {
+    // returns false if the header was already up to date
+    bool update(int32_t sink, int32_t src, int32_t salt);
+
+    bool matches(int32_t sink, int32_t src, int32_t salt) const {
+        return size > 0 && sink == sink_ && src == src_ && salt == salt_;
+    }
+
+    // write the complete message, returns its size or 0 if it doesn't fit
+    int32_t write(char *buf, int32_t bufsize, const data_packet& d) const;
+
+    char data[64];
+    int32_t size = 0; // 0: not built yet
+    int32_t typetag_onset = 0;
+private:
+    int32_t sink_ = 0;
+    int32_t src_ = 0;
+    int32_t salt_ = 0;
+};
+
+// Write a compact /d data message (blob = true) or silent block (blob = false),
+// returns its size or 0 if it doesn't fit.
+int32_t write_compact_data(char *buf, int32_t bufsize, int32_t salt,
+                           const data_packet& d, bool sendrate, bool blob);
+
 struct sink_desc : endpoint {
     sink_desc(void *_user, aoo_replyfn _fn, int32_t _id)
-        : endpoint(_user, _fn, _id), channel(0), format_changed(true), protocol_flags(0) {}
+        : endpoint(_user, _fn, _id), channel(0), format_changed(true), protocol_flags(0), relay_group(false) {}
     sink_desc(const sink_desc& other)
         : endpoint(other.user, other.fn, other.id),
           channel(other.channel.load()),
           format_changed(other.format_changed.load()),
-          protocol_flags(other.protocol_flags.load()){}
+          protocol_flags(other.protocol_flags.load()),
+          relay_group(other.relay_group.load()),
+          header(other.header){}
     sink_desc& operator=(const sink_desc& other){
         user = other.user;
         fn = other.fn;
@@ -81,14 +115,26 @@ struct sink_desc : endpoint {
         channel = other.channel.load();
         format_changed = other.format_changed.load();
         protocol_flags = other.protocol_flags.load();
+        relay_group = other.relay_group.load();
+        header = other.header;
         return *this;
     }
 
+    // compact messages for this sink go out once for the whole group (see aoo_opt_relay_group)
+    bool in_relay_group(const endpoint& group) const {
+        return group.fn && relay_group.load();
+    }
+
+    // same message as endpoint::send_data(), but written from the cached header
+    void send_data(int32_t src, int32_t salt, const data_packet& data) const;
+
     // data
     std::atomic<int16_t> channel;
     std::atomic<bool> format_changed;
     std::atomic<int8_t> protocol_flags;
-
+    std::atomic<bool> relay_group;
+    // NOTE: only touched by the send thread (see source::copy_sinks())
+    data_header header;
 };
 
 class source final : public isource {
@@ -154,17 +200,25 @@ class source final : public isource {
     // timing
     time_dll dll_;
     timer timer_;
+    std::atomic<audio_clock *> clock_{nullptr}; // shared clock (optional)
+    uint64_t clock_count_ = 0;
     // buffers and queues
     std::vector<char> sendbuffer_;
     dynamic_resampler resampler_;
-    lockfree::queue<aoo_sample> audioqueue_;
-    lockfree::queue<double> srqueue_;
-    lockfree::queue<event> eventqueue_;
+    lockfree::spsc_queue<aoo_sample> audioqueue_;
+    lockfree::spsc_queue<double> srqueue_;
+    lockfree::spsc_queue<event> eventqueue_;
     lockfree::queue<endpoint> formatrequestqueue_;
     lockfree::queue<data_request> datarequestqueue_;
     history_buffer history_;
+    // parity FEC
+    parity_group parity_;
+    std::vector<char> paritybuffer_;
+    std::array<int32_t, AOO_FEC_MAXGROUPSIZE> paritysizes_;
+    int32_t paritycount_ = 0;
     // sinks
     std::vector<sink_desc> sinks_;
+    endpoint relay_group_; // protected by sink_mutex_
     // thread synchronization
     aoo::shared_mutex update_mutex_;
     aoo::shared_mutex sink_mutex_;
@@ -173,6 +227,9 @@ class source final : public isource {
     std::atomic<int32_t> packetsize_{ AOO_PACKETSIZE };
     std::atomic<int32_t> resend_buffersize_{ AOO_RESEND_BUFSIZE };
     std::atomic<int32_t> redundancy_{ AOO_SEND_REDUNDANCY };
+    std::atomic<int32_t> fec_groupsize_{ AOO_FEC_GROUPSIZE };
+    std::atomic<float> dtx_threshold_{ AOO_DTX_THRESHOLD };
+    std::atomic<int32_t> dtx_hangover_{ AOO_DTX_HANGOVER };
     std::atomic<int32_t> dynamic_resampling_{ 1 };
     std::atomic<float> bandwidth_{ AOO_TIMEFILTER_BANDWIDTH };
     std::atomic<float> ping_interval_{ AOO_PING_INTERVAL * 0.001 };
@@ -185,10 +242,40 @@ class source final : public isource {
     std::atomic<int32_t> flushingout_ { 0 };
     bool lastplay_ = false;
     int32_t pushing_silent_frames_ = 0;
+    int32_t dtx_silent_blocks_ = 0;
+    // standby stream (see prepare_stream())
+    struct stream {
+        std::unique_ptr<aoo::encoder> encoder;
+        dynamic_resampler resampler;
+        lockfree::spsc_queue<aoo_sample> audioqueue;
+        lockfree::spsc_queue<double> srqueue;
+        history_buffer history;
+        int32_t nchannels = 0;
+        int32_t blocksize = 0;
+        int32_t samplerate = 0;
+        int32_t salt = 0;
+    };
+    stream standby_;
+    time_tag standby_time_;
+    spinlock standby_lock_;
+    aoo::shared_mutex prepare_mutex_; // serializes prepare_stream()
+    std::atomic<bool> standby_ready_{false}; // waiting to be adopted
+    std::atomic<bool> standby_retired_{false}; // holds the previous stream
+    std::atomic<bool> stream_changed_{false}; // all sinks need the new format
     
     // helper methods
     sink_desc * find_sink(void *endpoint, int32_t id);
 
+    audio_clock * shared_clock() const {
+        auto c = clock_.load();
+        return (c && c->matches(samplerate_, blocksize_)) ? c : nullptr;
+    }
+
+    const timer& get_timer() const {
+        auto c = shared_clock();
+        return c ? c->get_timer() : timer_;
+    }
+
     int32_t set_format(aoo_format& f);
     int32_t set_userformat(void * ptr, int32_t size);
 
@@ -198,12 +285,30 @@ class source final : public isource {
 
     void update_historybuffer();
 
+    bool prepare_stream(std::unique_ptr<encoder> enc, int32_t sr = 0,
+                        int32_t blocksize = 0, int32_t nchannels = 0);
+
+    void make_stream(stream& s);
+
+    bool adopt_stream();
+
+    void free_standby();
+
     bool send_format();
 
     bool send_data();
 
+    bool check_silence(const sink_desc *sinks, int32_t numsinks);
+
+    void copy_sinks(sink_desc *dest, int32_t salt);
+
     bool resend_data();
 
+    int32_t update_parity(int32_t seq, const char *data, int32_t nbytes);
+
+    void send_parity(const sink_desc *sinks, int32_t numsinks,
+                     int32_t salt, int32_t seq, double sr, int32_t nbytes);
+
     bool send_ping();
 
     void handle_format_request(void *endpoint, aoo_replyfn fn,
@@ -36,6 +36,13 @@
 
 #pragma once
 
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#elif JUCE_USE_ARM_NEON || defined (__arm64__) || defined (__aarch64__)
+ #include <arm_neon.h>
+ #define FF_METERS_USE_NEON 1
+#endif
+
 namespace foleys
 {
 
@@ -191,8 +198,18 @@ public:
     template<typename FloatType>
     void measureBlock (const juce::AudioBuffer<FloatType>& buffer, int startSample=0, int numSamples=0)
     {
-        lastMeasurement = juce::Time::currentTimeMillis();
-        if (! suspended)
+        measureBlock (buffer, startSample, numSamples, juce::Time::currentTimeMillis());
+    }
+
+    /**
+     Same as above, with the time of the measurement passed in (juce::Time::currentTimeMillis()),
+     so a process callback feeding many meters only has to read the clock once.
+     */
+    template<typename FloatType>
+    void measureBlock (const juce::AudioBuffer<FloatType>& buffer, int startSample, int numSamples, const juce::int64 timeMSecs)
+    {
+        lastMeasurement = timeMSecs;
+        if (! suspended && ! skipIdleBlock (timeMSecs))
         {
             const int         numChannels = buffer.getNumChannels ();
             numSamples  = numSamples <= 0 ? buffer.getNumSamples () : numSamples;
@@ -203,16 +220,104 @@ JUCE_COMPILER_WARNING("The use of levels.resize() is not realtime safe. Please c
 #endif
 
             for (int channel=0; channel < std::min (numChannels, int (levels.size())); ++channel) {
-                levels [size_t (channel)].setLevels (lastMeasurement,
-                                                     buffer.getMagnitude (channel, startSample, numSamples),
-                                                     buffer.getRMSLevel  (channel, startSample, numSamples),
-                                                     holdMSecs);
+                float peak = 0.0f, rms = 0.0f;
+                if (numSamples > 0) {
+                    double sumSquares = 0.0;
+                    measurePeakAndSumOfSquares (buffer.getReadPointer (channel, startSample), numSamples, peak, sumSquares);
+                    rms = float (std::sqrt (sumSquares / numSamples));
+                }
+                levels [size_t (channel)].setLevels (timeMSecs, peak, rms, holdMSecs);
             }
         }
 
         newDataFlag = true;
     }
 
+    /**
+     Peak magnitude and sum of squares of a block in a single pass, this is what
+     measureBlock uses instead of AudioBuffer::getMagnitude and getRMSLevel.
+     */
+    static void measurePeakAndSumOfSquares (const float* data, int numSamples, float& peak, double& sumSquares) noexcept
+    {
+        int i = 0;
+        float maxval = 0.0f;
+        float sum = 0.0f;
+
+#if JUCE_USE_SSE_INTRINSICS
+        const __m128 absMask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+        __m128 vmax = _mm_setzero_ps();
+        __m128 vsum0 = _mm_setzero_ps();
+        __m128 vsum1 = _mm_setzero_ps();
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            const __m128 a = _mm_loadu_ps (data + i);
+            const __m128 b = _mm_loadu_ps (data + i + 4);
+            vmax  = _mm_max_ps (vmax, _mm_max_ps (_mm_and_ps (a, absMask), _mm_and_ps (b, absMask)));
+            vsum0 = _mm_add_ps (vsum0, _mm_mul_ps (a, a));
+            vsum1 = _mm_add_ps (vsum1, _mm_mul_ps (b, b));
+        }
+
+        alignas (16) float lanes[4];
+        _mm_store_ps (lanes, vmax);
+        maxval = std::max (std::max (lanes[0], lanes[1]), std::max (lanes[2], lanes[3]));
+        _mm_store_ps (lanes, _mm_add_ps (vsum0, vsum1));
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif FF_METERS_USE_NEON
+        float32x4_t vmax = vdupq_n_f32 (0.0f);
+        float32x4_t vsum0 = vdupq_n_f32 (0.0f);
+        float32x4_t vsum1 = vdupq_n_f32 (0.0f);
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            const float32x4_t a = vld1q_f32 (data + i);
+            const float32x4_t b = vld1q_f32 (data + i + 4);
+            vmax  = vmaxq_f32 (vmax, vmaxq_f32 (vabsq_f32 (a), vabsq_f32 (b)));
+            vsum0 = vmlaq_f32 (vsum0, a, a);
+            vsum1 = vmlaq_f32 (vsum1, b, b);
+        }
+
+        const float32x4_t vsum = vaddq_f32 (vsum0, vsum1);
+        maxval = std::max (std::max (vgetq_lane_f32 (vmax, 0), vgetq_lane_f32 (vmax, 1)),
+                           std::max (vgetq_lane_f32 (vmax, 2), vgetq_lane_f32 (vmax, 3)));
+        sum = (vgetq_lane_f32 (vsum, 0) + vgetq_lane_f32 (vsum, 1)) + (vgetq_lane_f32 (vsum, 2) + vgetq_lane_f32 (vsum, 3));
+#endif
+
+        for (; i < numSamples; ++i)
+        {
+            const float s = data[i];
+            maxval = std::max (maxval, std::abs (s));
+            sum += s * s;
+        }
+
+        peak = maxval;
+        sumSquares = sum;
+    }
+
+    static void measurePeakAndSumOfSquares (const double* data, int numSamples, float& peak, double& sumSquares) noexcept
+    {
+        double maxval = 0.0;
+        double sum = 0.0;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            maxval = std::max (maxval, std::abs (data[i]));
+            sum += data[i] * data[i];
+        }
+        peak = float (maxval);
+        sumSquares = sum;
+    }
+
+    /**
+     Only measure every Nth block while no meter has displayed this source for idleMSecs,
+     which saves most of the metering work for meters that are hidden. The first paint
+     brings it back to measuring every block. 1 (the default) measures every block.
+     */
+    void setIdleDecimation (const int everyNthBlock, const juce::int64 idleMSecs = 1000)
+    {
+        idleDecimation = std::max (1, everyNthBlock);
+        idleTimeout = idleMSecs;
+    }
+
     /**
      This is called from the GUI. If processing was stalled, this will pump zeroes into the buffer,
      until the readings return to zero.
@@ -220,6 +325,7 @@ JUCE_COMPILER_WARNING("The use of levels.resize() is not realtime safe. Please c
     void decayIfNeeded()
     {
         juce::int64 time = juce::Time::currentTimeMillis();
+        lastDisplayed = time;
         if (time - lastMeasurement < 100)
             return;
 
@@ -373,6 +479,23 @@ JUCE_COMPILER_WARNING("The use of levels.resize() is not realtime safe. Please c
     }
 
 private:
+    bool skipIdleBlock (const juce::int64 time)
+    {
+        if (idleDecimation <= 1 || time - lastDisplayed.load() < idleTimeout)
+        {
+            idleCounter = 0;
+            return false;
+        }
+
+        if (++idleCounter >= idleDecimation)
+        {
+            idleCounter = 0;
+            return false;
+        }
+
+        return true;
+    }
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LevelMeterSource)
     juce::WeakReference<LevelMeterSource>::Master masterReference;
     friend class juce::WeakReference<LevelMeterSource>;
@@ -385,6 +508,12 @@ private:
 
     std::atomic<juce::int64> lastMeasurement;
 
+    // set from the GUI whenever a meter paints this source
+    std::atomic<juce::int64> lastDisplayed { 0 };
+    int idleDecimation = 1;
+    juce::int64 idleTimeout = 1000;
+    int idleCounter = 0;
+
     bool newDataFlag = true;
 
     bool suspended;